@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+
+static int failures;
+
+int64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int bench_parse_iterations(int argc, char **argv, int def)
+{
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 || strcmp(argv[i], "-n") == 0) {
+            int n = atoi(argv[i + 1]);
+            return n > 0 ? n : def;
+        }
+    }
+    return def;
+}
+
+const char *bench_parse_option(int argc, char **argv, const char *name, const char *def)
+{
+    for (int i = 1; i < argc - 1; i++) {
+        if (strncmp(argv[i], "--", 2) == 0 && strcmp(argv[i] + 2, name) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return def;
+}
+
+bench_series_t bench_series_create(const char *name, size_t capacity)
+{
+    bench_series_t series = {
+        .name = name,
+        .samples_ns = calloc(capacity, sizeof(int64_t)),
+        .capacity = capacity,
+    };
+    return series;
+}
+
+void bench_series_add(bench_series_t *series, int64_t sample_ns)
+{
+    if (series->count < series->capacity) {
+        series->samples_ns[series->count++] = sample_ns;
+    }
+}
+
+void bench_series_free(bench_series_t *series)
+{
+    free(series->samples_ns);
+    series->samples_ns = NULL;
+    series->count = 0;
+}
+
+static int compare_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t percentile(const int64_t *sorted, size_t count, double p)
+{
+    size_t idx = (size_t)(p * (double)(count - 1) + 0.5);
+    return sorted[idx];
+}
+
+void bench_report_header(const char *title)
+{
+    printf("\n%s\n", title);
+    printf("  %-40s %8s %10s %10s %10s %10s %10s %10s\n",
+           "case", "n", "min ns", "p50 ns", "p90 ns", "p99 ns", "max ns", "mean ns");
+}
+
+void bench_report(const bench_series_t *series)
+{
+    if (series->count == 0) {
+        printf("  %-40s %8s\n", series->name, "-");
+        return;
+    }
+
+    qsort(series->samples_ns, series->count, sizeof(int64_t), compare_i64);
+
+    double sum = 0;
+    for (size_t i = 0; i < series->count; i++) {
+        sum += (double)series->samples_ns[i];
+    }
+
+    printf("  %-40s %8zu %10lld %10lld %10lld %10lld %10lld %10.0f\n",
+           series->name, series->count,
+           (long long)series->samples_ns[0],
+           (long long)percentile(series->samples_ns, series->count, 0.50),
+           (long long)percentile(series->samples_ns, series->count, 0.90),
+           (long long)percentile(series->samples_ns, series->count, 0.99),
+           (long long)series->samples_ns[series->count - 1],
+           sum / (double)series->count);
+}
+
+void bench_check(int ok, const char *expr, const char *file, int line)
+{
+    if (!ok) {
+        fprintf(stderr, "CHECK FAILED: %s (%s:%d)\n", expr, file, line);
+        failures++;
+    }
+}
+
+int bench_exit_code(void)
+{
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,53 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Latency samples for one benchmark case
+ */
+typedef struct {
+    const char *name;
+    int64_t *samples_ns;
+    size_t count;
+    size_t capacity;
+} bench_series_t;
+
+/**
+ * @brief Host monotonic clock in ns, unaffected by virtual time skips
+ */
+int64_t bench_now_ns(void);
+
+/**
+ * @brief Parse "--iterations N" (or "-n N"), falling back to def
+ */
+int bench_parse_iterations(int argc, char **argv, int def);
+
+/**
+ * @brief Value of "--name VALUE", or def if absent
+ */
+const char *bench_parse_option(int argc, char **argv, const char *name, const char *def);
+
+bench_series_t bench_series_create(const char *name, size_t capacity);
+void bench_series_add(bench_series_t *series, int64_t sample_ns);
+void bench_series_free(bench_series_t *series);
+
+/**
+ * @brief Print the table header for bench_report()
+ */
+void bench_report_header(const char *title);
+
+/**
+ * @brief Print min / p50 / p90 / p99 / max / mean of a series in one row
+ */
+void bench_report(const bench_series_t *series);
+
+/**
+ * @brief Record a failed correctness check; the process exits non-zero
+ */
+#define BENCH_CHECK(cond) bench_check((cond), #cond, __FILE__, __LINE__)
+void bench_check(int ok, const char *expr, const char *file, int line);
+int bench_exit_code(void);
+
+#endif // BENCH_H
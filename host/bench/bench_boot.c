@@ -0,0 +1,250 @@
+// Boot pipeline: app_main to first publish, on cold and warm boots
+//
+// Each boot runs app_main in a forked child with a fresh process image, like
+// a reset; only NVS is carried from one boot to the next. The relay build
+// also checks that its state survives a reboot without a flash write per command.
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "config.h"
+#include "boot_events.h"
+#include "driver/i2c.h"
+#include "mqtt_manager.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#ifdef DEVICE_TYPE_RELAY
+#include "device_relay.h"
+#endif
+
+#define MQTT_CONNECT_US 50000   // TCP handshake and CONNECT/CONNACK on a LAN
+
+void app_main(void);
+
+typedef struct {
+    int32_t peripherals_ms;
+    int32_t wifi_ms;
+    int32_t mqtt_ms;
+    int32_t first_publish_ms;
+    host_wifi_stats_t wifi;
+    host_nvs_stats_t nvs;
+    uint32_t lease_renewals;    // DHCP leases after the lease check, on a link already up
+    uint32_t broker_drops;      // Broker sessions lost meanwhile
+    bool online_after_check;    // Broker connected again then
+    uint32_t readdressed_drops; // Broker sessions lost when a renewal then changed the address
+    bool online_readdressed;
+    char status[HOST_MQTT_PAYLOAD_MAX];
+#ifdef DEVICE_TYPE_RELAY
+    int relay_level;            // Relay GPIO once app_main returned, before any state sync
+    uint32_t command_writes;    // NVS writes caused by the command burst
+#endif
+} boot_result_t;
+
+static SemaphoreHandle_t status_done;
+static boot_result_t result;
+
+// The status message is complete once it carries the first-publish time
+static void capture_status(const host_mqtt_msg_t *msg, void *ctx)
+{
+    if (strcmp(msg->topic, MQTT_TOPIC_STATUS) != 0) {
+        return;
+    }
+    snprintf(result.status, sizeof(result.status), "%.*s", msg->len, msg->data);
+    if (strstr(result.status, "\"first_publish\":null") == NULL) {
+        xSemaphoreGive(status_done);
+    }
+}
+
+#ifdef DEVICE_TYPE_RELAY
+#define BURST_COMMANDS 40
+#define BURST_INTERVAL_MS 200
+
+// The webapp toggles the boiler rapidly, ending ON; returns the NVS writes
+// once the last change has been persisted
+static uint32_t command_burst(void)
+{
+    uint32_t writes_before = host_nvs_get_stats().writes;
+    for (int i = 0; i < BURST_COMMANDS; i++) {
+        host_mqtt_inject_data(MQTT_TOPIC_COMMAND, (i & 1) ? "ON" : "OFF", -1);
+        host_time_advance_us(BURST_INTERVAL_MS * 1000LL);
+    }
+    host_time_advance_us((RELAY_PERSIST_DELAY_MS + RELAY_PERSIST_MIN_INTERVAL_MS) * 1000LL);
+    BENCH_CHECK(host_gpio_get_pin(RELAY_GPIO_PIN).level == 0);
+    return host_nvs_get_stats().writes - writes_before;
+}
+#endif
+
+static void run_boot(int fd, const host_wifi_ap_t *ap, bool commands)
+{
+    host_log_set_sink(NULL);
+    host_time_set_virtual(true);
+    host_wifi_set_ap(ap);
+    host_mqtt_set_auto_connect(MQTT_CONNECT_US);
+    status_done = xSemaphoreCreateBinary();
+    host_mqtt_set_publish_hook(capture_status, NULL);
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+    BENCH_CHECK(host_aht20_attach(I2C_NUM_0, 0x38) == ESP_OK);
+    BENCH_CHECK(host_partition_create(STORE_FORWARD_PARTITION, 64 * 1024) == ESP_OK);
+#endif
+
+    app_main();
+#ifdef DEVICE_TYPE_RELAY
+    result.relay_level = host_gpio_get_pin(RELAY_GPIO_PIN).level;
+#endif
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_FIRST_PUBLISH, 30000));
+    BENCH_CHECK(xSemaphoreTake(status_done, portMAX_DELAY) == pdTRUE);
+
+    result.peripherals_ms = boot_events_elapsed_ms(BOOT_EVENT_PERIPHERALS);
+    result.wifi_ms = boot_events_elapsed_ms(BOOT_EVENT_WIFI);
+    result.mqtt_ms = boot_events_elapsed_ms(BOOT_EVENT_MQTT);
+    result.first_publish_ms = boot_events_elapsed_ms(BOOT_EVENT_FIRST_PUBLISH);
+    result.wifi = host_wifi_get_stats();
+    result.nvs = host_nvs_get_stats();
+
+    // A reused lease goes back to DHCP once it proved to work, which resets
+    // the address and so costs the broker session once
+    host_time_advance_us((WIFI_LEASE_CHECK_MS + 10000) * 1000LL);
+    result.lease_renewals = host_wifi_get_stats().dhcp_leases - result.wifi.dhcp_leases;
+    result.broker_drops = mqtt_get_link_stats().outages;
+    result.online_after_check = mqtt_is_connected();
+
+    // The server moves the device to another address at a later renewal
+    host_wifi_ap_t moved = *ap;
+    moved.lease.ip.addr += 1UL << 24;
+    host_wifi_set_ap(&moved);
+    host_wifi_renew_lease();
+    host_time_advance_us(10000 * 1000LL);
+    result.readdressed_drops = mqtt_get_link_stats().outages - result.broker_drops;
+    result.online_readdressed = mqtt_is_connected();
+#ifdef DEVICE_TYPE_RELAY
+    if (commands) {
+        result.command_writes = command_burst();
+    }
+#else
+    (void)commands;
+#endif
+
+    FILE *out = fdopen(fd, "wb");
+    BENCH_CHECK(fwrite(&result, sizeof(result), 1, out) == 1);
+    BENCH_CHECK(host_nvs_save(out) == ESP_OK);
+    fclose(out);
+    _exit(bench_exit_code());
+}
+
+/**
+ * @brief Boot once against the given AP; NVS afterwards is what the boot left
+ */
+static bool boot(const char *name, const host_wifi_ap_t *ap, bool commands, boot_result_t *r)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        run_boot(fds[1], ap, commands);
+    }
+    close(fds[1]);
+
+    FILE *in = fdopen(fds[0], "rb");
+    bool ok = fread(r, sizeof(*r), 1, in) == 1 && host_nvs_load(in) == ESP_OK;
+    fclose(in);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    printf("  %-22s %7ld %7ld %7ld %9ld %9u %5u %5u\n", name,
+           (long)r->peripherals_ms, (long)r->wifi_ms, (long)r->mqtt_ms, (long)r->first_publish_ms,
+           r->wifi.channels_scanned, r->wifi.dhcp_leases, r->nvs.writes);
+    return ok;
+}
+
+static bool status_has_timings(const boot_result_t *r)
+{
+    int wifi, mqtt, publish;
+    const char *boot_ms = strstr(r->status, "\"boot_ms\":");
+    return boot_ms != NULL
+        && sscanf(boot_ms, "\"boot_ms\":{\"wifi\":%d,\"mqtt\":%d,\"first_publish\":%d}",
+                  &wifi, &mqtt, &publish) == 3
+        && wifi == r->wifi_ms && mqtt == r->mqtt_ms && publish == r->first_publish_ms;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+
+    host_wifi_ap_t ap = host_wifi_get_ap();
+    host_wifi_ap_t moved = ap;
+    moved.channel = 11;
+    moved.bssid[5] ^= 0x01;
+
+    printf("Boot benchmarks (%s, AP on channel %d, %.0f ms/channel scan, %.0f ms join, %.0f ms DHCP)\n",
+           DEVICE_TYPE_STR, ap.channel, ap.scan_channel_us / 1e3, ap.assoc_us / 1e3, ap.dhcp_us / 1e3);
+    printf("\n  %-22s %7s %7s %7s %9s %9s %5s %5s\n", "boot (ms since reset)",
+           "device", "wifi", "mqtt", "1st pub", "channels", "dhcp", "nvs");
+
+    boot_result_t cold, warm, after_move, warm_again;
+    BENCH_CHECK(boot("cold (empty NVS)", &ap, false, &cold));
+    BENCH_CHECK(boot("warm", &ap, false, &warm));
+    BENCH_CHECK(boot("AP moved to channel 11", &moved, false, &after_move));
+    BENCH_CHECK(boot("warm after move", &moved, false, &warm_again));
+
+    // Device init overlaps association instead of waiting for it
+    BENCH_CHECK(cold.peripherals_ms < cold.wifi_ms);
+    BENCH_CHECK(cold.wifi_ms < cold.mqtt_ms && cold.mqtt_ms <= cold.first_publish_ms);
+    BENCH_CHECK(status_has_timings(&cold));
+    BENCH_CHECK(status_has_timings(&warm));
+
+    // Warm boots join the cached AP on its channel with the cached lease
+    BENCH_CHECK(warm.wifi.channels_scanned == 1 && warm.wifi.dhcp_leases == 0);
+    BENCH_CHECK(warm.wifi.static_joins == 1);
+    BENCH_CHECK(warm.nvs.writes == 0);
+    BENCH_CHECK(warm.first_publish_ms < cold.first_publish_ms);
+
+    // ... and then renew that lease with the DHCP server, back on the broker after one reconnect
+    BENCH_CHECK(warm.lease_renewals == 1 && warm.broker_drops == 1 && warm.online_after_check);
+    BENCH_CHECK(cold.lease_renewals == 0 && cold.broker_drops == 0 && cold.online_after_check);
+    // A renewal to another address leaves a session bound to the old one: reconnect
+    BENCH_CHECK(cold.readdressed_drops == 1 && cold.online_readdressed);
+    BENCH_CHECK(warm.readdressed_drops == 1 && warm.online_readdressed);
+
+    // A stale cache costs one probed channel, then scan and DHCP refresh it
+    BENCH_CHECK(after_move.wifi.dhcp_leases == 1 && after_move.nvs.writes > 0);
+    BENCH_CHECK(warm_again.wifi.static_joins == 1 && warm_again.wifi.channels_scanned == 1);
+
+#ifdef DEVICE_TYPE_RELAY
+    // The relay comes back in its last state without waiting for the webapp,
+    // and a burst of commands costs a couple of flash writes, not one each
+    boot_result_t burst, restored;
+    BENCH_CHECK(boot("warm, command burst", &moved, true, &burst));
+    BENCH_CHECK(boot("warm after burst", &moved, false, &restored));
+    BENCH_CHECK(cold.relay_level == 1 && warm.relay_level == 1);
+    BENCH_CHECK(restored.relay_level == 0);
+    uint32_t max_writes = BURST_COMMANDS * BURST_INTERVAL_MS / RELAY_PERSIST_MIN_INTERVAL_MS + 2;
+    BENCH_CHECK(burst.command_writes >= 1 && burst.command_writes <= max_writes);
+    BENCH_CHECK(restored.nvs.writes == 0);
+#endif
+
+    printf("\n  first publish: cold %ld ms, warm %ld ms (%.1fx faster)\n",
+           (long)cold.first_publish_ms, (long)warm.first_publish_ms,
+           (double)cold.first_publish_ms / (double)warm.first_publish_ms);
+    printf("  warm status: %s\n", warm.status);
+    printf("  reused lease renewed by DHCP %d s after joining: %u broker reconnect, %s\n", WIFI_LEASE_CHECK_MS / 1000,
+           warm.broker_drops, warm.online_after_check ? "online" : "offline");
+#ifdef DEVICE_TYPE_RELAY
+    printf("  relay: %d commands in %d ms -> %u NVS writes; next boot restored %s before any sync\n",
+           BURST_COMMANDS, BURST_COMMANDS * BURST_INTERVAL_MS, burst.command_writes,
+           restored.relay_level == 0 ? "ON" : "OFF");
+#endif
+
+    return bench_exit_code();
+}
@@ -0,0 +1,207 @@
+// Multi-channel relay (4 channels, mixed polarity): per-channel and batch
+// topics, and how far apart the pins switch when a command sets several
+// channels in one register write versus one command per channel
+
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "device_relay.h"
+#include "mqtt_manager.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#define LED_GPIO STATUS_LED_GPIO    // Shares the output register with the relays
+
+static const int channel_gpio[RELAY_CHANNEL_COUNT] = RELAY_CHANNEL_GPIOS;
+static SemaphoreHandle_t ack_sem;
+static host_mqtt_msg_t last_ack;
+
+static void capture_ack(const host_mqtt_msg_t *msg, void *ctx)
+{
+    size_t len = strlen(msg->topic);
+    if (len > 4 && strcmp(msg->topic + len - 4, "/ack") == 0) {
+        last_ack = *msg;
+        xSemaphoreGive(ack_sem);
+    }
+}
+
+static int level_for(int ch, bool on)
+{
+    bool active_low = (RELAY_CHANNEL_ACTIVE_LOW & (1U << ch)) != 0;
+    return on != active_low;
+}
+
+static bool channels_are(uint8_t states)
+{
+    for (int ch = 0; ch < RELAY_CHANNEL_COUNT; ch++) {
+        if (host_gpio_get_pin(channel_gpio[ch]).level != level_for(ch, (states & (1U << ch)) != 0)) {
+            return false;
+        }
+    }
+    return relay_get_channels() == states;
+}
+
+static bool send(const char *topic, const char *payload)
+{
+    host_mqtt_inject_data(topic, payload, -1);
+    return xSemaphoreTake(ack_sem, pdMS_TO_TICKS(1000)) == pdTRUE;
+}
+
+static const char *channel_topic(int ch, const char *suffix)
+{
+    static char topic[HOST_MQTT_TOPIC_MAX];
+    snprintf(topic, sizeof(topic), MQTT_TOPIC_CHANNEL_PREFIX "%d/%s", ch, suffix);
+    return topic;
+}
+
+// Time between the first and the last relay pin switching
+static int64_t switch_spread_ns(void)
+{
+    int64_t first = INT64_MAX, last = 0;
+    for (int ch = 0; ch < RELAY_CHANNEL_COUNT; ch++) {
+        int64_t t = host_gpio_get_pin(channel_gpio[ch]).last_write_ns;
+        first = t < first ? t : first;
+        last = t > last ? t : last;
+    }
+    return last - first;
+}
+
+static void check_topics(void)
+{
+    BENCH_CHECK(channels_are(0));
+    for (int ch = 0; ch < RELAY_CHANNEL_COUNT; ch++) {
+        BENCH_CHECK(host_mqtt_is_subscribed(channel_topic(ch, "set")));
+    }
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_CHANNELS_SET));
+
+    // One channel on its own topic, acknowledged on its own ACK topic
+    uint32_t writes_ch0 = host_gpio_get_pin(channel_gpio[0]).write_count;
+    BENCH_CHECK(send(channel_topic(2, "set"), "ON"));
+    BENCH_CHECK(strcmp(last_ack.topic, channel_topic(2, "ack")) == 0 && strcmp(last_ack.data, "ACK:ON") == 0);
+    BENCH_CHECK(channels_are(0x04));
+    BENCH_CHECK(host_gpio_get_pin(channel_gpio[0]).write_count == writes_ch0);
+
+    // The boiler topics still switch channel 0 alone
+    BENCH_CHECK(send(MQTT_TOPIC_COMMAND, "ON"));
+    BENCH_CHECK(strcmp(last_ack.topic, MQTT_TOPIC_ACK) == 0 && strcmp(last_ack.data, "ACK:ON") == 0);
+    BENCH_CHECK(channels_are(0x05));
+
+    // A batch: later entries win, untouched channels keep their state, the
+    // ACK lists every channel
+    BENCH_CHECK(send(MQTT_TOPIC_CHANNELS_SET, "1=ON,3=ON,0=ON,0=OFF"));
+    BENCH_CHECK(strcmp(last_ack.topic, MQTT_TOPIC_CHANNELS_ACK) == 0);
+    BENCH_CHECK(strcmp(last_ack.data, "0=OFF,1=ON,2=ON,3=ON") == 0);
+    BENCH_CHECK(channels_are(0x0E));
+    BENCH_CHECK(send(MQTT_TOPIC_CHANNELS_SET, "*=OFF"));
+    BENCH_CHECK(strcmp(last_ack.data, "0=OFF,1=OFF,2=OFF,3=OFF") == 0);
+    BENCH_CHECK(channels_are(0));
+
+    // Malformed batches and unknown channels switch nothing
+    uint32_t reg_writes = host_gpio_reg_write_count();
+    const char *bad[] = { "", "4=ON", "0=MAYBE", "0ON", "0=ON,", "01=ON", "0=ON;1=ON" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        host_mqtt_inject_data(MQTT_TOPIC_CHANNELS_SET, bad[i], -1);
+    }
+    host_mqtt_inject_data(channel_topic(1, "set"), "O", -1);
+    BENCH_CHECK(xSemaphoreTake(ack_sem, pdMS_TO_TICKS(50)) == pdFALSE);
+    BENCH_CHECK(host_gpio_reg_write_count() == reg_writes);
+    BENCH_CHECK(relay_set_channels(0x10, 0x10) == ESP_ERR_INVALID_ARG);
+    BENCH_CHECK(relay_set_channels(0, 0) == ESP_ERR_INVALID_ARG);
+
+    // Pins going the same way share one register write; the LED on the same
+    // port is never rewritten
+    int64_t led_written = host_gpio_get_pin(LED_GPIO).last_write_ns;
+    reg_writes = host_gpio_reg_write_count();
+    BENCH_CHECK(send(MQTT_TOPIC_CHANNELS_SET, "0=ON,1=ON"));       // Both active-LOW: W1TC only
+    BENCH_CHECK(host_gpio_reg_write_count() == reg_writes + 1);
+    BENCH_CHECK(host_gpio_get_pin(channel_gpio[0]).last_write_ns == host_gpio_get_pin(channel_gpio[1]).last_write_ns);
+    BENCH_CHECK(send(MQTT_TOPIC_CHANNELS_SET, "*=OFF"));             // Both directions: W1TS and W1TC
+    BENCH_CHECK(host_gpio_reg_write_count() == reg_writes + 3);
+    BENCH_CHECK(host_gpio_get_pin(LED_GPIO).level == 1);
+    BENCH_CHECK(host_gpio_get_pin(LED_GPIO).last_write_ns == led_written);
+}
+
+static void bench_switch_together(int iterations)
+{
+    bench_series_t seq_spread = bench_series_create("4 channel commands: first -> last pin", iterations);
+    bench_series_t batch_spread = bench_series_create("1 batch command: first -> last pin", iterations);
+    bench_series_t seq_total = bench_series_create("4 channel commands: inject -> last ACK", iterations);
+    bench_series_t batch_total = bench_series_create("1 batch command: inject -> ACK", iterations);
+    bench_series_t direct_seq = bench_series_create("relay_set_channel() x4", iterations);
+    bench_series_t direct_batch = bench_series_create("relay_set_channels() once", iterations);
+
+    for (int i = 0; i < iterations; i++) {
+        bool on = (i & 1) == 0;
+        const char *payload = on ? "ON" : "OFF";
+
+        int64_t t0 = host_time_now_ns();
+        bool acked = true;
+        for (int ch = 0; ch < RELAY_CHANNEL_COUNT; ch++) {
+            acked &= send(channel_topic(ch, "set"), payload);
+        }
+        BENCH_CHECK(acked && channels_are(on ? RELAY_ALL_CHANNELS : 0));
+        bench_series_add(&seq_total, last_ack.timestamp_ns - t0);
+        bench_series_add(&seq_spread, switch_spread_ns());
+
+        t0 = host_time_now_ns();
+        BENCH_CHECK(send(MQTT_TOPIC_CHANNELS_SET, on ? "*=OFF" : "*=ON"));
+        BENCH_CHECK(channels_are(on ? 0 : RELAY_ALL_CHANNELS));
+        bench_series_add(&batch_total, last_ack.timestamp_ns - t0);
+        bench_series_add(&batch_spread, switch_spread_ns());
+    }
+
+    // The same switching called directly, with nothing queued on the actuator
+    for (int i = 0; i < iterations; i++) {
+        bool on = (i & 1) == 0;
+        int64_t t0 = bench_now_ns();
+        for (int ch = 0; ch < RELAY_CHANNEL_COUNT; ch++) {
+            relay_set_channel((uint8_t)ch, on);
+        }
+        int64_t t1 = bench_now_ns();
+        relay_set_channels(RELAY_ALL_CHANNELS, on ? 0 : RELAY_ALL_CHANNELS);
+        int64_t t2 = bench_now_ns();
+        bench_series_add(&direct_seq, t1 - t0);
+        bench_series_add(&direct_batch, t2 - t1);
+    }
+
+    bench_report_header("Switching 4 channels (2 active-LOW, 2 active-HIGH)");
+    bench_report(&seq_spread);
+    bench_report(&batch_spread);
+    bench_report(&seq_total);
+    bench_report(&batch_total);
+    bench_report(&direct_seq);
+    bench_report(&direct_batch);
+
+    bench_series_free(&seq_spread);
+    bench_series_free(&batch_spread);
+    bench_series_free(&seq_total);
+    bench_series_free(&batch_total);
+    bench_series_free(&direct_seq);
+    bench_series_free(&direct_batch);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 2000);
+
+    host_log_set_sink(NULL);
+    ack_sem = xSemaphoreCreateBinary();
+    host_mqtt_set_publish_hook(capture_ack, NULL);
+
+    gpio_config_t led = { .pin_bit_mask = 1ULL << LED_GPIO, .mode = GPIO_MODE_OUTPUT };
+    BENCH_CHECK(gpio_config(&led) == ESP_OK && gpio_set_level(LED_GPIO, 1) == ESP_OK);
+
+    BENCH_CHECK(relay_init() == ESP_OK);
+    BENCH_CHECK(esp_event_loop_create_default() == ESP_OK);
+    BENCH_CHECK(mqtt_client_init() == ESP_OK);
+    host_mqtt_inject_connected();
+
+    printf("Relay channel benchmarks (%d channels, %d iterations)\n", RELAY_CHANNEL_COUNT, iterations);
+    check_topics();
+    bench_switch_together(iterations);
+
+    return bench_exit_code();
+}
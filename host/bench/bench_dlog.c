@@ -0,0 +1,310 @@
+// Deferred logging (DEFERRED_LOG): records rendered exactly as printf would,
+// the cost of a DLOGx call against ESP_LOGx, drops with several producers on
+// a full ring, and log levels set over MQTT
+//
+// Runs on the simulated clock so the dlog task stays asleep and the bench is
+// the only consumer of the ring.
+
+#include <float.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "dlog.h"
+#include "log_control.h"
+#include "device_relay.h"
+#include "mqtt_manager.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#define BENCH_TAG "DLOG_BENCH"
+
+static void drain(void)
+{
+    dlog_record_t record;
+    while (dlog_pop(&record)) {
+    }
+}
+
+static void check_rendered(const char *format, const char *expected, int line)
+{
+    dlog_record_t record;
+    char rendered[256];
+    bool popped = dlog_pop(&record);
+    BENCH_CHECK(popped);
+    if (!popped) {
+        return;
+    }
+    dlog_render(&record, rendered, sizeof(rendered));
+    BENCH_CHECK(strcmp(record.format, format) == 0);
+    BENCH_CHECK(strcmp(record.tag, BENCH_TAG) == 0);
+    if (strcmp(rendered, expected) != 0) {
+        printf("  line %d: \"%s\" rendered \"%s\", printf gives \"%s\"\n", line, format, rendered, expected);
+        BENCH_CHECK(false);
+    }
+}
+
+// Log through the ring and through snprintf, and compare
+#define CHECK_RENDER(format, ...) do {                                          \
+        char expected[256];                                                     \
+        snprintf(expected, sizeof(expected), format, ##__VA_ARGS__);            \
+        DLOGI(BENCH_TAG, format, ##__VA_ARGS__);                                \
+        check_rendered(format, expected, __LINE__);                             \
+    } while (0)
+
+static void bench_render_exact(void)
+{
+    char buffer[8] = { 'r', 'e', 'u', 's', 'e', 'd', '!', '!' };
+    int cases_before = (int)dlog_get_stats().written;
+
+    CHECK_RENDER("no arguments");
+    CHECK_RENDER("100%% done");
+    CHECK_RENDER("%d %i %u", -5, 7, 4000000000u);
+    CHECK_RENDER("%5d|%-5d|%05d|%+d|% d|%.3d", 42, 42, 42, 42, 42, 7);
+    CHECK_RENDER("%x %X %#x %o %#o %08x", 0xbeefu, 0xbeefu, 255u, 8u, 8u, 0x1234u);
+    CHECK_RENDER("%ld %lu %lld %llu", LONG_MIN, ULONG_MAX, LLONG_MIN, ULLONG_MAX);
+    CHECK_RENDER("%hhd %hhu %hd %hu", 300, 300, 70000, 70000);
+    CHECK_RENDER("%zu %jd %td", (size_t)123456, (intmax_t)-99, (ptrdiff_t)-7);
+    CHECK_RENDER("%" PRIu32 " %" PRId32 " %" PRIx32, UINT32_MAX, INT32_MIN, (uint32_t)0xabcdef01);
+    CHECK_RENDER("%c%c %3c|%-3c|", 'o', 'k', 'x', 'y');
+    CHECK_RENDER("%s|%10s|%-10s|%.3s|", "abc", "right", "left", "truncate");
+    CHECK_RENDER("TOPIC=%.*s DATA=%.*s", 5, "branko/boiler", 2, "ONOFF");
+    CHECK_RENDER("%*d|%-*d|%*d|%.*f|%.*f", 6, 42, 6, 42, -6, 42, 3, 3.14159, -1, 2.5);
+    CHECK_RENDER("%f %.2f %e %.3E %g %G %a", 21.456, -3.14159, 12345.678, 0.000123, 1e-10, 1e20, 0.5);
+    CHECK_RENDER("%.2f°C, %.2f%%", 21.50f, 45.25f);
+    CHECK_RENDER("%10.3f|%-10.1e|%+.0f", 3.14159, 2.5, 2.5);
+    CHECK_RENDER("%Lf %g %g", 1.5L, DBL_MAX, -0.0);
+    CHECK_RENDER("%p %p", (void *)0x1234, (void *)&buffer);
+    CHECK_RENDER("mixed %s=%d (%.1f%%) [%c] %lu", "relay", 1, 99.5, 'Z', 123456789UL);
+
+    // Strings are copied at the call, so the buffer may be reused before the render
+    DLOGI(BENCH_TAG, "buffer %.*s", 6, buffer);
+    memcpy(buffer, "changed!", sizeof(buffer));
+    check_rendered("buffer %.*s", "buffer reused", __LINE__);
+
+    // A string longer than the record is cut and the message marked
+    char long_string[200];
+    memset(long_string, 'x', sizeof(long_string) - 1);
+    long_string[sizeof(long_string) - 1] = '\0';
+    uint32_t truncated_before = dlog_get_stats().truncated;
+    DLOGI(BENCH_TAG, "long %s then %d", long_string, 5);
+    dlog_record_t record;
+    char rendered[256];
+    BENCH_CHECK(dlog_pop(&record));
+    BENCH_CHECK(record.truncated);
+    size_t len = dlog_render(&record, rendered, sizeof(rendered));
+    BENCH_CHECK(dlog_get_stats().truncated == truncated_before + 1);
+    // The text up to the first argument that did not fit is kept
+    BENCH_CHECK(len == strlen("long ") + DLOG_ARG_BYTES - sizeof(uint16_t) + strlen(" then ..."));
+    BENCH_CHECK(strncmp(rendered, "long xxxx", 9) == 0 && strcmp(rendered + len - 10, "x then ...") == 0);
+
+    // Rendering into a short buffer stops at its end
+    DLOGI(BENCH_TAG, "%s %d", "abcdefgh", 12345);
+    BENCH_CHECK(dlog_pop(&record));
+    BENCH_CHECK(dlog_render(&record, rendered, 6) == 5 && strcmp(rendered, "abcde") == 0);
+
+    printf("\nRender check: %d formats rendered identical to printf\n",
+           (int)dlog_get_stats().written - cases_before - 3);
+}
+
+static void bench_call_cost(int iterations)
+{
+    bench_series_t esp_data = bench_series_create("ESP_LOGI \"DATA=%.*s\"", iterations);
+    bench_series_t dlog_data = bench_series_create("DLOGI    \"DATA=%.*s\"", iterations);
+    bench_series_t esp_cmd = bench_series_create("ESP_LOGI \"Received %s command\"", iterations);
+    bench_series_t dlog_cmd = bench_series_create("DLOGI    \"Received %s command\"", iterations);
+    bench_series_t esp_temp = bench_series_create("ESP_LOGI \"... %s: %.2f°C (%u bytes)\"", iterations);
+    bench_series_t dlog_temp = bench_series_create("DLOGI    \"... %s: %.2f°C (%u bytes)\"", iterations);
+    bench_series_t esp_off = bench_series_create("ESP_LOGD, tag at INFO", iterations);
+    bench_series_t dlog_off = bench_series_create("DLOGD, tag at INFO", iterations);
+    bench_series_t render = bench_series_create("dlog_render (on the dlog task)", iterations);
+    char line[256];
+
+    for (int i = 0; i < iterations; i++) {
+        const char *state = (i & 1) ? "ON" : "OFF";
+        float temp = 20.0f + (float)(i % 100) / 10.0f;
+        dlog_record_t record;
+
+        int64_t t0 = bench_now_ns();
+        ESP_LOGI(BENCH_TAG, "DATA=%.*s", 2, state);
+        int64_t t1 = bench_now_ns();
+        DLOGI(BENCH_TAG, "DATA=%.*s", 2, state);
+        int64_t t2 = bench_now_ns();
+        ESP_LOGI(BENCH_TAG, "Received %s command for relay", state);
+        int64_t t3 = bench_now_ns();
+        DLOGI(BENCH_TAG, "Received %s command for relay", state);
+        int64_t t4 = bench_now_ns();
+        ESP_LOGI(BENCH_TAG, "Publishing temperature to %s: %.2f°C (%u bytes)", "branko/sensor/temperature", temp, 5u);
+        int64_t t5 = bench_now_ns();
+        DLOGI(BENCH_TAG, "Publishing temperature to %s: %.2f°C (%u bytes)", "branko/sensor/temperature", temp, 5u);
+        int64_t t6 = bench_now_ns();
+        ESP_LOGD(BENCH_TAG, "Filtered %d", i);
+        int64_t t7 = bench_now_ns();
+        DLOGD(BENCH_TAG, "Filtered %d", i);
+        int64_t t8 = bench_now_ns();
+
+        bench_series_add(&esp_data, t1 - t0);
+        bench_series_add(&dlog_data, t2 - t1);
+        bench_series_add(&esp_cmd, t3 - t2);
+        bench_series_add(&dlog_cmd, t4 - t3);
+        bench_series_add(&esp_temp, t5 - t4);
+        bench_series_add(&dlog_temp, t6 - t5);
+        bench_series_add(&esp_off, t7 - t6);
+        bench_series_add(&dlog_off, t8 - t7);
+
+        int popped = 0;
+        while (dlog_pop(&record)) {
+            int64_t r0 = bench_now_ns();
+            dlog_render(&record, line, sizeof(line));
+            int64_t r1 = bench_now_ns();
+            if (popped++ == 2) {
+                bench_series_add(&render, r1 - r0);     // The temperature line
+            }
+        }
+        BENCH_CHECK(popped == 3);
+    }
+
+    bench_report_header("Cost per log call on the calling task");
+    bench_report(&esp_data);
+    bench_report(&dlog_data);
+    bench_report(&esp_cmd);
+    bench_report(&dlog_cmd);
+    bench_report(&esp_temp);
+    bench_report(&dlog_temp);
+    bench_report(&esp_off);
+    bench_report(&dlog_off);
+    bench_report(&render);
+
+    bench_series_free(&esp_data);
+    bench_series_free(&dlog_data);
+    bench_series_free(&esp_cmd);
+    bench_series_free(&dlog_cmd);
+    bench_series_free(&esp_temp);
+    bench_series_free(&dlog_temp);
+    bench_series_free(&esp_off);
+    bench_series_free(&dlog_off);
+    bench_series_free(&render);
+}
+
+#define PRODUCERS 4
+#define RECORDS_PER_PRODUCER 5000
+
+static void *producer(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    for (int i = 0; i < RECORDS_PER_PRODUCER; i++) {
+        DLOGI(BENCH_TAG, "producer %d record %d", id, i);
+    }
+    return NULL;
+}
+
+// Nothing consumes while the producers run: the ring keeps the first
+// DLOG_RING_SLOTS records and every other call is dropped and counted
+static void bench_producers(void)
+{
+    drain();
+    dlog_stats_t before = dlog_get_stats();
+    pthread_t threads[PRODUCERS];
+
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&threads[i], NULL, producer, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    dlog_stats_t after = dlog_get_stats();
+    uint32_t written = after.written - before.written;
+    uint32_t dropped = after.dropped - before.dropped;
+    BENCH_CHECK(written == DLOG_RING_SLOTS);
+    BENCH_CHECK(written + dropped == PRODUCERS * RECORDS_PER_PRODUCER);
+
+    // Each producer's records come out whole and in its own order
+    int last[PRODUCERS] = { -1, -1, -1, -1 };
+    int popped = 0;
+    dlog_record_t record;
+    char line[64];
+    while (dlog_pop(&record)) {
+        int id, seq;
+        dlog_render(&record, line, sizeof(line));
+        BENCH_CHECK(sscanf(line, "producer %d record %d", &id, &seq) == 2 && id >= 0 && id < PRODUCERS);
+        if (id >= 0 && id < PRODUCERS) {
+            BENCH_CHECK(seq > last[id]);
+            last[id] = seq;
+        }
+        popped++;
+    }
+    BENCH_CHECK(popped == DLOG_RING_SLOTS);
+
+    // The ring takes records again once drained
+    DLOGI(BENCH_TAG, "after drain");
+    BENCH_CHECK(dlog_pop(&record) && strcmp(record.format, "after drain") == 0);
+
+    printf("\n%d producers x %d records on a %d-slot ring: %lu kept, %lu dropped\n", PRODUCERS,
+           RECORDS_PER_PRODUCER, DLOG_RING_SLOTS, (unsigned long)written, (unsigned long)dropped);
+}
+
+static uint32_t written_after(esp_log_level_t level)
+{
+    drain();
+    uint32_t before = dlog_get_stats().written;
+    DLOG_LEVEL(level, BENCH_TAG, "level %d", (int)level);
+    return dlog_get_stats().written - before;
+}
+
+static void bench_level_control(void)
+{
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_DIAG_LOG_LEVEL));
+
+    host_mqtt_inject_data(MQTT_TOPIC_DIAG_LOG_LEVEL, BENCH_TAG "=warn", -1);
+    BENCH_CHECK(esp_log_level_get(BENCH_TAG) == ESP_LOG_WARN);
+    BENCH_CHECK(written_after(ESP_LOG_INFO) == 0);
+    BENCH_CHECK(written_after(ESP_LOG_WARN) == 1);
+
+    host_mqtt_inject_data(MQTT_TOPIC_DIAG_LOG_LEVEL, " " BENCH_TAG " = D , MQTT_CLIENT=none", -1);
+    BENCH_CHECK(esp_log_level_get(BENCH_TAG) == ESP_LOG_DEBUG);
+    BENCH_CHECK(esp_log_level_get("MQTT_CLIENT") == ESP_LOG_NONE);
+    BENCH_CHECK(written_after(ESP_LOG_INFO) == 1);
+
+    // A bad entry is reported but does not stop the good ones
+    const char *mixed = "bogus,RELAY=loud," BENCH_TAG "=error";
+    BENCH_CHECK(log_control_apply(mixed, strlen(mixed)) == ESP_ERR_INVALID_ARG);
+    BENCH_CHECK(esp_log_level_get(BENCH_TAG) == ESP_LOG_ERROR);
+    BENCH_CHECK(log_control_apply("", 0) == ESP_OK);
+
+    // "*" resets every tag to one default
+    host_mqtt_inject_data(MQTT_TOPIC_DIAG_LOG_LEVEL, "*=info", -1);
+    BENCH_CHECK(esp_log_level_get(BENCH_TAG) == ESP_LOG_INFO);
+    BENCH_CHECK(esp_log_level_get("MQTT_CLIENT") == ESP_LOG_INFO);
+    BENCH_CHECK(written_after(ESP_LOG_INFO) == 1);
+
+    printf("\nLog levels over MQTT: set, per tag, \"*\" and rejected entries as expected\n");
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 20000);
+
+    host_log_set_sink(NULL);
+    host_time_set_virtual(true);
+    BENCH_CHECK(dlog_init() == ESP_OK);
+    vTaskDelay(1);      // The dlog task flushes once, then sleeps until the clock moves
+
+    BENCH_CHECK(relay_init() == ESP_OK);
+    BENCH_CHECK(esp_event_loop_create_default() == ESP_OK);
+    BENCH_CHECK(mqtt_client_init() == ESP_OK);
+    host_mqtt_inject_connected();
+    drain();
+
+    printf("Deferred logging benchmarks (%d iterations)\n", iterations);
+    bench_render_exact();
+    bench_call_cost(iterations);
+    bench_producers();
+    bench_level_control();
+
+    return bench_exit_code();
+}
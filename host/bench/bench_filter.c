@@ -0,0 +1,295 @@
+// Fixed-point sample conversion and filtering: every AHT20 word and the
+// BMP280 pressure range against a double reference, the cost of each, and
+// what the oversampling, median and EMA stages do to noise, spikes and steps
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "device_temp.h"
+#include "sensor_manager.h"
+#include "sensor_convert.h"
+#include "sensor_filter.h"
+#include "driver/i2c_master.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#define AHT20_WORDS (1u << 20)
+
+// The formulas the firmware used before, evaluated exactly: every product
+// and quotient below is representable in a double
+static int32_t ref_humidity(uint32_t raw)
+{
+    return (int32_t)floor((raw * 100.0) / 1048576.0 * 100.0 + 0.5);
+}
+
+static int32_t ref_temperature(uint32_t raw)
+{
+    return (int32_t)floor((((raw * 200.0) / 1048576.0) - 50.0) * 100.0 + 0.5);
+}
+
+static int32_t ref_pressure(uint32_t q8_pa)
+{
+    return (int32_t)floor(q8_pa / 256.0 + 0.5);
+}
+
+static void check_convert(void)
+{
+    uint32_t bad_h = 0, bad_t = 0, bad_p = 0, printed_diff = 0;
+    for (uint32_t raw = 0; raw < AHT20_WORDS; raw++) {
+        int32_t h = aht20_humidity_centi(raw);
+        int32_t t = aht20_temperature_centi(raw);
+        bad_h += h != ref_humidity(raw);
+        bad_t += t != ref_temperature(raw);
+
+        // What the float path published for the same word
+        char before[16], after[16];
+        snprintf(before, sizeof(before), "%.2f", (float)(((raw * 200.0) / 1048576.0) - 50.0));
+        snprintf(after, sizeof(after), "%.2f", (float)t / 100.0f);
+        printed_diff += strcmp(before, after) != 0;
+    }
+    // 300 to 1100 hPa, the BMP280 range, in 1/256 Pa
+    for (uint32_t q8 = 30000u * 256; q8 <= 110000u * 256; q8++) {
+        bad_p += bmp280_pressure_centi(q8) != ref_pressure(q8);
+    }
+    BENCH_CHECK(bad_h == 0 && bad_t == 0 && bad_p == 0);
+
+    printf("\nFixed point against the exact formula\n");
+    printf("  AHT20 humidity:    %u of %u words differ\n", bad_h, AHT20_WORDS);
+    printf("  AHT20 temperature: %u of %u words differ\n", bad_t, AHT20_WORDS);
+    printf("  BMP280 pressure:   %u of %u values differ\n", bad_p, 80000u * 256 + 1);
+    printf("  temperature text against the old float path: %u of %u words differ\n",
+           printed_diff, AHT20_WORDS);
+}
+
+static void bench_convert(int iterations)
+{
+    bench_series_t fixed = bench_series_create("integer kernels (T + RH)", iterations);
+    bench_series_t dbl = bench_series_create("double formulas (T + RH)", iterations);
+    volatile int32_t sink_i = 0;
+    volatile double sink_d = 0;
+    enum { BATCH = 1024 };
+
+    for (int i = 0; i < iterations; i++) {
+        uint32_t base = (uint32_t)(i * 7919) % (AHT20_WORDS - BATCH);
+
+        int64_t t0 = bench_now_ns();
+        for (uint32_t raw = base; raw < base + BATCH; raw++) {
+            sink_i = aht20_humidity_centi(raw) + aht20_temperature_centi(raw);
+        }
+        int64_t t1 = bench_now_ns();
+        for (uint32_t raw = base; raw < base + BATCH; raw++) {
+            sink_d = (raw * 100.0) / 1048576.0 + ((raw * 200.0) / 1048576.0) - 50.0;
+        }
+        int64_t t2 = bench_now_ns();
+        bench_series_add(&fixed, t1 - t0);
+        bench_series_add(&dbl, t2 - t1);
+    }
+    (void)sink_i;
+    (void)sink_d;
+
+    bench_report_header("Converting 1024 AHT20 frames (host FPU; the ESP32 emulates double in software)");
+    bench_report(&fixed);
+    bench_report(&dbl);
+    bench_series_free(&fixed);
+    bench_series_free(&dbl);
+}
+
+// Deterministic noise for repeatable runs
+static uint32_t lcg_state = 12345;
+
+static int32_t noise(int32_t amplitude)
+{
+    lcg_state = lcg_state * 1103515245u + 12345u;
+    return (int32_t)((lcg_state >> 16) % (uint32_t)(2 * amplitude + 1)) - amplitude;
+}
+
+typedef struct {
+    const char *name;
+    int oversample;
+    uint8_t median;
+    uint8_t ema_shift;
+} filter_case_t;
+
+#define SIGNAL_C        2150    // 21.50 °C
+#define NOISE_C         15      // Conversion noise, +-0.15 °C
+#define SPIKE_C         500     // One conversion in SPIKE_EVERY reads 5 °C high
+#define SPIKE_EVERY     37
+#define STEP_C          150     // The room warms by 1.5 °C
+#define SAMPLES         2000
+
+// One sample: oversample conversions, a spike hits the whole sample
+static int32_t sample(int oversample, int32_t truth, bool spike)
+{
+    int32_t sum = 0;
+    for (int n = 0; n < oversample; n++) {
+        sum += truth + noise(NOISE_C) + (spike ? SPIKE_C : 0);
+    }
+    return sensor_filter_average(sum, (uint32_t)oversample);
+}
+
+static void run_case(const filter_case_t *c, double *rms, int32_t *worst, int *settle)
+{
+    sensor_filter_t f;
+
+    // Noise only: rms error once the filters have warmed up
+    sensor_filter_init(&f, c->median, c->ema_shift);
+    lcg_state = 12345;
+    double sq = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        int32_t err = sensor_filter_update(&f, sample(c->oversample, SIGNAL_C, false)) - SIGNAL_C;
+        if (i >= 16) {
+            sq += (double)err * err;
+        }
+    }
+    *rms = sqrt(sq / (SAMPLES - 16));
+
+    // With spikes: the largest error that gets through
+    sensor_filter_reset(&f);
+    lcg_state = 12345;
+    *worst = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        int32_t err = sensor_filter_update(&f, sample(c->oversample, SIGNAL_C, i % SPIKE_EVERY == SPIKE_EVERY - 1)) - SIGNAL_C;
+        if (i >= 16) {
+            *worst = abs(err) > *worst ? abs(err) : *worst;
+        }
+    }
+
+    // Noise-free step: samples until the output is within 0.05 °C of the new value
+    sensor_filter_reset(&f);
+    for (int i = 0; i < 16; i++) {
+        sensor_filter_update(&f, SIGNAL_C);
+    }
+    *settle = 0;
+    while (*settle < 100 && SIGNAL_C + STEP_C - sensor_filter_update(&f, SIGNAL_C + STEP_C) > 5) {
+        (*settle)++;
+    }
+    (*settle)++;
+}
+
+static void check_filters(int iterations)
+{
+    static const filter_case_t cases[] = {
+        { "raw (no filtering)", 1, 1, 0 },
+        { "oversample 2", 2, 1, 0 },
+        { "median of 3", 1, 3, 0 },
+        { "EMA 1/4", 1, 1, 2 },
+        { "configured", SENSOR_OVERSAMPLE, SENSOR_MEDIAN_WINDOW, SENSOR_EMA_SHIFT },
+        { "oversample 4, median 5, EMA 1/8", 4, 5, 3 },
+    };
+    enum { CASES = sizeof(cases) / sizeof(cases[0]) };
+    double rms[CASES];
+    int32_t worst[CASES];
+    int settle[CASES];
+
+    printf("\nFilter stages on %.2f C with +-%.2f C noise, a %.0f C spike every %d samples, a %.1f C step\n",
+           SIGNAL_C / 100.0, NOISE_C / 100.0, SPIKE_C / 100.0, SPIKE_EVERY, STEP_C / 100.0);
+    printf("  %-34s %11s %11s %14s\n", "stages", "noise rms C", "worst C", "step (samples)");
+    for (int i = 0; i < CASES; i++) {
+        run_case(&cases[i], &rms[i], &worst[i], &settle[i]);
+        printf("  %-34s %11.3f %11.2f %14d\n", cases[i].name, rms[i] / 100.0, worst[i] / 100.0, settle[i]);
+    }
+
+    // The median takes the spikes out, the EMA and oversampling the noise
+    BENCH_CHECK(worst[0] >= SPIKE_C - NOISE_C);
+    BENCH_CHECK(worst[2] <= 2 * NOISE_C);
+    BENCH_CHECK(rms[1] < rms[0] && rms[3] < rms[0]);
+    if (SENSOR_MEDIAN_WINDOW >= 3) {
+        BENCH_CHECK(worst[4] <= 2 * NOISE_C);
+    }
+    BENCH_CHECK(settle[0] == 1 && settle[4] <= 16);
+
+    // A steady input comes out exactly, whatever the stages
+    for (int i = 0; i < CASES; i++) {
+        sensor_filter_t f;
+        sensor_filter_init(&f, cases[i].median, cases[i].ema_shift);
+        for (int32_t v = -4000; v <= 4000; v += 1237) {
+            sensor_filter_reset(&f);
+            int32_t out = 0;
+            for (int n = 0; n < 64; n++) {
+                out = sensor_filter_update(&f, v);
+            }
+            BENCH_CHECK(out == v);
+        }
+    }
+
+    // Cost of one update at the configured stages
+    bench_series_t update = bench_series_create("sensor_filter_update (configured)", iterations);
+    sensor_filter_t f;
+    sensor_filter_init(&f, SENSOR_MEDIAN_WINDOW, SENSOR_EMA_SHIFT);
+    volatile int32_t sink = 0;
+    for (int i = 0; i < iterations; i++) {
+        int32_t v = SIGNAL_C + noise(NOISE_C);
+        int64_t t0 = bench_now_ns();
+        sink = sensor_filter_update(&f, v);
+        bench_series_add(&update, bench_now_ns() - t0);
+    }
+    (void)sink;
+    bench_report_header("Filter cost per quantity and sample");
+    bench_report(&update);
+    bench_series_free(&update);
+}
+
+// Through the sensor manager: a sample that reads 5 °C high does not reach
+// the published value, and oversampled conversions are averaged
+static void check_pipeline(void)
+{
+    sensor_data_t data[SENSOR_MAX_COUNT];
+
+    host_time_set_virtual(true);
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+    BENCH_CHECK(host_aht20_attach(I2C_NUM_0, 0x38) == ESP_OK);
+    host_aht20_set_reading(21.5f, 45.0f);
+    BENCH_CHECK(temp_sensor_init() == ESP_OK);
+
+    uint32_t before = host_aht20_trigger_count();
+    for (int i = 0; i < 8; i++) {
+        BENCH_CHECK(sensor_manager_read(data) == ESP_OK);
+        BENCH_CHECK(fabsf(data[0].temperature - 21.5f) < 0.01f && fabsf(data[0].humidity - 45.0f) < 0.01f);
+    }
+    BENCH_CHECK(host_aht20_trigger_count() - before == 8 * SENSOR_OVERSAMPLE);
+
+    for (int n = 0; n < SENSOR_OVERSAMPLE; n++) {
+        host_aht20_queue_reading(26.5f, 45.0f);
+    }
+    BENCH_CHECK(sensor_manager_read(data) == ESP_OK);
+    float spiked = data[0].temperature;
+    if (SENSOR_MEDIAN_WINDOW >= 3) {
+        BENCH_CHECK(fabsf(spiked - 21.5f) < 0.01f);
+    }
+
+    printf("\nThrough sensor_manager_read (%d conversion(s), median of %d, EMA 1/%d)\n",
+           SENSOR_OVERSAMPLE, SENSOR_MEDIAN_WINDOW, 1 << SENSOR_EMA_SHIFT);
+    printf("  steady 21.50 C, then one sample at 26.50 C: published %.2f C\n", spiked);
+
+    // The conversions of a sample are averaged: with one conversion in every
+    // sample reading 0.40 C high, the output settles at the average
+    for (int i = 0; i < 32; i++) {
+        host_aht20_queue_reading(21.9f, 45.0f);
+        for (int n = 1; n < SENSOR_OVERSAMPLE; n++) {
+            host_aht20_queue_reading(21.5f, 45.0f);
+        }
+        BENCH_CHECK(sensor_manager_read(data) == ESP_OK);
+    }
+    float expected = 21.5f + 0.4f / SENSOR_OVERSAMPLE;
+    printf("  one conversion of %d at 21.90 C in every sample: published %.2f C\n", SENSOR_OVERSAMPLE,
+           data[0].temperature);
+    BENCH_CHECK(fabsf(data[0].temperature - expected) < 0.011f);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 10000);
+
+    host_log_set_sink(NULL);
+    printf("Sample conversion and filtering (%d iterations)\n", iterations);
+    check_convert();
+    bench_convert(iterations);
+    check_filters(iterations);
+    check_pipeline();
+
+    return bench_exit_code();
+}
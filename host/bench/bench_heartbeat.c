@@ -0,0 +1,180 @@
+// Heartbeat: the health record published while the device runs, decoded the
+// way the webapp would, and the cost of building it
+//
+// The firmware boots through app_main on the simulated clock. Heap figures and
+// stack use are set from here (host threads are not measured); the WiFi link
+// and the broker are lost once to show up in the reconnect and outage fields.
+
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "boot_events.h"
+#include "heartbeat.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+#include "driver/i2c.h"
+#define DEVICE_TASK "temp_task"
+#define DEVICE_TASK_STACK 4096
+#else
+#define DEVICE_TASK "relay_actuator"
+#define DEVICE_TASK_STACK 3072
+#endif
+
+#define HEARTBEAT_STACK_USED 1200
+
+void app_main(void);
+
+static uint8_t last_payload[HEARTBEAT_MAX_LEN];
+static size_t last_len;
+static int heartbeats;
+
+static void capture(const host_mqtt_msg_t *msg, void *ctx)
+{
+    (void)ctx;
+    if (strcmp(msg->topic, MQTT_TOPIC_HEARTBEAT) != 0) {
+        return;
+    }
+    last_len = (size_t)msg->len < sizeof(last_payload) ? (size_t)msg->len : sizeof(last_payload);
+    memcpy(last_payload, msg->data, last_len);
+    heartbeats++;
+}
+
+static int task_slot(const char *name)
+{
+    for (size_t i = 0; heartbeat_task_name(i) != NULL; i++) {
+        if (strcmp(heartbeat_task_name(i), name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Run until the next heartbeat and decode it
+static heartbeat_t next_heartbeat(void)
+{
+    heartbeat_t hb = {0};
+    int before = heartbeats;
+    host_time_advance_us((int64_t)HEARTBEAT_INTERVAL_MS * 1000);
+    BENCH_CHECK(heartbeats == before + 1);
+    BENCH_CHECK(last_len == HEARTBEAT_FIXED_LEN + 2 * (size_t)last_payload[28] + HEARTBEAT_LINK_LEN);
+    BENCH_CHECK(heartbeat_decode(last_payload, last_len, &hb) == ESP_OK);
+    return hb;
+}
+
+static void print_heartbeat(const char *title, const heartbeat_t *hb)
+{
+    printf("\n%s (%zu bytes)\n", title, last_len);
+    printf("  uptime %lu s, heap %lu free / %lu min, rssi %d dBm, outbox %u B\n",
+           (unsigned long)hb->uptime_s, (unsigned long)hb->free_heap, (unsigned long)hb->min_free_heap,
+           hb->rssi, hb->outbox_bytes);
+    printf("  reconnects wifi %u / mqtt %u, published %lu, failed %lu\n", hb->wifi_reconnects,
+           hb->mqtt_reconnects, (unsigned long)hb->published, (unsigned long)hb->publish_failed);
+    printf("  down: wifi %lu s, broker %lu s; broker recovery last %lu ms, longest %lu ms\n",
+           (unsigned long)hb->wifi_down_s, (unsigned long)hb->offline_s, (unsigned long)hb->last_recovery_ms,
+           (unsigned long)hb->longest_recovery_ms);
+    for (size_t i = 0; i < hb->task_count; i++) {
+        if (hb->stack_free[i] == HEARTBEAT_NO_TASK) {
+            printf("  %-16s -\n", heartbeat_task_name(i));
+        } else {
+            printf("  %-16s %u B stack free\n", heartbeat_task_name(i), hb->stack_free[i]);
+        }
+    }
+}
+
+static void run_device(void)
+{
+    host_time_set_virtual(true);
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+    BENCH_CHECK(host_aht20_attach(I2C_NUM_0, 0x38) == ESP_OK);
+    BENCH_CHECK(host_partition_create(STORE_FORWARD_PARTITION, 64 * 1024) == ESP_OK);
+#endif
+    host_mqtt_set_auto_connect(50000);
+
+    app_main();
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_MQTT, 30000));
+    host_heap_set_free(150000);
+    BENCH_CHECK(host_task_set_stack_used("heartbeat", HEARTBEAT_STACK_USED) == ESP_OK);
+
+    heartbeat_t first = next_heartbeat();
+    print_heartbeat("First heartbeat", &first);
+    BENCH_CHECK(first.free_heap == 150000 && first.min_free_heap == 150000);
+    BENCH_CHECK(first.rssi == host_wifi_get_ap().rssi);
+    BENCH_CHECK(first.wifi_reconnects == 0 && first.mqtt_reconnects == 0);
+    BENCH_CHECK(first.wifi_down_s == 0 && first.offline_s == 0 && first.longest_recovery_ms == 0);
+    BENCH_CHECK(first.published > 0 && first.publish_failed == 0);
+    BENCH_CHECK(first.task_count == (uint8_t)task_slot("heartbeat") + 1);
+    BENCH_CHECK(first.stack_free[task_slot("heartbeat")] == 3072 - HEARTBEAT_STACK_USED);
+    BENCH_CHECK(first.stack_free[task_slot(DEVICE_TASK)] == DEVICE_TASK_STACK);
+
+    // A dip in between is caught by the minimum; nothing is sent while offline
+    host_heap_set_free(120000);
+    host_heap_set_free(160000);
+    host_mqtt_set_broker_available(false);
+    int offline_from = heartbeats;
+    host_time_advance_us((int64_t)HEARTBEAT_INTERVAL_MS * 1000);
+    BENCH_CHECK(heartbeats == offline_from);
+    host_mqtt_set_broker_available(true);
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_MQTT, MQTT_BACKOFF_MAX_MS + 1000));
+    host_wifi_drop_link();
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_WIFI, 30000));
+
+    heartbeat_t second = next_heartbeat();
+    print_heartbeat("After a broker outage and a WiFi drop", &second);
+    BENCH_CHECK(second.uptime_s > first.uptime_s);
+    BENCH_CHECK(second.free_heap == 160000 && second.min_free_heap == 120000);
+    BENCH_CHECK(second.wifi_reconnects == 1 && second.mqtt_reconnects == 1);
+    BENCH_CHECK(second.offline_s >= HEARTBEAT_INTERVAL_MS / 1000);
+    BENCH_CHECK(second.last_recovery_ms >= HEARTBEAT_INTERVAL_MS
+                && second.last_recovery_ms == second.longest_recovery_ms);
+    BENCH_CHECK(second.published > first.published);
+}
+
+static void run_encoding(int iterations)
+{
+    heartbeat_t hb, decoded;
+    uint8_t buf[HEARTBEAT_MAX_LEN];
+    bench_series_t collect = bench_series_create("collect + encode", (size_t)iterations);
+    bench_series_t decode = bench_series_create("decode", (size_t)iterations);
+
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = bench_now_ns();
+        heartbeat_collect(&hb);
+        size_t len = heartbeat_encode(&hb, buf, sizeof(buf));
+        bench_series_add(&collect, bench_now_ns() - start);
+
+        start = bench_now_ns();
+        esp_err_t ret = heartbeat_decode(buf, len, &decoded);
+        bench_series_add(&decode, bench_now_ns() - start);
+        if (i == 0) {
+            BENCH_CHECK(ret == ESP_OK && memcmp(&decoded, &hb, sizeof(hb)) == 0);
+            BENCH_CHECK(heartbeat_encode(&hb, buf, len - 1) == 0);
+            BENCH_CHECK(heartbeat_decode(buf, len - 1, &decoded) == ESP_ERR_INVALID_SIZE);
+            buf[0] = 0;
+            BENCH_CHECK(heartbeat_decode(buf, len, &decoded) == ESP_ERR_INVALID_VERSION);
+        }
+    }
+
+    bench_report_header("Heartbeat record");
+    bench_report(&collect);
+    bench_report(&decode);
+    bench_series_free(&collect);
+    bench_series_free(&decode);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 100000);
+
+    host_log_set_sink(NULL);
+    host_mqtt_set_publish_hook(capture, NULL);
+
+    printf("Heartbeat (%s, every %d ms, %d iterations)\n", DEVICE_TYPE_STR, HEARTBEAT_INTERVAL_MS, iterations);
+    run_device();
+    run_encoding(iterations);
+
+    return bench_exit_code();
+}
@@ -0,0 +1,676 @@
+// Command load on the relay: ON/OFF at set rates and in bursts through a
+// broker stand-in, ON/OFF -> ACK latency percentiles, dropped commands and
+// the throughput ceiling
+//
+// The broker is modelled the way mosquitto serves this relay: publishers
+// (the webapp, operators) put commands on its queue, and one connection
+// delivers them in order to the relay, each a hop after it was published,
+// the way esp-mqtt's task reads its socket. ACKs leave through the client
+// hook and are matched in order to the commands the relay accepted;
+// relay_get_stats() tells a command the full actuator queue dropped from
+// one whose ACK went missing.
+//
+// Built a second time with RELAY_COMMAND_SEQ (bench_load_seq): commands
+// carry "#<seq>", an ACK answers its own command and every older one still
+// waiting (coalesced, latest wins), and redelivered commands are refused.
+// Two batches for different channels held up behind a third are merged, and
+// both switch; an older state waiting on another topic never outlives a newer
+// command for its channel. A sender going back to #1 is taken to have
+// restarted once its topic was quiet for RELAY_SEQ_RESTART_MS (skipped on the
+// shim's clock).
+//
+//   bench_load [--iterations N] [--pattern all|steady|burst|operators|ramp]
+//              [--rate HZ] [--burst N] [--operators N] [--hop-us US]
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "device_relay.h"
+#include "mqtt_manager.h"
+#include "esp_event.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#define BROKER_QUEUE_LEN    1024    // mosquitto's max_queued_messages is 1000
+#define PENDING_LEN         1024    // Accepted commands waiting for their ACK (power of two)
+#define DRAIN_TIMEOUT_NS    2000000000LL
+#define BURST_GAP_NS        20000000LL
+#define RAMP_STEPS          7
+
+typedef struct {
+    bool on;
+    uint32_t seq;
+    int64_t published_ns;
+    int64_t delivered_ns;
+} command_t;
+
+static struct {
+    int64_t hop_ns;             // Broker -> relay, and relay -> broker for the ACK
+} opts;
+
+// ============================================
+// Broker stand-in
+// ============================================
+
+static pthread_mutex_t broker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t broker_cond = PTHREAD_COND_INITIALIZER;
+static command_t broker_queue[BROKER_QUEUE_LEN];
+static size_t broker_head;
+static size_t broker_count;
+static bool broker_delivering;  // The connection holds a command not yet handed over
+static uint32_t broker_dropped;
+static uint32_t next_seq = 1;
+
+// Commands the relay took, oldest first; the client thread adds, the ACK hook removes
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static command_t pending[PENDING_LEN];
+static size_t pending_head;
+static size_t pending_count;
+
+static atomic_uint relay_dropped;
+static atomic_uint coalesced;   // Answered by a newer command's ACK
+static atomic_uint acked;
+static atomic_uint mismatched;  // ACK state is not the command's
+static atomic_uint unexpected;  // ACK with no command waiting
+static atomic_llong last_ack_ns;
+static bench_series_t *end_to_end;
+static bench_series_t *on_device;
+
+#ifdef RELAY_COMMAND_SEQ
+// Batch ACKs; with hold_switch set the actuator stops at its next output
+// write until released (the MQTT hook runs under the client lock, so the
+// actuator cannot be held there while commands are injected)
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_cond = PTHREAD_COND_INITIALIZER;
+static bool hold_switch;
+static bool switch_held;
+static int batch_acks;
+static char last_batch_ack[HOST_MQTT_PAYLOAD_MAX];
+#endif
+
+static void sleep_until(int64_t deadline_ns)
+{
+    // Sleep most of the way, spin the last stretch: a timer slack of 50 us
+    // would otherwise cap the rates tried here
+    int64_t left = deadline_ns - bench_now_ns();
+    if (left > 200000) {
+        struct timespec ts = { .tv_sec = (left - 100000) / 1000000000LL, .tv_nsec = (left - 100000) % 1000000000LL };
+        nanosleep(&ts, NULL);
+    }
+    while (bench_now_ns() < deadline_ns) {
+    }
+}
+
+static void broker_publish(bool on)
+{
+    pthread_mutex_lock(&broker_lock);
+    if (broker_count == BROKER_QUEUE_LEN) {
+        broker_dropped++;
+    } else {
+        broker_queue[(broker_head + broker_count) % BROKER_QUEUE_LEN] =
+            (command_t){ .on = on, .seq = next_seq++, .published_ns = bench_now_ns() };
+        broker_count++;
+        pthread_cond_signal(&broker_cond);
+    }
+    pthread_mutex_unlock(&broker_lock);
+}
+
+/**
+ * @brief The relay's connection: deliver each command a hop after it was
+ *        published, one at a time as the MQTT task would
+ */
+static void *client_thread(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&broker_lock);
+        while (broker_count == 0) {
+            pthread_cond_wait(&broker_cond, &broker_lock);
+        }
+        command_t cmd = broker_queue[broker_head];
+        broker_head = (broker_head + 1) % BROKER_QUEUE_LEN;
+        broker_count--;
+        broker_delivering = true;
+        pthread_mutex_unlock(&broker_lock);
+
+        sleep_until(cmd.published_ns + opts.hop_ns);
+        cmd.delivered_ns = bench_now_ns();
+
+        // Queued for the ACK before delivery: the actuator may ACK before
+        // the handler returns
+        pthread_mutex_lock(&pending_lock);
+        BENCH_CHECK(pending_count < PENDING_LEN);
+        pending[(pending_head + pending_count) % PENDING_LEN] = cmd;
+        pending_count++;
+        pthread_mutex_unlock(&pending_lock);
+
+        uint32_t dropped = relay_get_stats().dropped;
+#ifdef RELAY_COMMAND_SEQ
+        char payload[24];
+        snprintf(payload, sizeof(payload), "%s#%lu", cmd.on ? "ON" : "OFF", (unsigned long)cmd.seq);
+        host_mqtt_inject_data(MQTT_TOPIC_COMMAND, payload, -1);
+#else
+        host_mqtt_inject_data(MQTT_TOPIC_COMMAND, cmd.on ? "ON" : "OFF", -1);
+#endif
+        if (relay_get_stats().dropped != dropped) {
+            // Dropped commands never get an ACK; it was the newest one queued
+            pthread_mutex_lock(&pending_lock);
+            pending_count--;
+            pthread_mutex_unlock(&pending_lock);
+            atomic_fetch_add(&relay_dropped, 1);
+        }
+
+        pthread_mutex_lock(&broker_lock);
+        broker_delivering = false;
+        pthread_mutex_unlock(&broker_lock);
+    }
+    return NULL;
+}
+
+static void capture_ack(const host_mqtt_msg_t *msg, void *ctx)
+{
+#ifdef RELAY_COMMAND_SEQ
+    if (strcmp(msg->topic, MQTT_TOPIC_CHANNELS_ACK) == 0) {
+        pthread_mutex_lock(&batch_lock);
+        snprintf(last_batch_ack, sizeof(last_batch_ack), "%.*s", msg->len, msg->data);
+        batch_acks++;
+        pthread_cond_broadcast(&batch_cond);
+        pthread_mutex_unlock(&batch_lock);
+        return;
+    }
+#endif
+    if (strcmp(msg->topic, MQTT_TOPIC_ACK) != 0) {
+        return;
+    }
+    int64_t now = bench_now_ns();
+
+    pthread_mutex_lock(&pending_lock);
+#ifdef RELAY_COMMAND_SEQ
+    // Commands older than the one ACKed were replaced before the relay got to them
+    const char *hash = strchr(msg->data, '#');
+    uint32_t seq = hash != NULL ? (uint32_t)strtoul(hash + 1, NULL, 10) : 0;
+    while (pending_count > 0 && pending[pending_head].seq < seq) {
+        pending_head = (pending_head + 1) % PENDING_LEN;
+        pending_count--;
+        atomic_fetch_add(&coalesced, 1);
+    }
+    bool found = pending_count > 0 && pending[pending_head].seq == seq;
+    char expected[24];
+    snprintf(expected, sizeof(expected), "ACK:%s#%lu", pending[pending_head].on ? "ON" : "OFF", (unsigned long)seq);
+#else
+    bool found = pending_count > 0;
+    const char *expected = pending[pending_head].on ? "ACK:ON" : "ACK:OFF";
+#endif
+    command_t cmd = pending[pending_head];
+    if (found) {
+        pending_head = (pending_head + 1) % PENDING_LEN;
+        pending_count--;
+    }
+    pthread_mutex_unlock(&pending_lock);
+
+    if (!found) {
+        atomic_fetch_add(&unexpected, 1);
+        return;
+    }
+    if (strcmp(msg->data, expected) != 0) {
+        atomic_fetch_add(&mismatched, 1);
+    }
+    // The ACK still has its hop back to the broker
+    bench_series_add(end_to_end, now + opts.hop_ns - cmd.published_ns);
+    bench_series_add(on_device, now - cmd.delivered_ns);
+    atomic_store(&last_ack_ns, now);
+    atomic_fetch_add(&acked, 1);
+}
+
+// ============================================
+// Load patterns
+// ============================================
+
+typedef struct {
+    const char *name;
+    uint32_t sent;
+    uint32_t broker_dropped;
+    uint32_t relay_dropped;
+    uint32_t coalesced;         // Replaced by a newer command before it was switched
+    uint32_t acked;
+    uint32_t missing;           // Taken by the relay, never ACKed
+    double seconds;             // First publish to last ACK
+} load_result_t;
+
+static load_result_t load_begin(const char *name, bench_series_t *e2e, bench_series_t *device)
+{
+    pthread_mutex_lock(&broker_lock);
+    broker_dropped = 0;
+    pthread_mutex_unlock(&broker_lock);
+    atomic_store(&relay_dropped, 0);
+    atomic_store(&coalesced, 0);
+    atomic_store(&acked, 0);
+    end_to_end = e2e;
+    on_device = device;
+    return (load_result_t){ .name = name };
+}
+
+// Wait for the relay to work off the load
+static void load_end(load_result_t *r, int64_t start_ns)
+{
+    int64_t deadline = bench_now_ns() + DRAIN_TIMEOUT_NS;
+    for (;;) {
+        pthread_mutex_lock(&broker_lock);
+        bool idle = broker_count == 0 && !broker_delivering;
+        pthread_mutex_unlock(&broker_lock);
+        pthread_mutex_lock(&pending_lock);
+        idle = idle && pending_count == 0;
+        pthread_mutex_unlock(&pending_lock);
+        if (idle || bench_now_ns() > deadline) {
+            break;
+        }
+        sleep_until(bench_now_ns() + 100000);
+    }
+
+    pthread_mutex_lock(&broker_lock);
+    r->broker_dropped = broker_dropped;
+    pthread_mutex_unlock(&broker_lock);
+    pthread_mutex_lock(&pending_lock);
+    r->missing = (uint32_t)pending_count;
+    pending_count = 0;
+    pthread_mutex_unlock(&pending_lock);
+    r->relay_dropped = atomic_load(&relay_dropped);
+    r->coalesced = atomic_load(&coalesced);
+    r->acked = atomic_load(&acked);
+    r->seconds = (atomic_load(&last_ack_ns) - start_ns) / 1e9;
+
+    // Every command is accounted for, and every ACK belongs to its command
+    BENCH_CHECK(r->missing == 0);
+    BENCH_CHECK(r->sent == r->broker_dropped + r->relay_dropped + r->coalesced + r->acked);
+    BENCH_CHECK(atomic_load(&mismatched) == 0 && atomic_load(&unexpected) == 0);
+}
+
+// One publisher at a fixed rate (0: as fast as it can)
+static load_result_t run_steady(const char *name, int count, int rate, bench_series_t *e2e, bench_series_t *device)
+{
+    load_result_t r = load_begin(name, e2e, device);
+    int64_t period = rate > 0 ? 1000000000LL / rate : 0;
+    int64_t start = bench_now_ns();
+    for (int i = 0; i < count; i++) {
+        sleep_until(start + i * period);
+        broker_publish(i & 1);
+        r.sent++;
+    }
+    load_end(&r, start);
+    return r;
+}
+
+// A schedule replayed: burst commands back to back, a pause, again
+static load_result_t run_burst(int count, int burst, bench_series_t *e2e, bench_series_t *device)
+{
+    load_result_t r = load_begin("burst", e2e, device);
+    int64_t start = bench_now_ns();
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && i % burst == 0) {
+            sleep_until(bench_now_ns() + BURST_GAP_NS);
+        }
+        broker_publish(i & 1);
+        r.sent++;
+    }
+    load_end(&r, start);
+    return r;
+}
+
+typedef struct {
+    int count;
+    int64_t mean_gap_ns;
+    uint32_t seed;
+} operator_t;
+
+// An operator clicking ON and OFF at random (exponential gaps)
+static void *operator_thread(void *arg)
+{
+    operator_t *op = arg;
+    int64_t next = bench_now_ns();
+    for (int i = 0; i < op->count; i++) {
+        op->seed = op->seed * 1103515245u + 12345u;
+        double u = ((op->seed >> 8) + 1) / 16777217.0;
+        next += (int64_t)(-log1p(-u) * (double)op->mean_gap_ns);
+        sleep_until(next);
+        broker_publish(i & 1);
+    }
+    return NULL;
+}
+
+static load_result_t run_operators(int count, int operators, int rate, bench_series_t *e2e, bench_series_t *device)
+{
+    load_result_t r = load_begin("operators", e2e, device);
+    pthread_t threads[operators];
+    operator_t ops[operators];
+    int64_t start = bench_now_ns();
+    for (int i = 0; i < operators; i++) {
+        ops[i] = (operator_t){
+            .count = count / operators,
+            .mean_gap_ns = 1000000000LL * operators / rate,
+            .seed = 1234u + (uint32_t)i,
+        };
+        r.sent += (uint32_t)ops[i].count;
+        pthread_create(&threads[i], NULL, operator_thread, &ops[i]);
+    }
+    for (int i = 0; i < operators; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    load_end(&r, start);
+    return r;
+}
+
+// ============================================
+// Reporting
+// ============================================
+
+static void print_header(void)
+{
+    printf("\n  %-22s %7s %12s %11s %10s %7s %8s %10s\n", "load", "sent", "broker drop", "relay drop",
+           "coalesced", "acked", "missing", "ACKs/s");
+}
+
+static void print_result(const load_result_t *r)
+{
+    printf("  %-22s %7u %12u %11u %10u %7u %8u %10.0f\n", r->name, r->sent, r->broker_dropped, r->relay_dropped,
+           r->coalesced, r->acked, r->missing, r->seconds > 0 ? r->acked / r->seconds : 0.0);
+}
+
+static void report_series(const char *title, bench_series_t *e2e, bench_series_t *device)
+{
+    bench_report_header(title);
+    bench_report(e2e);
+    bench_report(device);
+    bench_series_free(e2e);
+    bench_series_free(device);
+}
+
+static void bench_patterns(const char *pattern, int count, int rate, int burst, int operators)
+{
+    bool all = strcmp(pattern, "all") == 0;
+    char title[96];
+
+    if (all || strcmp(pattern, "steady") == 0) {
+        bench_series_t e2e = bench_series_create("published -> ACK at broker", count);
+        bench_series_t device = bench_series_create("  of which relay: delivered -> ACK", count);
+        load_result_t r = run_steady("steady", count, rate, &e2e, &device);
+        print_header();
+        print_result(&r);
+        snprintf(title, sizeof(title), "Steady, %d commands/s", rate);
+        report_series(title, &e2e, &device);
+    }
+    if (all || strcmp(pattern, "burst") == 0) {
+        bench_series_t e2e = bench_series_create("published -> ACK at broker", count);
+        bench_series_t device = bench_series_create("  of which relay: delivered -> ACK", count);
+        load_result_t r = run_burst(count, burst, &e2e, &device);
+        print_header();
+        print_result(&r);
+#ifdef RELAY_COMMAND_SEQ
+        // Latest wins: nothing is lost to a full queue
+        BENCH_CHECK(r.relay_dropped == 0);
+        snprintf(title, sizeof(title), "Bursts of %d back to back, %lld ms apart (latest wins)", burst,
+                 BURST_GAP_NS / 1000000);
+#else
+        snprintf(title, sizeof(title), "Bursts of %d back to back, %lld ms apart (actuator queue %d)", burst,
+                 BURST_GAP_NS / 1000000, RELAY_CMD_QUEUE_LEN);
+#endif
+        report_series(title, &e2e, &device);
+    }
+    if (all || strcmp(pattern, "operators") == 0) {
+        bench_series_t e2e = bench_series_create("published -> ACK at broker", count);
+        bench_series_t device = bench_series_create("  of which relay: delivered -> ACK", count);
+        load_result_t r = run_operators(count, operators, rate, &e2e, &device);
+        print_header();
+        print_result(&r);
+        snprintf(title, sizeof(title), "%d operators at random, %d commands/s together", operators, rate);
+        report_series(title, &e2e, &device);
+    }
+    if (all || strcmp(pattern, "ramp") == 0) {
+        // Offered rate up until the relay falls behind; 0 is unpaced
+        static const int rates[RAMP_STEPS] = { 1000, 2000, 5000, 10000, 20000, 50000, 0 };
+        static const char *names[RAMP_STEPS] = {
+            "ramp 1000/s", "ramp 2000/s", "ramp 5000/s", "ramp 10000/s", "ramp 20000/s", "ramp 50000/s",
+            "ramp unpaced",
+        };
+        int per_step = count / RAMP_STEPS > 0 ? count / RAMP_STEPS : 1;
+        double ceiling = 0.0;
+        int clean_rate = 0;
+        bool clean = true;
+        print_header();
+        for (int i = 0; i < RAMP_STEPS; i++) {
+            bench_series_t e2e = bench_series_create("published -> ACK at broker", per_step);
+            bench_series_t device = bench_series_create("  of which relay: delivered -> ACK", per_step);
+            load_result_t r = run_steady(names[i], per_step, rates[i], &e2e, &device);
+            print_result(&r);
+            double throughput = r.seconds > 0 ? r.acked / r.seconds : 0.0;
+            ceiling = throughput > ceiling ? throughput : ceiling;
+            clean = clean && rates[i] > 0 && r.relay_dropped == 0 && r.broker_dropped == 0;
+            if (clean) {
+                clean_rate = rates[i];
+            }
+            bench_series_free(&e2e);
+            bench_series_free(&device);
+        }
+        printf("  ceiling: %.0f ACKs/s; no drops up to %d commands/s offered\n", ceiling, clean_rate);
+    }
+}
+
+#ifdef RELAY_COMMAND_SEQ
+/**
+ * @brief Deliver the last command again, and one from before it: neither
+ *        switches nor gets an ACK
+ */
+static void run_redelivery(void)
+{
+    pthread_mutex_lock(&broker_lock);
+    uint32_t last = next_seq - 1;
+    pthread_mutex_unlock(&broker_lock);
+    relay_stats_t before = relay_get_stats();
+    uint32_t acks = atomic_load(&acked);
+    char payload[24];
+
+    int64_t start = bench_now_ns();
+    snprintf(payload, sizeof(payload), "ON#%lu", (unsigned long)last);
+    host_mqtt_inject_data(MQTT_TOPIC_COMMAND, payload, -1);
+    snprintf(payload, sizeof(payload), "OFF#%lu", (unsigned long)(last - RELAY_SEQ_WINDOW / 2));
+    host_mqtt_inject_data(MQTT_TOPIC_COMMAND, payload, -1);
+    int64_t cost = bench_now_ns() - start;
+    sleep_until(bench_now_ns() + BURST_GAP_NS);
+
+    relay_stats_t after = relay_get_stats();
+    printf("\n  redelivered #%lu and stale #%lu: %u refused, %u switched, %.1f us each\n", (unsigned long)last,
+           (unsigned long)(last - RELAY_SEQ_WINDOW / 2), after.stale - before.stale, after.applied - before.applied,
+           cost / 2e3);
+    BENCH_CHECK(after.stale - before.stale == 2 && after.queued == before.queued);
+    BENCH_CHECK(atomic_load(&acked) == acks && atomic_load(&unexpected) == 0);
+}
+
+static void hold_at_switch(uint32_t pins, void *ctx)
+{
+    (void)pins;
+    (void)ctx;
+    pthread_mutex_lock(&batch_lock);
+    if (hold_switch) {
+        switch_held = true;
+        pthread_cond_broadcast(&batch_cond);
+        while (hold_switch) {
+            pthread_cond_wait(&batch_cond, &batch_lock);
+        }
+    }
+    pthread_mutex_unlock(&batch_lock);
+}
+
+// Send a batch and stop the actuator while it switches it
+static void hold_actuator(const char *batch)
+{
+    pthread_mutex_lock(&batch_lock);
+    hold_switch = true;
+    switch_held = false;
+    batch_acks = 0;
+    pthread_mutex_unlock(&batch_lock);
+    host_gpio_set_write_hook(hold_at_switch, NULL);
+    host_mqtt_inject_data(MQTT_TOPIC_CHANNELS_SET, batch, -1);
+    pthread_mutex_lock(&batch_lock);
+    while (!switch_held) {
+        pthread_cond_wait(&batch_cond, &batch_lock);
+    }
+    pthread_mutex_unlock(&batch_lock);
+}
+
+// Let the actuator go on and wait for the batch ACKs
+static void release_actuator(int batches)
+{
+    pthread_mutex_lock(&batch_lock);
+    hold_switch = false;
+    pthread_cond_broadcast(&batch_cond);
+    while (batch_acks < batches) {
+        pthread_cond_wait(&batch_cond, &batch_lock);
+    }
+    pthread_mutex_unlock(&batch_lock);
+    host_gpio_set_write_hook(NULL, NULL);
+    sleep_until(bench_now_ns() + BURST_GAP_NS);
+}
+
+/**
+ * @brief Two batches for different channels arrive while the actuator is
+ *        busy: they merge, both switch, and the newer number is ACKed
+ */
+static void run_batches(void)
+{
+    relay_stats_t before = relay_get_stats();
+    hold_actuator("2=ON,3=OFF#1");
+    host_mqtt_inject_data(MQTT_TOPIC_CHANNELS_SET, "3=ON#2", -1);
+    host_mqtt_inject_data(MQTT_TOPIC_CHANNELS_SET, "2=OFF#3", -1);
+    release_actuator(2);
+
+    relay_stats_t after = relay_get_stats();
+    pthread_mutex_lock(&batch_lock);
+    printf("  batches #2 (3=ON) and #3 (2=OFF) behind #1: %u coalesced, ACK %s\n",
+           after.coalesced - before.coalesced, last_batch_ack);
+    BENCH_CHECK(batch_acks == 2 && strstr(last_batch_ack, ",2=OFF,3=ON#3") != NULL);
+    pthread_mutex_unlock(&batch_lock);
+    BENCH_CHECK((relay_get_channels() & 0x0c) == 0x08);
+    BENCH_CHECK(after.coalesced - before.coalesced == 1 && after.applied - before.applied == 2);
+}
+
+/**
+ * @brief Batch "0=ON", then "OFF" on the command topic, then batch "1=ON",
+ *        all waiting: the batch merged last must not turn channel 0 back ON
+ */
+static void run_crossing(void)
+{
+    relay_stats_t before = relay_get_stats();
+    hold_actuator("0=OFF,1=OFF#10");
+    host_mqtt_inject_data(MQTT_TOPIC_CHANNELS_SET, "0=ON#11", -1);
+
+    // Matched to its ACK like the load's commands
+    bench_series_t e2e = bench_series_create("published -> ACK at broker", 1);
+    bench_series_t device = bench_series_create("  of which relay: delivered -> ACK", 1);
+    end_to_end = &e2e;
+    on_device = &device;
+    pthread_mutex_lock(&broker_lock);
+    command_t off = { .on = false, .seq = next_seq++, .published_ns = bench_now_ns() };
+    pthread_mutex_unlock(&broker_lock);
+    off.delivered_ns = off.published_ns;
+    pthread_mutex_lock(&pending_lock);
+    pending[(pending_head + pending_count) % PENDING_LEN] = off;
+    pending_count++;
+    pthread_mutex_unlock(&pending_lock);
+    char payload[24];
+    snprintf(payload, sizeof(payload), "OFF#%lu", (unsigned long)off.seq);
+    uint32_t acks = atomic_load(&acked);
+    host_mqtt_inject_data(MQTT_TOPIC_COMMAND, payload, -1);
+
+    host_mqtt_inject_data(MQTT_TOPIC_CHANNELS_SET, "1=ON#12", -1);
+    release_actuator(2);
+    bench_series_free(&e2e);
+    bench_series_free(&device);
+
+    relay_stats_t after = relay_get_stats();
+    pthread_mutex_lock(&batch_lock);
+    printf("  batch 0=ON, OFF, batch 1=ON behind a batch: channels 0x%02x, ACK %s\n", relay_get_channels(),
+           last_batch_ack);
+    BENCH_CHECK(strncmp(last_batch_ack, "0=OFF,1=ON,", 11) == 0 && strstr(last_batch_ack, "#12") != NULL);
+    pthread_mutex_unlock(&batch_lock);
+    BENCH_CHECK((relay_get_channels() & 0x03) == 0x02);
+    BENCH_CHECK(atomic_load(&acked) == acks + 1 && atomic_load(&mismatched) == 0 && atomic_load(&unexpected) == 0);
+    BENCH_CHECK(after.applied - before.applied == 3 && after.coalesced - before.coalesced == 1);
+}
+
+/**
+ * @brief A sender restarts at #1 after #30: refused at once as stale, taken
+ *        as a restart once the channel was quiet for RELAY_SEQ_RESTART_MS,
+ *        unlike a late redelivery
+ */
+static void run_restart(void)
+{
+    const char *topic = MQTT_TOPIC_CHANNEL_PREFIX "1/set";
+    relay_stats_t before = relay_get_stats();
+    host_mqtt_inject_data(topic, "ON#30", -1);
+    host_mqtt_inject_data(topic, "OFF#1", -1);
+    sleep_until(bench_now_ns() + BURST_GAP_NS);
+    BENCH_CHECK((relay_get_channels() & 0x02) != 0);
+
+    // However late, a redelivery or the sender's retry of the newest is no restart
+    host_time_advance_us((int64_t)RELAY_SEQ_RESTART_MS * 1000);
+    host_mqtt_inject_redelivery(topic, "OFF#29", -1);
+    host_mqtt_inject_data(topic, "ON#30", -1);
+    sleep_until(bench_now_ns() + BURST_GAP_NS);
+    BENCH_CHECK((relay_get_channels() & 0x02) != 0);
+
+    host_mqtt_inject_data(topic, "OFF#1", -1);
+    host_mqtt_inject_data(topic, "ON#1", -1);      // Redelivered: the window counts from #1 now
+    sleep_until(bench_now_ns() + BURST_GAP_NS);
+
+    relay_stats_t after = relay_get_stats();
+    printf("  #1 after #30: refused at once, switched %d ms later; %u refused in all\n", RELAY_SEQ_RESTART_MS,
+           after.stale - before.stale);
+    BENCH_CHECK((relay_get_channels() & 0x02) == 0);
+    BENCH_CHECK(after.stale - before.stale == 4 && after.applied - before.applied == 2);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 20000);
+    const char *pattern = bench_parse_option(argc, argv, "pattern", "all");
+    int rate = atoi(bench_parse_option(argc, argv, "rate", "1000"));
+    int burst = atoi(bench_parse_option(argc, argv, "burst", "64"));
+    int operators = atoi(bench_parse_option(argc, argv, "operators", "4"));
+    opts.hop_ns = atoll(bench_parse_option(argc, argv, "hop-us", "0")) * 1000;
+    if (rate <= 0 || burst <= 0 || operators <= 0 || opts.hop_ns < 0) {
+        fprintf(stderr, "--rate, --burst and --operators must be positive, --hop-us not negative\n");
+        return 2;
+    }
+
+    host_log_set_sink(NULL);
+    host_mqtt_set_publish_hook(capture_ack, NULL);
+    BENCH_CHECK(relay_init() == ESP_OK);
+    BENCH_CHECK(esp_event_loop_create_default() == ESP_OK);
+    BENCH_CHECK(mqtt_client_init() == ESP_OK);
+    host_mqtt_inject_connected();
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_COMMAND));
+
+    pthread_t client;
+    pthread_create(&client, NULL, client_thread, NULL);
+    pthread_detach(client);
+
+    printf("Command load (%d commands per pattern, broker hop %lld us each way)\n", iterations,
+           (long long)(opts.hop_ns / 1000));
+    bench_patterns(pattern, iterations, rate, burst, operators);
+#ifdef RELAY_COMMAND_SEQ
+    run_redelivery();
+    run_batches();
+    run_crossing();
+    run_restart();
+#endif
+
+    relay_stats_t stats = relay_get_stats();
+    BENCH_CHECK(stats.applied + stats.coalesced == stats.queued);
+    return bench_exit_code();
+}
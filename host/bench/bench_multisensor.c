@@ -0,0 +1,239 @@
+// Four sensors on both I2C controllers (an AHT20 and a BMP280 on each bus):
+// every sensor triggered together against one sensor after another, a slow
+// or unreachable sensor next to working ones, and the per-sensor topics
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "device_temp.h"
+#include "sensor_manager.h"
+#include "mqtt_manager.h"
+#include "driver/i2c_master.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#define SENSORS 4
+
+static const struct {
+    const char *name;
+    int port;
+    uint8_t addr;
+    bool bmp280;
+    float temperature;
+    float second;           // Humidity (AHT20) or pressure in hPa (BMP280)
+} rooms[SENSORS] = {
+    { "living", I2C_NUM_0, 0x38, false, 22.25f, 41.5f },
+    { "living_pressure", I2C_NUM_0, 0x77, true, 22.5f, 1009.75f },
+    { "bedroom", I2C_NUM_1, 0x38, false, 19.75f, 55.25f },
+    { "attic", I2C_NUM_1, 0x76, true, 12.5f, 1011.5f },
+};
+
+static SemaphoreHandle_t room_sem;
+static char room_payload[SENSORS][HOST_MQTT_PAYLOAD_MAX];
+static uint32_t temp_publishes;
+
+static void capture(const host_mqtt_msg_t *msg, void *ctx)
+{
+    (void)ctx;
+    if (strcmp(msg->topic, MQTT_TOPIC_TEMP) == 0) {
+        temp_publishes++;
+        return;
+    }
+    size_t prefix = strlen(MQTT_TOPIC_SENSOR_PREFIX);
+    for (int i = 1; i < SENSORS; i++) {
+        if (strncmp(msg->topic, MQTT_TOPIC_SENSOR_PREFIX, prefix) == 0 &&
+            strcmp(msg->topic + prefix, rooms[i].name) == 0 && room_payload[i][0] == '\0') {
+            snprintf(room_payload[i], sizeof(room_payload[i]), "%s", msg->data);
+            xSemaphoreGive(room_sem);
+        }
+    }
+}
+
+static bool reading_matches(const sensor_data_t *d, int i)
+{
+    if (!d->valid || strcmp(d->name, rooms[i].name) != 0 || fabsf(d->temperature - rooms[i].temperature) > 0.01f) {
+        return false;
+    }
+    if (rooms[i].bmp280) {
+        return d->fields == (SENSOR_HAS_TEMPERATURE | SENSOR_HAS_PRESSURE) &&
+               fabsf(d->pressure - rooms[i].second) < 0.01f;
+    }
+    return d->fields == (SENSOR_HAS_TEMPERATURE | SENSOR_HAS_HUMIDITY) &&
+           fabsf(d->humidity - rooms[i].second) < 0.01f;
+}
+
+static void set_readings(void)
+{
+    for (int i = 0; i < SENSORS; i++) {
+        if (rooms[i].bmp280) {
+            BENCH_CHECK(host_bmp280_set_reading(rooms[i].port, rooms[i].addr, rooms[i].temperature,
+                                                rooms[i].second) == ESP_OK);
+        } else {
+            BENCH_CHECK(host_aht20_set_reading_at(rooms[i].port, rooms[i].addr, rooms[i].temperature,
+                                                  rooms[i].second) == ESP_OK);
+        }
+    }
+}
+
+static void bench_init(void)
+{
+    host_i2c_reset_stats();
+    int64_t t0 = host_time_now_ns();
+    BENCH_CHECK(temp_sensor_init() == ESP_OK);
+    int64_t t1 = host_time_now_ns();
+
+    BENCH_CHECK(sensor_manager_count() == SENSORS);
+    for (int i = 0; i < SENSORS; i++) {
+        BENCH_CHECK(sensor_manager_ready(i));
+    }
+    host_i2c_stats_t stats = host_i2c_get_stats();
+    printf("\nsensor_manager_init (2 buses, %d sensors)\n", SENSORS);
+    printf("  simulated boot time: %.1f ms, I2C transactions: %u (%u NACKed)\n",
+           (double)(t1 - t0) / 1e6, stats.transactions, stats.nacks);
+}
+
+// Every sensor delivers its own reading, whichever bus it is on
+static void check_readings(void)
+{
+    sensor_data_t data[SENSOR_MAX_COUNT];
+    set_readings();
+    BENCH_CHECK(sensor_manager_read(data) == ESP_OK);
+    for (int i = 0; i < SENSORS; i++) {
+        BENCH_CHECK(reading_matches(&data[i], i));
+    }
+
+    // A subset can be sampled on its own; the rest report nothing
+    BENCH_CHECK(sensor_manager_start(0x05) == ESP_OK);
+    BENCH_CHECK(sensor_manager_collect(data, sensor_manager_sample_timeout_ms()) == ESP_OK);
+    BENCH_CHECK(data[0].valid && !data[1].valid && data[2].valid && !data[3].valid);
+    BENCH_CHECK(sensor_manager_start(0) == ESP_ERR_INVALID_STATE);
+
+    // A conversion that never finishes fails at its deadline without holding up
+    // the sensors that did finish, and the next sample recovers
+    host_bmp280_set_conversion_time_us(1000000);
+    BENCH_CHECK(sensor_manager_read(data) == ESP_FAIL);
+    BENCH_CHECK(reading_matches(&data[0], 0) && !data[1].valid && reading_matches(&data[2], 2) && !data[3].valid);
+    host_bmp280_set_conversion_time_us(11500);
+
+    // A stuck bus only costs the sensors on it
+    host_i2c_set_stuck(I2C_NUM_1, true);
+    BENCH_CHECK(sensor_manager_read(data) == ESP_FAIL);
+    BENCH_CHECK(reading_matches(&data[0], 0) && reading_matches(&data[1], 1));
+    BENCH_CHECK(!data[2].valid && !data[3].valid);
+    host_i2c_set_stuck(I2C_NUM_1, false);
+
+    BENCH_CHECK(sensor_manager_read(data) == ESP_OK);
+    for (int i = 0; i < SENSORS; i++) {
+        BENCH_CHECK(reading_matches(&data[i], i));
+    }
+}
+
+static void bench_overlap(int iterations)
+{
+    bench_series_t together = bench_series_create("all triggered together (simulated)", iterations);
+    bench_series_t sequential = bench_series_create("one after another (simulated)", iterations);
+    bench_series_t together_cpu = bench_series_create("all triggered together (host CPU)", iterations);
+    bench_series_t sequential_cpu = bench_series_create("one after another (host CPU)", iterations);
+    sensor_data_t data[SENSOR_MAX_COUNT];
+    sensor_data_t one[SENSOR_MAX_COUNT];
+    int64_t together_max = 0;
+    int64_t sequential_min = INT64_MAX;
+
+    uint32_t aht20_before = host_aht20_trigger_count();
+    uint32_t bmp280_before = host_bmp280_trigger_count();
+    for (int i = 0; i < iterations; i++) {
+        int64_t v0 = host_time_now_ns();
+        int64_t t0 = bench_now_ns();
+        BENCH_CHECK(sensor_manager_read(data) == ESP_OK);
+        int64_t t1 = bench_now_ns();
+        int64_t elapsed = host_time_now_ns() - v0;
+        together_max = elapsed > together_max ? elapsed : together_max;
+        bench_series_add(&together, elapsed);
+        bench_series_add(&together_cpu, t1 - t0);
+
+        // The same four readings with each conversion waited on before the next
+        v0 = host_time_now_ns();
+        t0 = bench_now_ns();
+        for (int s = 0; s < SENSORS; s++) {
+            BENCH_CHECK(sensor_manager_start((uint8_t)(1u << s)) == ESP_OK);
+            BENCH_CHECK(sensor_manager_collect(one, sensor_manager_sample_timeout_ms()) == ESP_OK);
+            BENCH_CHECK(reading_matches(&one[s], s));
+        }
+        t1 = bench_now_ns();
+        elapsed = host_time_now_ns() - v0;
+        sequential_min = elapsed < sequential_min ? elapsed : sequential_min;
+        bench_series_add(&sequential, elapsed);
+        bench_series_add(&sequential_cpu, t1 - t0);
+    }
+    BENCH_CHECK(host_aht20_trigger_count() - aht20_before == (uint32_t)iterations * 4 * SENSOR_OVERSAMPLE);
+    BENCH_CHECK(host_bmp280_trigger_count() - bmp280_before == (uint32_t)iterations * 4 * SENSOR_OVERSAMPLE);
+
+    printf("\nSampling 2 AHT20 (75 ms) and 2 BMP280 (11.5 ms) on two buses, %d conversion(s) each\n",
+           SENSOR_OVERSAMPLE);
+    bench_report_header("Sample time");
+    bench_report(&together);
+    bench_report(&sequential);
+    bench_report(&together_cpu);
+    bench_report(&sequential_cpu);
+
+    // Together the sample lasts about as long as the slowest conversion
+    BENCH_CHECK(together_max < SENSOR_OVERSAMPLE * 90 * 1000000LL);
+    BENCH_CHECK(sequential_min > SENSOR_OVERSAMPLE * 2 * 75 * 1000000LL);
+
+    bench_series_free(&together);
+    bench_series_free(&sequential);
+    bench_series_free(&together_cpu);
+    bench_series_free(&sequential_cpu);
+}
+
+// The publishing task sends the first sensor to the webapp topic and every
+// other one as JSON to its own topic
+static void check_topics(void)
+{
+    room_sem = xSemaphoreCreateCounting(SENSORS, 0);
+    host_mqtt_set_publish_hook(capture, NULL);
+    BENCH_CHECK(esp_event_loop_create_default() == ESP_OK);
+    BENCH_CHECK(mqtt_client_init() == ESP_OK);
+    host_mqtt_inject_connected();
+
+    BENCH_CHECK(temp_sensor_start_publishing(mqtt_get_client()) == ESP_OK);
+    for (int i = 1; i < SENSORS; i++) {
+        BENCH_CHECK(xSemaphoreTake(room_sem, pdMS_TO_TICKS(5000)) == pdTRUE);
+    }
+    BENCH_CHECK(temp_publishes >= 1);
+    BENCH_CHECK(strcmp(room_payload[1], "{\"temperature\":22.50,\"pressure\":1009.75}") == 0);
+    BENCH_CHECK(strcmp(room_payload[2], "{\"temperature\":19.75,\"humidity\":55.25}") == 0);
+    BENCH_CHECK(strcmp(room_payload[3], "{\"temperature\":12.50,\"pressure\":1011.50}") == 0);
+
+    printf("\nPer-sensor topics\n");
+    for (int i = 1; i < SENSORS; i++) {
+        printf("  %s%s: %s\n", MQTT_TOPIC_SENSOR_PREFIX, rooms[i].name, room_payload[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 2000);
+
+    host_log_set_sink(NULL);
+    host_time_set_virtual(true);
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+    for (int i = 0; i < SENSORS; i++) {
+        esp_err_t ret = rooms[i].bmp280 ? host_bmp280_attach(rooms[i].port, rooms[i].addr)
+                                        : host_aht20_attach(rooms[i].port, rooms[i].addr);
+        BENCH_CHECK(ret == ESP_OK);
+    }
+
+    printf("Multi-sensor benchmarks (%d sensors, %d iterations)\n", SENSORS, iterations);
+    bench_init();
+    check_readings();
+    bench_overlap(iterations);
+    check_topics();
+
+    return bench_exit_code();
+}
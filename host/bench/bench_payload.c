@@ -0,0 +1,351 @@
+// Binary payloads (PAYLOAD_BINARY) against the current text formats: wire
+// size and encode cost per message kind, plus a relay built with binary
+// payloads driven end to end
+//
+// Every binary message is also run through the webapp bridge, which has to
+// reproduce the text payload exactly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "device_relay.h"
+#include "mqtt_manager.h"
+#include "payload.h"
+#include "sample_ring.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "host_shim.h"
+#include "payload_bridge.h"
+#include "bench.h"
+
+#define BATCH_SMALL 10
+#define BATCH_LARGE 64
+#define SAMPLE_INTERVAL_MS 30000
+
+typedef struct {
+    const char *name;
+    size_t text_len;
+    size_t binary_len;
+    int64_t text_ns;
+    int64_t binary_ns;
+    int64_t decode_ns;
+} format_result_t;
+
+static format_result_t results[8];
+static int result_count;
+static volatile int sink;   // Keeps the timed loops from being optimized out
+
+// Values on a 0.01 grid, as the AHT20 conversion rounds to in practice, so
+// the hundredths on the wire print back to the same text
+static float grid(int centi)
+{
+    return centi / 100.0f;
+}
+
+static int cmp_ns(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t median_ns(bench_series_t *series)
+{
+    qsort(series->samples_ns, series->count, sizeof(series->samples_ns[0]), cmp_ns);
+    return series->count > 0 ? series->samples_ns[series->count / 2] : 0;
+}
+
+// An encoder under test: writes one message for arg into buf
+typedef size_t (*encode_fn_t)(const void *arg, void *buf, size_t len);
+
+static int64_t time_encoder(encode_fn_t fn, const void *arg, void *buf, size_t len, int iterations)
+{
+    bench_series_t series = bench_series_create("", (size_t)iterations);
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = bench_now_ns();
+        sink += (int)fn(arg, buf, len);
+        bench_series_add(&series, bench_now_ns() - start);
+    }
+    int64_t median = median_ns(&series);
+    bench_series_free(&series);
+    return median;
+}
+
+// ============================================
+// Message kinds
+// ============================================
+
+typedef struct {
+    float temperature;
+    float humidity;
+} reading_t;
+
+static size_t text_temperature(const void *arg, void *buf, size_t len)
+{
+    const reading_t *r = arg;
+    int n = snprintf(buf, len, "%.2f", r->temperature);
+    return n < 0 ? 0 : (size_t)n;
+}
+
+static size_t binary_temperature(const void *arg, void *buf, size_t len)
+{
+    const reading_t *r = arg;
+    return payload_encode_temperature(r->temperature, r->humidity, buf, len);
+}
+
+typedef struct {
+    const sample_ring_t *ring;
+    uint32_t now_ms;
+} batch_arg_t;
+
+static size_t text_batch(const void *arg, void *buf, size_t len)
+{
+    const batch_arg_t *b = arg;
+    return sample_ring_encode_json(b->ring, b->now_ms, buf, len, NULL);
+}
+
+static size_t binary_batch(const void *arg, void *buf, size_t len)
+{
+    const batch_arg_t *b = arg;
+    return payload_encode_batch(b->ring, b->now_ms, buf, len, NULL);
+}
+
+// The JSON mqtt_publish_connection_status() sends in text mode
+static size_t text_status(const void *arg, void *buf, size_t len)
+{
+    const payload_status_t *s = arg;
+    int n = snprintf(buf, len,
+                     "{\"status\":\"online\",\"device_type\":\"%s\",\"ip_address\":\"%u.%u.%u.%u\","
+                     "\"boot_ms\":{\"wifi\":%ld,\"mqtt\":%ld,\"first_publish\":%ld}}",
+                     "sensor", s->ip[0], s->ip[1], s->ip[2], s->ip[3],
+                     (long)s->wifi_ms, (long)s->mqtt_ms, (long)s->first_publish_ms);
+    return n < 0 ? 0 : (size_t)n;
+}
+
+static size_t binary_status(const void *arg, void *buf, size_t len)
+{
+    return payload_encode_status(arg, buf, len);
+}
+
+static size_t text_ack(const void *arg, void *buf, size_t len)
+{
+    int n = snprintf(buf, len, "%s", *(const bool *)arg ? "ACK:ON" : "ACK:OFF");
+    return n < 0 ? 0 : (size_t)n;
+}
+
+static size_t binary_ack(const void *arg, void *buf, size_t len)
+{
+    return payload_encode_relay(PAYLOAD_RELAY_ACK, *(const bool *)arg, 0, buf, len);
+}
+
+/**
+ * @brief Size and time both encoders of one message kind, and check the bridge
+ *        turns the binary form back into the exact text
+ */
+static void compare(const char *name, encode_fn_t text_fn, encode_fn_t binary_fn, const void *arg, int iterations)
+{
+    static char text[4096], bridged[4096];
+    static uint8_t binary[4096];
+
+    format_result_t *r = &results[result_count++];
+    r->name = name;
+    r->text_len = text_fn(arg, text, sizeof(text));
+    r->binary_len = binary_fn(arg, binary, sizeof(binary));
+    BENCH_CHECK(r->text_len > 0 && r->binary_len > 0);
+
+    size_t bridged_len = payload_bridge_to_text(binary, r->binary_len, bridged, sizeof(bridged));
+    BENCH_CHECK(bridged_len == r->text_len && memcmp(bridged, text, r->text_len) == 0);
+    if (bridged_len != r->text_len || memcmp(bridged, text, r->text_len) != 0) {
+        printf("  %s: bridge gave \"%.*s\"\n  expected     \"%.*s\"\n", name, (int)bridged_len, bridged,
+               (int)r->text_len, text);
+    }
+
+    r->text_ns = time_encoder(text_fn, arg, text, sizeof(text), iterations);
+    r->binary_ns = time_encoder(binary_fn, arg, binary, sizeof(binary), iterations);
+
+    bench_series_t series = bench_series_create("", (size_t)iterations);
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = bench_now_ns();
+        sink += (int)payload_bridge_to_text(binary, r->binary_len, bridged, sizeof(bridged));
+        bench_series_add(&series, bench_now_ns() - start);
+    }
+    r->decode_ns = median_ns(&series);
+    bench_series_free(&series);
+}
+
+static void fill_ring(sample_ring_t *ring, sensor_sample_t *storage, uint16_t n, uint32_t now_ms)
+{
+    sample_ring_init(ring, storage, n);
+    for (uint16_t i = 0; i < n; i++) {
+        sensor_sample_t s = {
+            .timestamp_ms = now_ms - (uint32_t)(n - i) * SAMPLE_INTERVAL_MS,
+            .temperature = grid(2150 + (i * 37) % 300 - 150),
+            .humidity = grid(4500 + (i * 53) % 900),
+        };
+        sample_ring_push(ring, &s);
+    }
+}
+
+static void run_formats(int iterations)
+{
+    static sensor_sample_t small_storage[BATCH_SMALL], large_storage[BATCH_LARGE];
+    sample_ring_t small, large;
+    uint32_t now_ms = 3600000;
+    fill_ring(&small, small_storage, BATCH_SMALL, now_ms);
+    fill_ring(&large, large_storage, BATCH_LARGE, now_ms);
+
+    reading_t reading = { grid(2347), grid(5512) };
+    reading_t negative = { grid(-1205), grid(8730) };
+    batch_arg_t small_batch = { &small, now_ms };
+    batch_arg_t large_batch = { &large, now_ms };
+    payload_status_t status = {
+        .online = true, .device_type = PAYLOAD_DEVICE_TEMP_SENSOR, .ip = { 192, 168, 1, 50 },
+        .wifi_ms = 1840, .mqtt_ms = 2215, .first_publish_ms = 2390,
+    };
+    bool on = true;
+
+    compare("temperature", text_temperature, binary_temperature, &reading, iterations);
+    compare("temperature < 0", text_temperature, binary_temperature, &negative, iterations);
+    compare("batch x10", text_batch, binary_batch, &small_batch, iterations);
+    compare("batch x64", text_batch, binary_batch, &large_batch, iterations);
+    compare("status", text_status, binary_status, &status, iterations);
+    compare("relay ack", text_ack, binary_ack, &on, iterations);
+
+    printf("\n  %-16s %10s %10s %8s %12s %12s %12s\n", "message", "text B", "binary B", "ratio",
+           "text ns", "binary ns", "bridge ns");
+    for (int i = 0; i < result_count; i++) {
+        format_result_t *r = &results[i];
+        printf("  %-16s %10zu %10zu %7.0f%% %12lld %12lld %12lld\n", r->name, r->text_len, r->binary_len,
+               100.0 * (double)r->binary_len / (double)r->text_len, (long long)r->text_ns,
+               (long long)r->binary_ns, (long long)r->decode_ns);
+    }
+
+    // Batches and the status message are where the bytes are
+    BENCH_CHECK(results[2].binary_len * 2 < results[2].text_len);
+    BENCH_CHECK(results[3].binary_len * 2 < results[3].text_len);
+    BENCH_CHECK(results[4].binary_len * 4 < results[4].text_len);
+}
+
+// ============================================
+// Decoder robustness
+// ============================================
+
+static void run_malformed(void)
+{
+    uint8_t buf[PAYLOAD_STATUS_MAX_LEN];
+    payload_status_t status = { .online = true, .device_type = PAYLOAD_DEVICE_RELAY, .wifi_ms = 5, .mqtt_ms = -1,
+                                .first_publish_ms = -1 };
+    size_t len = payload_encode_status(&status, buf, sizeof(buf));
+    payload_status_t decoded;
+    payload_type_t type;
+
+    // Every truncation is rejected, never read past
+    for (size_t cut = 0; cut < len; cut++) {
+        BENCH_CHECK(payload_decode_status(buf, cut, &decoded) != ESP_OK);
+    }
+    BENCH_CHECK(payload_decode_status(buf, len, &decoded) == ESP_OK);
+    BENCH_CHECK(decoded.wifi_ms == 5 && decoded.mqtt_ms == -1 && decoded.device_type == PAYLOAD_DEVICE_RELAY);
+
+    // Wrong type, wrong version
+    bool on;
+    BENCH_CHECK(payload_decode_relay(buf, len, PAYLOAD_RELAY_COMMAND, &on, NULL) == ESP_ERR_INVALID_RESPONSE);
+    buf[1] = PAYLOAD_SCHEMA_VERSION + 1;
+    BENCH_CHECK(payload_peek_type(buf, len, &type) == ESP_ERR_INVALID_VERSION);
+
+    // A newer sender's appended field is skipped: [1, 4, true, 7, {"x": [1, 2.5]}]
+    static const uint8_t extended[] = { 0x85, 0x01, 0x04, 0xF5, 0x07, 0xA1, 0x61, 'x', 0x82, 0x01,
+                                        0xF9, 0x41, 0x00 };
+    uint32_t seq = 0;
+    BENCH_CHECK(payload_decode_relay(extended, sizeof(extended), PAYLOAD_RELAY_COMMAND, &on, &seq) == ESP_OK && on);
+    BENCH_CHECK(seq == 7);
+
+    // The sequence number is optional, and a number past 32 bits is refused
+    uint8_t relay[PAYLOAD_RELAY_MAX_LEN];
+    len = payload_encode_relay(PAYLOAD_RELAY_ACK, false, UINT32_MAX, relay, sizeof(relay));
+    BENCH_CHECK(len == PAYLOAD_RELAY_MAX_LEN);
+    BENCH_CHECK(payload_decode_relay(relay, len, PAYLOAD_RELAY_ACK, &on, &seq) == ESP_OK && !on && seq == UINT32_MAX);
+    len = payload_encode_relay(PAYLOAD_RELAY_ACK, true, 0, relay, sizeof(relay));
+    BENCH_CHECK(payload_decode_relay(relay, len, PAYLOAD_RELAY_ACK, &on, &seq) == ESP_OK && on && seq == 0);
+    static const uint8_t too_big[] = { 0x84, 0x01, 0x04, 0xF5, 0x1B, 0, 0, 0, 1, 0, 0, 0, 0 };
+    BENCH_CHECK(payload_decode_relay(too_big, sizeof(too_big), PAYLOAD_RELAY_COMMAND, &on, &seq) != ESP_OK);
+
+    // Text payloads are not schema messages
+    BENCH_CHECK(payload_peek_type((const uint8_t *)"ON", 2, &type) != ESP_OK);
+    BENCH_CHECK(payload_peek_type((const uint8_t *)"23.47", 5, &type) != ESP_OK);
+}
+
+// ============================================
+// Relay with PAYLOAD_BINARY
+// ============================================
+
+static SemaphoreHandle_t ack_sem;
+static host_mqtt_msg_t last_ack;
+static host_mqtt_msg_t last_status;
+
+static void capture(const host_mqtt_msg_t *msg, void *ctx)
+{
+    (void)ctx;
+    if (strcmp(msg->topic, MQTT_TOPIC_ACK) == 0) {
+        last_ack = *msg;
+        xSemaphoreGive(ack_sem);
+    } else if (strcmp(msg->topic, MQTT_TOPIC_STATUS) == 0) {
+        last_status = *msg;
+    }
+}
+
+static void expect_ack(const char *text)
+{
+    char bridged[32];
+    BENCH_CHECK(xSemaphoreTake(ack_sem, pdMS_TO_TICKS(1000)) == pdTRUE);
+    size_t len = payload_bridge_to_text((const uint8_t *)last_ack.data, (size_t)last_ack.len, bridged,
+                                        sizeof(bridged));
+    BENCH_CHECK(len == strlen(text) && memcmp(bridged, text, len) == 0);
+}
+
+static void run_relay(void)
+{
+    uint8_t command[PAYLOAD_RELAY_MAX_LEN];
+    char bridged[512];
+
+    ack_sem = xSemaphoreCreateBinary();
+    host_mqtt_set_publish_hook(capture, NULL);
+    BENCH_CHECK(relay_init() == ESP_OK);
+    BENCH_CHECK(esp_event_loop_create_default() == ESP_OK);
+    BENCH_CHECK(mqtt_client_init() == ESP_OK);
+    host_mqtt_inject_connected();
+
+    // Status goes out in binary and bridges to the JSON the webapp knows
+    size_t len = payload_bridge_to_text((const uint8_t *)last_status.data, (size_t)last_status.len, bridged,
+                                        sizeof(bridged));
+    static const char online[] = "{\"status\":\"online\",\"device_type\":\"relay\"";
+    BENCH_CHECK(len > 0 && strncmp(bridged, online, strlen(online)) == 0);
+    printf("\nRelay with PAYLOAD_BINARY\n  status  %d bytes -> %s\n", last_status.len, bridged);
+
+    // Binary commands, and the webapp's current text commands, both switch it
+    len = payload_encode_relay(PAYLOAD_RELAY_COMMAND, true, 0, command, sizeof(command));
+    host_mqtt_inject_data(MQTT_TOPIC_COMMAND, (const char *)command, (int)len);
+    expect_ack("ACK:ON");
+    BENCH_CHECK(host_gpio_get_pin(RELAY_GPIO_PIN).level == 0);   // Active-LOW
+    printf("  command %zu bytes -> ACK %d bytes\n", len, last_ack.len);
+
+    host_mqtt_inject_data(MQTT_TOPIC_COMMAND, "OFF", -1);
+    expect_ack("ACK:OFF");
+    BENCH_CHECK(host_gpio_get_pin(RELAY_GPIO_PIN).level == 1);
+
+    len = payload_encode_relay(PAYLOAD_RELAY_ACK, true, 0, command, sizeof(command));
+    host_mqtt_inject_data(MQTT_TOPIC_COMMAND, (const char *)command, (int)len);
+    BENCH_CHECK(xSemaphoreTake(ack_sem, pdMS_TO_TICKS(100)) == pdFALSE);   // An ACK is not a command
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 20000);
+
+    host_log_set_sink(NULL);
+    printf("Payload formats (%d iterations, medians)\n", iterations);
+    run_formats(iterations);
+    run_malformed();
+    run_relay();
+
+    return bench_exit_code();
+}
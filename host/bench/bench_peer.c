@@ -0,0 +1,405 @@
+// Peer link: sensor readings straight to the relay next to the broker path
+//
+// Built once per device type. The relay build boots the thermostat relay and
+// plays the sensor: frames come in through the emulated ESP-NOW (and over
+// UDP on 127.0.0.1 for the latency), the same readings through the broker,
+// and whichever copy is second must be dropped. The sensor build boots the
+// sensor and checks what it sends, and that the link fails over to the
+// broker alone and comes back.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "config.h"
+#include "boot_events.h"
+#include "peer_link.h"
+#include "mqtt_router.h"
+#include "nvs_flash.h"
+#include "driver/i2c.h"
+#include "host_shim.h"
+#include "bench.h"
+
+// The broker path the peer link skips: sensor -> broker -> relay
+#define BROKER_HOP_MS       40u
+
+// The sensor's readings, the one topic in PEER_LINK_TOPICS
+#ifdef DEVICE_TYPE_RELAY
+#define READING_TOPIC       MQTT_TOPIC_THERMOSTAT_SENSOR
+#else
+#define READING_TOPIC       MQTT_TOPIC_TEMP
+#endif
+
+static const uint8_t peer_mac[6] = PEER_LINK_PEER_MAC;
+
+void app_main(void);
+
+static void boot(void)
+{
+    host_time_set_virtual(true);
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+    host_mqtt_set_auto_connect(50000);
+
+    app_main();
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_MQTT, 30000));
+    BENCH_CHECK(peer_link_get_stats().up);
+}
+
+static void bench_frames(int iterations)
+{
+    uint8_t buf[PEER_FRAME_MAX];
+    peer_frame_t frame;
+
+    size_t len = peer_frame_encode(0xBEEF, 0x01020304, "a/b", "21.50", 5, buf, sizeof(buf));
+    BENCH_CHECK(len == PEER_FRAME_HEADER + 3 + 5);
+    BENCH_CHECK(buf[0] == PEER_FRAME_VERSION && buf[1] == 0xEF && buf[3] == 0x04 && buf[7] == 3);
+    BENCH_CHECK(peer_frame_decode(buf, len, &frame) == ESP_OK);
+    BENCH_CHECK(frame.boot_id == 0xBEEF && frame.seq == 0x01020304 && frame.topic_len == 3);
+    BENCH_CHECK(memcmp(frame.topic, "a/b", 3) == 0 && frame.len == 5 && memcmp(frame.data, "21.50", 5) == 0);
+
+    // Too large for ESP-NOW, truncated, another version
+    static const char big[PEER_FRAME_MAX] = "";
+    BENCH_CHECK(peer_frame_encode(1, 1, "a/b", big, sizeof(big) - PEER_FRAME_HEADER - 2, buf, sizeof(buf)) == 0);
+    BENCH_CHECK(peer_frame_decode(buf, PEER_FRAME_HEADER - 1, &frame) == ESP_ERR_INVALID_SIZE);
+    BENCH_CHECK(peer_frame_decode(buf, PEER_FRAME_HEADER + 2, &frame) == ESP_ERR_INVALID_SIZE);
+    buf[0] = PEER_FRAME_VERSION + 1;
+    BENCH_CHECK(peer_frame_decode(buf, len, &frame) == ESP_ERR_INVALID_VERSION);
+
+    // Sequence window: late frames within 32 once, older ones never, a new
+    // boot starts afresh
+    peer_seq_window_t w = { 0 };
+    BENCH_CHECK(peer_seq_accept(&w, 1, 100) && !peer_seq_accept(&w, 1, 100));
+    BENCH_CHECK(peer_seq_accept(&w, 1, 105) && peer_seq_accept(&w, 1, 102) && !peer_seq_accept(&w, 1, 102));
+    BENCH_CHECK(peer_seq_accept(&w, 1, 140) && !peer_seq_accept(&w, 1, 105) && peer_seq_accept(&w, 1, 109));
+    BENCH_CHECK(peer_seq_accept(&w, 2, 0) && peer_seq_accept(&w, 2, 1));
+
+    bench_series_t encode = bench_series_create("peer_frame_encode (reading)", iterations);
+    bench_series_t decode = bench_series_create("peer_frame_decode + window", iterations);
+    w = (peer_seq_window_t){ 0 };
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = bench_now_ns();
+        len = peer_frame_encode(7, (uint32_t)i, READING_TOPIC, "21.50", 5, buf, sizeof(buf));
+        int64_t t1 = bench_now_ns();
+        bool ok = peer_frame_decode(buf, len, &frame) == ESP_OK && peer_seq_accept(&w, frame.boot_id, frame.seq);
+        int64_t t2 = bench_now_ns();
+        bench_series_add(&encode, t1 - t0);
+        bench_series_add(&decode, t2 - t1);
+        BENCH_CHECK(ok);
+    }
+    bench_report_header("Frames");
+    bench_report(&encode);
+    bench_report(&decode);
+    bench_series_free(&encode);
+    bench_series_free(&decode);
+}
+
+#ifdef DEVICE_TYPE_RELAY
+
+// ============================================
+// Relay: receiving
+// ============================================
+
+static int sent_frames;
+static char last_state[HOST_MQTT_PAYLOAD_MAX];
+
+static void capture_frame(const uint8_t *mac, const uint8_t *data, size_t len, void *ctx)
+{
+    sent_frames++;
+}
+
+static void capture_mqtt(const host_mqtt_msg_t *msg, void *ctx)
+{
+    if (strcmp(msg->topic, MQTT_TOPIC_THERMOSTAT_STATE) == 0) {
+        snprintf(last_state, sizeof(last_state), "%.*s", msg->len, msg->data);
+    }
+}
+
+// Frames as the sensor sends them
+static uint16_t sensor_boot = 0x1234;
+static uint32_t sensor_seq;
+
+static void peer_send_raw(const uint8_t *mac, const uint8_t *frame, size_t len)
+{
+    BENCH_CHECK(host_espnow_inject(mac, frame, len) == ESP_OK);
+    host_time_advance_us(1000);
+}
+
+static void peer_send(const char *topic, const char *reading)
+{
+    uint8_t frame[PEER_FRAME_MAX];
+    size_t len = peer_frame_encode(sensor_boot, sensor_seq++, topic, reading, strlen(reading), frame,
+                                   sizeof(frame));
+    BENCH_CHECK(len > 0);
+    peer_send_raw(peer_mac, frame, len);
+}
+
+static void broker_send(const char *reading)
+{
+    host_mqtt_inject_data(MQTT_TOPIC_THERMOSTAT_SENSOR, reading, (int)strlen(reading));
+    host_time_advance_us(1000);
+}
+
+static void check_paths(void)
+{
+    peer_link_stats_t before = peer_link_get_stats();
+
+    // Peer first: delivered at once, the broker's copy dropped
+    peer_send(READING_TOPIC, "21.50");
+    BENCH_CHECK(peer_link_get_stats().received == before.received + 1);
+    BENCH_CHECK(strstr(last_state, "\"failsafe\":false") != NULL);
+    broker_send("21.50");
+    BENCH_CHECK(peer_link_get_stats().mqtt_copies == before.mqtt_copies + 1);
+
+    // Broker first (the peer frame was late): the peer's copy dropped
+    broker_send("21.60");
+    peer_send(READING_TOPIC, "21.60");
+    peer_link_stats_t s = peer_link_get_stats();
+    BENCH_CHECK(s.peer_copies == before.peer_copies + 1 && s.received == before.received + 1);
+
+    // The same reading again later is a new message on both paths
+    host_time_advance_us(PEER_LINK_DEDUP_MS * 1000LL);
+    peer_send(READING_TOPIC, "21.60");
+    broker_send("21.60");
+    s = peer_link_get_stats();
+    BENCH_CHECK(s.received == before.received + 2 && s.mqtt_copies == before.mqtt_copies + 2);
+
+    // A replayed frame, and one from a restarted sensor
+    sensor_seq--;
+    peer_send(READING_TOPIC, "21.70");
+    BENCH_CHECK(peer_link_get_stats().replayed == before.replayed + 1);
+    sensor_boot++;
+    sensor_seq = 0;
+    peer_send(READING_TOPIC, "21.70");
+    BENCH_CHECK(peer_link_get_stats().received == before.received + 3);
+
+    // Only PEER_LINK_TOPICS, only well-formed frames, only the paired device
+    bool relay_before = host_gpio_get_pin(RELAY_GPIO_PIN).level;
+    peer_send(MQTT_TOPIC_COMMAND, "ON");
+    peer_send(MQTT_TOPIC_COMMAND, "OFF");
+    BENCH_CHECK(host_gpio_get_pin(RELAY_GPIO_PIN).level == relay_before);
+    uint8_t frame[PEER_FRAME_MAX];
+    size_t len = peer_frame_encode(sensor_boot, sensor_seq++, READING_TOPIC, "21.80", 5, frame, sizeof(frame));
+    peer_send_raw(peer_mac, frame, PEER_FRAME_HEADER - 1);
+    frame[7] = 200;
+    peer_send_raw(peer_mac, frame, len);
+    s = peer_link_get_stats();
+    BENCH_CHECK(s.rejected == before.rejected + 4);
+    uint8_t stranger[6] = { 0x02, 0, 0, 0, 0, 1 };
+    frame[7] = (uint8_t)strlen(READING_TOPIC);
+    peer_send_raw(stranger, frame, len);
+    BENCH_CHECK(peer_link_get_stats().received == s.received);
+
+    // Relay commands never run off the MQTT task, whoever delivers them
+    BENCH_CHECK(mqtt_router_mqtt_task_only(MQTT_TOPIC_COMMAND, (int)strlen(MQTT_TOPIC_COMMAND)));
+    BENCH_CHECK(!mqtt_router_deliver(MQTT_TOPIC_COMMAND, (int)strlen(MQTT_TOPIC_COMMAND), "ON", 2));
+    BENCH_CHECK(host_gpio_get_pin(RELAY_GPIO_PIN).level == relay_before);
+
+    // The relay has nothing on PEER_LINK_TOPICS to send
+    BENCH_CHECK(sent_frames == 0);
+    printf("\nPaths: peer first, broker first, repeats, replays, restarts, strangers and bad frames checked\n");
+}
+
+static void check_failover(void)
+{
+    // The sensor's link is down: the broker alone keeps the thermostat fed
+    // past its sensor timeout
+    peer_link_stats_t before = peer_link_get_stats();
+    char reading[16];
+    for (uint32_t ms = 0; ms < THERMOSTAT_SENSOR_TIMEOUT_MS + 30000; ms += 10000) {
+        snprintf(reading, sizeof(reading), "%.2f", 20.0 + ms / 1e6);
+        broker_send(reading);
+        host_time_advance_us(10000000 - 1000);
+    }
+    peer_link_stats_t s = peer_link_get_stats();
+    BENCH_CHECK(s.received == before.received && s.mqtt_copies == before.mqtt_copies);
+    BENCH_CHECK(strstr(last_state, "\"failsafe\":false") != NULL);
+    printf("Failover: %u s of readings over the broker alone, thermostat kept its sensor\n",
+           (THERMOSTAT_SENSOR_TIMEOUT_MS + 30000) / 1000);
+}
+
+static void bench_latency(int iterations)
+{
+    // The harness socket plays the sensor's radio
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t local_len = sizeof(local);
+    BENCH_CHECK(fd >= 0 && bind(fd, (struct sockaddr *)&local, sizeof(local)) == 0);
+    BENCH_CHECK(getsockname(fd, (struct sockaddr *)&local, &local_len) == 0);
+    uint16_t device_port = 0;
+    BENCH_CHECK(host_espnow_bind_udp(0, ntohs(local.sin_port), &device_port) == ESP_OK);
+    struct sockaddr_in device = { .sin_family = AF_INET, .sin_port = htons(device_port),
+                                  .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+
+    bench_series_t latency = bench_series_create("UDP frame -> thermostat reading", iterations);
+    uint8_t frame[PEER_FRAME_MAX];
+    char reading[16];
+    int lost = 0;
+    for (int i = 0; i < iterations; i++) {
+        // Distinct readings, or the dedup would take them for copies
+        snprintf(reading, sizeof(reading), "%.2f", 19.0 + (i % 500) / 100.0);
+        size_t len = peer_frame_encode(sensor_boot, sensor_seq++, READING_TOPIC, reading, strlen(reading),
+                                       frame, sizeof(frame));
+        uint32_t received = peer_link_get_stats().received;
+        int64_t t0 = bench_now_ns();
+        BENCH_CHECK(sendto(fd, frame, len, 0, (struct sockaddr *)&device, sizeof(device)) == (ssize_t)len);
+        while (peer_link_get_stats().received == received && bench_now_ns() - t0 < 100000000) {
+        }
+        if (peer_link_get_stats().received == received) {
+            lost++;
+            continue;
+        }
+        bench_series_add(&latency, bench_now_ns() - t0);
+    }
+    close(fd);
+    BENCH_CHECK(lost == 0);
+
+    printf("\nReading -> thermostat: broker path 2 hops, about %u ms; peer link below (host clock)\n",
+           2 * BROKER_HOP_MS);
+    bench_report_header("Peer link, UDP on 127.0.0.1 as the radio");
+    bench_report(&latency);
+    bench_series_free(&latency);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 10000);
+
+    host_log_set_sink(NULL);
+    host_mqtt_set_publish_hook(capture_mqtt, NULL);
+    host_espnow_set_hook(capture_frame, NULL);
+
+    printf("Peer link, relay (%d iterations)\n", iterations);
+    bench_frames(iterations);
+    boot();
+    check_paths();
+    check_failover();
+    bench_latency(iterations);
+
+    return bench_exit_code();
+}
+
+#else // DEVICE_TYPE_TEMP_SENSOR
+
+// ============================================
+// Sensor: sending
+// ============================================
+
+static int frames;
+static uint32_t last_seq;
+static char last_frame[HOST_MQTT_PAYLOAD_MAX];
+static int readings;
+static char last_reading[HOST_MQTT_PAYLOAD_MAX];
+
+static void capture_frame(const uint8_t *mac, const uint8_t *data, size_t len, void *ctx)
+{
+    peer_frame_t frame;
+    BENCH_CHECK(memcmp(mac, peer_mac, sizeof(peer_mac)) == 0);
+    BENCH_CHECK(peer_frame_decode(data, len, &frame) == ESP_OK);
+    BENCH_CHECK(frame.topic_len == strlen(READING_TOPIC) && memcmp(frame.topic, READING_TOPIC, frame.topic_len) == 0);
+    BENCH_CHECK(frames == 0 || frame.seq > last_seq);      // Gaps: frames the relay missed
+    last_seq = frame.seq;
+    snprintf(last_frame, sizeof(last_frame), "%.*s", (int)frame.len, (const char *)frame.data);
+    frames++;
+}
+
+static void capture_mqtt(const host_mqtt_msg_t *msg, void *ctx)
+{
+    if (strcmp(msg->topic, READING_TOPIC) == 0) {
+        snprintf(last_reading, sizeof(last_reading), "%.*s", msg->len, msg->data);
+        readings++;
+    }
+}
+
+static void run_readings(int count)
+{
+    host_time_advance_us((int64_t)count * TEMP_PUBLISH_INTERVAL_MS * 1000);
+}
+
+static void check_sending(void)
+{
+    // Every reading goes out on both paths, the same bytes
+    run_readings(6);
+    BENCH_CHECK(readings >= 5 && frames == readings);
+    BENCH_CHECK(strcmp(last_frame, last_reading) == 0);
+    peer_link_stats_t s = peer_link_get_stats();
+    BENCH_CHECK(s.sent == (uint32_t)frames && s.delivered == s.sent && s.up);
+    printf("\nSending: %d readings, each to the broker and the relay\n", readings);
+}
+
+static void check_failover(void)
+{
+    // The relay is out of range: down after PEER_LINK_FAIL_LIMIT, then a
+    // probe every PEER_LINK_PROBE_MS while the broker carries the readings
+    host_espnow_set_reachable(false);
+    peer_link_stats_t before = peer_link_get_stats();
+    int readings_before = readings;
+    run_readings(PEER_LINK_FAIL_LIMIT);
+    peer_link_stats_t s = peer_link_get_stats();
+    BENCH_CHECK(!s.up && s.failed == before.failed + PEER_LINK_FAIL_LIMIT);
+
+    int down_readings = 3 * PEER_LINK_PROBE_MS / TEMP_PUBLISH_INTERVAL_MS;
+    run_readings(down_readings);
+    s = peer_link_get_stats();
+    uint32_t probes = s.failed - before.failed - PEER_LINK_FAIL_LIMIT;
+    BENCH_CHECK(probes >= 2 && probes <= 4);
+    BENCH_CHECK(s.skipped >= (uint32_t)down_readings - probes - 1);
+    BENCH_CHECK(readings - readings_before >= PEER_LINK_FAIL_LIMIT + down_readings - 1);
+
+    // Back in range: the next probe finds it
+    host_espnow_set_reachable(true);
+    run_readings(PEER_LINK_PROBE_MS / TEMP_PUBLISH_INTERVAL_MS + 1);
+    s = peer_link_get_stats();
+    BENCH_CHECK(s.up);
+    int frames_before = frames;
+    run_readings(3);
+    BENCH_CHECK(frames - frames_before >= 2);
+
+    printf("Failover: down after %d unacknowledged frames, %u probes in %d s, up again at the next probe\n",
+           PEER_LINK_FAIL_LIMIT, (unsigned)probes, down_readings * TEMP_PUBLISH_INTERVAL_MS / 1000);
+}
+
+static void bench_forward(int iterations)
+{
+    bench_series_t cost = bench_series_create("peer_link_forward (reading)", iterations);
+    bench_series_t other = bench_series_create("peer_link_forward (other topic)", iterations);
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = bench_now_ns();
+        esp_err_t ret = peer_link_forward(READING_TOPIC, "21.50", 0);
+        int64_t t1 = bench_now_ns();
+        esp_err_t skip = peer_link_forward(MQTT_TOPIC_STATUS, "online", 0);
+        int64_t t2 = bench_now_ns();
+        bench_series_add(&cost, t1 - t0);
+        bench_series_add(&other, t2 - t1);
+        BENCH_CHECK(ret == ESP_OK && skip == ESP_ERR_NOT_SUPPORTED);
+    }
+    bench_report_header("Added to each publish");
+    bench_report(&cost);
+    bench_report(&other);
+    bench_series_free(&cost);
+    bench_series_free(&other);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 10000);
+
+    host_log_set_sink(NULL);
+    host_mqtt_set_publish_hook(capture_mqtt, NULL);
+    host_espnow_set_hook(capture_frame, NULL);
+
+    printf("Peer link, sensor (%d iterations)\n", iterations);
+    bench_frames(iterations);
+    BENCH_CHECK(host_aht20_attach(I2C_NUM_0, 0x38) == ESP_OK);
+    BENCH_CHECK(host_partition_create(STORE_FORWARD_PARTITION, 64 * 1024) == ESP_OK);
+    host_aht20_set_reading(21.5f, 45.0f);
+    boot();
+    check_sending();
+    check_failover();
+    bench_forward(iterations);
+
+    return bench_exit_code();
+}
+
+#endif
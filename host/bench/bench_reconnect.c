@@ -0,0 +1,247 @@
+// Reconnects: jittered backoff across a fleet, and one device riding out a
+// WiFi blip, an AP outage and a broker outage on the simulated clock
+//
+// The fleet part runs the backoff engine alone: --iterations devices lose the
+// broker at the same moment and retry until it is back after --outage-s.
+// Jittered backoff is compared with esp-mqtt's fixed reconnect interval and
+// with the same exponential schedule without jitter, by the busiest second
+// of attempts and of sessions the broker sees, and by how long devices take
+// to return.
+//
+// The device part boots the relay firmware through app_main.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "boot_events.h"
+#include "esp_timer.h"
+#include "mqtt_manager.h"
+#include "nvs_flash.h"
+#include "reconnect.h"
+#include "wifi_manager.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#define FIXED_INTERVAL_MS   10000   // esp-mqtt reconnect_timeout_ms default
+#define MQTT_CONNECT_US     50000
+#define AP_OUTAGE_MS        300000
+#define BROKER_OUTAGE_MS    120000
+
+void app_main(void);
+
+typedef enum {
+    SCHEDULE_FIXED,
+    SCHEDULE_EXPONENTIAL,
+    SCHEDULE_JITTERED,
+} schedule_t;
+
+static const char *schedule_names[] = { "fixed 10 s", "exponential, no jitter", "exponential, full jitter" };
+
+// Wait before attempt n without jitter: the top of the engine's window
+static uint32_t window_ms(uint32_t attempt)
+{
+    uint64_t window = MQTT_BACKOFF_BASE_MS;
+    for (uint32_t i = 0; i < attempt && window < MQTT_BACKOFF_MAX_MS; i++) {
+        window *= 2;
+    }
+    return window < MQTT_BACKOFF_MAX_MS ? (uint32_t)window : MQTT_BACKOFF_MAX_MS;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, int n, double p)
+{
+    int i = (int)ceil(p * n) - 1;
+    return sorted[i < 0 ? 0 : i];
+}
+
+static void run_fleet(int devices, uint32_t outage_ms)
+{
+    uint32_t horizon_s = (outage_ms + 2 * MQTT_BACKOFF_MAX_MS) / 1000 + 1;
+    uint32_t *per_second = calloc(horizon_s, sizeof(uint32_t));
+    uint32_t *sessions = calloc(horizon_s, sizeof(uint32_t));
+    uint32_t *recovery = calloc((size_t)devices, sizeof(uint32_t));
+    bench_series_t draw = bench_series_create("reconnect_next_ms", (size_t)devices * 64);
+
+    printf("\n%d devices lose the broker at once; it is back after %lu s\n", devices,
+           (unsigned long)(outage_ms / 1000));
+    printf("  %-26s %9s %9s %10s %9s %9s %9s\n", "schedule", "attempts", "peak/s", "sessions/s", "back p50",
+           "p99", "max");
+
+    for (schedule_t schedule = SCHEDULE_FIXED; schedule <= SCHEDULE_JITTERED; schedule++) {
+        memset(per_second, 0, horizon_s * sizeof(uint32_t));
+        memset(sessions, 0, horizon_s * sizeof(uint32_t));
+        uint32_t attempts = 0;
+        for (int d = 0; d < devices; d++) {
+            reconnect_t link;
+            reconnect_init(&link, MQTT_BACKOFF_BASE_MS, MQTT_BACKOFF_MAX_MS, 0x1234567u + (uint32_t)d * 7919u);
+            reconnect_up(&link, 0);
+            reconnect_down(&link, 0);
+
+            uint32_t t = 0;
+            for (;;) {
+                uint32_t delay;
+                if (schedule == SCHEDULE_FIXED) {
+                    delay = FIXED_INTERVAL_MS;
+                } else if (schedule == SCHEDULE_EXPONENTIAL) {
+                    delay = window_ms(link.attempt);
+                    reconnect_next_ms(&link);
+                } else {
+                    uint32_t window = window_ms(link.attempt);
+                    int64_t start = bench_now_ns();
+                    delay = reconnect_next_ms(&link);
+                    bench_series_add(&draw, bench_now_ns() - start);
+                    BENCH_CHECK(delay <= window);
+                }
+                t += delay;
+                attempts++;
+                per_second[t / 1000 < horizon_s ? t / 1000 : horizon_s - 1]++;
+                if (t >= outage_ms) {
+                    break;
+                }
+            }
+            BENCH_CHECK(reconnect_up(&link, t) == t);
+            sessions[t / 1000 < horizon_s ? t / 1000 : horizon_s - 1]++;
+            recovery[d] = t - outage_ms;
+        }
+
+        uint32_t peak = 0, peak_sessions = 0;
+        for (uint32_t s = 0; s < horizon_s; s++) {
+            peak = per_second[s] > peak ? per_second[s] : peak;
+            peak_sessions = sessions[s] > peak_sessions ? sessions[s] : peak_sessions;
+        }
+        qsort(recovery, (size_t)devices, sizeof(uint32_t), compare_u32);
+        printf("  %-26s %9lu %9lu %10lu %7.1f s %7.1f s %7.1f s\n", schedule_names[schedule],
+               (unsigned long)attempts, (unsigned long)peak, (unsigned long)peak_sessions,
+               percentile(recovery, devices, 0.50) / 1000.0, percentile(recovery, devices, 0.99) / 1000.0,
+               recovery[devices - 1] / 1000.0);
+
+        if (schedule == SCHEDULE_JITTERED) {
+            // Sessions come back spread over the window instead of all in one
+            // second, and nobody waits more than one full window
+            BENCH_CHECK(devices < 100 || peak_sessions * 10 < (uint32_t)devices);
+            BENCH_CHECK(peak < (uint32_t)devices);
+            BENCH_CHECK(recovery[devices - 1] <= MQTT_BACKOFF_MAX_MS);
+        } else {
+            BENCH_CHECK(peak == (uint32_t)devices && peak_sessions == (uint32_t)devices);
+        }
+    }
+
+    bench_report_header("Backoff engine");
+    bench_report(&draw);
+    bench_series_free(&draw);
+    free(per_second);
+    free(sessions);
+    free(recovery);
+}
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void print_link(const char *name, const reconnect_stats_t *stats)
+{
+    printf("  %-6s outages %lu, attempts %lu, down %.1f s, recovery last %.1f s / longest %.1f s\n", name,
+           (unsigned long)stats->outages, (unsigned long)stats->attempts, stats->downtime_ms / 1000.0,
+           stats->last_recovery_ms / 1000.0, stats->longest_recovery_ms / 1000.0);
+}
+
+static void run_device(void)
+{
+    host_time_set_virtual(true);
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+    host_mqtt_set_auto_connect(MQTT_CONNECT_US);
+    app_main();
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_MQTT, 30000));
+    host_time_advance_us(1000000);
+
+    // Beacon loss with the AP still there: one channel probed, no scan
+    host_wifi_stats_t before = host_wifi_get_stats();
+    host_wifi_drop_link();
+    host_time_advance_us(1000);
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_WIFI, 5000));
+    host_wifi_stats_t after = host_wifi_get_stats();
+    reconnect_stats_t blip = wifi_manager_get_link_stats();
+    printf("\nWiFi blip: rejoined in %lu ms, %lu attempt, %lu channel probed\n",
+           (unsigned long)blip.last_recovery_ms, (unsigned long)(after.connects - before.connects),
+           (unsigned long)(after.channels_scanned - before.channels_scanned));
+    BENCH_CHECK(after.connects - before.connects == 1 && after.channels_scanned - before.channels_scanned == 1);
+    BENCH_CHECK(blip.outages == 1 && blip.last_recovery_ms < 1000);
+    BENCH_CHECK(mqtt_is_connected());
+
+    // AP switched off: the session dies with the link, and nothing gives up
+    host_wifi_ap_t ap = host_wifi_get_ap();
+    ap.available = false;
+    before = host_wifi_get_stats();
+    uint32_t mqtt_before = host_mqtt_connect_attempts();
+    host_wifi_set_ap(&ap);
+    host_time_advance_us(1000);
+    host_mqtt_inject_disconnected();
+    host_time_advance_us((int64_t)AP_OUTAGE_MS * 1000);
+    after = host_wifi_get_stats();
+    uint32_t outage_attempts = after.connects - before.connects;
+    BENCH_CHECK(host_mqtt_connect_attempts() == mqtt_before);
+    BENCH_CHECK(!boot_events_is_set(BOOT_EVENT_WIFI));
+
+    ap.available = true;
+    host_wifi_set_ap(&ap);
+    uint32_t back_ms = now_ms();
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_MQTT, WIFI_BACKOFF_MAX_MS + 5000));
+    uint32_t online_ms = now_ms() - back_ms;
+    reconnect_stats_t wifi = wifi_manager_get_link_stats();
+    reconnect_stats_t broker = mqtt_get_link_stats();
+    printf("AP off for %d s: %lu WiFi attempts while down, %lu broker attempts; online %.1f s after the AP "
+           "returned\n", AP_OUTAGE_MS / 1000, (unsigned long)outage_attempts,
+           (unsigned long)(host_mqtt_connect_attempts() - mqtt_before), online_ms / 1000.0);
+    BENCH_CHECK(outage_attempts > 5 && outage_attempts < 30);
+    BENCH_CHECK(host_mqtt_connect_attempts() - mqtt_before == 1);
+    BENCH_CHECK(online_ms <= WIFI_BACKOFF_MAX_MS + 5000);
+    BENCH_CHECK(wifi.outages == 2 && wifi.last_recovery_ms >= AP_OUTAGE_MS);
+    BENCH_CHECK(broker.outages == 1 && broker.last_recovery_ms >= AP_OUTAGE_MS);
+
+    // Broker restart with WiFi up: backoff between failed sessions
+    mqtt_before = host_mqtt_connect_attempts();
+    host_mqtt_set_broker_available(false);
+    host_time_advance_us((int64_t)BROKER_OUTAGE_MS * 1000);
+    host_mqtt_set_broker_available(true);
+    back_ms = now_ms();
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_MQTT, MQTT_BACKOFF_MAX_MS + 1000));
+    online_ms = now_ms() - back_ms;
+    uint32_t broker_attempts = host_mqtt_connect_attempts() - mqtt_before;
+    broker = mqtt_get_link_stats();
+    printf("Broker down for %d s: %lu attempts; online %.1f s after it returned\n", BROKER_OUTAGE_MS / 1000,
+           (unsigned long)broker_attempts, online_ms / 1000.0);
+    BENCH_CHECK(broker_attempts > 2 && broker_attempts < 20);
+    BENCH_CHECK(online_ms <= MQTT_BACKOFF_MAX_MS + 1000);
+    BENCH_CHECK(broker.outages == 2 && broker.last_recovery_ms >= BROKER_OUTAGE_MS);
+
+    printf("\nLink figures\n");
+    wifi = wifi_manager_get_link_stats();
+    print_link("wifi", &wifi);
+    print_link("broker", &broker);
+}
+
+int main(int argc, char **argv)
+{
+    int devices = bench_parse_iterations(argc, argv, 1000);
+    int outage_s = atoi(bench_parse_option(argc, argv, "--outage-s", "120"));
+    if (devices < 1 || outage_s < 1) {
+        fprintf(stderr, "usage: %s [--iterations DEVICES] [--outage-s SECONDS]\n", argv[0]);
+        return 2;
+    }
+
+    host_log_set_sink(NULL);
+    printf("Reconnect backoff (WiFi %d..%d ms, broker %d..%d ms)\n", WIFI_BACKOFF_BASE_MS, WIFI_BACKOFF_MAX_MS,
+           MQTT_BACKOFF_BASE_MS, MQTT_BACKOFF_MAX_MS);
+    run_fleet(devices, (uint32_t)outage_s * 1000);
+    run_device();
+
+    return bench_exit_code();
+}
@@ -0,0 +1,256 @@
+// Relay build: mqtt_event_handler cost and command-to-GPIO latency through the
+// actuator task. Built a second time with DEFERRED_LOG (bench_relay_deferred)
+// to compare the handler cost with deferred logging.
+
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "dlog.h"
+#include "device_relay.h"
+#include "mqtt_manager.h"
+#include "mqtt_router.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "host_shim.h"
+#include "bench.h"
+
+static void bench_handler_cost(int iterations)
+{
+    bench_series_t command = bench_series_create("command ON/OFF", iterations);
+    bench_series_t state = bench_series_create("state sync response", iterations);
+    bench_series_t unmatched = bench_series_create("unmatched topic", iterations);
+
+    for (int i = 0; i < iterations; i++) {
+        const char *payload = (i & 1) ? "ON" : "OFF";
+
+        int64_t t0 = bench_now_ns();
+        host_mqtt_inject_data(MQTT_TOPIC_COMMAND, payload, -1);
+        int64_t t1 = bench_now_ns();
+        host_mqtt_inject_data(MQTT_TOPIC_STATE_RESPONSE, payload, -1);
+        int64_t t2 = bench_now_ns();
+        host_mqtt_inject_data("branko/unrelated/topic", payload, -1);
+        int64_t t3 = bench_now_ns();
+
+        bench_series_add(&command, t1 - t0);
+        bench_series_add(&state, t2 - t1);
+        bench_series_add(&unmatched, t3 - t2);
+#ifdef DEFERRED_LOG
+        // Print outside the timed part; with a full ring the calls would only
+        // count drops, which is cheaper than what is being measured
+        dlog_flush();
+#endif
+    }
+
+    bench_report_header("mqtt_event_handler: cost per MQTT_EVENT_DATA");
+    bench_report(&command);
+    bench_report(&state);
+    bench_report(&unmatched);
+
+    bench_series_free(&command);
+    bench_series_free(&state);
+    bench_series_free(&unmatched);
+}
+
+// ACKs are sent from the actuator task once the relay has switched
+static SemaphoreHandle_t ack_sem;
+static host_mqtt_msg_t last_ack;
+
+static void capture_ack(const host_mqtt_msg_t *msg, void *ctx)
+{
+    if (strcmp(msg->topic, MQTT_TOPIC_ACK) == 0 || strcmp(msg->topic, MQTT_TOPIC_STATE_SYNC_ACK) == 0) {
+        last_ack = *msg;
+        xSemaphoreGive(ack_sem);
+    }
+}
+
+// Let the actuator work off anything queued by earlier cases
+static void drain_actuator(void)
+{
+    vTaskDelay(pdMS_TO_TICKS(50));
+    while (xSemaphoreTake(ack_sem, 0) == pdTRUE) {
+    }
+}
+
+/**
+ * @brief Switch the relay back and forth; returns how many switches took at least slow_ns
+ */
+static int run_commands(bench_series_t *gpio, bench_series_t *ack, int iterations, int64_t slow_ns)
+{
+    int slow = 0;
+    for (int i = 0; i < iterations; i++) {
+        bool on = (i & 1) != 0;
+        uint32_t writes_before = host_gpio_get_pin(RELAY_GPIO_PIN).write_count;
+
+        int64_t t0 = host_time_now_ns();
+        host_mqtt_inject_data(MQTT_TOPIC_COMMAND, on ? "ON" : "OFF", -1);
+        bool acked = xSemaphoreTake(ack_sem, pdMS_TO_TICKS(1000)) == pdTRUE;
+        BENCH_CHECK(acked);
+        if (!acked) {
+            break;
+        }
+        host_gpio_pin_t pin = host_gpio_get_pin(RELAY_GPIO_PIN);
+
+        // Active-LOW relay, switched before the ACK reports its state
+        BENCH_CHECK(pin.level == (on ? 0 : 1));
+        BENCH_CHECK(pin.write_count == writes_before + 1);
+        BENCH_CHECK(strcmp(last_ack.topic, MQTT_TOPIC_ACK) == 0);
+        BENCH_CHECK(strcmp(last_ack.data, on ? "ACK:ON" : "ACK:OFF") == 0);
+        BENCH_CHECK(last_ack.timestamp_ns >= pin.last_write_ns);
+
+        bench_series_add(gpio, pin.last_write_ns - t0);
+        bench_series_add(ack, last_ack.timestamp_ns - t0);
+        slow += pin.last_write_ns - t0 >= slow_ns;
+    }
+    return slow;
+}
+
+#define SLOW_PUBLISH_US 20000   // Blocking publish on a congested link
+
+static void bench_command_to_gpio(int iterations)
+{
+    bench_series_t gpio = bench_series_create("MQTT_EVENT_DATA -> gpio_set_level", iterations);
+    bench_series_t ack = bench_series_create("MQTT_EVENT_DATA -> ACK queued", iterations);
+    int slow_iterations = iterations / 10 > 0 ? iterations / 10 : 1;
+    bench_series_t slow_gpio = bench_series_create("  with 20 ms publishes: -> gpio_set_level", slow_iterations);
+    bench_series_t slow_ack = bench_series_create("  with 20 ms publishes: -> ACK queued", slow_iterations);
+
+    drain_actuator();
+    run_commands(&gpio, &ack, iterations, INT64_MAX);
+
+    // Switching must not wait on the broker: with every blocking publish
+    // taking 20 ms, the relay still switches well within that
+    host_mqtt_set_publish_delay(SLOW_PUBLISH_US);
+    int slow = run_commands(&slow_gpio, &slow_ack, slow_iterations, SLOW_PUBLISH_US * 1000LL);
+    host_mqtt_set_publish_delay(0);
+    BENCH_CHECK(slow * 2 < slow_iterations);
+
+    // A state sync is switched by the actuator as well and confirmed on its own topic
+    host_mqtt_inject_data(MQTT_TOPIC_STATE_RESPONSE, "ON", -1);
+    BENCH_CHECK(xSemaphoreTake(ack_sem, pdMS_TO_TICKS(1000)) == pdTRUE);
+    BENCH_CHECK(strcmp(last_ack.topic, MQTT_TOPIC_STATE_SYNC_ACK) == 0);
+    BENCH_CHECK(strcmp(last_ack.data, "ACK:ON") == 0);
+    BENCH_CHECK(host_gpio_get_pin(RELAY_GPIO_PIN).level == 0);
+
+    // Topics and payloads must match exactly, not by prefix
+    uint32_t writes_before = host_gpio_get_pin(RELAY_GPIO_PIN).write_count;
+    char prefix_topic[] = MQTT_TOPIC_COMMAND;
+    prefix_topic[sizeof(prefix_topic) - 2] = '\0';
+    host_mqtt_inject_data(prefix_topic, "ON", -1);
+    host_mqtt_inject_data(MQTT_TOPIC_COMMAND, "O", -1);
+    host_mqtt_inject_data(MQTT_TOPIC_COMMAND, "", 0);
+    drain_actuator();
+    BENCH_CHECK(host_gpio_get_pin(RELAY_GPIO_PIN).write_count == writes_before);
+
+    bench_report_header("End-to-end command-to-GPIO latency (actuator task)");
+    bench_report(&gpio);
+    bench_report(&ack);
+    bench_report(&slow_gpio);
+    bench_report(&slow_ack);
+    bench_series_free(&gpio);
+    bench_series_free(&ack);
+    bench_series_free(&slow_gpio);
+    bench_series_free(&slow_ack);
+}
+
+#define BLOB_TOPIC   "host/bench/blob"
+#define STREAM_TOPIC "host/bench/stream"
+#define BLOB_SIZE    3000
+
+static char blob[BLOB_SIZE];
+static int blob_deliveries;
+static int blob_mismatches;
+static int stream_bytes;
+
+static void blob_handler(const char *data, int data_len, void *ctx)
+{
+    blob_deliveries++;
+    if (data_len != BLOB_SIZE || memcmp(data, blob, BLOB_SIZE) != 0) {
+        blob_mismatches++;
+    }
+}
+
+static void stream_handler(const char *chunk, int chunk_len, int offset, int total_len, void *ctx)
+{
+    if (memcmp(chunk, blob + offset, (size_t)chunk_len) != 0 || total_len != BLOB_SIZE) {
+        blob_mismatches++;
+    }
+    stream_bytes += chunk_len;
+}
+
+static void bench_reassembly(int iterations)
+{
+    bench_series_t contiguous = bench_series_create("3000 B in 256 B fragments, contiguous", iterations);
+    bench_series_t streamed = bench_series_create("3000 B in 256 B fragments, streamed", iterations);
+
+    for (int i = 0; i < BLOB_SIZE; i++) {
+        blob[i] = (char)('a' + i % 26);
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = bench_now_ns();
+        host_mqtt_inject_data_fragmented(BLOB_TOPIC, blob, BLOB_SIZE, 256);
+        int64_t t1 = bench_now_ns();
+        host_mqtt_inject_data_fragmented(STREAM_TOPIC, blob, BLOB_SIZE, 256);
+        int64_t t2 = bench_now_ns();
+
+        bench_series_add(&contiguous, t1 - t0);
+        bench_series_add(&streamed, t2 - t1);
+    }
+
+    BENCH_CHECK(blob_deliveries == iterations);
+    BENCH_CHECK(stream_bytes == iterations * BLOB_SIZE);
+    BENCH_CHECK(blob_mismatches == 0);
+
+    // Fragments of an unrouted message must not leak into a command
+    uint32_t writes_before = host_gpio_get_pin(RELAY_GPIO_PIN).write_count;
+    host_mqtt_inject_data_fragmented("host/bench/unrouted", "ONOFFONOFF", 10, 2);
+    BENCH_CHECK(host_gpio_get_pin(RELAY_GPIO_PIN).write_count == writes_before);
+
+    bench_report_header("Fragmented MQTT_EVENT_DATA reassembly");
+    bench_report(&contiguous);
+    bench_report(&streamed);
+
+    bench_series_free(&contiguous);
+    bench_series_free(&streamed);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 20000);
+
+    host_log_set_sink(NULL);
+#ifdef DEFERRED_LOG
+    BENCH_CHECK(dlog_init() == ESP_OK);
+#endif
+    ack_sem = xSemaphoreCreateBinary();
+    host_mqtt_set_publish_hook(capture_ack, NULL);
+
+    BENCH_CHECK(relay_init() == ESP_OK);
+    BENCH_CHECK(esp_event_loop_create_default() == ESP_OK);
+    BENCH_CHECK(mqtt_client_init() == ESP_OK);
+    BENCH_CHECK(mqtt_router_register(BLOB_TOPIC, blob_handler, NULL) == ESP_OK);
+    BENCH_CHECK(mqtt_router_register_stream(STREAM_TOPIC, stream_handler, NULL) == ESP_OK);
+    host_mqtt_inject_connected();
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_COMMAND));
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_STATE_RESPONSE));
+
+#ifdef DEFERRED_LOG
+    printf("Relay benchmarks, deferred logging (%d iterations)\n", iterations);
+#else
+    printf("Relay benchmarks (%d iterations)\n", iterations);
+#endif
+    bench_handler_cost(iterations);
+    bench_command_to_gpio(iterations);
+    bench_reassembly(iterations / 10 > 0 ? iterations / 10 : 1);
+
+#ifdef DEFERRED_LOG
+    dlog_flush();
+    dlog_stats_t stats = dlog_get_stats();
+    printf("\nDeferred log records: %lu written, %lu dropped, %lu truncated\n",
+           (unsigned long)stats.written, (unsigned long)stats.dropped, (unsigned long)stats.truncated);
+    BENCH_CHECK(stats.written > 0);
+#endif
+
+    return bench_exit_code();
+}
@@ -0,0 +1,334 @@
+// Report-by-exception: broker messages per hour against the fixed publishing
+// interval, how far the published value trails the reading, and settings
+// changed over MQTT on a running device
+//
+// The policy runs over a simulated day of a heated room; the device part
+// boots through app_main on the simulated clock with an emulated AHT20.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "boot_events.h"
+#include "report_policy.h"
+#include "driver/i2c.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#define DAY_MS      (24u * 3600u * 1000u)
+#define HOUR_MS     (3600u * 1000u)
+#define PI          3.14159265358979
+
+void app_main(void);
+
+// ============================================
+// Policy over a simulated day
+// ============================================
+
+// Room at 21 °C drifting 1 °C over the day, the heating on from 06:00 to
+// 06:30 (+2 °C), humidity following; readings already filtered, in hundredths
+static void room(uint32_t t_ms, sensor_data_t *d)
+{
+    double h = (double)t_ms / HOUR_MS;
+    double t = 21.0 + 0.5 * sin(2.0 * PI * h / 24.0);
+    if (h >= 6.0 && h < 6.5) {
+        t += 2.0 * (h - 6.0) / 0.5;
+    } else if (h >= 6.5 && h < 9.0) {
+        t += 2.0 * (1.0 - (h - 6.5) / 2.5);
+    }
+    memset(d, 0, sizeof(*d));
+    d->valid = true;
+    d->fields = SENSOR_HAS_TEMPERATURE | SENSOR_HAS_HUMIDITY;
+    d->temperature = roundf((float)t * 100.0f) / 100.0f;
+    d->humidity = roundf((float)(45.0 - 2.0 * (t - 21.0)) * 100.0f) / 100.0f;
+}
+
+typedef struct {
+    uint32_t samples;
+    uint32_t publishes;
+    uint32_t longest_silence_ms;
+    uint32_t heating_interval_ms;   // Longest sampling interval while heating
+    float worst_lag;                // Largest |reading - published|, checked every second
+} day_result_t;
+
+// Periodic publishing when interval_ms is set, the policy otherwise
+static day_result_t run_day(const report_config_t *cfg, uint32_t interval_ms, bench_series_t *cost)
+{
+    day_result_t r = {0};
+    report_state_t st;
+    report_state_init(&st, cfg);
+    sensor_data_t d;
+    float published = 0.0f;
+    uint32_t last_publish = 0;
+    uint32_t next_sample = 0;
+
+    for (uint32_t t = 0; t < DAY_MS; t += 1000) {
+        room(t, &d);
+        if (t == next_sample) {
+            r.samples++;
+            bool publish;
+            if (interval_ms > 0) {
+                publish = true;
+                next_sample = t + interval_ms;
+            } else {
+                int64_t t0 = bench_now_ns();
+                report_reason_t reason = report_on_sample(&st, cfg, &d, t);
+                int64_t t1 = bench_now_ns();
+                if (cost != NULL) {
+                    bench_series_add(cost, t1 - t0);
+                }
+                publish = reason != REPORT_NONE;
+                BENCH_CHECK(publish || fabsf(d.temperature - published) < cfg->temperature);
+                if (publish) {
+                    report_on_published(&st, &d, t);
+                }
+                // The day runs in whole seconds: round the wait up to one
+                uint32_t wait = (report_next_sample_ms(&st, cfg, t) + 999) / 1000 * 1000;
+                BENCH_CHECK(wait >= 1000);
+                next_sample = t + wait;
+                double h = (double)t / HOUR_MS;
+                if (h >= 6.1 && h < 6.5 && wait > r.heating_interval_ms) {
+                    r.heating_interval_ms = wait;
+                }
+            }
+            if (publish) {
+                if (r.publishes > 0 && t - last_publish > r.longest_silence_ms) {
+                    r.longest_silence_ms = t - last_publish;
+                }
+                r.publishes++;
+                published = d.temperature;
+                last_publish = t;
+            }
+        }
+        float lag = fabsf(d.temperature - published);
+        r.worst_lag = lag > r.worst_lag ? lag : r.worst_lag;
+    }
+    return r;
+}
+
+static void bench_policy(void)
+{
+    report_config_t cfg;
+    report_config_defaults(&cfg);
+    report_config_t fixed = cfg;
+    fixed.min_interval_ms = fixed.max_interval_ms = 10000;
+
+    bench_series_t cost = bench_series_create("report_on_sample", 100000);
+    day_result_t periodic = run_day(&cfg, TEMP_PUBLISH_INTERVAL_MS, NULL);
+    day_result_t adaptive = run_day(&cfg, 0, &cost);
+    day_result_t deadband = run_day(&fixed, 0, NULL);
+
+    // The deadband holds the published value within 0.2 °C when sampled;
+    // between samples the room moves at most one interval's worth on top
+    BENCH_CHECK(adaptive.publishes * 10 < periodic.publishes);
+    BENCH_CHECK(adaptive.longest_silence_ms <= cfg.max_silence_ms);
+    BENCH_CHECK(adaptive.heating_interval_ms < cfg.max_interval_ms);
+    BENCH_CHECK(adaptive.worst_lag < 2 * cfg.temperature);
+    BENCH_CHECK(adaptive.samples < deadband.samples);
+
+    printf("\nSimulated day: 21 °C +- 0.5 drift, heating +2 °C 06:00-06:30, humidity following\n");
+    printf("  deadbands %.1f °C / %.1f %%RH, sampling %lu-%lu s, max silence %lu s\n", cfg.temperature,
+           cfg.humidity, (unsigned long)cfg.min_interval_ms / 1000, (unsigned long)cfg.max_interval_ms / 1000,
+           (unsigned long)cfg.max_silence_ms / 1000);
+    printf("  %-34s %10s %12s %12s %12s\n", "policy", "samples", "publishes/h", "worst lag °C", "max gap s");
+    const struct { const char *name; const day_result_t *r; } rows[] = {
+        { "every 10 s (TEMP_PUBLISH_INTERVAL)", &periodic },
+        { "deadband, sampled every 10 s", &deadband },
+        { "deadband, adaptive sampling", &adaptive },
+    };
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+        printf("  %-34s %10u %12.1f %12.2f %12.0f\n", rows[i].name, rows[i].r->samples,
+               rows[i].r->publishes / 24.0, rows[i].r->worst_lag, rows[i].r->longest_silence_ms / 1e3);
+    }
+    printf("  broker messages: %.1f%% of periodic; sampling while heating every %lu s or faster\n",
+           100.0 * adaptive.publishes / periodic.publishes, (unsigned long)adaptive.heating_interval_ms / 1000);
+
+    bench_report_header("Policy cost per sample");
+    bench_report(&cost);
+    bench_series_free(&cost);
+}
+
+// ============================================
+// Settings messages
+// ============================================
+
+static bool apply(report_config_t *cfg, const char *msg)
+{
+    return report_config_apply(cfg, msg, strlen(msg)) == ESP_OK;
+}
+
+static void check_config(int iterations)
+{
+    report_config_t cfg, before;
+    report_config_defaults(&cfg);
+    BENCH_CHECK(report_config_valid(&cfg));
+
+    BENCH_CHECK(apply(&cfg, " temperature = 0.5, MIN_INTERVAL=10 ,max_interval=60"));
+    BENCH_CHECK(cfg.temperature == 0.5f && cfg.min_interval_ms == 10000 && cfg.max_interval_ms == 60000);
+    BENCH_CHECK(cfg.humidity == REPORT_DEADBAND_HUMIDITY);
+
+    // All or nothing: one bad entry leaves every setting as it was
+    before = cfg;
+    const char *rejected[] = {
+        "temperature=0.3,colour=blue", "humidity=-1", "pressure=abc", "min_interval=0",
+        "min_interval=90", "max_interval=2.5", "max_silence=30", "max_silence=100000", "temperature",
+        "temperature=nan",
+    };
+    for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+        BENCH_CHECK(!apply(&cfg, rejected[i]));
+        BENCH_CHECK(memcmp(&cfg, &before, sizeof(cfg)) == 0);
+    }
+
+    BENCH_CHECK(apply(&cfg, "defaults"));
+    report_config_defaults(&before);
+    BENCH_CHECK(memcmp(&cfg, &before, sizeof(cfg)) == 0);
+
+    char json[160];
+    BENCH_CHECK(report_config_encode_json(&cfg, json, sizeof(json)) > 0);
+    BENCH_CHECK(strcmp(json, "{\"temperature\":0.20,\"humidity\":1.00,\"pressure\":0.50,"
+                             "\"max_silence\":900,\"min_interval\":5,\"max_interval\":120}") == 0);
+    BENCH_CHECK(report_config_encode_json(&cfg, json, 16) == 0);
+
+    // Deadbands compare in hundredths: a 0.20 move at 0.2 reports, 0.19 does not
+    report_state_t st;
+    report_state_init(&st, &cfg);
+    sensor_data_t d = { .valid = true, .fields = SENSOR_HAS_TEMPERATURE, .temperature = 21.50f };
+    BENCH_CHECK(report_on_sample(&st, &cfg, &d, 0) == REPORT_FIRST);
+    report_on_published(&st, &d, 0);
+    d.temperature = 21.69f;
+    BENCH_CHECK(report_on_sample(&st, &cfg, &d, 5000) == REPORT_NONE);
+    d.temperature = 21.70f;
+    BENCH_CHECK(report_on_sample(&st, &cfg, &d, 10000) == REPORT_DEADBAND);
+    report_on_published(&st, &d, 10000);
+    BENCH_CHECK(report_on_sample(&st, &cfg, &d, 10000 + cfg.max_silence_ms) == REPORT_SILENCE);
+    // Humidity is not a field of this sensor: it never triggers a report
+    d.humidity = 90.0f;
+    report_on_published(&st, &d, 0);
+    BENCH_CHECK(report_on_sample(&st, &cfg, &d, 5000) == REPORT_NONE);
+
+    bench_series_t parse = bench_series_create("report_config_apply (3 entries)", iterations);
+    const char *msg = "temperature=0.3,humidity=2,max_interval=300";
+    for (int i = 0; i < iterations; i++) {
+        report_config_defaults(&cfg);
+        int64_t t0 = bench_now_ns();
+        esp_err_t ret = report_config_apply(&cfg, msg, strlen(msg));
+        bench_series_add(&parse, bench_now_ns() - t0);
+        BENCH_CHECK(ret == ESP_OK);
+    }
+    bench_report_header("Settings message");
+    bench_report(&parse);
+    bench_series_free(&parse);
+}
+
+// ============================================
+// Device over MQTT
+// ============================================
+
+static int readings;
+static int configs;
+static char last_config[HOST_MQTT_PAYLOAD_MAX];
+static int last_config_retain;
+
+static void capture(const host_mqtt_msg_t *msg, void *ctx)
+{
+    (void)ctx;
+    if (strcmp(msg->topic, MQTT_TOPIC_TEMP) == 0) {
+        readings++;
+    } else if (strcmp(msg->topic, MQTT_TOPIC_REPORT_CONFIG) == 0) {
+        snprintf(last_config, sizeof(last_config), "%.*s", msg->len, msg->data);
+        last_config_retain = msg->retain;
+        configs++;
+    }
+}
+
+// Publishes of the reading over the next ms of simulated time
+static int run_for(uint32_t ms)
+{
+    int before = readings;
+    host_time_advance_us((int64_t)ms * 1000);
+    return readings - before;
+}
+
+static void set_config(const char *msg)
+{
+    host_mqtt_inject_data(MQTT_TOPIC_REPORT_SET, msg, (int)strlen(msg));
+}
+
+static void bench_device(void)
+{
+    host_time_set_virtual(true);
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+    BENCH_CHECK(host_aht20_attach(I2C_NUM_0, 0x38) == ESP_OK);
+    BENCH_CHECK(host_partition_create(STORE_FORWARD_PARTITION, 64 * 1024) == ESP_OK);
+    host_aht20_set_reading(21.5f, 45.0f);
+    host_mqtt_set_auto_connect(50000);
+
+    app_main();
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_MQTT, 30000));
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_REPORT_SET));
+
+    // Let the filters settle on the first readings, then an hour of a steady room
+    run_for(60000);
+    BENCH_CHECK(configs == 1 && last_config_retain);
+    int steady = run_for(HOUR_MS);
+    BENCH_CHECK(steady <= (int)(HOUR_MS / REPORT_MAX_SILENCE_MS) + 1);
+
+    // A step is reported within two samples (the median window lets the
+    // first one through unchanged), at most two max intervals later
+    host_aht20_set_reading(23.0f, 45.0f);
+    int64_t t0 = host_time_now_ns();
+    int step = 0;
+    while (step == 0 && host_time_now_ns() - t0 < (int64_t)2 * REPORT_MAX_INTERVAL_MS * 1000000) {
+        step = run_for(1000);
+    }
+    double step_ms = (host_time_now_ns() - t0) / 1e6;
+    BENCH_CHECK(step > 0 && step_ms <= 2 * REPORT_MAX_INTERVAL_MS + 1000);
+    int settle = run_for(60000);
+
+    // New settings over MQTT: applied, kept in NVS and echoed retained
+    host_nvs_reset_stats();
+    set_config("temperature=0,max_interval=30");
+    BENCH_CHECK(configs == 2 && last_config_retain);
+    BENCH_CHECK(strstr(last_config, "\"temperature\":0.00") != NULL);
+    BENCH_CHECK(strstr(last_config, "\"max_interval\":30") != NULL);
+    BENCH_CHECK(host_nvs_get_stats().commits == 1);
+    int every = run_for(300000);
+    BENCH_CHECK(every >= 300000 / 30000 && every <= 300000 / REPORT_MIN_INTERVAL_MS + 1);
+
+    // A rejected message changes nothing and echoes the settings in force
+    char in_force[sizeof(last_config)];
+    strcpy(in_force, last_config);
+    set_config("temperature=-1");
+    BENCH_CHECK(configs == 3 && strcmp(last_config, in_force) == 0);
+    BENCH_CHECK(host_nvs_get_stats().commits == 1);
+
+    set_config("defaults");
+    BENCH_CHECK(configs == 4 && strstr(last_config, "\"temperature\":0.20") != NULL);
+    run_for(60000);
+    int back = run_for(HOUR_MS);
+    BENCH_CHECK(back <= (int)(HOUR_MS / REPORT_MAX_SILENCE_MS) + 1);
+
+    printf("\nDevice (AHT20 held steady, then stepped 21.5 -> 23.0 °C)\n");
+    printf("  steady hour: %d publishes (every %d ms: %u)\n", steady, TEMP_PUBLISH_INTERVAL_MS,
+           HOUR_MS / TEMP_PUBLISH_INTERVAL_MS);
+    printf("  step reported after %.1f s, %d more publishes while the filter settled\n", step_ms / 1e3, settle);
+    printf("  deadband 0, max interval 30 s over MQTT: %d publishes in 5 min\n", every);
+    printf("  back to defaults: %d publishes in the next hour\n", back);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 100000);
+
+    host_log_set_sink(NULL);
+    host_mqtt_set_publish_hook(capture, NULL);
+
+    printf("Report by exception (%d iterations)\n", iterations);
+    bench_policy();
+    check_config(iterations);
+    bench_device();
+
+    return bench_exit_code();
+}
@@ -0,0 +1,426 @@
+// Sensor build: AHT20 read/conversion cost against the emulated device
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "device_temp.h"
+#include "sensor_manager.h"
+#include "sensor_filter.h"
+#include "mqtt_manager.h"
+#include "driver/i2c.h"
+#include "driver/i2c_master.h"
+#include "i2c_topology.h"
+#include "nvs_flash.h"
+#include "sample_ring.h"
+#include "store_forward.h"
+#include "host_shim.h"
+#include "bench.h"
+
+static void bench_init(void)
+{
+    host_i2c_reset_stats();
+
+    int64_t virtual_t0 = host_time_now_ns();
+    int64_t t0 = bench_now_ns();
+    BENCH_CHECK(temp_sensor_init() == ESP_OK);
+    int64_t t1 = bench_now_ns();
+    int64_t virtual_t1 = host_time_now_ns();
+
+    host_i2c_stats_t stats = host_i2c_get_stats();
+    printf("\ntemp_sensor_init\n");
+    printf("  simulated boot time: %.1f ms, host CPU: %.1f us\n",
+           (double)(virtual_t1 - virtual_t0) / 1e6, (double)(t1 - t0) / 1e3);
+    printf("  I2C transactions: %u (%u NACKed), driver heap allocations: %u\n",
+           stats.transactions, stats.nacks, stats.allocations);
+}
+
+static void bench_read(int iterations)
+{
+    // Fast, typical and slower-than-datasheet conversions, cycled per sample
+    static const int64_t conversion_us[] = { 45000, 75000, 95000 };
+    enum { CASES = sizeof(conversion_us) / sizeof(conversion_us[0]) };
+    int64_t latency_sum[CASES] = {0};
+    int64_t latency_max[CASES] = {0};
+    int samples[CASES] = {0};
+    int lost = 0;
+    bench_series_t read = bench_series_create("sensor_manager_read (poll state machine)", iterations);
+    sensor_data_t data[SENSOR_MAX_COUNT];
+
+    // What the published values should be: the inputs through the same filters
+    sensor_filter_t expect_t, expect_h;
+    sensor_filter_init(&expect_t, SENSOR_MEDIAN_WINDOW, SENSOR_EMA_SHIFT);
+    sensor_filter_init(&expect_h, SENSOR_MEDIAN_WINDOW, SENSOR_EMA_SHIFT);
+
+    host_i2c_reset_stats();
+    for (int i = 0; i < iterations; i++) {
+        int c = i % CASES;
+        float temperature = -10.0f + (float)(i % 500) * 0.1f;
+        float humidity = (float)(i % 100);
+        host_aht20_set_conversion_time_us(conversion_us[c]);
+        for (int n = 0; n < SENSOR_OVERSAMPLE; n++) {
+            host_aht20_queue_reading(temperature, humidity);
+        }
+
+        int64_t virtual_t0 = host_time_now_ns();
+        int64_t t0 = bench_now_ns();
+        esp_err_t ret = sensor_manager_read(data);
+        int64_t t1 = bench_now_ns();
+        int64_t latency = host_time_now_ns() - virtual_t0;
+
+        if (ret != ESP_OK) {
+            lost++;
+            continue;
+        }
+        float t = sensor_filter_update(&expect_t, (int32_t)lroundf(temperature * 100.0f)) / 100.0f;
+        float h = sensor_filter_update(&expect_h, (int32_t)lroundf(humidity * 100.0f)) / 100.0f;
+        BENCH_CHECK(fabsf(data[0].temperature - t) < 0.011f);
+        BENCH_CHECK(fabsf(data[0].humidity - h) < 0.011f);
+        bench_series_add(&read, t1 - t0);
+        latency_sum[c] += latency;
+        if (latency > latency_max[c]) {
+            latency_max[c] = latency;
+        }
+        samples[c]++;
+    }
+    host_i2c_stats_t stats = host_i2c_get_stats();
+    BENCH_CHECK(lost == 0);
+
+    // Start now, collect later: the caller's task is free during the conversion
+    host_aht20_set_conversion_time_us(75000);
+    BENCH_CHECK(sensor_manager_start(SENSOR_ALL) == ESP_OK);
+    BENCH_CHECK(sensor_manager_start(SENSOR_ALL) == ESP_ERR_INVALID_STATE);
+    BENCH_CHECK(sensor_manager_collect(data, 0) == ESP_ERR_TIMEOUT);
+    host_time_advance_us(SENSOR_OVERSAMPLE * 100000);
+    BENCH_CHECK(sensor_manager_collect(data, 0) == ESP_OK && data[0].valid);
+
+    // A conversion that never finishes fails at the deadline, and the next one recovers
+    host_aht20_set_conversion_time_us(1000000);
+    BENCH_CHECK(sensor_manager_read(data) == ESP_FAIL && !data[0].valid);
+    host_aht20_set_conversion_time_us(75000);
+    BENCH_CHECK(sensor_manager_read(data) == ESP_OK);
+
+    bench_report_header("aht20_read: host cost per sample (I2C emulation + conversion)");
+    bench_report(&read);
+    printf("  I2C transactions per sample: %.2f, driver heap allocations per sample: %.2f\n",
+           (double)stats.transactions / iterations, (double)stats.allocations / iterations);
+    BENCH_CHECK(stats.allocations == 0);
+    printf("  simulated trigger-to-result latency, %d conversion(s) per sample\n", SENSOR_OVERSAMPLE);
+    printf("  (the fixed 80 ms delay lost every sample slower than 80 ms):\n");
+    for (int c = 0; c < CASES; c++) {
+        printf("    conversion %5.1f ms: mean %5.1f ms, max %5.1f ms over %d samples\n",
+               conversion_us[c] / 1e3, samples[c] ? (double)latency_sum[c] / samples[c] / 1e6 : 0.0,
+               latency_max[c] / 1e6, samples[c]);
+    }
+    printf("  lost samples: %d\n", lost);
+    bench_series_free(&read);
+}
+
+static bool count_trans_done(i2c_master_dev_handle_t dev, const i2c_master_event_data_t *evt, void *arg)
+{
+    (void)dev;
+    if (evt->event == I2C_EVENT_DONE) {
+        (*(uint32_t *)arg)++;
+    }
+    return false;
+}
+
+// The AHT20 frame read on I2C_NUM_1, through the legacy command-link API the
+// driver used before and through a persistent device handle
+static void bench_i2c_api(int iterations)
+{
+    bench_series_t legacy = bench_series_create("legacy command link", iterations);
+    bench_series_t sync = bench_series_create("device handle, blocking", iterations);
+    bench_series_t async = bench_series_create("device handle, async callback", iterations);
+    uint8_t frame[7];
+
+    BENCH_CHECK(host_aht20_attach(I2C_NUM_1, 0x38) == ESP_OK);
+
+    // Before: a command link is allocated and freed per transaction
+    i2c_config_t conf = { .mode = I2C_MODE_MASTER, .master.clk_speed = I2C_FREQ_HZ };
+    BENCH_CHECK(i2c_param_config(I2C_NUM_1, &conf) == ESP_OK);
+    BENCH_CHECK(i2c_driver_install(I2C_NUM_1, I2C_MODE_MASTER, 0, 0, 0) == ESP_OK);
+    host_i2c_reset_stats();
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = bench_now_ns();
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (0x38 << 1) | I2C_MASTER_READ, true);
+        i2c_master_read(cmd, frame, 6, I2C_MASTER_ACK);
+        i2c_master_read_byte(cmd, &frame[6], I2C_MASTER_NACK);
+        i2c_master_stop(cmd);
+        esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_1, cmd, pdMS_TO_TICKS(10));
+        i2c_cmd_link_delete(cmd);
+        int64_t t1 = bench_now_ns();
+        BENCH_CHECK(ret == ESP_OK);
+        bench_series_add(&legacy, t1 - t0);
+    }
+    host_i2c_stats_t legacy_stats = host_i2c_get_stats();
+    BENCH_CHECK(i2c_driver_delete(I2C_NUM_1) == ESP_OK);
+
+    // After: bus and device handles are created once
+    i2c_master_bus_config_t bus_config = { .i2c_port = I2C_NUM_1, .trans_queue_depth = 4 };
+    i2c_device_config_t dev_config = { .device_address = 0x38, .scl_speed_hz = I2C_FREQ_HZ };
+    i2c_master_bus_handle_t bus;
+    i2c_master_dev_handle_t dev;
+    BENCH_CHECK(i2c_new_master_bus(&bus_config, &bus) == ESP_OK);
+    BENCH_CHECK(i2c_master_bus_add_device(bus, &dev_config, &dev) == ESP_OK);
+
+    host_i2c_reset_stats();
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = bench_now_ns();
+        esp_err_t ret = i2c_master_receive(dev, frame, sizeof(frame), 10);
+        int64_t t1 = bench_now_ns();
+        BENCH_CHECK(ret == ESP_OK);
+        bench_series_add(&sync, t1 - t0);
+    }
+    host_i2c_stats_t sync_stats = host_i2c_get_stats();
+
+    uint32_t completions = 0;
+    i2c_master_event_callbacks_t callbacks = { .on_trans_done = count_trans_done };
+    BENCH_CHECK(i2c_master_register_event_callbacks(dev, &callbacks, &completions) == ESP_OK);
+    host_i2c_reset_stats();
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = bench_now_ns();
+        esp_err_t ret = i2c_master_receive(dev, frame, sizeof(frame), 10);
+        int64_t t1 = bench_now_ns();
+        BENCH_CHECK(ret == ESP_OK);
+        bench_series_add(&async, t1 - t0);
+    }
+    host_i2c_stats_t async_stats = host_i2c_get_stats();
+    BENCH_CHECK(completions == (uint32_t)iterations);
+
+    BENCH_CHECK(i2c_master_bus_rm_device(dev) == ESP_OK);
+    BENCH_CHECK(i2c_del_master_bus(bus) == ESP_OK);
+
+    bench_report_header("I2C transaction overhead (7-byte frame read, emulated device)");
+    bench_report(&legacy);
+    bench_report(&sync);
+    bench_report(&async);
+    printf("  heap allocations per transaction: legacy %.2f, blocking %.2f, async %.2f\n",
+           (double)legacy_stats.allocations / iterations, (double)sync_stats.allocations / iterations,
+           (double)async_stats.allocations / iterations);
+    bench_series_free(&legacy);
+    bench_series_free(&sync);
+    bench_series_free(&async);
+}
+
+typedef struct {
+    const char *name;
+    i2c_topology_result_t result;
+    esp_err_t ret;
+    double boot_ms;
+    uint32_t timeouts;
+} topology_boot_t;
+
+static topology_boot_t discover_boot(const char *name, i2c_master_bus_handle_t bus, const uint8_t *expected,
+                                     size_t expected_count, bool force)
+{
+    topology_boot_t boot = { .name = name };
+    i2c_topology_t topology;
+
+    host_i2c_reset_stats();
+    int64_t t0 = host_time_now_ns();
+    boot.ret = i2c_topology_discover(bus, I2C_NUM_1, expected, expected_count, force, &topology, &boot.result);
+    boot.boot_ms = (double)(host_time_now_ns() - t0) / 1e6;
+    boot.timeouts = host_i2c_get_stats().timeouts;
+    return boot;
+}
+
+// Bus discovery on I2C_NUM_1 across simulated reboots (NVS persists in between)
+static void bench_topology(void)
+{
+    static const uint8_t expected[] = { 0x38 };
+    static const uint8_t expected_missing[] = { 0x38, 0x40 };
+    topology_boot_t boots[6];
+    int n = 0;
+
+    i2c_master_bus_config_t bus_config = { .i2c_port = I2C_NUM_1 };
+    i2c_master_bus_handle_t bus;
+    BENCH_CHECK(i2c_new_master_bus(&bus_config, &bus) == ESP_OK);
+    BENCH_CHECK(i2c_topology_forget(I2C_NUM_1) == ESP_OK);
+
+    boots[n] = discover_boot("first boot (no cache)", bus, expected, 1, false);
+    BENCH_CHECK(boots[n].ret == ESP_OK && boots[n].result.full_scan && boots[n].result.probes == 126);
+    BENCH_CHECK(boots[n].result.devices == 1);
+    n++;
+
+    host_nvs_reset_stats();
+    boots[n] = discover_boot("later boot (cached map)", bus, expected, 1, false);
+    BENCH_CHECK(boots[n].ret == ESP_OK && boots[n].result.from_cache && boots[n].result.probes == 1);
+    BENCH_CHECK(host_nvs_get_stats().writes == 0);
+    n++;
+
+    boots[n] = discover_boot("forced scan", bus, expected, 1, true);
+    BENCH_CHECK(boots[n].ret == ESP_OK && boots[n].result.full_scan);
+    n++;
+
+    boots[n] = discover_boot("expected device missing", bus, expected_missing, 2, false);
+    BENCH_CHECK(boots[n].ret == ESP_OK && boots[n].result.full_scan && boots[n].result.probes == 127);
+    n++;
+
+    host_i2c_set_stuck(I2C_NUM_1, true);
+    boots[n] = discover_boot("stuck bus (cached map)", bus, expected, 1, false);
+    BENCH_CHECK(boots[n].ret == ESP_ERR_TIMEOUT && boots[n].result.bus_stuck);
+    n++;
+    BENCH_CHECK(i2c_topology_forget(I2C_NUM_1) == ESP_OK);
+    boots[n] = discover_boot("stuck bus (no cache)", bus, expected, 1, false);
+    BENCH_CHECK(boots[n].ret == ESP_ERR_TIMEOUT && boots[n].result.probes == I2C_SCAN_MAX_TIMEOUTS);
+    n++;
+    host_i2c_set_stuck(I2C_NUM_1, false);
+
+    BENCH_CHECK(i2c_del_master_bus(bus) == ESP_OK);
+
+    printf("\nI2C topology discovery (simulated time; probe timeout %d ms)\n", I2C_PROBE_TIMEOUT_MS);
+    printf("  %-28s %8s %8s %10s\n", "boot", "probes", "devices", "time ms");
+    for (int i = 0; i < n; i++) {
+        printf("  %-28s %8u %8u %10.1f%s\n", boots[i].name, boots[i].result.probes, boots[i].result.devices,
+               boots[i].boot_ms, boots[i].result.bus_stuck ? "  (aborted: bus stuck)" : "");
+    }
+    printf("  previous scanner on a stuck bus: 126 probes x 50 ms = %.1f ms\n", 126 * 50.0);
+}
+
+static void bench_batch(int iterations)
+{
+    enum { BATCH = 32 };
+    sensor_sample_t storage[BATCH];
+    sample_ring_t ring;
+    char payload[64 + BATCH * 32];
+    char single[16];
+    bench_series_t encode = bench_series_create("encode 32-sample JSON batch", iterations);
+
+    sample_ring_init(&ring, storage, BATCH);
+    for (int i = 0; i < BATCH; i++) {
+        sensor_sample_t sample = { .timestamp_ms = 60000 + i * 2000, .temperature = 21.0f + i * 0.01f,
+                                   .humidity = 40.0f + i * 0.1f };
+        sample_ring_push(&ring, &sample);
+    }
+    BENCH_CHECK(sample_ring_full(&ring));
+
+    size_t len = 0;
+    uint16_t encoded = 0;
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = bench_now_ns();
+        len = sample_ring_encode_json(&ring, 124000, payload, sizeof(payload), &encoded);
+        int64_t t1 = bench_now_ns();
+        bench_series_add(&encode, t1 - t0);
+    }
+    BENCH_CHECK(encoded == BATCH);
+    BENCH_CHECK(payload[len - 1] == '}');
+
+    // Overwrite-oldest behaviour
+    sensor_sample_t extra = { .timestamp_ms = 1 };
+    sample_ring_push(&ring, &extra);
+    BENCH_CHECK(ring.dropped == 1 && sample_ring_at(&ring, BATCH - 1)->timestamp_ms == 1);
+
+    // Approximate MQTT PUBLISH size: 2 B fixed header + 2 B topic length + topic + payload
+    int single_len = snprintf(single, sizeof(single), "%.2f", 21.0f);
+    double per_sample_single = 4.0 + strlen(MQTT_TOPIC_TEMP) + single_len;
+    double per_sample_batch = (4.0 + strlen(MQTT_TOPIC_TEMP_BATCH) + len) / BATCH;
+
+    bench_report_header("Batched publishing");
+    bench_report(&encode);
+    printf("  wire bytes per sample: %.1f single (temp only), %.1f batched (temp + humidity + timestamp)\n",
+           per_sample_single, per_sample_batch);
+    printf("  broker messages per %d samples: %d single, 1 batch (+1 latest-value publish)\n", BATCH, BATCH);
+    bench_series_free(&encode);
+}
+
+static void bench_store_forward(int iterations)
+{
+    const uint32_t partition_size = 64 * 1024;
+    int outage = iterations < 3000 ? iterations : 3000;
+    bench_series_t append = bench_series_create("append while offline", outage);
+    bench_series_t drain = bench_series_create("drain 20 readings per message", outage);
+
+    BENCH_CHECK(host_partition_create(STORE_FORWARD_PARTITION, partition_size) == ESP_OK);
+    BENCH_CHECK(store_forward_init() == ESP_OK);
+    BENCH_CHECK(store_forward_pending() == 0);
+
+    // Outage: every reading goes to flash
+    host_mqtt_inject_disconnected();
+    for (int i = 0; i < outage; i++) {
+        sensor_sample_t sample = { .timestamp_ms = 1000u * i, .temperature = 20.0f + (i % 100) * 0.01f,
+                                   .humidity = 50.0f };
+        int64_t t0 = bench_now_ns();
+        BENCH_CHECK(store_forward_append(&sample) == ESP_OK);
+        int64_t t1 = bench_now_ns();
+        bench_series_add(&append, t1 - t0);
+    }
+    BENCH_CHECK(store_forward_flush() == ESP_OK);
+    store_forward_stats_t before = store_forward_get_stats();
+    host_flash_stats_t flash = host_partition_stats(STORE_FORWARD_PARTITION);
+
+    // Reboot: the log is recovered from flash alone
+    BENCH_CHECK(store_forward_init() == ESP_OK);
+    BENCH_CHECK(store_forward_pending() == (uint32_t)outage);
+
+    // Reconnect and drain
+    host_mqtt_inject_connected();
+    uint32_t publishes_before = host_mqtt_publish_count();
+    int drained_total = 0;
+    for (;;) {
+        int64_t t0 = bench_now_ns();
+        int drained = store_forward_drain(mqtt_get_client(), STORE_DRAIN_BATCH_SIZE);
+        int64_t t1 = bench_now_ns();
+        if (drained <= 0) {
+            break;
+        }
+        bench_series_add(&drain, t1 - t0);
+        drained_total += drained;
+    }
+    uint32_t messages = host_mqtt_publish_count() - publishes_before;
+    BENCH_CHECK(drained_total == outage);
+    BENCH_CHECK(strcmp(host_mqtt_last_publish()->topic, MQTT_TOPIC_TEMP_BACKLOG) == 0);
+
+    // Drain marks survive a reboot
+    BENCH_CHECK(store_forward_init() == ESP_OK);
+    BENCH_CHECK(store_forward_pending() == 0);
+
+    // Wear over several wraps of the log
+    host_mqtt_inject_disconnected();
+    uint32_t slots = partition_size / 16;
+    for (uint32_t i = 0; i < slots * 4; i++) {
+        sensor_sample_t sample = { .timestamp_ms = i, .temperature = 21.0f, .humidity = 40.0f };
+        store_forward_append(&sample);
+    }
+    store_forward_stats_t wrapped = store_forward_get_stats();
+    host_flash_stats_t worn = host_partition_stats(STORE_FORWARD_PARTITION);
+    BENCH_CHECK(wrapped.dropped > 0);
+    BENCH_CHECK(wrapped.pending < slots);
+
+    bench_report_header("Store-and-forward (64 KB partition)");
+    bench_report(&append);
+    bench_report(&drain);
+    printf("  outage of %d readings: %u flash writes, %u sector erases, %llu bytes programmed\n",
+           outage, before.flash_writes, before.sector_erases, (unsigned long long)flash.bytes_written);
+    printf("  drained in %u messages\n", messages);
+    printf("  after %u appends (4 wraps): max erases per sector %u, total erases %u, dropped %u\n",
+           slots * 4, worn.max_sector_erases, worn.sector_erases, wrapped.dropped);
+
+    bench_series_free(&append);
+    bench_series_free(&drain);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 20000);
+
+    host_log_set_sink(NULL);
+    host_time_set_virtual(true);
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+    BENCH_CHECK(host_aht20_attach(I2C_NUM_0, 0x38) == ESP_OK);
+
+    printf("Sensor benchmarks (%d iterations)\n", iterations);
+    bench_init();
+    bench_read(iterations);
+    bench_i2c_api(iterations);
+    bench_topology();
+    bench_batch(iterations);
+
+    BENCH_CHECK(esp_event_loop_create_default() == ESP_OK);
+    BENCH_CHECK(mqtt_client_init() == ESP_OK);
+    bench_store_forward(iterations);
+
+    return bench_exit_code();
+}
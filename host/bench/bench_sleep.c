@@ -0,0 +1,250 @@
+// Deep-sleep duty cycle: when the radio comes up, what reaches the broker, and
+// the energy per reading
+//
+// Each wake runs app_main in a forked child on a fresh clock, as after a wake
+// from deep sleep; RTC memory and NVS are carried from one wake to the next.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "config.h"
+#include "driver/i2c.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#define MQTT_CONNECT_US 50000
+#define WAKES 55
+#define STEP_WAKE 25            // Temperature jumps past the report threshold
+#define OUTAGE_FIRST 40         // AP switched off for these wakes
+#define OUTAGE_LAST 50
+#define MAX_WAKE_SAMPLES TEMP_SLEEP_BUFFER_SIZE
+#define BATTERY_MAH 2000
+
+void app_main(void);
+
+typedef struct {
+    int64_t awake_us;
+    uint64_t sleep_us;
+    uint32_t wifi_connects;
+    int samples;                        // Readings received by the broker this wake
+    uint32_t timestamps[MAX_WAKE_SAMPLES];
+    float temperatures[MAX_WAKE_SAMPLES];
+    char energy[160];                   // Energy report, if one was published
+} wake_result_t;
+
+static wake_result_t result;
+static int result_fd;
+
+// Collect the readings of each batch: {"now":N,"s":[[ms,t,h],...]}
+static void capture(const host_mqtt_msg_t *msg, void *ctx)
+{
+    (void)ctx;
+    if (strcmp(msg->topic, MQTT_TOPIC_TEMP_ENERGY) == 0) {
+        snprintf(result.energy, sizeof(result.energy), "%.*s", msg->len, msg->data);
+        return;
+    }
+    if (strcmp(msg->topic, MQTT_TOPIC_TEMP_BATCH) != 0) {
+        return;
+    }
+    const char *p = strstr(msg->data, "\"s\":[");
+    if (p == NULL) {
+        return;
+    }
+    p += 5;
+    unsigned long ts;
+    float temperature, humidity;
+    int used;
+    while (result.samples < MAX_WAKE_SAMPLES
+           && sscanf(p, "[%lu,%f,%f]%n", &ts, &temperature, &humidity, &used) == 3) {
+        result.timestamps[result.samples] = (uint32_t)ts;
+        result.temperatures[result.samples] = temperature;
+        result.samples++;
+        p += used;
+        if (*p == ',') {
+            p++;
+        }
+    }
+}
+
+static void on_deep_sleep(uint64_t sleep_us, void *ctx)
+{
+    (void)ctx;
+    result.awake_us = esp_timer_get_time();
+    result.sleep_us = sleep_us;
+    result.wifi_connects = host_wifi_get_stats().connects;
+
+    FILE *out = fdopen(result_fd, "wb");
+    BENCH_CHECK(fwrite(&result, sizeof(result), 1, out) == 1);
+    BENCH_CHECK(host_rtc_save(out) == ESP_OK);
+    BENCH_CHECK(host_nvs_save(out) == ESP_OK);
+    fclose(out);
+    _exit(bench_exit_code());
+}
+
+static void run_wake(int fd, const host_wifi_ap_t *ap, float temperature, bool from_sleep, FILE *rtc)
+{
+    result_fd = fd;
+    host_log_set_sink(NULL);
+    host_time_set_virtual(true);
+    host_wifi_set_ap(ap);
+    host_mqtt_set_auto_connect(MQTT_CONNECT_US);
+    host_mqtt_set_publish_hook(capture, NULL);
+    host_sleep_set_handler(on_deep_sleep, NULL);
+    BENCH_CHECK(host_aht20_attach(I2C_NUM_0, 0x38) == ESP_OK);
+    host_aht20_set_reading(temperature, 45.0f);
+    if (from_sleep) {
+        BENCH_CHECK(host_rtc_load(rtc) == ESP_OK);
+    }
+
+    app_main();
+    BENCH_CHECK(!"app_main returned instead of entering deep sleep");
+    _exit(bench_exit_code());
+}
+
+/**
+ * @brief One wake; rtc and NVS are replaced by what the wake left behind
+ */
+static bool wake(const host_wifi_ap_t *ap, float temperature, FILE **rtc, wake_result_t *r)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        run_wake(fds[1], ap, temperature, *rtc != NULL, *rtc);
+    }
+    close(fds[1]);
+
+    FILE *in = fdopen(fds[0], "rb");
+    FILE *next_rtc = tmpfile();
+    bool ok = fread(r, sizeof(*r), 1, in) == 1;
+
+    // Copy the RTC image through so the next wake can load it
+    uint32_t size = 0;
+    ok = ok && fread(&size, sizeof(size), 1, in) == 1;
+    char *image = ok ? malloc(size + 1) : NULL;
+    ok = ok && image != NULL && (size == 0 || fread(image, size, 1, in) == 1);
+    ok = ok && fwrite(&size, sizeof(size), 1, next_rtc) == 1 && (size == 0 || fwrite(image, size, 1, next_rtc) == 1);
+    free(image);
+    ok = ok && host_nvs_load(in) == ESP_OK;
+    fclose(in);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    if (*rtc != NULL) {
+        fclose(*rtc);
+    }
+    rewind(next_rtc);
+    *rtc = next_rtc;
+    return ok;
+}
+
+static bool expected_connect(int n)
+{
+    static const int wakes[] = { 1, 11, 21, STEP_WAKE, 35, 45, 55 };
+    for (size_t i = 0; i < sizeof(wakes) / sizeof(wakes[0]); i++) {
+        if (wakes[i] == n) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+
+    host_wifi_ap_t ap = host_wifi_get_ap();
+    host_wifi_ap_t outage = ap;
+    outage.available = false;
+
+    printf("Deep-sleep duty cycle (%d s period, publish every %d wakes or on %.1f C change, %d-reading RTC buffer)\n",
+           TEMP_SLEEP_INTERVAL_MS / 1000, TEMP_SLEEP_CONNECT_EVERY, (double)TEMP_SLEEP_REPORT_DELTA_C,
+           TEMP_SLEEP_BUFFER_SIZE);
+    printf("  step to %.1f C at wake %d, AP off for wakes %d-%d\n\n", 23.0, STEP_WAKE, OUTAGE_FIRST, OUTAGE_LAST);
+
+    FILE *rtc = NULL;
+    int published = 0;
+    int64_t awake_sample_only = 0, awake_connect = 0, awake_failed = 0;
+    int n_sample_only = 0, n_connect = 0, n_failed = 0;
+    uint32_t last_ts = 0;
+    char energy[sizeof(result.energy)] = "";
+
+    printf("  wakes that brought up the radio:\n  %5s %9s %8s\n", "wake", "awake ms", "readings");
+    for (int n = 1; n <= WAKES; n++) {
+        bool down = n >= OUTAGE_FIRST && n <= OUTAGE_LAST;
+        float temperature = n >= STEP_WAKE ? 23.0f : 21.5f;
+        wake_result_t r;
+        bool ok = wake(down ? &outage : &ap, temperature, &rtc, &r);
+        BENCH_CHECK(ok);
+        if (!ok) {
+            break;
+        }
+
+        bool radio = r.wifi_connects > 0;
+        BENCH_CHECK(radio == expected_connect(n));
+        // Wakes stay one period apart however long the radio was on
+        BENCH_CHECK(r.awake_us / 1000 + (int64_t)(r.sleep_us / 1000) == TEMP_SLEEP_INTERVAL_MS);
+
+        // Every reading reaches the broker once, in order, one period apart
+        for (int i = 0; i < r.samples; i++) {
+            BENCH_CHECK(published == 0 || r.timestamps[i] > last_ts);
+            BENCH_CHECK(published == 0 || r.timestamps[i] - last_ts < TEMP_SLEEP_INTERVAL_MS + 1000);
+            BENCH_CHECK(r.temperatures[i] == (published + 1 >= STEP_WAKE ? 23.0f : 21.5f));
+            last_ts = r.timestamps[i];
+            published++;
+        }
+
+        if (!radio) {
+            awake_sample_only += r.awake_us;
+            n_sample_only++;
+        } else if (r.samples > 0) {
+            awake_connect += r.awake_us;
+            n_connect++;
+            snprintf(energy, sizeof(energy), "%s", r.energy);
+            printf("  %5d %9.0f %8d%s\n", n, r.awake_us / 1e3, r.samples,
+                   n == STEP_WAKE ? "  (threshold)" : n == 1 ? "  (first reading)" : "");
+        } else {
+            awake_failed += r.awake_us;
+            n_failed++;
+            printf("  %5d %9.0f %8d  (AP down, readings kept)\n", n, r.awake_us / 1e3, 0);
+        }
+    }
+    if (rtc != NULL) {
+        fclose(rtc);
+    }
+    BENCH_CHECK(published == WAKES);
+
+    printf("\n  %-28s %9s %6s\n", "wake type", "awake ms", "count");
+    printf("  %-28s %9.1f %6d\n", "reading only", awake_sample_only / 1e3 / (n_sample_only ? n_sample_only : 1),
+           n_sample_only);
+    printf("  %-28s %9.1f %6d\n", "reading + publish", awake_connect / 1e3 / (n_connect ? n_connect : 1), n_connect);
+    printf("  %-28s %9.1f %6d\n", "publish attempt, AP down", awake_failed / 1e3 / (n_failed ? n_failed : 1),
+           n_failed);
+
+    // The report published at the last wake covers every wake before it
+    unsigned long avg_ua = 0, uj = 0;
+    const char *p = strstr(energy, "\"avg_ua\":");
+    BENCH_CHECK(p != NULL && sscanf(p, "\"avg_ua\":%lu,\"uj_per_sample\":%lu", &avg_ua, &uj) == 2);
+    unsigned long always_on_ua = ENERGY_RADIO_MA * 1000UL;
+    BENCH_CHECK(avg_ua > 0 && avg_ua < always_on_ua / 20);
+
+    printf("\n  energy report: %s\n", energy);
+    printf("  average current %lu uA vs %lu uA awake with WiFi up (%.0fx less)\n",
+           avg_ua, always_on_ua, (double)always_on_ua / (double)avg_ua);
+    printf("  %lu uJ per reading; %d mAh cell: %.0f days vs %.1f days\n", uj, BATTERY_MAH,
+           BATTERY_MAH * 1000.0 / avg_ua / 24.0, BATTERY_MAH * 1000.0 / always_on_ua / 24.0);
+
+    return bench_exit_code();
+}
@@ -0,0 +1,560 @@
+// On-device thermostat: a day of a heated room under local control against the
+// webapp loop, short cycling, and the relay device regulating on its own
+//
+// The room is a two-stage thermal plant: the radiator follows the burner with
+// a 10 min lag and the room follows the radiator with a 4 h time constant,
+// 5 °C outside. The sensor reads it every 10 s to 0.01 °C with a little
+// noise. The device part boots through app_main on the simulated clock and
+// gets the readings over MQTT, as from the sensor.
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "boot_events.h"
+#include "thermostat.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#define HOUR_MS             (3600u * 1000u)
+#define DAY_MS              (24u * HOUR_MS)
+#define READING_MS          10000u
+#define SIM_STEP_MS         100u
+
+#define OUTDOOR_C           5.0
+#define FULL_C              30.0        // Room temperature with the burner always on
+#define RADIATOR_TAU_S      600.0
+#define ROOM_TAU_S          14400.0
+
+// The webapp loop: sensor -> broker -> webapp -> broker -> relay
+#define BROKER_HOP_MS       40u
+#define WEBAPP_PROCESS_MS   250u
+#define WEBAPP_DELAY_MS     (2 * BROKER_HOP_MS + WEBAPP_PROCESS_MS)
+#define OUTAGE_START_MS     (13u * HOUR_MS)
+#define OUTAGE_END_MS       (15u * HOUR_MS)
+
+#define SCHEDULE            "06:30=21,22:00=17"
+
+void app_main(void);
+
+// ============================================
+// Thermal plant
+// ============================================
+
+typedef struct {
+    double room;
+    double radiator;            // 0 (cold) to 1 (burner on for ever)
+    uint32_t noise;
+} plant_t;
+
+static void plant_init(plant_t *p, double room)
+{
+    p->room = room;
+    p->radiator = (room - OUTDOOR_C) / (FULL_C - OUTDOOR_C);
+    p->noise = 12345;
+}
+
+static void plant_step(plant_t *p, bool burner, double dt_s)
+{
+    p->radiator += ((burner ? 1.0 : 0.0) - p->radiator) * dt_s / RADIATOR_TAU_S;
+    p->room += (OUTDOOR_C + p->radiator * (FULL_C - OUTDOOR_C) - p->room) * dt_s / ROOM_TAU_S;
+}
+
+// What the sensor publishes: +-0.08 °C of noise, in hundredths
+static float plant_read(plant_t *p)
+{
+    p->noise = p->noise * 1103515245u + 12345u;
+    double noise = ((int)((p->noise >> 16) % 161) - 80) / 1000.0;
+    return roundf((float)(p->room + noise) * 100.0f) / 100.0f;
+}
+
+// ============================================
+// A simulated day, engine only
+// ============================================
+
+typedef struct {
+    const char *name;
+    thermostat_algorithm_t algorithm;
+    float hysteresis;
+    bool protect;               // Minimum run and pause
+    bool webapp;                // Decided remotely: WEBAPP_DELAY_MS late, nothing during the outage
+} loop_t;
+
+typedef struct {
+    double rms;                 // Once settled: an hour after each setpoint change
+    float overshoot;
+    uint32_t starts;
+    uint32_t shortest_on_ms;
+    uint32_t shortest_off_ms;
+    float outage_worst;         // Largest |room - setpoint| during the outage
+} day_result_t;
+
+static void switch_times(day_result_t *r, bool on, uint32_t now, uint32_t *since, bool *first)
+{
+    uint32_t length = now - *since;
+    uint32_t *shortest = on ? &r->shortest_off_ms : &r->shortest_on_ms;
+    if (!*first && length < *shortest) {
+        *shortest = length;
+    }
+    *first = false;
+    *since = now;
+    r->starts += on;
+}
+
+static day_result_t run_day(const loop_t *loop, bench_series_t *cost)
+{
+    thermostat_params_t params;
+    thermostat_params_defaults(&params);
+    params.algorithm = loop->algorithm;
+    params.hysteresis = loop->hysteresis;
+    if (!loop->protect) {
+        params.min_on_ms = params.min_off_ms = 0;
+    }
+
+    thermostat_t t;
+    thermostat_init(&t, &params, false, 0);
+    thermostat_schedule_t schedule;
+    int now_minute;
+    BENCH_CHECK(thermostat_parse_schedule(SCHEDULE, strlen(SCHEDULE), &schedule, &now_minute) == ESP_OK);
+    thermostat_set_schedule(&t, &schedule);
+    thermostat_set_clock(&t, 0, 0);
+
+    plant_t plant;
+    plant_init(&plant, 17.0);
+    day_result_t r = { .shortest_on_ms = UINT32_MAX, .shortest_off_ms = UINT32_MAX };
+    double sq_error = 0.0;
+    uint32_t settled = 0;
+    bool relay = false;
+    bool first = true;
+    uint32_t since = 0;
+    uint32_t next_update = 0;
+    bool pending = false;       // Webapp decision on its way to the relay
+    bool pending_on = false;
+    uint32_t pending_at = 0;
+    float last_setpoint = thermostat_setpoint(&t, 0);
+    uint32_t setpoint_changed = 0;
+
+    for (uint32_t now = 0; now < DAY_MS; now += SIM_STEP_MS) {
+        bool outage = loop->webapp && now >= OUTAGE_START_MS && now < OUTAGE_END_MS;
+        bool reading = now % READING_MS == 0;
+        if (reading) {
+            thermostat_set_reading(&t, plant_read(&plant), now);
+        }
+
+        if (!outage && (reading || now >= next_update)) {
+            uint32_t next_ms;
+            int64_t t0 = bench_now_ns();
+            bool want = thermostat_update(&t, relay, now, &next_ms);
+            if (cost != NULL) {
+                bench_series_add(cost, bench_now_ns() - t0);
+            }
+            next_update = now + next_ms;
+            if (!loop->webapp && want != relay) {
+                relay = want;
+                switch_times(&r, relay, now, &since, &first);
+            } else if (loop->webapp && want != (pending ? pending_on : relay)) {
+                pending = true;
+                pending_on = want;
+                pending_at = now + WEBAPP_DELAY_MS;
+            }
+        }
+        if (pending && now >= pending_at) {
+            pending = false;
+            if (pending_on != relay) {
+                relay = pending_on;
+                switch_times(&r, relay, now, &since, &first);
+            }
+        }
+
+        plant_step(&plant, relay, SIM_STEP_MS / 1000.0);
+
+        float setpoint = thermostat_setpoint(&t, now);
+        if (setpoint != last_setpoint) {
+            last_setpoint = setpoint;
+            setpoint_changed = now;
+        }
+        float error = (float)plant.room - setpoint;
+        if (reading && now - setpoint_changed >= HOUR_MS) {
+            sq_error += (double)error * error;
+            settled++;
+            r.overshoot = error > r.overshoot ? error : r.overshoot;
+        }
+        if (now >= OUTAGE_START_MS && now < OUTAGE_END_MS && fabsf(error) > r.outage_worst) {
+            r.outage_worst = fabsf(error);
+        }
+    }
+    r.rms = settled > 0 ? sqrt(sq_error / settled) : 0.0;
+    return r;
+}
+
+static void bench_day(void)
+{
+    const loop_t loops[] = {
+        { "webapp, hysteresis 0.3 °C", THERMOSTAT_HYSTERESIS, 0.3f, true, true },
+        { "device, hysteresis 0.3 °C", THERMOSTAT_HYSTERESIS, 0.3f, true, false },
+        { "device, PID", THERMOSTAT_PID, 0.3f, true, false },
+        { "device, hysteresis 0.05 °C", THERMOSTAT_HYSTERESIS, 0.05f, true, false },
+        { "  without min run / pause", THERMOSTAT_HYSTERESIS, 0.05f, false, false },
+    };
+    day_result_t r[sizeof(loops) / sizeof(loops[0])];
+    bench_series_t cost = bench_series_create("thermostat_update", 2 * DAY_MS / READING_MS);
+    for (size_t i = 0; i < sizeof(loops) / sizeof(loops[0]); i++) {
+        r[i] = run_day(&loops[i], i == 1 ? &cost : NULL);
+    }
+
+    // Minimum run and pause hold whatever the band; without them sensor
+    // noise in a narrow band starts the burner several times as often
+    for (size_t i = 0; i < sizeof(loops) / sizeof(loops[0]); i++) {
+        if (loops[i].protect) {
+            BENCH_CHECK(r[i].shortest_on_ms >= THERMOSTAT_MIN_ON_MS);
+            BENCH_CHECK(r[i].shortest_off_ms >= THERMOSTAT_MIN_OFF_MS);
+        }
+    }
+    BENCH_CHECK(r[4].starts > 2 * r[3].starts);
+    BENCH_CHECK(r[4].shortest_on_ms < THERMOSTAT_MIN_ON_MS);
+
+    // Local control rides through the webapp outage; the webapp loop leaves
+    // the burner as it was for two hours
+    BENCH_CHECK(r[1].outage_worst < 1.0f && r[2].outage_worst < 1.0f);
+    BENCH_CHECK(r[0].outage_worst > 2.0f);
+    BENCH_CHECK(r[1].rms < 0.5 && r[2].rms < 0.5);
+
+    printf("\nSimulated day: %s, 5 °C outside, radiator lag %.0f min, room %.0f h, readings every %u s\n",
+           SCHEDULE, RADIATOR_TAU_S / 60, ROOM_TAU_S / 3600, READING_MS / 1000);
+    printf("  webapp down 13:00-15:00; min run %u s, min pause %u s\n", THERMOSTAT_MIN_ON_MS / 1000,
+           THERMOSTAT_MIN_OFF_MS / 1000);
+    printf("  %-28s %9s %12s %8s %12s %12s %14s\n", "loop", "RMS °C", "overshoot °C", "starts/h",
+           "shortest on", "shortest off", "outage worst");
+    for (size_t i = 0; i < sizeof(loops) / sizeof(loops[0]); i++) {
+        printf("  %-28s %9.2f %12.2f %8.1f %10.0f s %10.0f s %11.2f °C\n", loops[i].name, r[i].rms,
+               r[i].overshoot, r[i].starts / 24.0, r[i].shortest_on_ms / 1e3, r[i].shortest_off_ms / 1e3,
+               r[i].outage_worst);
+    }
+
+    bench_report_header("Decision cost");
+    bench_report(&cost);
+    bench_series_free(&cost);
+}
+
+// ============================================
+// Schedule and override messages
+// ============================================
+
+static bool parse(const char *msg, thermostat_schedule_t *schedule, int *now_minute)
+{
+    return thermostat_parse_schedule(msg, strlen(msg), schedule, now_minute) == ESP_OK;
+}
+
+static void check_messages(int iterations)
+{
+    thermostat_schedule_t s;
+    int now_minute;
+    BENCH_CHECK(parse(" 22:00 = 17 , now=07:12, 06:30=21.5", &s, &now_minute));
+    BENCH_CHECK(now_minute == 7 * 60 + 12 && s.count == 2);
+    BENCH_CHECK(s.slots[0].minute == 390 && s.slots[0].setpoint == 21.5f && s.slots[1].minute == 1320);
+    BENCH_CHECK(parse("", &s, &now_minute) && s.count == 0 && now_minute == -1);
+
+    const char *rejected[] = {
+        "06:30=21,06:30=19", "6:30=21", "24:00=20", "06:60=20", "06:30=40", "06:30=abc", "06:30",
+        "now=25:00", "00:00=20,01:00=20,02:00=20,03:00=20,04:00=20,05:00=20,06:00=20,07:00=20,08:00=20",
+    };
+    for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+        BENCH_CHECK(!parse(rejected[i], &s, &now_minute));
+    }
+
+    // The last slot of the day runs past midnight until the first
+    thermostat_params_t params;
+    thermostat_params_defaults(&params);
+    thermostat_t t;
+    thermostat_init(&t, &params, false, 0);
+    BENCH_CHECK(thermostat_setpoint(&t, 0) == THERMOSTAT_DEFAULT_SETPOINT_C);
+    BENCH_CHECK(parse("now=23:59,06:30=21,22:00=17", &s, &now_minute));
+    thermostat_set_schedule(&t, &s);
+    BENCH_CHECK(thermostat_setpoint(&t, 0) == THERMOSTAT_DEFAULT_SETPOINT_C);
+    thermostat_set_clock(&t, (uint16_t)now_minute, 0);
+    BENCH_CHECK(thermostat_setpoint(&t, 0) == 17.0f);
+    BENCH_CHECK(thermostat_setpoint(&t, 6 * HOUR_MS + 30 * 60000) == 17.0f);
+    BENCH_CHECK(thermostat_setpoint(&t, 6 * HOUR_MS + 31 * 60000) == 21.0f);
+
+    // Overrides: a setpoint or ON / OFF for THERMOSTAT_OVERRIDE_MS, then auto
+    BENCH_CHECK(thermostat_override(&t, " 23.5 ", 6, 1000) == ESP_OK && t.mode == THERMOSTAT_HOLD);
+    BENCH_CHECK(thermostat_setpoint(&t, 1000 + THERMOSTAT_OVERRIDE_MS - 1) == 23.5f);
+    BENCH_CHECK(thermostat_setpoint(&t, 1000 + THERMOSTAT_OVERRIDE_MS) == 17.0f);
+    BENCH_CHECK(thermostat_override(&t, "on", 2, 0) == ESP_OK && t.mode == THERMOSTAT_FORCE_ON);
+    BENCH_CHECK(thermostat_override(&t, "sauna", 5, 0) == ESP_ERR_INVALID_ARG && t.mode == THERMOSTAT_FORCE_ON);
+    BENCH_CHECK(thermostat_override(&t, "50", 2, 0) == ESP_ERR_INVALID_ARG);
+    BENCH_CHECK(thermostat_override(&t, "manual", 6, 0) == ESP_OK && !thermostat_command(&t, true, 0));
+    BENCH_CHECK(thermostat_override(&t, "AUTO", 4, 0) == ESP_OK && thermostat_command(&t, false, 0));
+    BENCH_CHECK(t.mode == THERMOSTAT_FORCE_OFF);
+
+    // No reading: OFF at once, whatever the minimum run
+    thermostat_init(&t, &params, true, 0);
+    uint32_t next_ms;
+    BENCH_CHECK(!thermostat_update(&t, true, 1000, &next_ms) && t.failsafe);
+    thermostat_set_reading(&t, 15.0f, 2000);
+    BENCH_CHECK(!thermostat_update(&t, false, 2000, &next_ms) && next_ms <= THERMOSTAT_MIN_OFF_MS);
+    thermostat_set_reading(&t, 15.0f, 1000 + THERMOSTAT_MIN_OFF_MS);
+    BENCH_CHECK(thermostat_update(&t, false, 1000 + THERMOSTAT_MIN_OFF_MS, &next_ms) && !t.failsafe);
+    uint32_t stale = 1000 + THERMOSTAT_MIN_OFF_MS + THERMOSTAT_SENSOR_TIMEOUT_MS;
+    BENCH_CHECK(!thermostat_update(&t, true, stale, &next_ms) && t.failsafe);
+
+    char json[160];
+    BENCH_CHECK(thermostat_encode_json(&t, 0, json, sizeof(json)) > 0);
+    BENCH_CHECK(strcmp(json, "{\"mode\":\"auto\",\"setpoint\":20.00,\"temperature\":15.00,\"heating\":false,"
+                             "\"failsafe\":true}") == 0);
+    BENCH_CHECK(thermostat_encode_json(&t, 0, json, 32) == 0);
+
+    bench_series_t cost = bench_series_create("thermostat_parse_schedule (4 slots)", iterations);
+    const char *msg = "now=07:12,06:30=21,08:30=18,17:00=21,22:00=17";
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = bench_now_ns();
+        bool ok = parse(msg, &s, &now_minute);
+        bench_series_add(&cost, bench_now_ns() - t0);
+        BENCH_CHECK(ok && s.count == 4);
+    }
+    bench_report_header("Schedule message");
+    bench_report(&cost);
+    bench_series_free(&cost);
+}
+
+// ============================================
+// Device over MQTT
+// ============================================
+
+static int states;
+static char last_state[HOST_MQTT_PAYLOAD_MAX];
+static int last_state_retain;
+static atomic_int acks;
+static atomic_int switches;
+static atomic_llong switch_ns;  // Host clock: virtual time stands still while tasks run
+
+static void capture(const host_mqtt_msg_t *msg, void *ctx)
+{
+    (void)ctx;
+    if (strcmp(msg->topic, MQTT_TOPIC_THERMOSTAT_STATE) == 0) {
+        snprintf(last_state, sizeof(last_state), "%.*s", msg->len, msg->data);
+        last_state_retain = msg->retain;
+        states++;
+    } else if (strcmp(msg->topic, MQTT_TOPIC_ACK) == 0) {
+        atomic_fetch_add(&acks, 1);
+    }
+}
+
+static void capture_switch(uint32_t pins, void *ctx)
+{
+    (void)ctx;
+    if (pins & (1UL << RELAY_GPIO_PIN)) {
+        atomic_store(&switch_ns, bench_now_ns());
+        atomic_fetch_add(&switches, 1);
+    }
+}
+
+static bool burner_on(void)
+{
+    return host_gpio_get_pin(RELAY_GPIO_PIN).level == 0;    // Active-LOW
+}
+
+static void send(const char *topic, const char *msg)
+{
+    host_mqtt_inject_data(topic, msg, (int)strlen(msg));
+}
+
+typedef struct {
+    plant_t plant;
+    bool readings;              // The sensor is publishing
+    uint32_t elapsed_ms;
+    bool on;
+    uint32_t since_ms;
+    bool seen_switch;
+    uint32_t shortest_on_ms;
+    uint32_t shortest_off_ms;
+    uint32_t starts;
+    double sq_error;
+    uint32_t samples;
+} room_t;
+
+// Run the room for ms: a reading every READING_MS, the burner as the relay is
+static void run_room(room_t *room, uint32_t ms, float setpoint, bench_series_t *latency)
+{
+    char msg[16];
+    for (uint32_t end = room->elapsed_ms + ms; room->elapsed_ms < end; room->elapsed_ms += 1000) {
+        int switches_before = atomic_load(&switches);
+        int64_t t0 = bench_now_ns();
+        if (room->readings && room->elapsed_ms % READING_MS == 0) {
+            float reading = plant_read(&room->plant);
+            snprintf(msg, sizeof(msg), "%.2f", reading);
+            t0 = bench_now_ns();
+            send(MQTT_TOPIC_THERMOSTAT_SENSOR, msg);
+            if (setpoint > 0.0f) {
+                room->sq_error += ((double)reading - setpoint) * ((double)reading - setpoint);
+                room->samples++;
+            }
+        }
+        host_time_advance_us(1000000);
+        if (latency != NULL && atomic_load(&switches) != switches_before && room->readings
+            && room->elapsed_ms % READING_MS == 0) {
+            bench_series_add(latency, atomic_load(&switch_ns) - t0);
+        }
+
+        bool on = burner_on();
+        if (on != room->on) {
+            uint32_t length = room->elapsed_ms - room->since_ms;
+            uint32_t *shortest = on ? &room->shortest_off_ms : &room->shortest_on_ms;
+            if (room->seen_switch && length < *shortest) {
+                *shortest = length;
+            }
+            room->seen_switch = true;
+            room->starts += on;
+            room->on = on;
+            room->since_ms = room->elapsed_ms;
+        }
+        plant_step(&room->plant, on, 1.0);
+    }
+}
+
+static bool state_has(const char *field)
+{
+    return strstr(last_state, field) != NULL;
+}
+
+static void bench_device(void)
+{
+    host_time_set_virtual(true);
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+    host_mqtt_set_auto_connect(50000);
+
+    app_main();
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_MQTT, 30000));
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_THERMOSTAT_SENSOR));
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_THERMOSTAT_SCHEDULE));
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_THERMOSTAT_OVERRIDE));
+
+    // Nothing heard from the sensor yet: OFF
+    room_t room = { .shortest_on_ms = UINT32_MAX, .shortest_off_ms = UINT32_MAX };
+    plant_init(&room.plant, 17.0);
+    run_room(&room, 1000, 0.0f, NULL);
+    BENCH_CHECK(!burner_on());
+    BENCH_CHECK(states >= 1 && last_state_retain && state_has("\"failsafe\":true"));
+
+    // The schedule is kept in NVS only when it changes
+    host_nvs_reset_stats();
+    send(MQTT_TOPIC_THERMOSTAT_SCHEDULE, "now=07:00," SCHEDULE);
+    send(MQTT_TOPIC_THERMOSTAT_SCHEDULE, "now=07:00," SCHEDULE);
+    BENCH_CHECK(host_nvs_get_stats().commits == 1);
+
+    // Warm up to 21 °C, then four hours regulated
+    bench_series_t latency = bench_series_create("reading -> relay switched", 1000);
+    room.readings = true;
+    run_room(&room, 2 * HOUR_MS, 0.0f, &latency);
+    BENCH_CHECK(state_has("\"setpoint\":21.00"));
+    room.starts = 0;
+    int states_before = states;
+    int acks_before = atomic_load(&acks);
+    run_room(&room, 4 * HOUR_MS, 21.0f, &latency);
+    double rms = sqrt(room.sq_error / room.samples);
+    BENCH_CHECK(rms < 0.5);
+    BENCH_CHECK(room.starts >= 2);
+    BENCH_CHECK(room.shortest_on_ms >= THERMOSTAT_MIN_ON_MS && room.shortest_off_ms >= THERMOSTAT_MIN_OFF_MS);
+    // State goes out on changes, not with every reading
+    BENCH_CHECK(states - states_before <= (int)room.starts * 2 + 2);
+    BENCH_CHECK(latency.count >= 2);
+    // Switching on its own is not a command: no ACK
+    BENCH_CHECK(atomic_load(&acks) == acks_before);
+
+    // The sensor goes quiet: OFF within the timeout, whatever the minimum run
+    room.readings = false;
+    run_room(&room, THERMOSTAT_SENSOR_TIMEOUT_MS + 2000, 0.0f, NULL);
+    BENCH_CHECK(!burner_on() && state_has("\"failsafe\":true"));
+    room.readings = true;
+    run_room(&room, 20000, 0.0f, NULL);
+    BENCH_CHECK(state_has("\"failsafe\":false"));
+
+    // An override setpoint from the webapp holds, then the schedule is back
+    send(MQTT_TOPIC_THERMOSTAT_OVERRIDE, "23");
+    run_room(&room, 1000, 0.0f, NULL);
+    BENCH_CHECK(state_has("\"mode\":\"hold\"") && state_has("\"setpoint\":23.00"));
+    run_room(&room, THERMOSTAT_OVERRIDE_MS - 2000, 0.0f, NULL);
+    float held = (float)room.plant.room;
+    BENCH_CHECK(held > 22.0f);
+    run_room(&room, 2000, 0.0f, NULL);
+    BENCH_CHECK(state_has("\"mode\":\"auto\"") && state_has("\"setpoint\":21.00"));
+
+    // OFF from the webapp's command topic holds against a cold room
+    send(MQTT_TOPIC_COMMAND, "OFF");
+    room.plant.room = 18.0;
+    run_room(&room, 10 * 60000, 0.0f, NULL);
+    BENCH_CHECK(!burner_on() && state_has("\"mode\":\"OFF\""));
+    send(MQTT_TOPIC_THERMOSTAT_OVERRIDE, "auto");
+    run_room(&room, THERMOSTAT_MIN_OFF_MS + 20000, 0.0f, NULL);
+    BENCH_CHECK(burner_on());
+
+    // So do a batch naming channel 0 and channel 0's own topic
+    send(MQTT_TOPIC_CHANNELS_SET, "0=OFF");
+    room.plant.room = 18.0;
+    run_room(&room, 10 * 60000, 0.0f, NULL);
+    BENCH_CHECK(!burner_on() && state_has("\"mode\":\"OFF\""));
+    send(MQTT_TOPIC_CHANNEL_PREFIX "0/set", "ON");
+    room.plant.room = 26.0;
+    run_room(&room, 5 * 60000, 0.0f, NULL);
+    BENCH_CHECK(burner_on() && state_has("\"mode\":\"ON\""));
+    send(MQTT_TOPIC_THERMOSTAT_OVERRIDE, "auto");
+    run_room(&room, 20000, 0.0f, NULL);
+    BENCH_CHECK(!burner_on());
+
+    // And the webapp's state sync after a reconnect: held, not switched straight back
+    room.starts = 0;
+    room.shortest_on_ms = UINT32_MAX;
+    send(MQTT_TOPIC_STATE_RESPONSE, "ON");
+    run_room(&room, THERMOSTAT_MIN_ON_MS + 60000, 0.0f, NULL);
+    BENCH_CHECK(burner_on() && state_has("\"mode\":\"ON\"") && room.starts == 1);
+    send(MQTT_TOPIC_THERMOSTAT_OVERRIDE, "auto");
+    run_room(&room, 20000, 0.0f, NULL);
+    BENCH_CHECK(!burner_on() && room.shortest_on_ms >= THERMOSTAT_MIN_ON_MS);
+
+    // Manual: the thermostat stands aside and the relay follows the commands
+    send(MQTT_TOPIC_THERMOSTAT_OVERRIDE, "manual");
+    send(MQTT_TOPIC_COMMAND, "OFF");
+    run_room(&room, 5 * 60000, 0.0f, NULL);
+    BENCH_CHECK(!burner_on() && state_has("\"mode\":\"manual\""));
+    send(MQTT_TOPIC_COMMAND, "ON");
+    room.plant.room = 26.0;
+    run_room(&room, 5 * 60000, 0.0f, NULL);
+    BENCH_CHECK(burner_on());
+    send(MQTT_TOPIC_THERMOSTAT_OVERRIDE, "auto");
+    run_room(&room, 20000, 0.0f, NULL);
+    BENCH_CHECK(!burner_on());
+
+#ifdef THERMOSTAT_PID
+    printf("\nDevice (PID control, schedule %s from 07:00)\n", SCHEDULE);
+#else
+    printf("\nDevice (hysteresis control, schedule %s from 07:00)\n", SCHEDULE);
+#endif
+    printf("  4 h at 21 °C: RMS %.2f °C, %.1f starts/h, shortest run %.0f s, shortest pause %.0f s\n", rms,
+           room.starts / 4.0, room.shortest_on_ms / 1e3, room.shortest_off_ms / 1e3);
+    printf("  hold 23 °C for %u h: %.2f °C when it ended; OFF, auto and manual followed\n",
+           THERMOSTAT_OVERRIDE_MS / HOUR_MS, held);
+    printf("  reading -> relay through the webapp: 2 broker hops + processing, about %u ms\n",
+           WEBAPP_DELAY_MS);
+    bench_report_header("On the device (host clock)");
+    bench_report(&latency);
+    bench_series_free(&latency);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 100000);
+
+    host_log_set_sink(NULL);
+    host_mqtt_set_publish_hook(capture, NULL);
+    host_gpio_set_write_hook(capture_switch, NULL);
+
+    printf("Thermostat (%d iterations)\n", iterations);
+    bench_day();
+    check_messages(iterations);
+    bench_device();
+
+    return bench_exit_code();
+}
@@ -0,0 +1,148 @@
+// Latency probes (LATENCY_TRACE): per-stage histograms as published on the
+// diagnostics topic
+//
+// Relay: commands injected on a real clock, each stage timed from
+// MQTT_EVENT_DATA. Sensor: the publishing task on the simulated clock, each
+// stage timed from the AHT20 trigger.
+
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "latency_trace.h"
+#include "mqtt_manager.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+#include "bench.h"
+
+#ifdef DEVICE_TYPE_RELAY
+#include "device_relay.h"
+#else
+#include "boot_events.h"
+#include "driver/i2c.h"
+#endif
+
+typedef struct {
+    char stage[16];
+    unsigned long n, mean_us, p50_us, p99_us, max_us;
+} stage_report_t;
+
+static stage_report_t reports[LATENCY_STAGE_COUNT];
+static int report_count;
+static SemaphoreHandle_t ack_sem;
+
+static void capture(const host_mqtt_msg_t *msg, void *ctx)
+{
+#ifdef DEVICE_TYPE_RELAY
+    if (strcmp(msg->topic, MQTT_TOPIC_ACK) == 0) {
+        xSemaphoreGive(ack_sem);
+        return;
+    }
+#endif
+    if (strcmp(msg->topic, MQTT_TOPIC_DIAG_LATENCY) != 0 || report_count >= LATENCY_STAGE_COUNT) {
+        return;
+    }
+    stage_report_t *r = &reports[report_count];
+    if (sscanf(msg->data, "{\"stage\":\"%15[^\"]\",\"n\":%lu,\"mean_us\":%lu,\"p50_us\":%lu,\"p99_us\":%lu,\"max_us\":%lu",
+               r->stage, &r->n, &r->mean_us, &r->p50_us, &r->p99_us, &r->max_us) == 6) {
+        report_count++;
+    }
+}
+
+// Ask for the report the way the webapp would
+static void request_report(const char *payload)
+{
+    report_count = 0;
+    host_mqtt_inject_data(MQTT_TOPIC_DIAG_REQUEST, payload, -1);
+    BENCH_CHECK(report_count == LATENCY_STAGE_COUNT);
+}
+
+static void print_reports(const char *title)
+{
+    printf("\n%s\n  %-12s %8s %10s %10s %10s %10s\n", title, "stage", "n", "mean us", "p50 us", "p99 us", "max us");
+    for (int i = 0; i < report_count; i++) {
+        printf("  %-12s %8lu %10lu %10lu %10lu %10lu\n", reports[i].stage, reports[i].n, reports[i].mean_us,
+               reports[i].p50_us, reports[i].p99_us, reports[i].max_us);
+    }
+}
+
+// Every stage saw every sample, and each comes after the one before it
+static void check_reports(unsigned long expected_n)
+{
+    for (int i = 0; i < report_count; i++) {
+        BENCH_CHECK(reports[i].n >= expected_n);
+        BENCH_CHECK(reports[i].p50_us <= reports[i].p99_us && reports[i].p99_us <= reports[i].max_us);
+        BENCH_CHECK(i == 0 || reports[i].mean_us >= reports[i - 1].mean_us);
+    }
+}
+
+#ifdef DEVICE_TYPE_RELAY
+static void run(int iterations)
+{
+    BENCH_CHECK(relay_init() == ESP_OK);
+    BENCH_CHECK(esp_event_loop_create_default() == ESP_OK);
+    BENCH_CHECK(mqtt_client_init() == ESP_OK);
+    host_mqtt_inject_connected();
+    BENCH_CHECK(host_mqtt_is_subscribed(MQTT_TOPIC_DIAG_REQUEST));
+
+    for (int i = 0; i < iterations; i++) {
+        host_mqtt_inject_data(MQTT_TOPIC_COMMAND, (i & 1) ? "ON" : "OFF", -1);
+        BENCH_CHECK(xSemaphoreTake(ack_sem, pdMS_TO_TICKS(1000)) == pdTRUE);
+    }
+    // The ACK stage is recorded once the publish returns, just after the hook
+    // above saw it; let the actuator task finish the last one
+    for (int wait = 0; wait < 100 && latency_trace_get(LATENCY_CMD_ACK).count < (uint32_t)iterations; wait++) {
+        vTaskDelay(1);
+    }
+
+    request_report("reset");
+    print_reports("Command path, from MQTT_EVENT_DATA (real clock)");
+    for (int i = 0; i < report_count; i++) {
+        BENCH_CHECK(reports[i].n == (unsigned long)iterations);
+    }
+    check_reports((unsigned long)iterations);
+
+    // "reset" cleared the histograms after reporting them
+    request_report("latency");
+    for (int i = 0; i < report_count; i++) {
+        BENCH_CHECK(reports[i].n == 0);
+    }
+}
+#else
+void app_main(void);
+
+static void run(int iterations)
+{
+    host_time_set_virtual(true);
+    BENCH_CHECK(nvs_flash_init() == ESP_OK);
+    BENCH_CHECK(host_aht20_attach(I2C_NUM_0, 0x38) == ESP_OK);
+    BENCH_CHECK(host_partition_create(STORE_FORWARD_PARTITION, 64 * 1024) == ESP_OK);
+    host_mqtt_set_auto_connect(50000);
+
+    app_main();
+    BENCH_CHECK(boot_events_wait(BOOT_EVENT_FIRST_PUBLISH, 30000));
+    host_time_advance_us((int64_t)iterations * TEMP_PUBLISH_INTERVAL_MS * 1000);
+
+    request_report("latency");
+    print_reports("Sensor path, from the AHT20 trigger (simulated clock)");
+    check_reports((unsigned long)iterations);
+    // The conversion itself dominates: the sensor needs tens of ms
+    BENCH_CHECK(report_count > 0 && reports[0].mean_us >= 40000);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_parse_iterations(argc, argv, 5000);
+
+    host_log_set_sink(NULL);
+    ack_sem = xSemaphoreCreateBinary();
+    host_mqtt_set_publish_hook(capture, NULL);
+
+    printf("Latency trace (%s, %d iterations, %d stages)\n", DEVICE_TYPE_STR, iterations, LATENCY_STAGE_COUNT);
+    run(iterations);
+
+    return bench_exit_code();
+}
@@ -0,0 +1,81 @@
+// Payload bridge: binary device payloads in, webapp text out
+//
+// Reads "<topic> <hex payload>" lines, as printed by
+//   mosquitto_sub -t 'branko/#' -F '%t %x'
+// and writes "<topic> <text payload>" lines for republishing to the webapp.
+// Payloads that are not schema messages pass through: printable text as is,
+// anything else (heartbeats) as hex prefixed with "hex:".
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "payload_bridge.h"
+
+#define LINE_MAX_LEN 4096
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static size_t parse_hex(const char *hex, uint8_t *out, size_t out_len)
+{
+    size_t n = 0;
+    while (hex[0] != '\0' && hex[1] != '\0' && n < out_len) {
+        int hi = hex_nibble(hex[0]), lo = hex_nibble(hex[1]);
+        if (hi < 0 || lo < 0) {
+            break;
+        }
+        out[n++] = (uint8_t)(hi << 4 | lo);
+        hex += 2;
+    }
+    return n;
+}
+
+static bool printable(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (!isprint(data[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    static char line[LINE_MAX_LEN];
+    static uint8_t payload[LINE_MAX_LEN / 2];
+    static char text[LINE_MAX_LEN * 2];
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *space = strchr(line, ' ');
+        if (space == NULL) {
+            continue;
+        }
+        *space = '\0';
+        const char *hex = space + 1;
+
+        size_t len = parse_hex(hex, payload, sizeof(payload));
+        if (payload_bridge_to_text(payload, len, text, sizeof(text)) > 0) {
+            printf("%s %s\n", line, text);
+        } else if (printable(payload, len)) {
+            printf("%s %.*s\n", line, (int)len, (const char *)payload);
+        } else {
+            printf("%s hex:%s\n", line, hex);
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
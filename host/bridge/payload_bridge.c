@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include "payload.h"
+#include "payload_bridge.h"
+
+#define BRIDGE_MAX_BATCH 256
+
+static size_t finish(int n, size_t out_len)
+{
+    return n < 0 || (size_t)n >= out_len ? 0 : (size_t)n;
+}
+
+static void format_boot_ms(char *buf, size_t len, int32_t ms)
+{
+    if (ms < 0) {
+        snprintf(buf, len, "null");
+    } else {
+        snprintf(buf, len, "%ld", (long)ms);
+    }
+}
+
+// Same JSON as mqtt_publish_connection_status() and the LWT in text mode
+static size_t status_to_text(const payload_status_t *status, char *out, size_t out_len)
+{
+    if (!status->online) {
+        return finish(snprintf(out, out_len, "{\"status\":\"offline\"}"), out_len);
+    }
+
+    char wifi_ms[12], mqtt_ms[12], publish_ms[12];
+    format_boot_ms(wifi_ms, sizeof(wifi_ms), status->wifi_ms);
+    format_boot_ms(mqtt_ms, sizeof(mqtt_ms), status->mqtt_ms);
+    format_boot_ms(publish_ms, sizeof(publish_ms), status->first_publish_ms);
+    return finish(snprintf(out, out_len,
+                           "{\"status\":\"online\",\"device_type\":\"%s\",\"ip_address\":\"%u.%u.%u.%u\","
+                           "\"boot_ms\":{\"wifi\":%s,\"mqtt\":%s,\"first_publish\":%s}}",
+                           status->device_type == PAYLOAD_DEVICE_RELAY ? "relay" : "sensor",
+                           status->ip[0], status->ip[1], status->ip[2], status->ip[3],
+                           wifi_ms, mqtt_ms, publish_ms), out_len);
+}
+
+static size_t batch_to_text(const uint8_t *payload, size_t len, char *out, size_t out_len)
+{
+    static sensor_sample_t samples[BRIDGE_MAX_BATCH];
+    uint32_t now_ms;
+    uint16_t count;
+    if (payload_decode_batch(payload, len, &now_ms, samples, BRIDGE_MAX_BATCH, &count) != ESP_OK) {
+        return 0;
+    }
+
+    // The firmware's own JSON encoder, over the decoded samples
+    sample_ring_t ring;
+    sample_ring_init(&ring, samples, BRIDGE_MAX_BATCH);
+    ring.count = count;
+    uint16_t encoded;
+    size_t n = sample_ring_encode_json(&ring, now_ms, out, out_len, &encoded);
+    return encoded == count ? n : 0;
+}
+
+size_t payload_bridge_to_text(const uint8_t *payload, size_t len, char *out, size_t out_len)
+{
+    payload_type_t type;
+    if (payload_peek_type(payload, len, &type) != ESP_OK) {
+        return 0;
+    }
+
+    switch (type) {
+        case PAYLOAD_TEMPERATURE: {
+            float temperature, humidity;
+            if (payload_decode_temperature(payload, len, &temperature, &humidity) != ESP_OK) {
+                return 0;
+            }
+            return finish(snprintf(out, out_len, "%.2f", temperature), out_len);
+        }
+        case PAYLOAD_SAMPLE_BATCH:
+            return batch_to_text(payload, len, out, out_len);
+        case PAYLOAD_STATUS: {
+            payload_status_t status;
+            if (payload_decode_status(payload, len, &status) != ESP_OK) {
+                return 0;
+            }
+            return status_to_text(&status, out, out_len);
+        }
+        case PAYLOAD_RELAY_COMMAND:
+        case PAYLOAD_RELAY_ACK: {
+            bool on;
+            uint32_t seq;
+            if (payload_decode_relay(payload, len, type, &on, &seq) != ESP_OK) {
+                return 0;
+            }
+            const char *prefix = type == PAYLOAD_RELAY_ACK ? "ACK:" : "";
+            if (seq != 0) {
+                return finish(snprintf(out, out_len, "%s%s#%lu", prefix, on ? "ON" : "OFF", (unsigned long)seq),
+                              out_len);
+            }
+            return finish(snprintf(out, out_len, "%s%s", prefix, on ? "ON" : "OFF"), out_len);
+        }
+        default:
+            return 0;
+    }
+}
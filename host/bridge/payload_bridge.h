@@ -0,0 +1,19 @@
+#ifndef PAYLOAD_BRIDGE_H
+#define PAYLOAD_BRIDGE_H
+
+// Host-side translation of PAYLOAD_BINARY messages back to the text and JSON
+// payloads the webapp parses, so devices can switch formats before the webapp
+// does.
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Render a binary payload as the text the firmware would have sent
+ *
+ * @return Length written (excluding NUL), 0 if payload is not a schema
+ *         message or out is too small
+ */
+size_t payload_bridge_to_text(const uint8_t *payload, size_t len, char *out, size_t out_len);
+
+#endif // PAYLOAD_BRIDGE_H
@@ -0,0 +1,13 @@
+#ifndef CONFIG_SECRETS_H
+#define CONFIG_SECRETS_H
+
+// Placeholder credentials for the host build (nothing connects anywhere)
+
+#define WIFI_SSID "host-ssid"
+#define WIFI_PASS "host-password"
+
+#define MQTT_BROKER_URI "mqtt://127.0.0.1"
+#define MQTT_USERNAME ""
+#define MQTT_PASSWORD ""
+
+#endif // CONFIG_SECRETS_H
@@ -0,0 +1,14 @@
+#ifndef ESP_ATTR_H
+#define ESP_ATTR_H
+
+// Host stand-in for ESP-IDF esp_attr.h
+//
+// RTC_DATA_ATTR variables are gathered in one section, which the harness can
+// save and restore around a simulated deep sleep (host_rtc_save/load).
+
+#define RTC_DATA_ATTR   __attribute__((section("host_rtc_data")))
+#define RTC_NOINIT_ATTR RTC_DATA_ATTR
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#endif // ESP_ATTR_H
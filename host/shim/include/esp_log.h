@@ -0,0 +1,46 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+// Host stand-in for ESP-IDF esp_log.h
+//
+// Messages are always formatted (so benchmarks see the real formatting cost)
+// and then written to the sink selected with host_log_set_sink().
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+#endif
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+esp_log_level_t esp_log_level_get(const char *tag);
+uint32_t esp_log_timestamp(void);
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+void esp_log_writev(esp_log_level_t level, const char *tag, const char *format, va_list args);
+
+#define ESP_LOG_LEVEL(level, tag, letter, format, ...) do {                              \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                                 \
+            esp_log_write((level), (tag), letter " (%" PRIu32 ") %s: " format "\n",       \
+                          esp_log_timestamp(), (tag), ##__VA_ARGS__);                     \
+        }                                                                                 \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR,   tag, "E", format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN,    tag, "W", format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO,    tag, "I", format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG,   tag, "D", format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_VERBOSE, tag, "V", format, ##__VA_ARGS__)
+
+#endif // ESP_LOG_H
@@ -0,0 +1,10 @@
+#ifndef ESP_RANDOM_H
+#define ESP_RANDOM_H
+
+// Host stand-in for ESP-IDF esp_random.h (seedable through host_shim.h)
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
+
+#endif // ESP_RANDOM_H
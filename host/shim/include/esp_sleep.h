@@ -0,0 +1,24 @@
+#ifndef ESP_SLEEP_H
+#define ESP_SLEEP_H
+
+// Host stand-in for ESP-IDF esp_sleep.h (deep sleep only)
+//
+// Entering deep sleep hands over to the harness (host_sleep_set_handler),
+// which ends the simulated boot; the next one runs in a fresh process.
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_SLEEP_WAKEUP_UNDEFINED = 0,     // Power-on or reset, not a wake from sleep
+    ESP_SLEEP_WAKEUP_EXT0 = 2,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER,
+} esp_sleep_wakeup_cause_t;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void);
+void esp_deep_sleep_start(void) __attribute__((noreturn));
+void esp_deep_sleep(uint64_t time_in_us) __attribute__((noreturn));
+
+#endif // ESP_SLEEP_H
@@ -0,0 +1,11 @@
+#ifndef ESP_SYSTEM_H
+#define ESP_SYSTEM_H
+
+// Host stand-in for ESP-IDF esp_system.h (heap figures set through host_shim.h)
+
+#include <stdint.h>
+
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#endif // ESP_SYSTEM_H
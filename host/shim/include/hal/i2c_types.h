@@ -0,0 +1,12 @@
+#ifndef HAL_I2C_TYPES_H
+#define HAL_I2C_TYPES_H
+
+// Host stand-in for ESP-IDF hal/i2c_types.h (port numbers shared by both drivers)
+
+typedef int i2c_port_t;
+
+#define I2C_NUM_0   0
+#define I2C_NUM_1   1
+#define I2C_NUM_MAX 2
+
+#endif // HAL_I2C_TYPES_H
@@ -0,0 +1,466 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+// Control surface of the host stand-in layer. Firmware sources never include
+// this header; only the host benchmarks and tests do.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "esp_err.h"
+#include "esp_netif.h"
+#include "mqtt_client.h"
+
+// ============================================
+// Time
+// ============================================
+
+/**
+ * @brief Monotonic nanoseconds since process start (plus skipped virtual time)
+ */
+int64_t host_time_now_ns(void);
+
+/**
+ * @brief Make vTaskDelay() advance a virtual clock instead of sleeping
+ *
+ * Lets sensor code with fixed conversion delays run at full speed while the
+ * emulated devices still see the delay elapse. Timed semaphore and event group
+ * waits also skip ahead, firing due esp_timer callbacks on the way.
+ */
+void host_time_set_virtual(bool enabled);
+
+/**
+ * @brief Advance the virtual clock without sleeping, firing due esp_timers in order
+ */
+void host_time_advance_us(int64_t us);
+
+// ============================================
+// Tasks and heap
+// ============================================
+
+/**
+ * @brief Record stack use of a running task (only ever raises the mark)
+ *
+ * Host threads run on host-sized stacks that are not measured, so
+ * uxTaskGetStackHighWaterMark() reports the full stack_depth given to
+ * xTaskCreate() less whatever was recorded here.
+ *
+ * @return ESP_ERR_NOT_FOUND if no running task has that name
+ */
+esp_err_t host_task_set_stack_used(const char *name, uint32_t bytes);
+
+/**
+ * @brief Set what esp_get_free_heap_size() reports (default 180 KB)
+ *
+ * esp_get_minimum_free_heap_size() follows the lowest value ever set.
+ */
+void host_heap_set_free(uint32_t bytes);
+
+// ============================================
+// Logging
+// ============================================
+
+/**
+ * @brief Select where formatted log lines go (NULL = format, then discard)
+ */
+void host_log_set_sink(FILE *sink);
+
+// ============================================
+// GPIO
+// ============================================
+
+typedef struct {
+    int level;
+    bool configured;
+    uint32_t write_count;
+    int64_t last_write_ns;
+} host_gpio_pin_t;
+
+/**
+ * @brief Snapshot of one emulated pin
+ */
+host_gpio_pin_t host_gpio_get_pin(int gpio_num);
+
+/**
+ * @brief Writes to the GPIO output set/clear registers (REG_WRITE) since reset
+ *
+ * Pins switched together by one register write share one last_write_ns.
+ */
+uint32_t host_gpio_reg_write_count(void);
+
+typedef void (*host_gpio_write_hook_t)(uint32_t pins, void *ctx);
+
+/**
+ * @brief Called after each output register write with the pins it drove
+ *
+ * Runs on the writing task, outside the GPIO lock; NULL removes it.
+ */
+void host_gpio_set_write_hook(host_gpio_write_hook_t hook, void *ctx);
+
+void host_gpio_reset(void);
+
+// ============================================
+// I2C
+// ============================================
+
+typedef struct {
+    uint32_t transactions;      // i2c_master_cmd_begin(), transfer and probe calls
+    uint32_t nacks;             // transactions that hit no device
+    uint32_t timeouts;          // transactions that timed out on a stuck bus
+    uint32_t cmd_links_alloc;   // i2c_cmd_link_create() heap allocations
+    uint32_t allocations;       // all driver heap allocations (command links, bus and device handles)
+} host_i2c_stats_t;
+
+host_i2c_stats_t host_i2c_get_stats(void);
+void host_i2c_reset_stats(void);
+
+/**
+ * @brief Emulated I2C peripheral
+ *
+ * start() is called on every (repeated) START addressed to the device,
+ * write()/read() for the data phase, stop() on STOP.
+ */
+typedef struct {
+    void (*start)(void *ctx, bool read);
+    esp_err_t (*write)(void *ctx, const uint8_t *data, size_t len);
+    esp_err_t (*read)(void *ctx, uint8_t *data, size_t len);
+    void (*stop)(void *ctx);
+    void *ctx;
+} host_i2c_device_ops_t;
+
+esp_err_t host_i2c_attach(int port, uint8_t addr, const host_i2c_device_ops_t *ops);
+void host_i2c_detach_all(void);
+
+/**
+ * @brief Hold the bus low, as with missing pull-ups or a stuck device
+ *
+ * Every transaction on the port then runs into its timeout, which is spent on
+ * the clock (virtual time when enabled), and fails with ESP_ERR_TIMEOUT.
+ */
+void host_i2c_set_stuck(int port, bool stuck);
+
+// ============================================
+// AHT20 model
+// ============================================
+
+/**
+ * @brief Attach an emulated AHT20 (normally port 0, address 0x38)
+ *
+ * Each call adds a separate device, up to 4. The calls below without a port
+ * and address apply to every attached AHT20.
+ */
+esp_err_t host_aht20_attach(int port, uint8_t addr);
+
+/**
+ * @brief Reading returned once the queue of scripted samples is empty
+ */
+void host_aht20_set_reading(float temperature, float humidity);
+
+/**
+ * @brief Reading of the one AHT20 at port/addr
+ *
+ * @return ESP_ERR_NOT_FOUND if none is attached there
+ */
+esp_err_t host_aht20_set_reading_at(int port, uint8_t addr, float temperature, float humidity);
+
+/**
+ * @brief Queue a one-shot reading; queued readings are consumed per trigger
+ */
+void host_aht20_queue_reading(float temperature, float humidity);
+
+/**
+ * @brief Conversion time after a trigger (default 75 ms)
+ */
+void host_aht20_set_conversion_time_us(int64_t us);
+
+/**
+ * @brief Number of measurement triggers the devices have received
+ */
+uint32_t host_aht20_trigger_count(void);
+
+// ============================================
+// BMP280 model
+// ============================================
+
+/**
+ * @brief Attach an emulated BMP280 (address 0x76 or 0x77), up to 4
+ *
+ * Register map, forced-mode conversions and the datasheet's example
+ * trimming parameters; the raw values are chosen so that the datasheet
+ * compensation returns the set reading. Starts at 21.5 °C, 1013.25 hPa.
+ */
+esp_err_t host_bmp280_attach(int port, uint8_t addr);
+
+/**
+ * @brief Reading of the BMP280 at port/addr, latched at the next trigger
+ *
+ * @return ESP_ERR_NOT_FOUND if none is attached there
+ */
+esp_err_t host_bmp280_set_reading(int port, uint8_t addr, float temperature, float pressure_hpa);
+
+/**
+ * @brief Forced conversion time of every BMP280 (default 11.5 ms)
+ */
+void host_bmp280_set_conversion_time_us(int64_t us);
+
+/**
+ * @brief Number of forced conversions the devices have started
+ */
+uint32_t host_bmp280_trigger_count(void);
+
+// ============================================
+// Flash partitions
+// ============================================
+
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t sector_erases;
+    uint32_t max_sector_erases;  // Erases of the most-worn sector
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+} host_flash_stats_t;
+
+/**
+ * @brief Create a RAM-backed data partition (size a multiple of 4 KB)
+ *
+ * Contents start out as junk, not erased, like a freshly flashed device
+ * whose partition was never initialized.
+ */
+esp_err_t host_partition_create(const char *label, uint32_t size);
+
+host_flash_stats_t host_partition_stats(const char *label);
+
+// ============================================
+// NVS
+// ============================================
+
+typedef struct {
+    uint32_t reads;             // successful nvs_get_* calls
+    uint32_t writes;            // nvs_set_*/nvs_erase_* calls that changed flash
+    uint32_t unchanged_writes;  // nvs_set_* calls that matched the stored value (no flash write)
+    uint32_t commits;
+} host_nvs_stats_t;
+
+host_nvs_stats_t host_nvs_get_stats(void);
+void host_nvs_reset_stats(void);
+
+/**
+ * @brief Write every stored key to a stream / replace the store with one
+ *
+ * Lets a harness carry NVS across simulated reboots, e.g. from a forked
+ * child that ran the firmware back to its parent.
+ */
+esp_err_t host_nvs_save(FILE *out);
+esp_err_t host_nvs_load(FILE *in);
+
+// ============================================
+// Deep sleep
+// ============================================
+
+typedef void (*host_deep_sleep_handler_t)(uint64_t sleep_us, void *ctx);
+
+/**
+ * @brief Called from esp_deep_sleep_start(); must not return (e.g. _exit())
+ */
+void host_sleep_set_handler(host_deep_sleep_handler_t handler, void *ctx);
+
+/**
+ * @brief Write RTC_DATA_ATTR memory to a stream / restore it from one
+ *
+ * Loading also makes esp_sleep_get_wakeup_cause() report a timer wake, as
+ * RTC memory only survives deep sleep. Carried from boot to boot like NVS.
+ */
+esp_err_t host_rtc_save(FILE *out);
+esp_err_t host_rtc_load(FILE *in);
+
+// ============================================
+// WiFi
+// ============================================
+
+/**
+ * @brief The access point the emulated station joins
+ *
+ * A scan costs scan_channel_us per channel probed; joining then takes
+ * assoc_us, and a DHCP lease another dhcp_us unless the station runs with a
+ * static address.
+ */
+typedef struct {
+    const char *ssid;           // NULL matches any SSID
+    uint8_t bssid[6];
+    uint8_t channel;            // 1..13
+    int8_t rssi;
+    bool available;             // false: switched off or out of range
+    int64_t scan_channel_us;    // Active scan dwell per channel
+    int64_t assoc_us;           // Authentication, association and 4-way handshake
+    int64_t dhcp_us;            // DHCP DISCOVER to ACK
+    esp_netif_ip_info_t lease;  // Address the DHCP server hands out
+    uint32_t dns;               // DNS server in the lease
+} host_wifi_ap_t;
+
+typedef struct {
+    uint32_t connects;          // esp_wifi_connect() attempts
+    uint32_t channels_scanned;
+    uint32_t dhcp_leases;
+    uint32_t static_joins;      // joins that skipped DHCP with a static address
+} host_wifi_stats_t;
+
+host_wifi_ap_t host_wifi_get_ap(void);
+
+/**
+ * @brief Reconfigure the AP; making it unavailable drops a joined station
+ */
+void host_wifi_set_ap(const host_wifi_ap_t *ap);
+
+/**
+ * @brief Lose the link as on a beacon timeout
+ */
+void host_wifi_drop_link(void);
+
+/**
+ * @brief Renew the lease in place, as lwIP does at T1, to the AP's current
+ *        lease (which may be another address); no-op unless on DHCP and joined
+ */
+void host_wifi_renew_lease(void);
+
+host_wifi_stats_t host_wifi_get_stats(void);
+
+// ============================================
+// Random
+// ============================================
+
+void host_random_seed(uint32_t seed);
+
+// ============================================
+// MQTT
+// ============================================
+
+#define HOST_MQTT_TOPIC_MAX   128
+#define HOST_MQTT_PAYLOAD_MAX 512
+
+typedef struct {
+    char topic[HOST_MQTT_TOPIC_MAX];
+    char data[HOST_MQTT_PAYLOAD_MAX];
+    int len;
+    int qos;
+    int retain;
+    int msg_id;
+    int64_t timestamp_ns;
+} host_mqtt_msg_t;
+
+typedef void (*host_mqtt_publish_hook_t)(const host_mqtt_msg_t *msg, void *ctx);
+
+/**
+ * @brief Called synchronously from esp_mqtt_client_publish()/enqueue()
+ */
+void host_mqtt_set_publish_hook(host_mqtt_publish_hook_t hook, void *ctx);
+
+/**
+ * @brief Time esp_mqtt_client_publish() blocks on a connected client
+ *
+ * Models a slow link or broker: the wait is real time, taken while holding
+ * the client's API lock as esp-mqtt does for the socket write.
+ * esp_mqtt_client_enqueue() does not wait.
+ */
+void host_mqtt_set_publish_delay(int64_t delay_us);
+
+/**
+ * @brief Number of publishes since the last host_mqtt_reset()
+ */
+uint32_t host_mqtt_publish_count(void);
+
+/**
+ * @brief Most recent publish (NULL if none)
+ */
+const host_mqtt_msg_t *host_mqtt_last_publish(void);
+
+bool host_mqtt_is_subscribed(const char *topic);
+void host_mqtt_reset(void);
+
+/**
+ * @brief Deliver MQTT_EVENT_CONNECTED / MQTT_EVENT_DISCONNECTED to the client
+ */
+void host_mqtt_inject_connected(void);
+void host_mqtt_inject_disconnected(void);
+
+/**
+ * @brief Connect automatically connect_us after esp_mqtt_client_start() or
+ *        esp_mqtt_client_reconnect()
+ *
+ * Models the TCP handshake and CONNECT/CONNACK round trip. The attempt fails
+ * (MQTT_EVENT_ERROR, then MQTT_EVENT_DISCONNECTED) while the broker is down
+ * or the station has no address. A negative value (the default) leaves
+ * connecting to host_mqtt_inject_connected().
+ */
+void host_mqtt_set_auto_connect(int64_t connect_us);
+
+/**
+ * @brief Take the broker down (dropping a connected client) or bring it back
+ */
+void host_mqtt_set_broker_available(bool available);
+
+/**
+ * @brief Connection attempts made by the client since boot
+ */
+uint32_t host_mqtt_connect_attempts(void);
+
+/**
+ * @brief Deliver one MQTT_EVENT_DATA in a single event
+ *
+ * Topic and payload are laid out back to back in the receive buffer without
+ * terminators, the same way esp-mqtt hands them to the handler.
+ */
+void host_mqtt_inject_data(const char *topic, const char *data, int len);
+
+/**
+ * @brief Deliver MQTT_EVENT_DATA split into chunk-sized events
+ *
+ * Only the first event carries the topic, as with esp-mqtt when a payload
+ * exceeds the client buffer.
+ */
+void host_mqtt_inject_data_fragmented(const char *topic, const char *data, int len, int chunk);
+
+/**
+ * @brief Deliver MQTT_EVENT_DATA flagged DUP, as the broker resends a QoS 1
+ *        message it has no PUBACK for
+ */
+void host_mqtt_inject_redelivery(const char *topic, const char *data, int len);
+
+// ============================================
+// ESP-NOW
+// ============================================
+
+typedef void (*host_espnow_hook_t)(const uint8_t *mac, const uint8_t *data, size_t len, void *ctx);
+
+/**
+ * @brief Called synchronously from esp_now_send() with each frame
+ */
+void host_espnow_set_hook(host_espnow_hook_t hook, void *ctx);
+
+/**
+ * @brief Whether the peer acknowledges frames (default true)
+ *
+ * esp_now_send() still succeeds while unreachable; the send callback
+ * reports ESP_NOW_SEND_FAIL, as for a peer out of range.
+ */
+void host_espnow_set_reachable(bool reachable);
+
+/**
+ * @brief Deliver a frame from mac to the receive callback, on the calling thread
+ */
+esp_err_t host_espnow_inject(const uint8_t *mac, const uint8_t *data, size_t len);
+
+/**
+ * @brief Carry frames over UDP on 127.0.0.1 as well: sent to peer_port,
+ *        received on port as from the added peer
+ *
+ * Frames arriving on port are delivered from a thread of the shim, so two
+ * processes (or a harness socket) can play the two devices.
+ *
+ * @param port Local port, 0 for any free one
+ * @param bound Set to the local port
+ */
+esp_err_t host_espnow_bind_udp(uint16_t port, uint16_t peer_port, uint16_t *bound);
+
+#endif // HOST_SHIM_H
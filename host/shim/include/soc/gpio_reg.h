@@ -0,0 +1,15 @@
+#ifndef SOC_GPIO_REG_H
+#define SOC_GPIO_REG_H
+
+// Host stand-in for ESP-IDF soc/gpio_reg.h (ESP32): output registers for
+// GPIO 0-31. Writing a mask to W1TS drives those pins HIGH and to W1TC LOW,
+// leaving every other pin as it was.
+
+#include "soc/soc.h"
+
+#define DR_REG_GPIO_BASE   0x3ff44000
+#define GPIO_OUT_REG       (DR_REG_GPIO_BASE + 0x0004)
+#define GPIO_OUT_W1TS_REG  (DR_REG_GPIO_BASE + 0x0008)
+#define GPIO_OUT_W1TC_REG  (DR_REG_GPIO_BASE + 0x000c)
+
+#endif // SOC_GPIO_REG_H
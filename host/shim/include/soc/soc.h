@@ -0,0 +1,15 @@
+#ifndef SOC_SOC_H
+#define SOC_SOC_H
+
+// Host stand-in for ESP-IDF soc/soc.h. Register accesses go to the peripheral
+// models in the shim (only the GPIO output registers are modelled).
+
+#include <stdint.h>
+
+void host_reg_write(uint32_t reg, uint32_t value);
+uint32_t host_reg_read(uint32_t reg);
+
+#define REG_WRITE(_r, _v) host_reg_write((uint32_t)(_r), (uint32_t)(_v))
+#define REG_READ(_r)      host_reg_read((uint32_t)(_r))
+
+#endif // SOC_SOC_H
@@ -0,0 +1,211 @@
+// Host stand-in for esp_err, esp_log, esp_random and the esp_system heap figures
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "nvs_flash.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "host_shim.h"
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:                        return "ESP_OK";
+        case ESP_FAIL:                      return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:         return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:          return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:             return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:         return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:               return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:      return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:           return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION:       return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NOT_FINISHED:          return "ESP_ERR_NOT_FINISHED";
+        case ESP_ERR_NVS_NOT_INITIALIZED:   return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND:         return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_TYPE_MISMATCH:     return "ESP_ERR_NVS_TYPE_MISMATCH";
+        case ESP_ERR_NVS_READ_ONLY:         return "ESP_ERR_NVS_READ_ONLY";
+        case ESP_ERR_NVS_NOT_ENOUGH_SPACE:  return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+        case ESP_ERR_NVS_INVALID_HANDLE:    return "ESP_ERR_NVS_INVALID_HANDLE";
+        case ESP_ERR_NVS_INVALID_LENGTH:    return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_NVS_NO_FREE_PAGES:     return "ESP_ERR_NVS_NO_FREE_PAGES";
+        case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+        case ESP_ERR_WIFI_NOT_INIT:         return "ESP_ERR_WIFI_NOT_INIT";
+        case ESP_ERR_WIFI_NOT_STARTED:      return "ESP_ERR_WIFI_NOT_STARTED";
+        case ESP_ERR_WIFI_CONN:             return "ESP_ERR_WIFI_CONN";
+        case ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED: return "ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED";
+        case ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED: return "ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED";
+        case ESP_ERR_ESP_NETIF_DHCP_NOT_STOPPED:     return "ESP_ERR_ESP_NETIF_DHCP_NOT_STOPPED";
+        default:                            return "UNKNOWN ERROR";
+    }
+}
+
+// ============================================
+// Logging
+// ============================================
+
+#define LOG_TAG_LEVELS_MAX 32
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *log_sink;
+static bool log_sink_set;
+static esp_log_level_t log_default_level = ESP_LOG_INFO;
+static struct {
+    char tag[24];
+    esp_log_level_t level;
+} log_tag_levels[LOG_TAG_LEVELS_MAX];
+static int log_tag_level_count;
+
+void host_log_set_sink(FILE *sink)
+{
+    pthread_mutex_lock(&log_lock);
+    log_sink = sink;
+    log_sink_set = true;
+    pthread_mutex_unlock(&log_lock);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    pthread_mutex_lock(&log_lock);
+    if (strcmp(tag, "*") == 0) {
+        log_default_level = level;
+        log_tag_level_count = 0;
+    } else {
+        int i;
+        for (i = 0; i < log_tag_level_count; i++) {
+            if (strcmp(log_tag_levels[i].tag, tag) == 0) {
+                break;
+            }
+        }
+        if (i < LOG_TAG_LEVELS_MAX) {
+            snprintf(log_tag_levels[i].tag, sizeof(log_tag_levels[i].tag), "%s", tag);
+            log_tag_levels[i].level = level;
+            if (i == log_tag_level_count) {
+                log_tag_level_count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&log_lock);
+}
+
+static esp_log_level_t level_for_tag_locked(const char *tag)
+{
+    for (int i = 0; i < log_tag_level_count; i++) {
+        if (strcmp(log_tag_levels[i].tag, tag) == 0) {
+            return log_tag_levels[i].level;
+        }
+    }
+    return log_default_level;
+}
+
+esp_log_level_t esp_log_level_get(const char *tag)
+{
+    pthread_mutex_lock(&log_lock);
+    esp_log_level_t level = level_for_tag_locked(tag);
+    pthread_mutex_unlock(&log_lock);
+    return level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void esp_log_writev(esp_log_level_t level, const char *tag, const char *format, va_list args)
+{
+    char line[512];
+
+    pthread_mutex_lock(&log_lock);
+    if (level > level_for_tag_locked(tag)) {
+        pthread_mutex_unlock(&log_lock);
+        return;
+    }
+    FILE *sink = log_sink_set ? log_sink : stdout;
+    pthread_mutex_unlock(&log_lock);
+
+    // Format even without a sink so benchmarks pay the same cost as the UART path
+    int len = vsnprintf(line, sizeof(line), format, args);
+    if (sink != NULL && len > 0) {
+        fwrite(line, 1, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1, sink);
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    esp_log_writev(level, tag, format, args);
+    va_end(args);
+}
+
+// ============================================
+// Random
+// ============================================
+
+static pthread_mutex_t random_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t random_state = 0x12345678;
+
+void host_random_seed(uint32_t seed)
+{
+    pthread_mutex_lock(&random_lock);
+    random_state = seed ? seed : 1;
+    pthread_mutex_unlock(&random_lock);
+}
+
+uint32_t esp_random(void)
+{
+    // xorshift32: deterministic per seed so host runs are reproducible
+    pthread_mutex_lock(&random_lock);
+    uint32_t x = random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    random_state = x;
+    pthread_mutex_unlock(&random_lock);
+    return x;
+}
+
+// ============================================
+// Heap
+// ============================================
+
+// Not the host's malloc arena: a figure the harness sets, sized like an
+// ESP32 after WiFi and the MQTT client are up
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t heap_free = 180 * 1024;
+static uint32_t heap_min_free = 180 * 1024;
+
+void host_heap_set_free(uint32_t bytes)
+{
+    pthread_mutex_lock(&heap_lock);
+    heap_free = bytes;
+    if (bytes < heap_min_free) {
+        heap_min_free = bytes;
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    pthread_mutex_lock(&heap_lock);
+    uint32_t bytes = heap_free;
+    pthread_mutex_unlock(&heap_lock);
+    return bytes;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    pthread_mutex_lock(&heap_lock);
+    uint32_t bytes = heap_min_free;
+    pthread_mutex_unlock(&heap_lock);
+    return bytes;
+}
@@ -0,0 +1,180 @@
+// Host stand-in for ESP-NOW: one paired peer, frames handed to a harness
+// hook and optionally carried over UDP on 127.0.0.1 to another process.
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "esp_now.h"
+#include "host_shim.h"
+
+static bool initialized;
+static esp_now_recv_cb_t recv_cb;
+static esp_now_send_cb_t send_cb;
+static uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+static bool has_peer;
+static host_espnow_hook_t send_hook;
+static void *send_hook_ctx;
+static atomic_bool reachable = true;
+
+static int udp_socket = -1;
+static struct sockaddr_in udp_peer;
+static pthread_t udp_thread;
+
+esp_err_t esp_now_init(void)
+{
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void)
+{
+    initialized = false;
+    recv_cb = NULL;
+    send_cb = NULL;
+    has_peer = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    if (!initialized) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    if (!initialized) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    send_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    if (!initialized) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (has_peer) {
+        return ESP_ERR_ESPNOW_FULL;
+    }
+    memcpy(peer_addr, peer->peer_addr, ESP_NOW_ETH_ALEN);
+    has_peer = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *addr, const uint8_t *data, size_t len)
+{
+    if (!initialized) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (data == NULL || len == 0 || len > ESP_NOW_MAX_DATA_LEN) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (!has_peer || memcmp(addr, peer_addr, ESP_NOW_ETH_ALEN) != 0) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+
+    bool delivered = atomic_load(&reachable);
+    if (delivered && send_hook != NULL) {
+        send_hook(addr, data, len, send_hook_ctx);
+    }
+    if (delivered && udp_socket >= 0) {
+        delivered = sendto(udp_socket, data, len, 0, (struct sockaddr *)&udp_peer, sizeof(udp_peer)) == (ssize_t)len;
+    }
+    if (send_cb != NULL) {
+        const esp_now_send_info_t tx_info = {
+            .des_addr = peer_addr,
+            .ifidx = WIFI_IF_STA,
+            .data = (uint8_t *)data,
+            .data_len = (uint8_t)len,
+        };
+        send_cb(&tx_info, delivered ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL);
+    }
+    return ESP_OK;
+}
+
+void host_espnow_set_hook(host_espnow_hook_t hook, void *ctx)
+{
+    send_hook_ctx = ctx;
+    send_hook = hook;
+}
+
+void host_espnow_set_reachable(bool value)
+{
+    atomic_store(&reachable, value);
+}
+
+esp_err_t host_espnow_inject(const uint8_t *mac, const uint8_t *data, size_t len)
+{
+    if (recv_cb == NULL) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t des[ESP_NOW_ETH_ALEN] = {0};
+    memcpy(src, mac, ESP_NOW_ETH_ALEN);
+    esp_now_recv_info_t info = { .src_addr = src, .des_addr = des };
+    recv_cb(&info, data, (int)len);
+    return ESP_OK;
+}
+
+static void *udp_receive(void *arg)
+{
+    (void)arg;
+    uint8_t frame[ESP_NOW_MAX_DATA_LEN + 1];
+    for (;;) {
+        ssize_t n = recv(udp_socket, frame, sizeof(frame), 0);
+        if (n < 0) {
+            break;
+        }
+        // Larger than ESP-NOW could carry: the radio would never deliver it
+        if (n > 0 && n <= ESP_NOW_MAX_DATA_LEN && has_peer) {
+            host_espnow_inject(peer_addr, frame, (size_t)n);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t host_espnow_bind_udp(uint16_t port, uint16_t peer_port, uint16_t *bound)
+{
+    if (udp_socket >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_port = htons(port) };
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t local_len = sizeof(local);
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0
+        || getsockname(fd, (struct sockaddr *)&local, &local_len) != 0) {
+        close(fd);
+        return ESP_FAIL;
+    }
+    if (bound != NULL) {
+        *bound = ntohs(local.sin_port);
+    }
+    udp_peer = (struct sockaddr_in){ .sin_family = AF_INET, .sin_port = htons(peer_port) };
+    udp_peer.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    udp_socket = fd;
+
+    if (pthread_create(&udp_thread, NULL, udp_receive, NULL) != 0) {
+        close(fd);
+        udp_socket = -1;
+        return ESP_FAIL;
+    }
+    pthread_detach(udp_thread);
+    return ESP_OK;
+}
@@ -0,0 +1,142 @@
+// Host stand-in for the esp_event default loop
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_event.h"
+
+#define EVENT_MAX_HANDLERS 16
+#define EVENT_DATA_MAX     256
+
+typedef struct {
+    bool used;
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_entry_t;
+
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool loop_created;
+static event_handler_entry_t handlers[EVENT_MAX_HANDLERS];
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    pthread_mutex_lock(&event_lock);
+    esp_err_t ret = loop_created ? ESP_ERR_INVALID_STATE : ESP_OK;
+    loop_created = true;
+    pthread_mutex_unlock(&event_lock);
+    return ret;
+}
+
+esp_err_t esp_event_loop_delete_default(void)
+{
+    pthread_mutex_lock(&event_lock);
+    loop_created = false;
+    memset(handlers, 0, sizeof(handlers));
+    pthread_mutex_unlock(&event_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    if (event_handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&event_lock);
+    esp_err_t ret = loop_created ? ESP_ERR_NO_MEM : ESP_ERR_INVALID_STATE;
+    for (int i = 0; loop_created && i < EVENT_MAX_HANDLERS; i++) {
+        if (!handlers[i].used) {
+            handlers[i] = (event_handler_entry_t){
+                .used = true,
+                .base = event_base,
+                .id = event_id,
+                .handler = event_handler,
+                .arg = event_handler_arg,
+            };
+            if (instance != NULL) {
+                *instance = &handlers[i];
+            }
+            ret = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&event_lock);
+    return ret;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    return esp_event_handler_instance_register(event_base, event_id, event_handler, event_handler_arg, NULL);
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t event_base, int32_t event_id,
+                                                esp_event_handler_instance_t instance)
+{
+    (void)event_base;
+    (void)event_id;
+    if (instance == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&event_lock);
+    ((event_handler_entry_t *)instance)->used = false;
+    pthread_mutex_unlock(&event_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+                                       esp_event_handler_t event_handler)
+{
+    pthread_mutex_lock(&event_lock);
+    for (int i = 0; i < EVENT_MAX_HANDLERS; i++) {
+        if (handlers[i].used && handlers[i].base == event_base && handlers[i].id == event_id
+            && handlers[i].handler == event_handler) {
+            handlers[i].used = false;
+        }
+    }
+    pthread_mutex_unlock(&event_lock);
+    return ESP_OK;
+}
+
+static bool handler_matches(const event_handler_entry_t *entry, esp_event_base_t base, int32_t id)
+{
+    return entry->used
+        && (entry->base == ESP_EVENT_ANY_BASE || entry->base == base)
+        && (entry->id == ESP_EVENT_ANY_ID || entry->id == id);
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    if (event_data_size > EVENT_DATA_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t data[EVENT_DATA_MAX];
+    if (event_data != NULL) {
+        memcpy(data, event_data, event_data_size);
+    }
+
+    // Snapshot the matching handlers so they may register or post in turn
+    event_handler_entry_t matched[EVENT_MAX_HANDLERS];
+    int count = 0;
+    pthread_mutex_lock(&event_lock);
+    if (!loop_created) {
+        pthread_mutex_unlock(&event_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < EVENT_MAX_HANDLERS; i++) {
+        if (handler_matches(&handlers[i], event_base, event_id)) {
+            matched[count++] = handlers[i];
+        }
+    }
+    pthread_mutex_unlock(&event_lock);
+
+    for (int i = 0; i < count; i++) {
+        matched[i].handler(matched[i].arg, event_base, event_id, event_data != NULL ? data : NULL);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,180 @@
+// Host stand-in for esp_partition: RAM-backed partitions with NOR semantics
+// and per-sector wear accounting
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "host_shim.h"
+
+#define MAX_PARTITIONS 4
+
+typedef struct {
+    esp_partition_t part;
+    uint8_t *data;
+    uint32_t *sector_erases;
+    host_flash_stats_t stats;
+} host_partition_t;
+
+static pthread_mutex_t flash_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_partition_t partitions[MAX_PARTITIONS];
+static int partition_count;
+
+static host_partition_t *find_locked(const esp_partition_t *partition)
+{
+    for (int i = 0; i < partition_count; i++) {
+        if (&partitions[i].part == partition) {
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+static host_partition_t *find_by_label_locked(const char *label)
+{
+    for (int i = 0; i < partition_count; i++) {
+        if (strcmp(partitions[i].part.label, label) == 0) {
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t host_partition_create(const char *label, uint32_t size)
+{
+    if (label == NULL || size == 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&flash_lock);
+    esp_err_t ret = ESP_OK;
+    if (find_by_label_locked(label) != NULL) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (partition_count >= MAX_PARTITIONS) {
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        host_partition_t *p = &partitions[partition_count];
+        memset(p, 0, sizeof(*p));
+        p->data = malloc(size);
+        p->sector_erases = calloc(size / SPI_FLASH_SEC_SIZE, sizeof(uint32_t));
+        if (p->data == NULL || p->sector_erases == NULL) {
+            free(p->data);
+            free(p->sector_erases);
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            // Fresh flash is not guaranteed to be erased; start from junk
+            for (uint32_t i = 0; i < size; i++) {
+                p->data[i] = (uint8_t)(i * 131u + 7u);
+            }
+            p->part.type = ESP_PARTITION_TYPE_DATA;
+            p->part.subtype = ESP_PARTITION_SUBTYPE_ANY;
+            p->part.address = 0x110000 + (uint32_t)partition_count * 0x100000;
+            p->part.size = size;
+            p->part.erase_size = SPI_FLASH_SEC_SIZE;
+            snprintf(p->part.label, sizeof(p->part.label), "%s", label);
+            partition_count++;
+        }
+    }
+    pthread_mutex_unlock(&flash_lock);
+    return ret;
+}
+
+host_flash_stats_t host_partition_stats(const char *label)
+{
+    host_flash_stats_t stats = {0};
+    pthread_mutex_lock(&flash_lock);
+    host_partition_t *p = find_by_label_locked(label);
+    if (p != NULL) {
+        stats = p->stats;
+        stats.max_sector_erases = 0;
+        for (uint32_t i = 0; i < p->part.size / SPI_FLASH_SEC_SIZE; i++) {
+            if (p->sector_erases[i] > stats.max_sector_erases) {
+                stats.max_sector_erases = p->sector_erases[i];
+            }
+        }
+    }
+    pthread_mutex_unlock(&flash_lock);
+    return stats;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    (void)subtype;
+
+    pthread_mutex_lock(&flash_lock);
+    const esp_partition_t *found = NULL;
+    if (label != NULL) {
+        host_partition_t *p = find_by_label_locked(label);
+        found = p != NULL ? &p->part : NULL;
+    } else if (partition_count > 0) {
+        found = &partitions[0].part;
+    }
+    if (found != NULL && type != ESP_PARTITION_TYPE_ANY && found->type != type) {
+        found = NULL;
+    }
+    pthread_mutex_unlock(&flash_lock);
+    return found;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    pthread_mutex_lock(&flash_lock);
+    host_partition_t *p = find_locked(partition);
+    esp_err_t ret = ESP_OK;
+    if (p == NULL || dst == NULL) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else if (src_offset > p->part.size || size > p->part.size - src_offset) {
+        ret = ESP_ERR_INVALID_SIZE;
+    } else {
+        memcpy(dst, p->data + src_offset, size);
+        p->stats.reads++;
+        p->stats.bytes_read += size;
+    }
+    pthread_mutex_unlock(&flash_lock);
+    return ret;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    pthread_mutex_lock(&flash_lock);
+    host_partition_t *p = find_locked(partition);
+    esp_err_t ret = ESP_OK;
+    if (p == NULL || src == NULL) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else if (dst_offset > p->part.size || size > p->part.size - dst_offset) {
+        ret = ESP_ERR_INVALID_SIZE;
+    } else {
+        // NOR flash: programming can only clear bits
+        const uint8_t *bytes = src;
+        for (size_t i = 0; i < size; i++) {
+            p->data[dst_offset + i] &= bytes[i];
+        }
+        p->stats.writes++;
+        p->stats.bytes_written += size;
+    }
+    pthread_mutex_unlock(&flash_lock);
+    return ret;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    pthread_mutex_lock(&flash_lock);
+    host_partition_t *p = find_locked(partition);
+    esp_err_t ret = ESP_OK;
+    if (p == NULL) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else if (offset > p->part.size || size > p->part.size - offset) {
+        ret = ESP_ERR_INVALID_SIZE;
+    } else {
+        memset(p->data + offset, 0xFF, size);
+        for (size_t s = offset / SPI_FLASH_SEC_SIZE; s < (offset + size) / SPI_FLASH_SEC_SIZE; s++) {
+            p->sector_erases[s]++;
+            p->stats.sector_erases++;
+        }
+    }
+    pthread_mutex_unlock(&flash_lock);
+    return ret;
+}
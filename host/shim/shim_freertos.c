@@ -0,0 +1,660 @@
+// Host stand-in for FreeRTOS tasks, ticks and event groups
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "host_shim.h"
+#include "shim_internal.h"
+
+static int64_t boot_ns;
+static atomic_llong virtual_offset_ns;
+static atomic_llong virtual_base_ns;   // Real time at which the clock was frozen
+static atomic_bool virtual_time;
+
+static int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+__attribute__((constructor)) static void host_time_boot(void)
+{
+    boot_ns = monotonic_ns();
+}
+
+int64_t host_time_now_ns(void)
+{
+    int64_t base = atomic_load(&virtual_time) ? atomic_load(&virtual_base_ns) : monotonic_ns() - boot_ns;
+    return base + atomic_load(&virtual_offset_ns);
+}
+
+void host_time_set_virtual(bool enabled)
+{
+    if (enabled && !atomic_load(&virtual_time)) {
+        atomic_store(&virtual_base_ns, monotonic_ns() - boot_ns);
+    }
+    atomic_store(&virtual_time, enabled);
+    host_timer_wake();
+}
+
+bool host_time_is_virtual(void)
+{
+    return atomic_load(&virtual_time);
+}
+
+void host_time_skip_us(int64_t us)
+{
+    atomic_fetch_add(&virtual_offset_ns, us * 1000);
+}
+
+// ============================================
+// Virtual time scheduler
+// ============================================
+//
+// With virtual time on, every blocking call parks its task in host_sim_wait().
+// The clock only moves once all tasks (including the esp_timer service) are
+// parked and none of them can go on; it then jumps to the earliest deadline.
+// However slowly the host runs the tasks, they see the order of events the
+// target would.
+
+typedef struct sim_waiter {
+    bool (*ready)(void *ctx);
+    void *ctx;
+    int64_t deadline_us;
+    struct sim_waiter *next;
+} sim_waiter_t;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_cond = PTHREAD_COND_INITIALIZER;
+static sim_waiter_t *sim_waiters;
+static int sim_tasks = 1;   // The main thread, xTaskCreate() tasks and the timer service
+static int sim_parked;
+
+static bool never_ready(void *ctx)
+{
+    (void)ctx;
+    return false;
+}
+
+static int64_t deadline_after(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        return INT64_MAX;
+    }
+    return esp_timer_get_time() + (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+void host_sim_notify(void)
+{
+    if (!atomic_load(&virtual_time)) {
+        return;
+    }
+    pthread_mutex_lock(&sim_lock);
+    pthread_cond_broadcast(&sim_cond);
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void host_sim_task_count(int delta)
+{
+    pthread_mutex_lock(&sim_lock);
+    sim_tasks += delta;
+    pthread_cond_broadcast(&sim_cond);
+    pthread_mutex_unlock(&sim_lock);
+}
+
+// A waiter past its deadline still lets timers due by then fire first, unless
+// a callback is already running (it may be waiting on this very task)
+static bool sim_expired(const sim_waiter_t *w, int64_t now)
+{
+    return w->deadline_us <= now && (host_timer_next_expiry() > now || host_timer_dispatching());
+}
+
+// With sim_lock held: the earliest deadline if every task is parked and none
+// can go on yet, -1 otherwise
+static int64_t sim_idle_until_locked(int64_t now)
+{
+    if (sim_parked < sim_tasks) {
+        return -1;
+    }
+    int64_t next = INT64_MAX;
+    for (sim_waiter_t *w = sim_waiters; w != NULL; w = w->next) {
+        if (w->ready(w->ctx) || sim_expired(w, now)) {
+            return -1;
+        }
+        if (w->deadline_us < next) {
+            next = w->deadline_us;
+        }
+    }
+    return next;
+}
+
+void host_sim_wait(bool (*ready)(void *ctx), void *ctx, int64_t deadline_us)
+{
+    sim_waiter_t self = { .ready = ready, .ctx = ctx, .deadline_us = deadline_us };
+    pthread_mutex_lock(&sim_lock);
+    self.next = sim_waiters;
+    sim_waiters = &self;
+    sim_parked++;
+    pthread_cond_broadcast(&sim_cond);   // This task parking may leave the rest idle
+
+    for (;;) {
+        int64_t now = esp_timer_get_time();
+        if (ready(ctx) || sim_expired(&self, now)) {
+            break;
+        }
+        int64_t next = sim_idle_until_locked(now);
+        if (next > now && next != INT64_MAX) {
+            host_time_skip_us(next - now);
+            pthread_cond_broadcast(&sim_cond);
+        } else {
+            // Someone can run, or everything waits forever for a thread
+            // outside the tasks (a bench harness) to post an event
+            pthread_cond_wait(&sim_cond, &sim_lock);
+        }
+    }
+
+    for (sim_waiter_t **link = &sim_waiters; *link != NULL; link = &(*link)->next) {
+        if (*link == &self) {
+            *link = self.next;
+            break;
+        }
+    }
+    sim_parked--;
+    pthread_cond_broadcast(&sim_cond);
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void host_time_advance_us(int64_t us)
+{
+    if (!atomic_load(&virtual_time)) {
+        host_time_skip_us(us);
+        return;
+    }
+    host_sim_wait(never_ready, NULL, esp_timer_get_time() + us);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return host_time_now_ns() / 1000;
+}
+
+// Real-time deadline for pthread_cond_timedwait()
+static void deadline_after_ticks(struct timespec *ts, TickType_t ticks)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    int64_t ns = ts->tv_nsec + (int64_t)ticks * portTICK_PERIOD_MS * 1000000LL;
+    ts->tv_sec += ns / 1000000000LL;
+    ts->tv_nsec = ns % 1000000000LL;
+}
+
+// ============================================
+// Tasks
+// ============================================
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t code;
+    void *parameters;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_count;
+    char name[16];
+    uint32_t stack_depth;
+    uint32_t stack_used;        // Set by the harness; host threads are not measured
+    struct host_task *next;     // Running tasks, for xTaskGetHandle()
+};
+
+static __thread struct host_task *current_task;
+static pthread_mutex_t task_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct host_task *task_list;
+
+static void task_list_remove(struct host_task *task)
+{
+    pthread_mutex_lock(&task_list_lock);
+    for (struct host_task **link = &task_list; *link != NULL; link = &(*link)->next) {
+        if (*link == task) {
+            *link = task->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&task_list_lock);
+}
+
+static struct host_task *task_alloc(void)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    return task;
+}
+
+static void *task_trampoline(void *arg)
+{
+    struct host_task *task = arg;
+    current_task = task;
+    task->code(task->parameters);
+    task_list_remove(task);
+    host_sim_task_count(-1);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                                   void *parameters, UBaseType_t priority, TaskHandle_t *created_task,
+                                   BaseType_t core_id)
+{
+    (void)priority;
+    (void)core_id;
+
+    struct host_task *task = task_alloc();
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->code = task_code;
+    task->parameters = parameters;
+    task->stack_depth = stack_depth;
+    snprintf(task->name, sizeof(task->name), "%s", name != NULL ? name : "");
+
+    pthread_mutex_lock(&task_list_lock);
+    task->next = task_list;
+    task_list = task;
+    pthread_mutex_unlock(&task_list_lock);
+
+    host_sim_task_count(1);
+    if (pthread_create(&task->thread, NULL, task_trampoline, task) != 0) {
+        task_list_remove(task);
+        host_sim_task_count(-1);
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+#ifdef __linux__
+    if (name != NULL) {
+        char short_name[16];
+        snprintf(short_name, sizeof(short_name), "%s", name);
+        pthread_setname_np(task->thread, short_name);
+    }
+#endif
+
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                       void *parameters, UBaseType_t priority, TaskHandle_t *created_task)
+{
+    return xTaskCreatePinnedToCore(task_code, name, stack_depth, parameters, priority,
+                                   created_task, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL) {
+        if (current_task != NULL) {
+            task_list_remove(current_task);
+        }
+        host_sim_task_count(-1);
+        pthread_exit(NULL);
+    }
+    // Deleting another task is not supported on the host
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    int64_t ns = (int64_t)ticks * portTICK_PERIOD_MS * 1000000LL;
+    if (atomic_load(&virtual_time)) {
+        host_sim_wait(never_ready, NULL, esp_timer_get_time() + ns / 1000);
+        return;
+    }
+    struct timespec ts = { .tv_sec = ns / 1000000000LL, .tv_nsec = ns % 1000000000LL };
+    nanosleep(&ts, NULL);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake_time, TickType_t time_increment)
+{
+    TickType_t target = *previous_wake_time + time_increment;
+    TickType_t now = xTaskGetTickCount();
+    *previous_wake_time = target;
+
+    if ((int32_t)(target - now) <= 0) {
+        return pdFALSE;
+    }
+    vTaskDelay(target - now);
+    return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_time_now_ns() / (portTICK_PERIOD_MS * 1000000LL));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // Threads not started by xTaskCreate() (the main thread) get a handle on first use
+    if (current_task == NULL) {
+        current_task = task_alloc();
+    }
+    return current_task;
+}
+
+TaskHandle_t xTaskGetHandle(const char *name)
+{
+    pthread_mutex_lock(&task_list_lock);
+    struct host_task *task = task_list;
+    while (task != NULL && strcmp(task->name, name) != 0) {
+        task = task->next;
+    }
+    pthread_mutex_unlock(&task_list_lock);
+    return task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    if (task == NULL) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    pthread_mutex_lock(&task_list_lock);
+    UBaseType_t free_bytes = task->stack_used < task->stack_depth ? task->stack_depth - task->stack_used : 0;
+    pthread_mutex_unlock(&task_list_lock);
+    return free_bytes;
+}
+
+esp_err_t host_task_set_stack_used(const char *name, uint32_t bytes)
+{
+    pthread_mutex_lock(&task_list_lock);
+    struct host_task *task = task_list;
+    while (task != NULL && strcmp(task->name, name) != 0) {
+        task = task->next;
+    }
+    if (task != NULL && bytes > task->stack_used) {
+        task->stack_used = bytes;
+    }
+    pthread_mutex_unlock(&task_list_lock);
+    return task != NULL ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+// ============================================
+// Task notifications (counting semaphore use only)
+// ============================================
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify_count++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    host_sim_notify();
+    return pdPASS;
+}
+
+static bool notified(void *ctx)
+{
+    struct host_task *task = ctx;
+    pthread_mutex_lock(&task->lock);
+    bool ready = task->notify_count > 0;
+    pthread_mutex_unlock(&task->lock);
+    return ready;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    if (atomic_load(&virtual_time) && ticks_to_wait != 0) {
+        // Only this task takes its notifications, so no retry is needed
+        host_sim_wait(notified, task, deadline_after(ticks_to_wait));
+        ticks_to_wait = 0;
+    }
+
+    struct timespec deadline;
+    if (ticks_to_wait != portMAX_DELAY) {
+        deadline_after_ticks(&deadline, ticks_to_wait);
+    }
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_count == 0 && ticks_to_wait != 0) {
+        if (ticks_to_wait == portMAX_DELAY) {
+            pthread_cond_wait(&task->cond, &task->lock);
+        } else if (pthread_cond_timedwait(&task->cond, &task->lock, &deadline) != 0) {
+            break;
+        }
+    }
+    uint32_t count = task->notify_count;
+    if (count > 0) {
+        task->notify_count = clear_on_exit ? 0 : count - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return count;
+}
+
+// ============================================
+// Event groups
+// ============================================
+
+struct host_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct host_event_group *group = calloc(1, sizeof(*group));
+    if (group == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->cond, NULL);
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t result = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    host_sim_notify();
+    return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t result = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return result;
+}
+
+typedef struct {
+    EventGroupHandle_t group;
+    EventBits_t bits;
+    BaseType_t wait_for_all;
+} bits_wait_t;
+
+static bool bits_ready(void *ctx)
+{
+    bits_wait_t *wait = ctx;
+    EventBits_t set = xEventGroupGetBits(wait->group) & wait->bits;
+    return wait->wait_for_all ? (set == wait->bits) : (set != 0);
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks_to_wait)
+{
+    if (atomic_load(&virtual_time) && ticks_to_wait != 0) {
+        bits_wait_t wait = { .group = group, .bits = bits, .wait_for_all = wait_for_all };
+        host_sim_wait(bits_ready, &wait, deadline_after(ticks_to_wait));
+        ticks_to_wait = 0;
+    }
+
+    struct timespec deadline;
+    if (ticks_to_wait != portMAX_DELAY) {
+        deadline_after_ticks(&deadline, ticks_to_wait);
+    }
+
+    pthread_mutex_lock(&group->lock);
+    for (;;) {
+        EventBits_t set = group->bits & bits;
+        bool satisfied = wait_for_all ? (set == bits) : (set != 0);
+        if (satisfied || ticks_to_wait == 0) {
+            break;
+        }
+        if (ticks_to_wait == portMAX_DELAY) {
+            pthread_cond_wait(&group->cond, &group->lock);
+        } else if (pthread_cond_timedwait(&group->cond, &group->lock, &deadline) != 0) {
+            break;
+        }
+    }
+    EventBits_t result = group->bits;
+    bool satisfied = wait_for_all ? ((result & bits) == bits) : ((result & bits) != 0);
+    if (satisfied && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return result;
+}
+
+// ============================================
+// Semaphores
+// ============================================
+
+struct host_semaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max_count;
+};
+
+static SemaphoreHandle_t semaphore_create(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    struct host_semaphore *sem = calloc(1, sizeof(*sem));
+    if (sem == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->count = initial_count;
+    sem->max_count = max_count;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return semaphore_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return semaphore_create(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    return semaphore_create(max_count, initial_count);
+}
+
+static bool semaphore_ready(void *ctx)
+{
+    struct host_semaphore *sem = ctx;
+    pthread_mutex_lock(&sem->lock);
+    bool ready = sem->count > 0;
+    pthread_mutex_unlock(&sem->lock);
+    return ready;
+}
+
+// Another task may take the count between the wake-up and the take, so retry
+static BaseType_t semaphore_take_virtual(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+    int64_t deadline = deadline_after(ticks_to_wait);
+    for (;;) {
+        pthread_mutex_lock(&sem->lock);
+        bool taken = sem->count > 0;
+        if (taken) {
+            sem->count--;
+        }
+        pthread_mutex_unlock(&sem->lock);
+        if (taken) {
+            return pdTRUE;
+        }
+        if (ticks_to_wait == 0 || esp_timer_get_time() >= deadline) {
+            return pdFALSE;
+        }
+        host_sim_wait(semaphore_ready, sem, deadline);
+    }
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+    if (atomic_load(&virtual_time)) {
+        return semaphore_take_virtual(sem, ticks_to_wait);
+    }
+
+    struct timespec deadline;
+    if (ticks_to_wait != portMAX_DELAY) {
+        deadline_after_ticks(&deadline, ticks_to_wait);
+    }
+
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0) {
+        if (ticks_to_wait == 0) {
+            break;
+        }
+        if (ticks_to_wait == portMAX_DELAY) {
+            pthread_cond_wait(&sem->cond, &sem->lock);
+        } else if (pthread_cond_timedwait(&sem->cond, &sem->lock, &deadline) != 0) {
+            break;
+        }
+    }
+    BaseType_t taken = pdFALSE;
+    if (sem->count > 0) {
+        sem->count--;
+        taken = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    BaseType_t given = pdFALSE;
+    if (sem->count < sem->max_count) {
+        sem->count++;
+        given = pdTRUE;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    host_sim_notify();
+    return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
@@ -0,0 +1,132 @@
+// Host stand-in for driver/gpio
+
+#include <pthread.h>
+#include <string.h>
+#include "driver/gpio.h"
+#include "soc/gpio_reg.h"
+#include "host_shim.h"
+
+static pthread_mutex_t gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_gpio_pin_t pins[GPIO_NUM_MAX];
+static uint32_t reg_writes;
+static host_gpio_write_hook_t write_hook;
+static void *write_hook_ctx;
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    if (config == NULL || (config->pin_bit_mask >> GPIO_NUM_MAX) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&gpio_lock);
+    for (int i = 0; i < GPIO_NUM_MAX; i++) {
+        if (config->pin_bit_mask & (1ULL << i)) {
+            pins[i].configured = true;
+        }
+    }
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t now = host_time_now_ns();
+    pthread_mutex_lock(&gpio_lock);
+    pins[gpio_num].level = level ? 1 : 0;
+    pins[gpio_num].write_count++;
+    pins[gpio_num].last_write_ns = now;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&gpio_lock);
+    int level = pins[gpio_num].level;
+    pthread_mutex_unlock(&gpio_lock);
+    return level;
+}
+
+// GPIO 0-31 in the output registers; every other register reads as 0
+void host_reg_write(uint32_t reg, uint32_t value)
+{
+    if (reg != GPIO_OUT_REG && reg != GPIO_OUT_W1TS_REG && reg != GPIO_OUT_W1TC_REG) {
+        return;
+    }
+
+    int64_t now = host_time_now_ns();
+    pthread_mutex_lock(&gpio_lock);
+    for (int i = 0; i < 32; i++) {
+        bool selected = reg == GPIO_OUT_REG || (value & (1UL << i)) != 0;
+        if (!selected) {
+            continue;
+        }
+        pins[i].level = reg == GPIO_OUT_REG ? (int)((value >> i) & 1) : reg == GPIO_OUT_W1TS_REG;
+        pins[i].write_count++;
+        pins[i].last_write_ns = now;
+    }
+    reg_writes++;
+    host_gpio_write_hook_t hook = write_hook;
+    void *ctx = write_hook_ctx;
+    pthread_mutex_unlock(&gpio_lock);
+
+    if (hook != NULL) {
+        hook(reg == GPIO_OUT_REG ? UINT32_MAX : value, ctx);
+    }
+}
+
+uint32_t host_reg_read(uint32_t reg)
+{
+    uint32_t value = 0;
+    if (reg == GPIO_OUT_REG) {
+        pthread_mutex_lock(&gpio_lock);
+        for (int i = 0; i < 32; i++) {
+            value |= (uint32_t)pins[i].level << i;
+        }
+        pthread_mutex_unlock(&gpio_lock);
+    }
+    return value;
+}
+
+uint32_t host_gpio_reg_write_count(void)
+{
+    pthread_mutex_lock(&gpio_lock);
+    uint32_t count = reg_writes;
+    pthread_mutex_unlock(&gpio_lock);
+    return count;
+}
+
+host_gpio_pin_t host_gpio_get_pin(int gpio_num)
+{
+    host_gpio_pin_t pin = {0};
+    if (gpio_num >= 0 && gpio_num < GPIO_NUM_MAX) {
+        pthread_mutex_lock(&gpio_lock);
+        pin = pins[gpio_num];
+        pthread_mutex_unlock(&gpio_lock);
+    }
+    return pin;
+}
+
+void host_gpio_set_write_hook(host_gpio_write_hook_t hook, void *ctx)
+{
+    pthread_mutex_lock(&gpio_lock);
+    write_hook_ctx = ctx;
+    write_hook = hook;
+    pthread_mutex_unlock(&gpio_lock);
+}
+
+void host_gpio_reset(void)
+{
+    pthread_mutex_lock(&gpio_lock);
+    memset(pins, 0, sizeof(pins));
+    reg_writes = 0;
+    pthread_mutex_unlock(&gpio_lock);
+}
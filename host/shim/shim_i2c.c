@@ -0,0 +1,1020 @@
+// Host stand-in for the legacy driver/i2c command-link API and the
+// driver/i2c_master bus/device API, plus AHT20 and BMP280 models that answer
+// at the port and address they are attached to.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "driver/i2c.h"
+#include "driver/i2c_master.h"
+#include "esp_timer.h"
+#include "host_shim.h"
+#include "shim_internal.h"
+
+#define I2C_MAX_DEVICES  8
+#define I2C_CMD_MAX_OPS  16
+
+// Bus time at 100 kHz: 9 clocks per byte (8 bits + ACK), plus START/STOP
+#define I2C_US_PER_BYTE     90
+#define I2C_US_PER_FRAME    10
+
+typedef struct {
+    bool installed;
+    bool stuck;
+    struct {
+        uint8_t addr;
+        host_i2c_device_ops_t ops;
+    } devices[I2C_MAX_DEVICES];
+    int device_count;
+} i2c_bus_t;
+
+typedef enum {
+    I2C_OP_START,
+    I2C_OP_WRITE,
+    I2C_OP_READ,
+    I2C_OP_STOP,
+} i2c_op_kind_t;
+
+typedef struct {
+    i2c_op_kind_t kind;
+    uint8_t byte;           // I2C_OP_WRITE of a single byte
+    const uint8_t *wdata;   // I2C_OP_WRITE of a caller buffer (NULL = use byte)
+    uint8_t *rdata;         // I2C_OP_READ destination
+    size_t len;
+} i2c_op_t;
+
+typedef struct {
+    i2c_op_t ops[I2C_CMD_MAX_OPS];
+    int count;
+} i2c_cmd_link_t;
+
+static pthread_mutex_t i2c_lock = PTHREAD_MUTEX_INITIALIZER;
+static i2c_bus_t buses[I2C_NUM_MAX];
+static host_i2c_stats_t stats;
+
+// Attached instances of the device models at the end of this file
+static int aht20_count;
+static int bmp280_count;
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    if (i2c_num < 0 || i2c_num >= I2C_NUM_MAX || i2c_conf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len,
+                             size_t slv_tx_buf_len, int intr_alloc_flags)
+{
+    (void)mode;
+    (void)slv_rx_buf_len;
+    (void)slv_tx_buf_len;
+    (void)intr_alloc_flags;
+
+    if (i2c_num < 0 || i2c_num >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&i2c_lock);
+    esp_err_t ret = buses[i2c_num].installed ? ESP_FAIL : ESP_OK;
+    buses[i2c_num].installed = true;
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t i2c_num)
+{
+    if (i2c_num < 0 || i2c_num >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&i2c_lock);
+    buses[i2c_num].installed = false;
+    pthread_mutex_unlock(&i2c_lock);
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    i2c_cmd_link_t *link = calloc(1, sizeof(*link));
+    if (link != NULL) {
+        pthread_mutex_lock(&i2c_lock);
+        stats.cmd_links_alloc++;
+        stats.allocations++;
+        pthread_mutex_unlock(&i2c_lock);
+    }
+    return link;
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    free(cmd_handle);
+}
+
+static esp_err_t cmd_append(i2c_cmd_handle_t cmd_handle, i2c_op_t op)
+{
+    i2c_cmd_link_t *link = cmd_handle;
+    if (link == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (link->count >= I2C_CMD_MAX_OPS) {
+        return ESP_ERR_NO_MEM;
+    }
+    link->ops[link->count++] = op;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    return cmd_append(cmd_handle, (i2c_op_t){ .kind = I2C_OP_START });
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    (void)ack_en;
+    return cmd_append(cmd_handle, (i2c_op_t){ .kind = I2C_OP_WRITE, .byte = data, .len = 1 });
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t *data, size_t data_len, bool ack_en)
+{
+    (void)ack_en;
+    return cmd_append(cmd_handle, (i2c_op_t){ .kind = I2C_OP_WRITE, .wdata = data, .len = data_len });
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack)
+{
+    (void)ack;
+    return cmd_append(cmd_handle, (i2c_op_t){ .kind = I2C_OP_READ, .rdata = data, .len = 1 });
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, i2c_ack_type_t ack)
+{
+    (void)ack;
+    return cmd_append(cmd_handle, (i2c_op_t){ .kind = I2C_OP_READ, .rdata = data, .len = data_len });
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return cmd_append(cmd_handle, (i2c_op_t){ .kind = I2C_OP_STOP });
+}
+
+static host_i2c_device_ops_t *find_device_locked(i2c_port_t port, uint8_t addr)
+{
+    for (int i = 0; i < buses[port].device_count; i++) {
+        if (buses[port].devices[i].addr == addr) {
+            return &buses[port].devices[i].ops;
+        }
+    }
+    return NULL;
+}
+
+// Transfers take bus time on the virtual clock, so scans and polls show up in
+// simulated boot and sample latency; real-time runs are not slowed down
+static void spend_bus_time(size_t bytes)
+{
+    if (host_time_is_virtual()) {
+        host_time_advance_us(I2C_US_PER_FRAME + (int64_t)bytes * I2C_US_PER_BYTE);
+    }
+}
+
+// A stuck bus times out every transaction; called with i2c_lock held, which it releases
+static esp_err_t stuck_timeout_unlock(int64_t timeout_us)
+{
+    stats.timeouts++;
+    pthread_mutex_unlock(&i2c_lock);
+    if (host_time_is_virtual()) {
+        host_time_advance_us(timeout_us);
+    } else {
+        struct timespec ts = { .tv_sec = timeout_us / 1000000, .tv_nsec = (timeout_us % 1000000) * 1000 };
+        nanosleep(&ts, NULL);
+    }
+    return ESP_ERR_TIMEOUT;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    i2c_cmd_link_t *link = cmd_handle;
+    if (i2c_num < 0 || i2c_num >= I2C_NUM_MAX || link == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&i2c_lock);
+    if (!buses[i2c_num].installed) {
+        pthread_mutex_unlock(&i2c_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    stats.transactions++;
+    if (buses[i2c_num].stuck) {
+        return stuck_timeout_unlock((int64_t)ticks_to_wait * portTICK_PERIOD_MS * 1000);
+    }
+
+    esp_err_t ret = ESP_OK;
+    host_i2c_device_ops_t *dev = NULL;
+    bool expect_addr = false;
+    size_t bytes = 0;
+
+    for (int i = 0; i < link->count && ret == ESP_OK; i++) {
+        i2c_op_t *op = &link->ops[i];
+        if (op->kind == I2C_OP_WRITE || op->kind == I2C_OP_READ) {
+            bytes += op->len;
+        }
+        switch (op->kind) {
+            case I2C_OP_START:
+                expect_addr = true;
+                break;
+
+            case I2C_OP_WRITE: {
+                const uint8_t *bytes = op->wdata ? op->wdata : &op->byte;
+                size_t len = op->len;
+                if (expect_addr && len > 0) {
+                    uint8_t addr_byte = bytes[0];
+                    dev = find_device_locked(i2c_num, addr_byte >> 1);
+                    if (dev == NULL) {
+                        stats.nacks++;
+                        ret = ESP_FAIL;
+                        break;
+                    }
+                    if (dev->start) {
+                        dev->start(dev->ctx, (addr_byte & 1) == I2C_MASTER_READ);
+                    }
+                    expect_addr = false;
+                    bytes++;
+                    len--;
+                }
+                if (len > 0 && dev != NULL && dev->write) {
+                    ret = dev->write(dev->ctx, bytes, len);
+                }
+                break;
+            }
+
+            case I2C_OP_READ:
+                if (dev == NULL || dev->read == NULL) {
+                    ret = ESP_FAIL;
+                } else {
+                    ret = dev->read(dev->ctx, op->rdata, op->len);
+                }
+                break;
+
+            case I2C_OP_STOP:
+                if (dev != NULL && dev->stop) {
+                    dev->stop(dev->ctx);
+                }
+                dev = NULL;
+                break;
+        }
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    spend_bus_time(bytes);
+    return ret;
+}
+
+esp_err_t host_i2c_attach(int port, uint8_t addr, const host_i2c_device_ops_t *ops)
+{
+    if (port < 0 || port >= I2C_NUM_MAX || ops == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&i2c_lock);
+    i2c_bus_t *bus = &buses[port];
+    esp_err_t ret = ESP_OK;
+    if (find_device_locked(port, addr) != NULL) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (bus->device_count >= I2C_MAX_DEVICES) {
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        bus->devices[bus->device_count].addr = addr;
+        bus->devices[bus->device_count].ops = *ops;
+        bus->device_count++;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+void host_i2c_set_stuck(int port, bool stuck)
+{
+    if (port < 0 || port >= I2C_NUM_MAX) {
+        return;
+    }
+    pthread_mutex_lock(&i2c_lock);
+    buses[port].stuck = stuck;
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+void host_i2c_detach_all(void)
+{
+    pthread_mutex_lock(&i2c_lock);
+    for (int i = 0; i < I2C_NUM_MAX; i++) {
+        buses[i].device_count = 0;
+    }
+    aht20_count = 0;
+    bmp280_count = 0;
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+host_i2c_stats_t host_i2c_get_stats(void)
+{
+    pthread_mutex_lock(&i2c_lock);
+    host_i2c_stats_t snapshot = stats;
+    pthread_mutex_unlock(&i2c_lock);
+    return snapshot;
+}
+
+void host_i2c_reset_stats(void)
+{
+    pthread_mutex_lock(&i2c_lock);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+// ============================================
+// Bus/device API (driver/i2c_master.h)
+// ============================================
+
+struct i2c_master_bus_t {
+    i2c_port_t port;
+    size_t trans_queue_depth;
+};
+
+struct i2c_master_dev_t {
+    struct i2c_master_bus_t *bus;
+    uint8_t addr;
+    i2c_master_callback_t on_trans_done;
+    void *user_data;
+};
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle)
+{
+    if (bus_config == NULL || ret_bus_handle == NULL ||
+        bus_config->i2c_port < 0 || bus_config->i2c_port >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct i2c_master_bus_t *bus = calloc(1, sizeof(*bus));
+    if (bus == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    bus->port = bus_config->i2c_port;
+    bus->trans_queue_depth = bus_config->trans_queue_depth;
+
+    pthread_mutex_lock(&i2c_lock);
+    esp_err_t ret = ESP_OK;
+    if (buses[bus->port].installed) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        buses[bus->port].installed = true;
+        stats.allocations++;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+
+    if (ret != ESP_OK) {
+        free(bus);
+        return ret;
+    }
+    *ret_bus_handle = bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle)
+{
+    if (bus_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&i2c_lock);
+    buses[bus_handle->port].installed = false;
+    pthread_mutex_unlock(&i2c_lock);
+    free(bus_handle);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                    i2c_master_dev_handle_t *ret_handle)
+{
+    if (bus_handle == NULL || dev_config == NULL || ret_handle == NULL ||
+        dev_config->dev_addr_length != I2C_ADDR_BIT_LEN_7 || dev_config->device_address > 0x7F) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct i2c_master_dev_t *dev = calloc(1, sizeof(*dev));
+    if (dev == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    dev->bus = bus_handle;
+    dev->addr = (uint8_t)dev_config->device_address;
+
+    pthread_mutex_lock(&i2c_lock);
+    stats.allocations++;
+    pthread_mutex_unlock(&i2c_lock);
+
+    *ret_handle = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_register_event_callbacks(i2c_master_dev_handle_t i2c_dev,
+                                              const i2c_master_event_callbacks_t *cbs, void *user_data)
+{
+    if (i2c_dev == NULL || cbs == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (i2c_dev->bus->trans_queue_depth == 0) {
+        // Asynchronous transactions need a queue
+        return ESP_ERR_INVALID_STATE;
+    }
+    i2c_dev->on_trans_done = cbs->on_trans_done;
+    i2c_dev->user_data = user_data;
+    return ESP_OK;
+}
+
+// One START [write] [repeated START read] STOP sequence; called with i2c_lock held
+static esp_err_t transfer_locked(i2c_port_t port, uint8_t addr, const uint8_t *write_buffer, size_t write_size,
+                                 uint8_t *read_buffer, size_t read_size)
+{
+    if (!buses[port].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    stats.transactions++;
+    if (buses[port].stuck) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    host_i2c_device_ops_t *dev = find_device_locked(port, addr);
+    if (dev == NULL) {
+        stats.nacks++;
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t ret = ESP_OK;
+    if (write_size > 0 || read_size == 0) {
+        if (dev->start) {
+            dev->start(dev->ctx, false);
+        }
+        if (write_size > 0 && dev->write) {
+            ret = dev->write(dev->ctx, write_buffer, write_size);
+        }
+    }
+    if (ret == ESP_OK && read_size > 0) {
+        if (dev->start) {
+            dev->start(dev->ctx, true);
+        }
+        ret = dev->read ? dev->read(dev->ctx, read_buffer, read_size) : ESP_FAIL;
+    }
+    if (dev->stop) {
+        dev->stop(dev->ctx);
+    }
+    return ret;
+}
+
+static esp_err_t device_transfer(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                                 uint8_t *read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+    if (i2c_dev == NULL || (write_size > 0 && write_buffer == NULL) || (read_size > 0 && read_buffer == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&i2c_lock);
+    esp_err_t ret = transfer_locked(i2c_dev->bus->port, i2c_dev->addr, write_buffer, write_size,
+                                    read_buffer, read_size);
+    if (ret == ESP_ERR_TIMEOUT) {
+        ret = stuck_timeout_unlock((int64_t)xfer_timeout_ms * 1000);
+    } else {
+        pthread_mutex_unlock(&i2c_lock);
+        if (ret != ESP_ERR_INVALID_STATE) {
+            // Address byte, data, and a repeated-START address byte before a read
+            spend_bus_time(1 + write_size + (read_size > 0 && write_size > 0 ? 1 : 0) + read_size);
+        }
+    }
+
+    if (i2c_dev->on_trans_done == NULL) {
+        // Synchronous: a missing ACK is reported like the IDF driver does
+        return ret == ESP_ERR_NOT_FOUND ? ESP_ERR_INVALID_STATE : ret;
+    }
+    if (ret == ESP_ERR_INVALID_STATE) {
+        return ret;     // Bus not installed: nothing was queued
+    }
+    i2c_master_event_data_t evt = { .event = ret == ESP_OK ? I2C_EVENT_DONE :
+                                             ret == ESP_ERR_TIMEOUT ? I2C_EVENT_TIMEOUT : I2C_EVENT_NACK };
+    i2c_dev->on_trans_done(i2c_dev, &evt, i2c_dev->user_data);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                              int xfer_timeout_ms)
+{
+    return device_transfer(i2c_dev, write_buffer, write_size, NULL, 0, xfer_timeout_ms);
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t *read_buffer, size_t read_size,
+                             int xfer_timeout_ms)
+{
+    return device_transfer(i2c_dev, NULL, 0, read_buffer, read_size, xfer_timeout_ms);
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer,
+                                      size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                      int xfer_timeout_ms)
+{
+    return device_transfer(i2c_dev, write_buffer, write_size, read_buffer, read_size, xfer_timeout_ms);
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms)
+{
+    if (bus_handle == NULL || address > 0x7F) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&i2c_lock);
+    esp_err_t ret = transfer_locked(bus_handle->port, (uint8_t)address, NULL, 0, NULL, 0);
+    if (ret == ESP_ERR_TIMEOUT) {
+        return stuck_timeout_unlock((int64_t)xfer_timeout_ms * 1000);
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    if (ret != ESP_ERR_INVALID_STATE) {
+        spend_bus_time(1);
+    }
+    return ret;
+}
+
+esp_err_t i2c_master_bus_wait_all_done(i2c_master_bus_handle_t bus_handle, int timeout_ms)
+{
+    (void)timeout_ms;
+    // Host transfers complete before the submitting call returns
+    return bus_handle != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// ============================================
+// AHT20 model
+// ============================================
+
+#define AHT20_STATUS_BUSY       0x80
+#define AHT20_STATUS_CALIBRATED 0x08
+#define AHT20_QUEUE_LEN         64
+#define SENSOR_MODELS_MAX       4   // Instances of each model
+
+typedef struct {
+    int port;
+    uint8_t addr;
+    bool calibrated;
+    bool measuring;
+    int64_t trigger_us;
+    int64_t conversion_us;
+    float temperature;
+    float humidity;
+    uint8_t frame[7];
+    size_t read_pos;
+    uint32_t triggers;
+    struct {
+        float temperature;
+        float humidity;
+    } queue[AHT20_QUEUE_LEN];
+    int queue_head;
+    int queue_count;
+} aht20_model_t;
+
+// Settings a newly attached AHT20 starts with; the host_aht20_set_*()
+// calls that address every instance update them too
+static aht20_model_t aht20_defaults = {
+    .conversion_us = 75000,
+    .temperature = 21.5f,
+    .humidity = 45.0f,
+};
+static aht20_model_t aht20_models[SENSOR_MODELS_MAX];
+
+static uint8_t aht20_crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint32_t aht20_to_raw(double value)
+{
+    double raw = round(value * 1048576.0);
+    if (raw < 0) {
+        raw = 0;
+    }
+    if (raw > 0xFFFFF) {
+        raw = 0xFFFFF;
+    }
+    return (uint32_t)raw;
+}
+
+static void aht20_latch_sample(aht20_model_t *m)
+{
+    float temperature = m->temperature;
+    float humidity = m->humidity;
+    if (m->queue_count > 0) {
+        temperature = m->queue[m->queue_head].temperature;
+        humidity = m->queue[m->queue_head].humidity;
+        m->queue_head = (m->queue_head + 1) % AHT20_QUEUE_LEN;
+        m->queue_count--;
+    }
+
+    uint32_t raw_h = aht20_to_raw(humidity / 100.0);
+    uint32_t raw_t = aht20_to_raw((temperature + 50.0) / 200.0);
+    m->frame[1] = (uint8_t)(raw_h >> 12);
+    m->frame[2] = (uint8_t)(raw_h >> 4);
+    m->frame[3] = (uint8_t)(((raw_h & 0x0F) << 4) | ((raw_t >> 16) & 0x0F));
+    m->frame[4] = (uint8_t)(raw_t >> 8);
+    m->frame[5] = (uint8_t)raw_t;
+}
+
+static void aht20_start(void *ctx, bool read)
+{
+    aht20_model_t *m = ctx;
+    (void)read;
+    m->read_pos = 0;
+}
+
+static esp_err_t aht20_write(void *ctx, const uint8_t *data, size_t len)
+{
+    aht20_model_t *m = ctx;
+    switch (data[0]) {
+        case 0xBA:  // soft reset
+            m->measuring = false;
+            break;
+        case 0xBE:  // initialize / load calibration
+            m->calibrated = true;
+            break;
+        case 0xAC:  // trigger measurement
+            if (len == 3) {
+                m->measuring = true;
+                m->trigger_us = esp_timer_get_time();
+                m->triggers++;
+                aht20_latch_sample(m);
+            }
+            break;
+        default:
+            break;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t aht20_read(void *ctx, uint8_t *data, size_t len)
+{
+    aht20_model_t *m = ctx;
+
+    bool busy = m->measuring && (esp_timer_get_time() - m->trigger_us) < m->conversion_us;
+    m->frame[0] = (busy ? AHT20_STATUS_BUSY : 0) | (m->calibrated ? AHT20_STATUS_CALIBRATED : 0) | 0x10;
+    m->frame[6] = aht20_crc8(m->frame, 6);
+
+    for (size_t i = 0; i < len; i++) {
+        data[i] = m->read_pos < sizeof(m->frame) ? m->frame[m->read_pos] : 0xFF;
+        m->read_pos++;
+    }
+    return ESP_OK;
+}
+
+// Called with i2c_lock held
+static aht20_model_t *aht20_find_locked(int port, uint8_t addr)
+{
+    for (int i = 0; i < aht20_count; i++) {
+        if (aht20_models[i].port == port && aht20_models[i].addr == addr) {
+            return &aht20_models[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t host_aht20_attach(int port, uint8_t addr)
+{
+    pthread_mutex_lock(&i2c_lock);
+    if (aht20_count >= SENSOR_MODELS_MAX) {
+        pthread_mutex_unlock(&i2c_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    aht20_model_t *m = &aht20_models[aht20_count];
+    *m = aht20_defaults;
+    m->port = port;
+    m->addr = addr;
+    pthread_mutex_unlock(&i2c_lock);
+
+    host_i2c_device_ops_t ops = {
+        .start = aht20_start,
+        .write = aht20_write,
+        .read = aht20_read,
+        .ctx = m,
+    };
+    esp_err_t ret = host_i2c_attach(port, addr, &ops);
+    if (ret == ESP_OK) {
+        pthread_mutex_lock(&i2c_lock);
+        aht20_count++;
+        pthread_mutex_unlock(&i2c_lock);
+    }
+    return ret;
+}
+
+void host_aht20_set_reading(float temperature, float humidity)
+{
+    pthread_mutex_lock(&i2c_lock);
+    aht20_defaults.temperature = temperature;
+    aht20_defaults.humidity = humidity;
+    for (int i = 0; i < aht20_count; i++) {
+        aht20_models[i].temperature = temperature;
+        aht20_models[i].humidity = humidity;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+esp_err_t host_aht20_set_reading_at(int port, uint8_t addr, float temperature, float humidity)
+{
+    pthread_mutex_lock(&i2c_lock);
+    aht20_model_t *m = aht20_find_locked(port, addr);
+    if (m != NULL) {
+        m->temperature = temperature;
+        m->humidity = humidity;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return m != NULL ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void host_aht20_queue_reading(float temperature, float humidity)
+{
+    pthread_mutex_lock(&i2c_lock);
+    for (int i = 0; i < aht20_count; i++) {
+        aht20_model_t *m = &aht20_models[i];
+        if (m->queue_count < AHT20_QUEUE_LEN) {
+            int tail = (m->queue_head + m->queue_count) % AHT20_QUEUE_LEN;
+            m->queue[tail].temperature = temperature;
+            m->queue[tail].humidity = humidity;
+            m->queue_count++;
+        }
+    }
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+void host_aht20_set_conversion_time_us(int64_t us)
+{
+    pthread_mutex_lock(&i2c_lock);
+    aht20_defaults.conversion_us = us;
+    for (int i = 0; i < aht20_count; i++) {
+        aht20_models[i].conversion_us = us;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+uint32_t host_aht20_trigger_count(void)
+{
+    pthread_mutex_lock(&i2c_lock);
+    uint32_t count = 0;
+    for (int i = 0; i < aht20_count; i++) {
+        count += aht20_models[i].triggers;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return count;
+}
+
+// ============================================
+// BMP280 model
+// ============================================
+
+#define BMP280_REG_CALIB    0x88
+#define BMP280_REG_CHIP_ID  0xD0
+#define BMP280_REG_RESET    0xE0
+#define BMP280_REG_STATUS   0xF3
+#define BMP280_REG_CTRL     0xF4
+#define BMP280_REG_DATA     0xF7
+#define BMP280_STATUS_MEASURING 0x08
+
+// Trimming parameters of the datasheet's worked example (section 8.2)
+static const uint16_t bmp280_trim[12] = {
+    27504, 26435, (uint16_t)-1000, 36477, (uint16_t)-10685, 3024,
+    2855, 140, (uint16_t)-7, 15500, (uint16_t)-14600, 6000,
+};
+
+typedef struct {
+    int port;
+    uint8_t addr;
+    uint8_t regs[256];
+    uint8_t pointer;        // Register the next read starts at
+    bool measuring;
+    int64_t trigger_us;
+    int64_t conversion_us;
+    float temperature;      // °C
+    float pressure;         // hPa
+    float latched_temperature;
+    float latched_pressure;
+    uint32_t triggers;
+} bmp280_model_t;
+
+static bmp280_model_t bmp280_models[SENSOR_MODELS_MAX];
+static int64_t bmp280_conversion_us = 11500;   // Typical at temperature x1, pressure x4
+
+static void bmp280_reset_regs(bmp280_model_t *m)
+{
+    memset(m->regs, 0, sizeof(m->regs));
+    m->regs[BMP280_REG_CHIP_ID] = 0x58;
+    for (int i = 0; i < 12; i++) {
+        m->regs[BMP280_REG_CALIB + i * 2] = (uint8_t)bmp280_trim[i];
+        m->regs[BMP280_REG_CALIB + i * 2 + 1] = (uint8_t)(bmp280_trim[i] >> 8);
+    }
+    // Data registers read 0x80000 until the first conversion
+    m->regs[BMP280_REG_DATA] = 0x80;
+    m->regs[BMP280_REG_DATA + 3] = 0x80;
+    m->measuring = false;
+}
+
+// Datasheet compensation, the same arithmetic the firmware decodes with
+static int32_t bmp280_model_t_fine(int32_t adc_t)
+{
+    int32_t t1 = (int32_t)bmp280_trim[0], t2 = (int16_t)bmp280_trim[1], t3 = (int16_t)bmp280_trim[2];
+    int32_t var1 = (((adc_t >> 3) - (t1 * 2)) * t2) >> 11;
+    int32_t var2 = (((((adc_t >> 4) - t1) * ((adc_t >> 4) - t1)) >> 12) * t3) >> 14;
+    return var1 + var2;
+}
+
+static int64_t bmp280_model_pressure(int32_t adc_p, int32_t t_fine)
+{
+    int64_t p1 = bmp280_trim[3];
+    int64_t p2 = (int16_t)bmp280_trim[4], p3 = (int16_t)bmp280_trim[5], p4 = (int16_t)bmp280_trim[6];
+    int64_t p5 = (int16_t)bmp280_trim[7], p6 = (int16_t)bmp280_trim[8], p7 = (int16_t)bmp280_trim[9];
+    int64_t p8 = (int16_t)bmp280_trim[10], p9 = (int16_t)bmp280_trim[11];
+
+    int64_t var1 = (int64_t)t_fine - 128000;
+    int64_t var2 = var1 * var1 * p6 + var1 * p5 * ((int64_t)1 << 17) + p4 * ((int64_t)1 << 35);
+    var1 = ((var1 * var1 * p3) >> 8) + var1 * p2 * ((int64_t)1 << 12);
+    var1 = ((((int64_t)1 << 47) + var1) * p1) >> 33;
+    int64_t p = 1048576 - adc_p;
+    p = ((p * ((int64_t)1 << 31)) - var2) * 3125 / var1;
+    var1 = (p9 * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (p8 * p) >> 19;
+    return ((p + var1 + var2) >> 8) + p7 * 16;
+}
+
+// Raw values that compensate to the wanted reading, found by bisection
+// (temperature rises with adc_T, pressure falls with adc_P)
+static void bmp280_latch_raw(bmp280_model_t *m)
+{
+    int32_t want_t = (int32_t)lround(m->latched_temperature * 100.0);
+    int32_t lo = 0, hi = 0xFFFFF;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (((bmp280_model_t_fine(mid) * 5 + 128) >> 8) < want_t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    int32_t adc_t = lo;
+    int32_t t_fine = bmp280_model_t_fine(adc_t);
+
+    int64_t want_p = llround(m->latched_pressure * 25600.0);
+    lo = 0;
+    hi = 0xFFFFF;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (bmp280_model_pressure(mid, t_fine) > want_p) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    int32_t adc_p = lo;
+
+    uint8_t *d = &m->regs[BMP280_REG_DATA];
+    d[0] = (uint8_t)(adc_p >> 12);
+    d[1] = (uint8_t)(adc_p >> 4);
+    d[2] = (uint8_t)((adc_p & 0x0F) << 4);
+    d[3] = (uint8_t)(adc_t >> 12);
+    d[4] = (uint8_t)(adc_t >> 4);
+    d[5] = (uint8_t)((adc_t & 0x0F) << 4);
+}
+
+// A finished forced conversion updates the data registers and returns to sleep mode
+static void bmp280_update(bmp280_model_t *m)
+{
+    if (m->measuring && esp_timer_get_time() - m->trigger_us >= m->conversion_us) {
+        m->measuring = false;
+        bmp280_latch_raw(m);
+        m->regs[BMP280_REG_CTRL] &= (uint8_t)~0x03;
+    }
+    m->regs[BMP280_REG_STATUS] = m->measuring ? BMP280_STATUS_MEASURING : 0;
+}
+
+static esp_err_t bmp280_write(void *ctx, const uint8_t *data, size_t len)
+{
+    bmp280_model_t *m = ctx;
+    m->pointer = data[0];
+
+    // Register and value pairs; a lone register byte only sets the read pointer
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        uint8_t reg = data[i];
+        uint8_t value = data[i + 1];
+        if (reg == BMP280_REG_RESET) {
+            if (value == 0xB6) {
+                bmp280_reset_regs(m);
+            }
+        } else if (reg == BMP280_REG_CTRL) {
+            m->regs[reg] = value;
+            uint8_t mode = value & 0x03;
+            if ((mode == 1 || mode == 2) && !m->measuring) {
+                m->measuring = true;
+                m->trigger_us = esp_timer_get_time();
+                m->latched_temperature = m->temperature;
+                m->latched_pressure = m->pressure;
+                m->triggers++;
+            }
+        } else if (reg >= 0xF4) {
+            m->regs[reg] = value;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t bmp280_read(void *ctx, uint8_t *data, size_t len)
+{
+    bmp280_model_t *m = ctx;
+    bmp280_update(m);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = m->regs[m->pointer++];
+    }
+    return ESP_OK;
+}
+
+static bmp280_model_t *bmp280_find_locked(int port, uint8_t addr)
+{
+    for (int i = 0; i < bmp280_count; i++) {
+        if (bmp280_models[i].port == port && bmp280_models[i].addr == addr) {
+            return &bmp280_models[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t host_bmp280_attach(int port, uint8_t addr)
+{
+    pthread_mutex_lock(&i2c_lock);
+    if (bmp280_count >= SENSOR_MODELS_MAX) {
+        pthread_mutex_unlock(&i2c_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    bmp280_model_t *m = &bmp280_models[bmp280_count];
+    memset(m, 0, sizeof(*m));
+    m->port = port;
+    m->addr = addr;
+    m->conversion_us = bmp280_conversion_us;
+    m->temperature = 21.5f;
+    m->pressure = 1013.25f;
+    bmp280_reset_regs(m);
+    pthread_mutex_unlock(&i2c_lock);
+
+    host_i2c_device_ops_t ops = {
+        .write = bmp280_write,
+        .read = bmp280_read,
+        .ctx = m,
+    };
+    esp_err_t ret = host_i2c_attach(port, addr, &ops);
+    if (ret == ESP_OK) {
+        pthread_mutex_lock(&i2c_lock);
+        bmp280_count++;
+        pthread_mutex_unlock(&i2c_lock);
+    }
+    return ret;
+}
+
+esp_err_t host_bmp280_set_reading(int port, uint8_t addr, float temperature, float pressure_hpa)
+{
+    pthread_mutex_lock(&i2c_lock);
+    bmp280_model_t *m = bmp280_find_locked(port, addr);
+    if (m != NULL) {
+        m->temperature = temperature;
+        m->pressure = pressure_hpa;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return m != NULL ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void host_bmp280_set_conversion_time_us(int64_t us)
+{
+    pthread_mutex_lock(&i2c_lock);
+    bmp280_conversion_us = us;
+    for (int i = 0; i < bmp280_count; i++) {
+        bmp280_models[i].conversion_us = us;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+uint32_t host_bmp280_trigger_count(void)
+{
+    pthread_mutex_lock(&i2c_lock);
+    uint32_t count = 0;
+    for (int i = 0; i < bmp280_count; i++) {
+        count += bmp280_models[i].triggers;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return count;
+}
@@ -0,0 +1,59 @@
+#ifndef SHIM_INTERNAL_H
+#define SHIM_INTERNAL_H
+
+// Hooks shared between the shim translation units (not part of the control API)
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief True while host_time_set_virtual(true) is in effect
+ */
+bool host_time_is_virtual(void);
+
+/**
+ * @brief Move the clock forward without firing timers
+ */
+void host_time_skip_us(int64_t us);
+
+/**
+ * @brief Park the calling task until ready(ctx) or the virtual deadline
+ *
+ * ready() runs with the scheduler lock held and must only take object locks.
+ * Use INT64_MAX to wait without a deadline.
+ */
+void host_sim_wait(bool (*ready)(void *ctx), void *ctx, int64_t deadline_us);
+
+/**
+ * @brief Let parked tasks re-check their condition after a state change
+ *
+ * Call without holding the lock of the changed object.
+ */
+void host_sim_notify(void);
+
+/**
+ * @brief Account for a task (thread) starting (+1) or exiting (-1)
+ */
+void host_sim_task_count(int delta);
+
+/**
+ * @brief Expiry of the earliest armed esp_timer, INT64_MAX if none
+ */
+int64_t host_timer_next_expiry(void);
+
+/**
+ * @brief True while a timer callback runs
+ */
+bool host_timer_dispatching(void);
+
+/**
+ * @brief Make the timer service re-check the clock mode
+ */
+void host_timer_wake(void);
+
+/**
+ * @brief End a connected MQTT session as a lost socket would (no-op if none)
+ */
+void host_mqtt_drop_session(void);
+
+#endif // SHIM_INTERNAL_H
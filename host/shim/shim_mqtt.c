@@ -0,0 +1,510 @@
+// Host stand-in for the esp-mqtt client: captures publishes and lets the
+// harness inject broker events into the registered handler.
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mqtt_client.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "host_shim.h"
+#include "shim_internal.h"
+
+ESP_EVENT_DEFINE_BASE(MQTT_EVENTS);
+
+#define MQTT_MAX_SUBSCRIPTIONS 32
+#define MQTT_OUTBOX_LEN        64
+#define MQTT_RX_BUFFER_SIZE    (HOST_MQTT_TOPIC_MAX + HOST_MQTT_PAYLOAD_MAX + 1)
+
+struct esp_mqtt_client {
+    esp_mqtt_client_config_t config;
+    esp_event_handler_t handler;
+    esp_mqtt_event_id_t handler_event;
+    void *handler_arg;
+    bool started;
+    bool connected;
+    int next_msg_id;
+    char subscriptions[MQTT_MAX_SUBSCRIPTIONS][HOST_MQTT_TOPIC_MAX];
+    int subscription_count;
+    host_mqtt_msg_t outbox[MQTT_OUTBOX_LEN];
+    int outbox_count;
+};
+
+static pthread_mutex_t mqtt_lock;
+static struct esp_mqtt_client *active_client;
+static host_mqtt_publish_hook_t publish_hook;
+static void *publish_hook_ctx;
+static uint32_t publish_count;
+static host_mqtt_msg_t last_publish;
+static int64_t auto_connect_us = -1;
+static int64_t publish_delay_us;
+static esp_timer_handle_t connect_timer;
+static bool broker_available = true;
+static uint32_t connect_attempts;
+
+__attribute__((constructor)) static void mqtt_lock_init(void)
+{
+    // esp-mqtt holds a recursive API lock while dispatching events, so
+    // handlers may publish from inside the callback
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mqtt_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    struct esp_mqtt_client *client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        return NULL;
+    }
+    client->config = *config;
+    client->next_msg_id = 1;
+
+    pthread_mutex_lock(&mqtt_lock);
+    active_client = client;
+    pthread_mutex_unlock(&mqtt_lock);
+    return client;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&mqtt_lock);
+    esp_err_t ret = client->started ? ESP_FAIL : ESP_OK;
+    client->started = true;
+    if (ret == ESP_OK && auto_connect_us >= 0 && connect_timer != NULL) {
+        connect_attempts++;
+        esp_timer_start_once(connect_timer, (uint64_t)auto_connect_us);
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+    return ret;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&mqtt_lock);
+    esp_err_t ret = client->started && !client->connected ? ESP_OK : ESP_FAIL;
+    if (ret == ESP_OK && auto_connect_us >= 0 && connect_timer != NULL) {
+        connect_attempts++;
+        esp_timer_stop(connect_timer);
+        esp_timer_start_once(connect_timer, (uint64_t)auto_connect_us);
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+    return ret;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&mqtt_lock);
+    client->started = false;
+    client->connected = false;
+    pthread_mutex_unlock(&mqtt_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&mqtt_lock);
+    if (active_client == client) {
+        active_client = NULL;
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+    free(client);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&mqtt_lock);
+    client->handler = event_handler;
+    client->handler_event = event;
+    client->handler_arg = event_handler_arg;
+    pthread_mutex_unlock(&mqtt_lock);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    (void)qos;
+    if (client == NULL || topic == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mqtt_lock);
+    int msg_id = -1;
+    if (client->connected) {
+        bool known = false;
+        for (int i = 0; i < client->subscription_count; i++) {
+            known |= strcmp(client->subscriptions[i], topic) == 0;
+        }
+        if (!known && client->subscription_count < MQTT_MAX_SUBSCRIPTIONS) {
+            snprintf(client->subscriptions[client->subscription_count++], HOST_MQTT_TOPIC_MAX, "%s", topic);
+        }
+        msg_id = client->next_msg_id++;
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+    return msg_id;
+}
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic)
+{
+    if (client == NULL || topic == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mqtt_lock);
+    for (int i = 0; i < client->subscription_count; i++) {
+        if (strcmp(client->subscriptions[i], topic) == 0) {
+            memmove(client->subscriptions[i], client->subscriptions[i + 1],
+                    (size_t)(client->subscription_count - i - 1) * HOST_MQTT_TOPIC_MAX);
+            client->subscription_count--;
+            break;
+        }
+    }
+    int msg_id = client->next_msg_id++;
+    pthread_mutex_unlock(&mqtt_lock);
+    return msg_id;
+}
+
+static void fill_msg(host_mqtt_msg_t *msg, const char *topic, const char *data, int len,
+                     int qos, int retain, int msg_id)
+{
+    snprintf(msg->topic, sizeof(msg->topic), "%s", topic);
+    if (data == NULL) {
+        len = 0;
+    } else if (len <= 0) {
+        len = (int)strlen(data);
+    }
+    msg->len = len < HOST_MQTT_PAYLOAD_MAX ? len : HOST_MQTT_PAYLOAD_MAX;
+    if (msg->len > 0) {
+        memcpy(msg->data, data, (size_t)msg->len);
+    }
+    if (msg->len < HOST_MQTT_PAYLOAD_MAX) {
+        msg->data[msg->len] = '\0';
+    }
+    msg->qos = qos;
+    msg->retain = retain;
+    msg->msg_id = msg_id;
+    msg->timestamp_ns = host_time_now_ns();
+}
+
+static void deliver_locked(const host_mqtt_msg_t *msg)
+{
+    publish_count++;
+    last_publish = *msg;
+    if (publish_hook != NULL) {
+        publish_hook(msg, publish_hook_ctx);
+    }
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain, bool store)
+{
+    if (client == NULL || topic == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mqtt_lock);
+    int msg_id = qos > 0 ? client->next_msg_id++ : 0;
+    host_mqtt_msg_t msg;
+    fill_msg(&msg, topic, data, len, qos, retain, msg_id);
+
+    if (client->connected) {
+        deliver_locked(&msg);
+    } else if ((qos > 0 || store) && client->outbox_count < MQTT_OUTBOX_LEN) {
+        client->outbox[client->outbox_count++] = msg;
+    } else {
+        msg_id = -1;
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+    return msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain)
+{
+    // A blocking publish writes to the socket under the API lock
+    pthread_mutex_lock(&mqtt_lock);
+    if (client != NULL && client->connected && publish_delay_us > 0) {
+        struct timespec ts = { .tv_sec = publish_delay_us / 1000000, .tv_nsec = publish_delay_us % 1000000 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+    int msg_id = esp_mqtt_client_enqueue(client, topic, data, len, qos, retain, false);
+    pthread_mutex_unlock(&mqtt_lock);
+    return msg_id;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&mqtt_lock);
+    int size = 0;
+    for (int i = 0; i < client->outbox_count; i++) {
+        size += client->outbox[i].len + (int)strlen(client->outbox[i].topic);
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+    return size;
+}
+
+// ============================================
+// Harness side
+// ============================================
+
+void host_mqtt_set_publish_hook(host_mqtt_publish_hook_t hook, void *ctx)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    publish_hook = hook;
+    publish_hook_ctx = ctx;
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+void host_mqtt_set_publish_delay(int64_t delay_us)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    publish_delay_us = delay_us;
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+uint32_t host_mqtt_publish_count(void)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    uint32_t count = publish_count;
+    pthread_mutex_unlock(&mqtt_lock);
+    return count;
+}
+
+const host_mqtt_msg_t *host_mqtt_last_publish(void)
+{
+    return publish_count > 0 ? &last_publish : NULL;
+}
+
+bool host_mqtt_is_subscribed(const char *topic)
+{
+    bool found = false;
+    pthread_mutex_lock(&mqtt_lock);
+    if (active_client != NULL) {
+        for (int i = 0; i < active_client->subscription_count; i++) {
+            found |= strcmp(active_client->subscriptions[i], topic) == 0;
+        }
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+    return found;
+}
+
+void host_mqtt_reset(void)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    publish_count = 0;
+    memset(&last_publish, 0, sizeof(last_publish));
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+static void dispatch_locked(esp_mqtt_event_t *event)
+{
+    struct esp_mqtt_client *client = active_client;
+    if (client == NULL || client->handler == NULL) {
+        return;
+    }
+    if (client->handler_event != MQTT_EVENT_ANY && client->handler_event != event->event_id) {
+        return;
+    }
+    event->client = client;
+    client->handler(client->handler_arg, MQTT_EVENTS, event->event_id, event);
+}
+
+void host_mqtt_inject_connected(void)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    if (active_client != NULL) {
+        active_client->connected = true;
+        active_client->subscription_count = 0;
+
+        // Resend what queued up in the outbox while offline
+        for (int i = 0; i < active_client->outbox_count; i++) {
+            deliver_locked(&active_client->outbox[i]);
+        }
+        active_client->outbox_count = 0;
+
+        esp_mqtt_event_t event = { .event_id = MQTT_EVENT_CONNECTED };
+        dispatch_locked(&event);
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+static bool station_has_address(void)
+{
+    esp_netif_ip_info_t ip_info;
+    esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    return netif == NULL || (esp_netif_get_ip_info(netif, &ip_info) == ESP_OK && ip_info.ip.addr != 0);
+}
+
+static void auto_connect_cb(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&mqtt_lock);
+    struct esp_mqtt_client *client = active_client;
+    if (client != NULL && client->started && !client->connected) {
+        if (broker_available && station_has_address()) {
+            host_mqtt_inject_connected();
+        } else {
+            // esp-mqtt reports the transport error, then aborts the connection
+            esp_mqtt_event_t error = { .event_id = MQTT_EVENT_ERROR };
+            dispatch_locked(&error);
+            esp_mqtt_event_t disconnected = { .event_id = MQTT_EVENT_DISCONNECTED };
+            dispatch_locked(&disconnected);
+        }
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+void host_mqtt_set_auto_connect(int64_t connect_us)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    auto_connect_us = connect_us;
+    if (connect_timer == NULL && connect_us >= 0) {
+        const esp_timer_create_args_t args = { .callback = auto_connect_cb, .name = "mqtt_connect" };
+        esp_timer_create(&args, &connect_timer);
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+void host_mqtt_set_broker_available(bool available)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    broker_available = available;
+    if (!available && active_client != NULL && active_client->connected) {
+        host_mqtt_inject_disconnected();
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+uint32_t host_mqtt_connect_attempts(void)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    uint32_t attempts = connect_attempts;
+    pthread_mutex_unlock(&mqtt_lock);
+    return attempts;
+}
+
+// Ends the session; the client stays started and waits for esp_mqtt_client_reconnect()
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&mqtt_lock);
+    esp_err_t ret = client->started ? ESP_OK : ESP_FAIL;
+    if (client->connected) {
+        client->connected = false;
+        esp_mqtt_event_t event = { .event_id = MQTT_EVENT_DISCONNECTED };
+        dispatch_locked(&event);
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+    return ret;
+}
+
+void host_mqtt_drop_session(void)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    if (active_client != NULL && active_client->connected) {
+        host_mqtt_inject_disconnected();
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+void host_mqtt_inject_disconnected(void)
+{
+    pthread_mutex_lock(&mqtt_lock);
+    if (active_client != NULL) {
+        active_client->connected = false;
+        esp_mqtt_event_t event = { .event_id = MQTT_EVENT_DISCONNECTED };
+        dispatch_locked(&event);
+    }
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+static void inject_data(const char *topic, const char *data, int len, int chunk, bool dup)
+{
+    // Topic and payload share one buffer with no terminator in between, as
+    // they do in the esp-mqtt receive buffer
+    char rx_buffer[MQTT_RX_BUFFER_SIZE];
+    int topic_len = (int)strlen(topic);
+
+    if (len < 0) {
+        len = (int)strlen(data);
+    }
+    if (chunk <= 0 || chunk > HOST_MQTT_PAYLOAD_MAX) {
+        chunk = HOST_MQTT_PAYLOAD_MAX;
+    }
+    if (topic_len > HOST_MQTT_TOPIC_MAX) {
+        topic_len = HOST_MQTT_TOPIC_MAX;
+    }
+
+    pthread_mutex_lock(&mqtt_lock);
+    int offset = 0;
+    do {
+        int piece = len - offset < chunk ? len - offset : chunk;
+        bool first = offset == 0;
+        int head = first ? topic_len : 0;
+
+        if (first) {
+            memcpy(rx_buffer, topic, (size_t)topic_len);
+        }
+        if (piece > 0) {
+            memcpy(rx_buffer + head, data + offset, (size_t)piece);
+        }
+        // Poison the byte after the payload so handlers cannot rely on a terminator
+        rx_buffer[head + piece] = '#';
+
+        esp_mqtt_event_t event = {
+            .event_id = MQTT_EVENT_DATA,
+            .topic = first ? rx_buffer : NULL,
+            .topic_len = head,
+            .data = rx_buffer + head,
+            .data_len = piece,
+            .total_data_len = len,
+            .current_data_offset = offset,
+            .qos = 1,
+            .dup = dup,
+        };
+        dispatch_locked(&event);
+        offset += piece;
+    } while (offset < len);
+    pthread_mutex_unlock(&mqtt_lock);
+}
+
+void host_mqtt_inject_data_fragmented(const char *topic, const char *data, int len, int chunk)
+{
+    inject_data(topic, data, len, chunk, false);
+}
+
+void host_mqtt_inject_data(const char *topic, const char *data, int len)
+{
+    inject_data(topic, data, len, HOST_MQTT_PAYLOAD_MAX, false);
+}
+
+void host_mqtt_inject_redelivery(const char *topic, const char *data, int len)
+{
+    inject_data(topic, data, len, HOST_MQTT_PAYLOAD_MAX, true);
+}
@@ -0,0 +1,323 @@
+// Host stand-in for nvs_flash and the nvs.h key/value API
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+
+#define NVS_MAX_ENTRIES     64
+#define NVS_MAX_HANDLES     16
+#define NVS_NAME_MAX        16      // 15 characters + NUL, as on the target
+#define NVS_VALUE_MAX       512
+
+typedef enum {
+    NVS_TYPE_U8,
+    NVS_TYPE_U16,
+    NVS_TYPE_U32,
+    NVS_TYPE_I32,
+    NVS_TYPE_U64,
+    NVS_TYPE_STR,
+    NVS_TYPE_BLOB,
+} nvs_type_t;
+
+typedef struct {
+    bool used;
+    char ns[NVS_NAME_MAX];
+    char key[NVS_NAME_MAX];
+    nvs_type_t type;
+    size_t len;
+    uint8_t value[NVS_VALUE_MAX];
+} nvs_entry_t;
+
+typedef struct {
+    bool open;
+    bool writable;
+    char ns[NVS_NAME_MAX];
+} nvs_open_handle_t;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool nvs_initialized;
+static nvs_entry_t entries[NVS_MAX_ENTRIES];
+static nvs_open_handle_t handles[NVS_MAX_HANDLES];
+static host_nvs_stats_t stats;
+
+esp_err_t nvs_flash_init(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    nvs_initialized = true;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    memset(entries, 0, sizeof(entries));
+    nvs_initialized = false;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (namespace_name == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(namespace_name) >= NVS_NAME_MAX) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t ret = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    if (!nvs_initialized) {
+        ret = ESP_ERR_NVS_NOT_INITIALIZED;
+    } else {
+        for (int i = 0; i < NVS_MAX_HANDLES; i++) {
+            if (!handles[i].open) {
+                handles[i].open = true;
+                handles[i].writable = open_mode == NVS_READWRITE;
+                strcpy(handles[i].ns, namespace_name);
+                *out_handle = (nvs_handle_t)(i + 1);
+                ret = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    if (handle >= 1 && handle <= NVS_MAX_HANDLES) {
+        handles[handle - 1].open = false;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+static nvs_open_handle_t *handle_locked(nvs_handle_t handle)
+{
+    if (handle < 1 || handle > NVS_MAX_HANDLES || !handles[handle - 1].open) {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+static nvs_entry_t *find_locked(const char *ns, const char *key)
+{
+    for (int i = 0; i < NVS_MAX_ENTRIES; i++) {
+        if (entries[i].used && strcmp(entries[i].ns, ns) == 0 && strcmp(entries[i].key, key) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t ret = handle_locked(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+    if (ret == ESP_OK) {
+        stats.commits++;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = handle_locked(handle);
+    esp_err_t ret = ESP_OK;
+    if (h == NULL) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!h->writable) {
+        ret = ESP_ERR_NVS_READ_ONLY;
+    } else {
+        nvs_entry_t *e = find_locked(h->ns, key);
+        if (e == NULL) {
+            ret = ESP_ERR_NVS_NOT_FOUND;
+        } else {
+            e->used = false;
+            stats.writes++;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = handle_locked(handle);
+    esp_err_t ret = ESP_OK;
+    if (h == NULL) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!h->writable) {
+        ret = ESP_ERR_NVS_READ_ONLY;
+    } else {
+        for (int i = 0; i < NVS_MAX_ENTRIES; i++) {
+            if (entries[i].used && strcmp(entries[i].ns, h->ns) == 0) {
+                entries[i].used = false;
+                stats.writes++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+// Like the target, writing the value an entry already holds costs no flash write
+static esp_err_t set_value(nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t len)
+{
+    if (key == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(key) >= NVS_NAME_MAX) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (len > NVS_VALUE_MAX) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = handle_locked(handle);
+    esp_err_t ret = ESP_OK;
+    if (h == NULL) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!h->writable) {
+        ret = ESP_ERR_NVS_READ_ONLY;
+    } else {
+        nvs_entry_t *e = find_locked(h->ns, key);
+        if (e != NULL && e->type == type && e->len == len && memcmp(e->value, value, len) == 0) {
+            stats.unchanged_writes++;
+        } else {
+            for (int i = 0; e == NULL && i < NVS_MAX_ENTRIES; i++) {
+                if (!entries[i].used) {
+                    e = &entries[i];
+                }
+            }
+            if (e == NULL) {
+                ret = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+            } else {
+                e->used = true;
+                strcpy(e->ns, h->ns);
+                strcpy(e->key, key);
+                e->type = type;
+                e->len = len;
+                memcpy(e->value, value, len);
+                stats.writes++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+// Fixed-size values need an exact length; strings and blobs report theirs
+static esp_err_t get_value(nvs_handle_t handle, const char *key, nvs_type_t type, void *out, size_t *len,
+                           bool variable)
+{
+    if (key == NULL || len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = handle_locked(handle);
+    nvs_entry_t *e = h ? find_locked(h->ns, key) : NULL;
+    esp_err_t ret = ESP_OK;
+    if (h == NULL) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (e == NULL) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    } else if (e->type != type) {
+        ret = ESP_ERR_NVS_TYPE_MISMATCH;
+    } else if (variable && out == NULL) {
+        *len = e->len;
+    } else if (*len < e->len) {
+        ret = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out, e->value, e->len);
+        *len = e->len;
+    }
+    if (ret == ESP_OK) {
+        stats.reads++;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+#define NVS_SCALAR(suffix, ctype, tag)                                                  \
+    esp_err_t nvs_set_##suffix(nvs_handle_t handle, const char *key, ctype value)       \
+    {                                                                                   \
+        return set_value(handle, key, tag, &value, sizeof(value));                      \
+    }                                                                                   \
+    esp_err_t nvs_get_##suffix(nvs_handle_t handle, const char *key, ctype *out_value)  \
+    {                                                                                   \
+        size_t len = sizeof(*out_value);                                                \
+        return get_value(handle, key, tag, out_value, &len, false);                     \
+    }
+
+NVS_SCALAR(u8, uint8_t, NVS_TYPE_U8)
+NVS_SCALAR(u16, uint16_t, NVS_TYPE_U16)
+NVS_SCALAR(u32, uint32_t, NVS_TYPE_U32)
+NVS_SCALAR(i32, int32_t, NVS_TYPE_I32)
+NVS_SCALAR(u64, uint64_t, NVS_TYPE_U64)
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return set_value(handle, key, NVS_TYPE_STR, value, value ? strlen(value) + 1 : 0);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set_value(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return get_value(handle, key, NVS_TYPE_STR, out_value, length, true);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return get_value(handle, key, NVS_TYPE_BLOB, out_value, length, true);
+}
+
+host_nvs_stats_t host_nvs_get_stats(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    host_nvs_stats_t snapshot = stats;
+    pthread_mutex_unlock(&nvs_lock);
+    return snapshot;
+}
+
+void host_nvs_reset_stats(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t host_nvs_save(FILE *out)
+{
+    pthread_mutex_lock(&nvs_lock);
+    size_t written = fwrite(entries, sizeof(entries), 1, out);
+    pthread_mutex_unlock(&nvs_lock);
+    return written == 1 && fflush(out) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t host_nvs_load(FILE *in)
+{
+    static nvs_entry_t loaded[NVS_MAX_ENTRIES];
+    if (fread(loaded, sizeof(loaded), 1, in) != 1) {
+        return ESP_FAIL;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    memcpy(entries, loaded, sizeof(entries));
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,80 @@
+// Host stand-in for deep sleep and RTC slow memory
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_sleep.h"
+#include "host_shim.h"
+
+// Bounds of the RTC_DATA_ATTR section, provided by the linker; weak so builds
+// without RTC variables still link
+extern char __start_host_rtc_data[] __attribute__((weak));
+extern char __stop_host_rtc_data[] __attribute__((weak));
+
+static uint64_t wakeup_us;
+static esp_sleep_wakeup_cause_t wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static host_deep_sleep_handler_t sleep_handler;
+static void *sleep_handler_ctx;
+
+static size_t rtc_size(void)
+{
+    return __start_host_rtc_data != NULL ? (size_t)(__stop_host_rtc_data - __start_host_rtc_data) : 0;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    wakeup_us = time_in_us;
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void)
+{
+    return wakeup_cause;
+}
+
+void esp_deep_sleep_start(void)
+{
+    if (sleep_handler != NULL) {
+        sleep_handler(wakeup_us, sleep_handler_ctx);
+    }
+    // The handler must end the boot; without one there is nothing to wake
+    abort();
+}
+
+void esp_deep_sleep(uint64_t time_in_us)
+{
+    esp_sleep_enable_timer_wakeup(time_in_us);
+    esp_deep_sleep_start();
+}
+
+// ============================================
+// Harness side
+// ============================================
+
+void host_sleep_set_handler(host_deep_sleep_handler_t handler, void *ctx)
+{
+    sleep_handler = handler;
+    sleep_handler_ctx = ctx;
+}
+
+esp_err_t host_rtc_save(FILE *out)
+{
+    uint32_t size = (uint32_t)rtc_size();
+    if (fwrite(&size, sizeof(size), 1, out) != 1
+        || (size > 0 && fwrite(__start_host_rtc_data, size, 1, out) != 1)) {
+        return ESP_FAIL;
+    }
+    return fflush(out) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t host_rtc_load(FILE *in)
+{
+    uint32_t size;
+    if (fread(&size, sizeof(size), 1, in) != 1 || size != rtc_size()) {
+        return ESP_FAIL;
+    }
+    if (size > 0 && fread(__start_host_rtc_data, size, 1, in) != 1) {
+        return ESP_FAIL;
+    }
+    wakeup_cause = ESP_SLEEP_WAKEUP_TIMER;
+    return ESP_OK;
+}
@@ -0,0 +1,243 @@
+// Host stand-in for esp_timer one-shot and periodic timers
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "shim_internal.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    bool armed;
+    int64_t expiry_us;
+    int64_t period_us;      // 0 for one-shot
+    struct esp_timer *next;
+};
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;
+static struct esp_timer *timers;
+static bool service_started;
+static bool dispatching;    // A callback is running on the service thread
+
+static struct esp_timer *earliest_locked(void)
+{
+    struct esp_timer *best = NULL;
+    for (struct esp_timer *t = timers; t != NULL; t = t->next) {
+        if (t->armed && (best == NULL || t->expiry_us < best->expiry_us)) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+// Disarm (or re-arm a periodic timer) and run its callback; called with timer_lock held
+static void fire_locked(struct esp_timer *t)
+{
+    if (t->period_us > 0) {
+        t->expiry_us += t->period_us;
+    } else {
+        t->armed = false;
+    }
+    esp_timer_cb_t callback = t->callback;
+    void *arg = t->arg;
+    dispatching = true;
+    pthread_mutex_unlock(&timer_lock);
+
+    callback(arg);
+
+    pthread_mutex_lock(&timer_lock);
+    dispatching = false;
+}
+
+int64_t host_timer_next_expiry(void)
+{
+    pthread_mutex_lock(&timer_lock);
+    struct esp_timer *t = earliest_locked();
+    int64_t expiry = t != NULL ? t->expiry_us : INT64_MAX;
+    pthread_mutex_unlock(&timer_lock);
+    return expiry;
+}
+
+bool host_timer_dispatching(void)
+{
+    pthread_mutex_lock(&timer_lock);
+    bool busy = dispatching;
+    pthread_mutex_unlock(&timer_lock);
+    return busy;
+}
+
+void host_timer_wake(void)
+{
+    pthread_mutex_lock(&timer_lock);
+    if (service_started) {
+        pthread_cond_signal(&timer_cond);
+    }
+    pthread_mutex_unlock(&timer_lock);
+}
+
+// Virtual time: wake when the earliest timer is due or an earlier one is armed
+static bool timer_due(void *ctx)
+{
+    int64_t waited_for = *(int64_t *)ctx;
+    int64_t expiry = host_timer_next_expiry();
+    return expiry < waited_for || expiry <= esp_timer_get_time();
+}
+
+static void *timer_service(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&timer_lock);
+    for (;;) {
+        struct esp_timer *t = earliest_locked();
+        int64_t wait_us = t != NULL ? t->expiry_us - esp_timer_get_time() : INT64_MAX;
+        if (wait_us <= 0) {
+            fire_locked(t);
+            continue;
+        }
+        if (host_time_is_virtual()) {
+            // Park like a task, so the clock can move to the expiry
+            int64_t expiry = t != NULL ? t->expiry_us : INT64_MAX;
+            pthread_mutex_unlock(&timer_lock);
+            host_sim_wait(timer_due, &expiry, expiry);
+            pthread_mutex_lock(&timer_lock);
+        } else if (t == NULL) {
+            pthread_cond_wait(&timer_cond, &timer_lock);
+        } else {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            int64_t ns = deadline.tv_nsec + wait_us * 1000;
+            deadline.tv_sec += ns / 1000000000LL;
+            deadline.tv_nsec = ns % 1000000000LL;
+            pthread_cond_timedwait(&timer_cond, &timer_lock, &deadline);
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t start_service_locked(void)
+{
+    if (service_started) {
+        return ESP_OK;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_t thread;
+    host_sim_task_count(1);
+    if (pthread_create(&thread, NULL, timer_service, NULL) != 0) {
+        host_sim_task_count(-1);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(thread);
+    service_started = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    t->callback = create_args->callback;
+    t->arg = create_args->arg;
+    t->name = create_args->name;
+
+    pthread_mutex_lock(&timer_lock);
+    esp_err_t err = start_service_locked();
+    if (err == ESP_OK) {
+        t->next = timers;
+        timers = t;
+    }
+    pthread_mutex_unlock(&timer_lock);
+
+    if (err != ESP_OK) {
+        free(t);
+        return err;
+    }
+    *out_handle = t;
+    return ESP_OK;
+}
+
+static esp_err_t timer_arm(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer_lock);
+    if (timer->armed) {
+        pthread_mutex_unlock(&timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->expiry_us = esp_timer_get_time() + (int64_t)timeout_us;
+    timer->period_us = (int64_t)period_us;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+    host_sim_notify();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_arm(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    if (period_us == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return timer_arm(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer_lock);
+    esp_err_t err = timer->armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+    timer->armed = false;
+    pthread_mutex_unlock(&timer_lock);
+    return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer_lock);
+    if (timer->armed) {
+        pthread_mutex_unlock(&timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (struct esp_timer **link = &timers; *link != NULL; link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&timer_lock);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&timer_lock);
+    bool armed = timer != NULL && timer->armed;
+    pthread_mutex_unlock(&timer_lock);
+    return armed;
+}
@@ -0,0 +1,524 @@
+// Host stand-in for esp_wifi and esp_netif: one station joining one modelled
+// access point. Scanning, association and DHCP take their configured time on
+// the esp_timer clock (virtual time when enabled) and end in the same events
+// the WiFi driver posts on the target.
+
+#include <pthread.h>
+#include <string.h>
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "host_shim.h"
+#include "shim_internal.h"
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+#define WIFI_CHANNELS 13
+
+// ============================================
+// Netif
+// ============================================
+
+struct esp_netif_obj {
+    bool created;
+    bool dhcpc_running;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns[ESP_NETIF_DNS_MAX];
+};
+
+// Modules that only read the address (status messages) work without WiFi
+static struct esp_netif_obj sta_netif = {
+    .dhcpc_running = true,
+    .ip_info = {
+        .ip = { .addr = 0x3201A8C0 },       // 192.168.1.50
+        .netmask = { .addr = 0x00FFFFFF },  // 255.255.255.0
+        .gw = { .addr = 0x0101A8C0 },       // 192.168.1.1
+    },
+};
+
+static pthread_mutex_t wifi_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void lease_on_link_locked(void);
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    memset(&sta_netif, 0, sizeof(sta_netif));
+    sta_netif.created = true;
+    sta_netif.dhcpc_running = true;
+    pthread_mutex_unlock(&wifi_lock);
+    return &sta_netif;
+}
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key)
+{
+    return strcmp(if_key, "WIFI_STA_DEF") == 0 ? &sta_netif : NULL;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info)
+{
+    if (esp_netif == NULL || ip_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    *ip_info = esp_netif->ip_info;
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif, const esp_netif_ip_info_t *ip_info)
+{
+    if (esp_netif == NULL || ip_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    esp_err_t ret = ESP_ERR_ESP_NETIF_DHCP_NOT_STOPPED;
+    if (!esp_netif->dhcpc_running) {
+        esp_netif->ip_info = *ip_info;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    return ret;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t *esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns)
+{
+    if (esp_netif == NULL || dns == NULL || type >= ESP_NETIF_DNS_MAX) {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    *dns = esp_netif->dns[type];
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns)
+{
+    if (esp_netif == NULL || dns == NULL || type >= ESP_NETIF_DNS_MAX) {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    esp_netif->dns[type] = *dns;
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif)
+{
+    if (esp_netif == NULL) {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    esp_err_t ret = esp_netif->dhcpc_running ? ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED : ESP_OK;
+    esp_netif->dhcpc_running = true;
+    bool reset = false;
+    if (ret == ESP_OK) {
+        // As in IDF, the address is reset until DHCP answers
+        reset = esp_netif->ip_info.ip.addr != 0;
+        memset(&esp_netif->ip_info, 0, sizeof(esp_netif->ip_info));
+        lease_on_link_locked();
+    }
+    pthread_mutex_unlock(&wifi_lock);
+
+    // lwIP aborts the TCP connections bound to the old address
+    if (reset) {
+        host_mqtt_drop_session();
+    }
+    return ret;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif)
+{
+    if (esp_netif == NULL) {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    esp_err_t ret = esp_netif->dhcpc_running ? ESP_OK : ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED;
+    esp_netif->dhcpc_running = false;
+    pthread_mutex_unlock(&wifi_lock);
+    return ret;
+}
+
+// ============================================
+// Access point model
+// ============================================
+
+static host_wifi_ap_t ap = {
+    .ssid = NULL,
+    .bssid = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 },
+    .channel = 6,
+    .rssi = -58,
+    .available = true,
+    .scan_channel_us = 120000,      // esp_wifi active scan default dwell
+    .assoc_us = 150000,
+    .dhcp_us = 600000,
+    .lease = {
+        .ip = { .addr = 0x3201A8C0 },       // 192.168.1.50
+        .netmask = { .addr = 0x00FFFFFF },  // 255.255.255.0
+        .gw = { .addr = 0x0101A8C0 },       // 192.168.1.1
+    },
+    .dns = 0x0101A8C0,
+};
+
+// ============================================
+// Station
+// ============================================
+
+typedef enum {
+    STEP_NONE,
+    STEP_START,         // post WIFI_EVENT_STA_START
+    STEP_ASSOCIATED,    // post WIFI_EVENT_STA_CONNECTED (and GOT_IP with a static address)
+    STEP_LEASED,        // DHCP done, post IP_EVENT_STA_GOT_IP
+    STEP_NOT_FOUND,     // scan found no matching AP
+    STEP_LEFT,          // post WIFI_EVENT_STA_DISCONNECTED
+} wifi_step_t;
+
+static bool wifi_initialized;
+static bool wifi_started;
+static bool wifi_busy;          // connecting or connected
+static bool wifi_associated;
+static wifi_config_t wifi_config;
+static wifi_step_t wifi_step;
+static uint8_t wifi_leave_reason;
+static esp_timer_handle_t wifi_timer;
+static host_wifi_stats_t stats;
+
+static void schedule_locked(wifi_step_t step, int64_t delay_us)
+{
+    esp_timer_stop(wifi_timer);
+    wifi_step = step;
+    esp_timer_start_once(wifi_timer, delay_us > 0 ? (uint64_t)delay_us : 0);
+}
+
+// DHCP started on a station already associated on a static address: the
+// server answers after the usual DHCP time
+static void lease_on_link_locked(void)
+{
+    if (wifi_associated && wifi_step == STEP_NONE) {
+        schedule_locked(STEP_LEASED, ap.dhcp_us);
+    }
+}
+
+static void post_got_ip(void)
+{
+    // ip_changed compares with the address of the previous GOT_IP
+    static uint32_t last_ip;
+    ip_event_got_ip_t event = { .esp_netif = &sta_netif };
+    esp_netif_get_ip_info(&sta_netif, &event.ip_info);
+    event.ip_changed = event.ip_info.ip.addr != last_ip;
+    last_ip = event.ip_info.ip.addr;
+    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &event, sizeof(event), 0);
+}
+
+static void post_disconnected(uint8_t reason)
+{
+    wifi_event_sta_disconnected_t event = { .reason = reason, .rssi = ap.rssi };
+    memcpy(event.ssid, wifi_config.sta.ssid, sizeof(event.ssid));
+    event.ssid_len = (uint8_t)strnlen((const char *)event.ssid, sizeof(event.ssid));
+    memcpy(event.bssid, ap.bssid, sizeof(event.bssid));
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event), 0);
+}
+
+static void wifi_step_cb(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&wifi_lock);
+    wifi_step_t step = wifi_step;
+    wifi_step = STEP_NONE;
+    bool static_ip = false;
+    wifi_event_sta_connected_t connected = { 0 };
+    switch (step) {
+        case STEP_ASSOCIATED:
+            wifi_associated = true;
+            memcpy(connected.ssid, wifi_config.sta.ssid, sizeof(connected.ssid));
+            connected.ssid_len = (uint8_t)strnlen((const char *)connected.ssid, sizeof(connected.ssid));
+            memcpy(connected.bssid, ap.bssid, sizeof(connected.bssid));
+            connected.channel = ap.channel;
+            connected.authmode = WIFI_AUTH_WPA2_PSK;
+            connected.aid = 1;
+            if (sta_netif.dhcpc_running) {
+                schedule_locked(STEP_LEASED, ap.dhcp_us);
+            } else {
+                static_ip = true;
+                stats.static_joins++;
+            }
+            break;
+        case STEP_LEASED:
+            sta_netif.ip_info = ap.lease;
+            sta_netif.dns[ESP_NETIF_DNS_MAIN].ip.u_addr.ip4.addr = ap.dns;
+            sta_netif.dns[ESP_NETIF_DNS_MAIN].ip.type = ESP_IPADDR_TYPE_V4;
+            stats.dhcp_leases++;
+            break;
+        case STEP_NOT_FOUND:
+        case STEP_LEFT:
+            wifi_busy = false;
+            wifi_associated = false;
+            if (sta_netif.dhcpc_running) {
+                memset(&sta_netif.ip_info, 0, sizeof(sta_netif.ip_info));
+            }
+            break;
+        default:
+            break;
+    }
+    uint8_t reason = step == STEP_NOT_FOUND ? WIFI_REASON_NO_AP_FOUND : wifi_leave_reason;
+    pthread_mutex_unlock(&wifi_lock);
+
+    // Post without the lock held; handlers call back into the driver
+    switch (step) {
+        case STEP_START:
+            esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, 0);
+            break;
+        case STEP_ASSOCIATED:
+            esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &connected, sizeof(connected), 0);
+            if (static_ip) {
+                post_got_ip();
+            }
+            break;
+        case STEP_LEASED:
+            post_got_ip();
+            break;
+        case STEP_NOT_FOUND:
+        case STEP_LEFT:
+            post_disconnected(reason);
+            break;
+        default:
+            break;
+    }
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    esp_err_t ret = ESP_OK;
+    if (wifi_timer == NULL) {
+        const esp_timer_create_args_t args = { .callback = wifi_step_cb, .name = "wifi" };
+        ret = esp_timer_create(&args, &wifi_timer);
+    }
+    wifi_initialized = ret == ESP_OK;
+    pthread_mutex_unlock(&wifi_lock);
+    return ret;
+}
+
+esp_err_t esp_wifi_deinit(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    esp_err_t ret = wifi_started ? ESP_ERR_INVALID_STATE : ESP_OK;
+    if (ret == ESP_OK) {
+        wifi_initialized = false;
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    return ret;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    if (!wifi_initialized) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    return mode == WIFI_MODE_STA ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (!wifi_initialized) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (interface != WIFI_IF_STA) {
+        return ESP_ERR_WIFI_IF;
+    }
+    if (conf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    wifi_config = *conf;
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (!wifi_initialized) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (interface != WIFI_IF_STA) {
+        return ESP_ERR_WIFI_IF;
+    }
+    if (conf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    *conf = wifi_config;
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    if (!wifi_initialized) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    if (!wifi_started) {
+        wifi_started = true;
+        schedule_locked(STEP_START, 0);
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    esp_timer_stop(wifi_timer);
+    wifi_step = STEP_NONE;
+    wifi_started = false;
+    wifi_busy = false;
+    wifi_associated = false;
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+/**
+ * Time the scan takes and whether it finds the AP: with a channel configured
+ * only that channel is probed; otherwise a fast scan stops on the AP's
+ * channel and an all-channel scan (or a failed one) covers every channel.
+ */
+static int64_t scan_locked(bool *found)
+{
+    const wifi_sta_config_t *sta = &wifi_config.sta;
+    bool ssid_match = ap.ssid == NULL || strncmp((const char *)sta->ssid, ap.ssid, sizeof(sta->ssid)) == 0;
+    bool bssid_match = !sta->bssid_set || memcmp(sta->bssid, ap.bssid, sizeof(ap.bssid)) == 0;
+    *found = ap.available && ssid_match && bssid_match;
+
+    int channels = WIFI_CHANNELS;
+    if (sta->channel != 0) {
+        *found = *found && sta->channel == ap.channel;
+        channels = 1;
+    } else if (*found && sta->scan_method == WIFI_FAST_SCAN) {
+        channels = ap.channel;
+    }
+    stats.channels_scanned += (uint32_t)channels;
+    return channels * ap.scan_channel_us;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    esp_err_t ret = ESP_OK;
+    if (!wifi_initialized) {
+        ret = ESP_ERR_WIFI_NOT_INIT;
+    } else if (!wifi_started) {
+        ret = ESP_ERR_WIFI_NOT_STARTED;
+    } else if (wifi_busy) {
+        ret = ESP_ERR_WIFI_CONN;
+    } else {
+        bool found;
+        int64_t scan_us = scan_locked(&found);
+        wifi_busy = true;
+        stats.connects++;
+        if (found) {
+            schedule_locked(STEP_ASSOCIATED, scan_us + ap.assoc_us);
+        } else {
+            schedule_locked(STEP_NOT_FOUND, scan_us);
+        }
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    return ret;
+}
+
+static void leave_locked(uint8_t reason)
+{
+    if (wifi_busy && wifi_step != STEP_LEFT) {
+        wifi_leave_reason = reason;
+        schedule_locked(STEP_LEFT, 0);
+    }
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    esp_err_t ret = wifi_started ? ESP_OK : ESP_ERR_WIFI_NOT_STARTED;
+    leave_locked(WIFI_REASON_ASSOC_LEAVE);
+    pthread_mutex_unlock(&wifi_lock);
+    return ret;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    if (ap_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    esp_err_t ret = ESP_ERR_WIFI_CONN;
+    if (wifi_associated) {
+        memset(ap_info, 0, sizeof(*ap_info));
+        memcpy(ap_info->bssid, ap.bssid, sizeof(ap_info->bssid));
+        memcpy(ap_info->ssid, wifi_config.sta.ssid, sizeof(wifi_config.sta.ssid));
+        ap_info->primary = ap.channel;
+        ap_info->rssi = ap.rssi;
+        ap_info->authmode = WIFI_AUTH_WPA2_PSK;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    return ret;
+}
+
+// ============================================
+// Harness control
+// ============================================
+
+host_wifi_ap_t host_wifi_get_ap(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    host_wifi_ap_t copy = ap;
+    pthread_mutex_unlock(&wifi_lock);
+    return copy;
+}
+
+void host_wifi_set_ap(const host_wifi_ap_t *new_ap)
+{
+    pthread_mutex_lock(&wifi_lock);
+    ap = *new_ap;
+    if (!ap.available) {
+        leave_locked(WIFI_REASON_BEACON_TIMEOUT);
+    }
+    pthread_mutex_unlock(&wifi_lock);
+}
+
+void host_wifi_drop_link(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    leave_locked(WIFI_REASON_BEACON_TIMEOUT);
+    pthread_mutex_unlock(&wifi_lock);
+}
+
+void host_wifi_renew_lease(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    bool renewed = wifi_associated && sta_netif.dhcpc_running && sta_netif.ip_info.ip.addr != 0;
+    if (renewed) {
+        sta_netif.ip_info = ap.lease;
+        stats.dhcp_leases++;
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    if (renewed) {
+        post_got_ip();
+    }
+}
+
+host_wifi_stats_t host_wifi_get_stats(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    host_wifi_stats_t copy = stats;
+    pthread_mutex_unlock(&wifi_lock);
+    return copy;
+}
@@ -0,0 +1,57 @@
+#ifndef BOOT_EVENTS_H
+#define BOOT_EVENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+// Readiness events; WIFI and MQTT are cleared again while the link is down
+#define BOOT_EVENT_WIFI           (1 << 0)  // Station has an IP address
+#define BOOT_EVENT_MQTT           (1 << 1)  // Broker session is up
+#define BOOT_EVENT_PERIPHERALS    (1 << 2)  // Relay or sensor initialized
+#define BOOT_EVENT_FIRST_PUBLISH  (1 << 3)  // First device message accepted by the client
+
+/**
+ * @brief Create the readiness event group
+ *
+ * Call first thing in app_main. Events set before this are ignored.
+ */
+esp_err_t boot_events_init(void);
+
+/**
+ * @brief Signal readiness and record the time each event is first reached
+ *
+ * @return true if any of the events was reached for the first time since boot
+ */
+bool boot_events_set(EventBits_t events);
+
+/**
+ * @brief Withdraw readiness (the first-reached times are kept)
+ */
+void boot_events_clear(EventBits_t events);
+
+/**
+ * @brief True if all the events are currently set
+ */
+bool boot_events_is_set(EventBits_t events);
+
+/**
+ * @brief Block until all the events are set
+ *
+ * @return true if they are set, false on timeout or before boot_events_init()
+ */
+bool boot_events_wait(EventBits_t events, uint32_t timeout_ms);
+
+/**
+ * @brief Milliseconds from boot until the event was first reached
+ *
+ * Counted from esp_timer start, shortly before app_main; the time spent in
+ * the bootloader is not included.
+ *
+ * @return Elapsed time, or -1 if the event has not been reached yet
+ */
+int32_t boot_events_elapsed_ms(EventBits_t event);
+
+#endif // BOOT_EVENTS_H
@@ -0,0 +1,104 @@
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Allocation-free CBOR (RFC 8949) writer and reader over caller buffers.
+ *
+ * Covers what the payload schema needs: integers, byte and text strings,
+ * definite-length arrays and maps, false/true/null. The reader can also skip
+ * tags and floats, so fields appended by a newer schema are stepped over.
+ * Indefinite lengths are not supported.
+ *
+ * Errors are sticky: after an overflow or a malformed item every further call
+ * fails, so a sequence of puts or gets can be checked once at the end.
+ */
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t pos;
+    bool overflow;
+} cbor_writer_t;
+
+typedef enum {
+    CBOR_TYPE_UINT,
+    CBOR_TYPE_NEGINT,
+    CBOR_TYPE_BYTES,
+    CBOR_TYPE_TEXT,
+    CBOR_TYPE_ARRAY,
+    CBOR_TYPE_MAP,
+    CBOR_TYPE_TAG,
+    CBOR_TYPE_SIMPLE,   // false, true, null, undefined and floats
+    CBOR_TYPE_NONE,     // End of input or after an error
+} cbor_type_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    bool error;
+} cbor_reader_t;
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t len);
+void cbor_put_uint(cbor_writer_t *w, uint64_t value);
+void cbor_put_int(cbor_writer_t *w, int64_t value);
+void cbor_put_bool(cbor_writer_t *w, bool value);
+void cbor_put_null(cbor_writer_t *w);
+void cbor_put_bytes(cbor_writer_t *w, const void *data, size_t len);
+void cbor_put_text(cbor_writer_t *w, const char *text, size_t len);
+
+/**
+ * @brief Start an array of count items / a map of count key-value pairs
+ */
+void cbor_put_array(cbor_writer_t *w, size_t count);
+void cbor_put_map(cbor_writer_t *w, size_t count);
+
+/**
+ * @brief Bytes written, 0 if anything did not fit
+ */
+size_t cbor_writer_finish(const cbor_writer_t *w);
+
+/**
+ * @brief Encoded size of an integer, for sizing a message before writing it
+ */
+size_t cbor_int_size(int64_t value);
+
+void cbor_reader_init(cbor_reader_t *r, const uint8_t *buf, size_t len);
+cbor_type_t cbor_peek_type(const cbor_reader_t *r);
+bool cbor_peek_null(const cbor_reader_t *r);
+
+/**
+ * @brief Read one item of the given type
+ *
+ * @return false (and the reader is in error) on a type mismatch, an integer
+ *         out of range or truncated input
+ */
+bool cbor_get_uint(cbor_reader_t *r, uint64_t *value);
+bool cbor_get_int(cbor_reader_t *r, int64_t *value);
+bool cbor_get_bool(cbor_reader_t *r, bool *value);
+bool cbor_get_null(cbor_reader_t *r);
+
+/**
+ * @brief Read a string in place; data points into the input buffer
+ */
+bool cbor_get_bytes(cbor_reader_t *r, const uint8_t **data, size_t *len);
+bool cbor_get_text(cbor_reader_t *r, const char **text, size_t *len);
+
+bool cbor_get_array(cbor_reader_t *r, size_t *count);
+bool cbor_get_map(cbor_reader_t *r, size_t *count);
+
+/**
+ * @brief Step over one complete item, including everything nested in it
+ */
+bool cbor_skip(cbor_reader_t *r);
+
+static inline bool cbor_reader_ok(const cbor_reader_t *r)
+{
+    return !r->error;
+}
+
+#endif // CBOR_H
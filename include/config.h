@@ -9,18 +9,30 @@
 // ============================================
 // DEVICE TYPE SELECTION (uncomment ONE)
 // ============================================
+// Can also be passed as a build flag (-DDEVICE_TYPE_...), which the host
+// build does to compile both variants
+#if !defined(DEVICE_TYPE_RELAY) && !defined(DEVICE_TYPE_TEMP_SENSOR)
 #define DEVICE_TYPE_RELAY
 //#define DEVICE_TYPE_TEMP_SENSOR
+#endif
 
 // ============================================
 // WiFi Configuration
 // ============================================
-#define WIFI_MAX_RETRY 5
+#define WIFI_BACKOFF_BASE_MS 1000   // Reconnects never give up: jittered backoff, see reconnect.h
+#define WIFI_BACKOFF_MAX_MS 60000
+
+#define WIFI_FAST_REJOIN           // Rejoin the last AP from NVS without a scan
+#define WIFI_REUSE_LEASE           // and on its cached lease; renewing it later costs one broker reconnect
+#define WIFI_LEASE_CHECK_MS 15000  // MQTT up this long on a reused lease, then DHCP renews it
 
 // ============================================
 // MQTT Configuration
 // ============================================
 #define MQTT_PORT 1883
+#define MQTT_REASSEMBLY_BUFFER_SIZE 4096  // Largest fragmented message delivered as one contiguous payload
+#define MQTT_BACKOFF_BASE_MS 2000   // Broker reconnects, see WIFI_BACKOFF_BASE_MS
+#define MQTT_BACKOFF_MAX_MS 120000
 
 // Device-specific MQTT topics and settings
 #ifdef DEVICE_TYPE_RELAY
@@ -32,6 +44,77 @@
     #define MQTT_TOPIC_STATE_REQUEST "branko/boiler/state/request"      // Publish: request current state on boot
     #define MQTT_TOPIC_STATE_RESPONSE "branko/boiler/state/response"    // Subscribe: receive current state from webapp
     #define MQTT_TOPIC_STATE_SYNC_ACK "branko/boiler/state/sync_ack"    // Publish: sends ACK after state sync complete
+
+    // Relay channels: channel n is driven by entry n of RELAY_CHANNEL_GPIOS
+    // (GPIO 0-31 only, so one set/clear register covers every channel) and is
+    // active-LOW (ON = pin LOW) if bit n of RELAY_CHANNEL_ACTIVE_LOW is set.
+    // Channel 0 is the boiler: the topics above switch it alone. Every channel
+    // also has its own topics, and MQTT_TOPIC_CHANNELS_SET switches several at
+    // once with one register write per direction. A 4-relay board might use:
+    //   #define RELAY_CHANNEL_COUNT 4
+    //   #define RELAY_CHANNEL_GPIOS { RELAY_GPIO_PIN, 26, 25, 14 }
+    //   #define RELAY_CHANNEL_ACTIVE_LOW 0x03     // Boiler and pump modules; zone valves are active-HIGH
+    #define RELAY_GPIO_PIN 27                       // Channel 0 (IO27 / D27)
+    #ifndef RELAY_CHANNEL_COUNT                     // Or define all three in build_flags for another board
+    #define RELAY_CHANNEL_COUNT 1                   // 1 to 8
+    #define RELAY_CHANNEL_GPIOS { RELAY_GPIO_PIN }
+    #define RELAY_CHANNEL_ACTIVE_LOW 0x01
+    #endif
+    #define MQTT_TOPIC_CHANNEL_PREFIX "branko/devices/relay/channel/"   // + "<n>/set" (subscribe: ON/OFF), "<n>/ack" (publish)
+    #define MQTT_TOPIC_CHANNELS_SET "branko/devices/relay/channels/set"  // Subscribe: "0=ON,2=OFF" ("*=OFF" for all), text only
+    #define MQTT_TOPIC_CHANNELS_ACK "branko/devices/relay/channels/ack"  // Publish: every channel's state after a batch, same format
+
+    // Actuator task: the MQTT handler only decodes commands and queues them;
+    // a dedicated task switches the relay and then queues the ACK, whose
+    // payload is the resulting state ("ACK:ON" / "ACK:OFF"). The switching
+    // time does not depend on the broker or the MQTT outbox.
+    #define RELAY_ACTUATOR_PRIORITY 10  // Above the MQTT task (5)
+    #define RELAY_ACTUATOR_CORE 1       // APP CPU, away from WiFi and lwIP on core 0
+    #define RELAY_CMD_QUEUE_LEN 8       // Commands waiting to be switched (power of two)
+
+    // Sequence-numbered, latest-wins commands: "ON#42" is ACKed "ACK:ON#42" (device_relay.h)
+    //#define RELAY_COMMAND_SEQ
+    #define RELAY_SEQ_WINDOW 64         // Up to this far below the newest is stale, further is a restart
+    #define RELAY_SEQ_RESTART_MS 3000   // Or a lower number after this long quiet, unless redelivered
+
+    // Persisted state: the relay state is kept in NVS and restored by
+    // relay_init, so a reboot resumes the last state instead of OFF until the
+    // webapp answers the sync request (which then only corrects a difference).
+    // Changes are coalesced and flash writes rate-limited, so a chattering
+    // command stream costs at most one write per RELAY_PERSIST_MIN_INTERVAL_MS.
+    #define RELAY_PERSIST_STATE
+    #define RELAY_PERSIST_DELAY_MS 2000             // Settle time before a change is written
+    #define RELAY_PERSIST_MIN_INTERVAL_MS 30000     // Shortest time between two writes
+
+    // On-device thermostat (uncomment RELAY_THERMOSTAT): channel 0 follows
+    // the room temperature the sensor publishes on MQTT_TOPIC_THERMOSTAT_SENSOR
+    // directly, instead of waiting for the webapp to turn each reading into
+    // an ON/OFF command (one broker hop instead of two plus the webapp, and
+    // the heating keeps working while the webapp is down). The webapp
+    // pushes a daily schedule on MQTT_TOPIC_THERMOSTAT_SCHEDULE, e.g.
+    // "now=07:12,06:30=21,22:00=17" (its clock, then the setpoint from each
+    // time on; kept in NVS, the clock is not) and supervises:
+    // MQTT_TOPIC_THERMOSTAT_OVERRIDE takes "ON", "OFF" or a setpoint for
+    // THERMOSTAT_OVERRIDE_MS, "auto" to go back to the schedule and "manual"
+    // to hand the relay to MQTT_TOPIC_COMMAND alone. While the thermostat
+    // runs, ON/OFF on MQTT_TOPIC_COMMAND is an override too. Without a fresh
+    // reading for THERMOSTAT_SENSOR_TIMEOUT_MS the boiler goes OFF.
+    //#define RELAY_THERMOSTAT
+    #define MQTT_TOPIC_THERMOSTAT_SENSOR "branko/sensor/temperature"            // Subscribe: the sensor's MQTT_TOPIC_TEMP
+    #define MQTT_TOPIC_THERMOSTAT_SCHEDULE "branko/boiler/thermostat/schedule"  // Subscribe: daily schedule
+    #define MQTT_TOPIC_THERMOSTAT_OVERRIDE "branko/boiler/thermostat/override"  // Subscribe: ON / OFF / setpoint / auto / manual
+    #define MQTT_TOPIC_THERMOSTAT_STATE "branko/boiler/thermostat/state"        // Publish: JSON state on every change (retained)
+    //#define THERMOSTAT_PID                        // Time-proportioning PID instead of hysteresis
+    #define THERMOSTAT_DEFAULT_SETPOINT_C 20.0f     // Until the webapp sends a schedule and its clock
+    #define THERMOSTAT_HYSTERESIS_C 0.3f            // ON at setpoint - this, OFF at setpoint + this
+    #define THERMOSTAT_KP 0.5f                      // PID: duty per °C below the setpoint
+    #define THERMOSTAT_KI 0.5f                      // PID: duty per °C·hour
+    #define THERMOSTAT_KD 0.0f                      // PID: duty per °C/hour of falling temperature
+    #define THERMOSTAT_CYCLE_MS 600000              // PID: ON for duty x this, every this
+    #define THERMOSTAT_MIN_ON_MS 120000             // Against short cycling: shortest burner run
+    #define THERMOSTAT_MIN_OFF_MS 180000            // and shortest pause
+    #define THERMOSTAT_SENSOR_TIMEOUT_MS 120000     // No reading this long: OFF
+    #define THERMOSTAT_OVERRIDE_MS 7200000          // How long ON / OFF / setpoint overrides last
 #endif
 
 #ifdef DEVICE_TYPE_TEMP_SENSOR
@@ -40,12 +123,121 @@
     #define MQTT_TOPIC_TEMP "branko/sensor/temperature"           // Publish: temperature readings
     #define MQTT_TOPIC_STATUS "branko/devices/temp_sensor/status" // Publish: device connection status
 
-    // I2C Configuration for AHT20 + BMP280
-    #define I2C_SDA_PIN 32
+    // I2C Configuration for AHT20 + BMP280. The second controller only comes
+    // up when SENSOR_TABLE puts a sensor on it.
+    #define I2C_SDA_PIN 32      // I2C_NUM_0
     #define I2C_SCL_PIN 33
+    #define I2C1_SDA_PIN 25     // I2C_NUM_1
+    #define I2C1_SCL_PIN 26
     #define I2C_FREQ_HZ 100000  // 100kHz I2C frequency
 
+    // Sensors (sensor_manager.h): name, type (SENSOR_AHT20 or SENSOR_BMP280),
+    // I2C port and address, up to 8 entries. All of them are triggered
+    // together and convert at the same time. The first entry is the primary
+    // sensor: it publishes to MQTT_TOPIC_TEMP and feeds the batch, store and
+    // sleep buffers. Every other sensor publishes a JSON reading to
+    // MQTT_TOPIC_SENSOR_PREFIX "<name>". The AHT20 address is fixed, so a
+    // second one goes on the other bus.
+    #ifndef SENSOR_TABLE
+    #define SENSOR_TABLE { \
+        { "main", SENSOR_AHT20, I2C_NUM_0, 0x38 }, \
+        /* { "main_pressure", SENSOR_BMP280, I2C_NUM_0, 0x77 }, */ \
+        /* { "bedroom", SENSOR_AHT20, I2C_NUM_1, 0x38 }, */ \
+    }
+    #endif
+    #define MQTT_TOPIC_SENSOR_PREFIX "branko/sensor/room/"  // Publish: readings of the sensors after the first
+
+    // I2C topology cache: the addresses found on the bus are kept in NVS and
+    // later boots only probe those. A full scan runs when an expected device
+    // is missing, when the cache is empty, or always with I2C_FORCE_FULL_SCAN.
+    //#define I2C_FORCE_FULL_SCAN
+    #define I2C_PROBE_TIMEOUT_MS 5      // Per-address probe timeout
+    #define I2C_SCAN_MAX_TIMEOUTS 3     // Consecutive probe timeouts that abort a scan (bus stuck)
+
     #define TEMP_PUBLISH_INTERVAL_MS 10000  // Publish every 10 seconds
+    #define TEMP_FIRST_READING_WAIT_MS 15000  // Longest the first reading waits for MQTT before it is stored
+
+    // Report-by-exception (uncomment TEMP_REPORT_BY_EXCEPTION): instead of
+    // every TEMP_PUBLISH_INTERVAL_MS, a sensor publishes when a quantity moved
+    // its deadband away from the last published value, and at least every
+    // max silence. The sampling interval adapts between the min and max
+    // interval: short while readings move, long while they are stable. The
+    // values below are defaults; "key=value" pairs on MQTT_TOPIC_REPORT_SET
+    // change them at runtime (kept in NVS), e.g. "temperature=0.2,max_silence=900"
+    // (deadbands in °C, %RH and hPa, times in seconds). The applied settings
+    // are published retained to MQTT_TOPIC_REPORT_CONFIG. Not used with
+    // TEMP_BATCH_MODE or TEMP_DEEP_SLEEP_MODE, which have their own schedules.
+    //#define TEMP_REPORT_BY_EXCEPTION
+    #define MQTT_TOPIC_REPORT_SET "branko/devices/temp_sensor/report/set"       // Subscribe: report settings
+    #define MQTT_TOPIC_REPORT_CONFIG "branko/devices/temp_sensor/report/config" // Publish: applied settings (retained)
+    #define REPORT_DEADBAND_TEMP_C 0.2f         // Publish on a change this large
+    #define REPORT_DEADBAND_HUMIDITY 1.0f       // %RH
+    #define REPORT_DEADBAND_PRESSURE_HPA 0.5f
+    #define REPORT_MAX_SILENCE_MS 900000        // Publish at least every 15 minutes
+    #define REPORT_MIN_INTERVAL_MS 5000         // Fastest sampling, while readings move
+    #define REPORT_MAX_INTERVAL_MS 120000       // Slowest sampling, while they are stable
+
+    // Batched publishing (comment out TEMP_BATCH_MODE for one message per sample)
+    // Samples go into a ring buffer at TEMP_SAMPLE_INTERVAL_MS and are flushed
+    // as one message every TEMP_BATCH_FLUSH_INTERVAL_MS, or earlier when the
+    // buffer fills. The latest value is still sent to MQTT_TOPIC_TEMP on every
+    // flush for the webapp.
+    //#define TEMP_BATCH_MODE
+    #define MQTT_TOPIC_TEMP_BATCH "branko/sensor/temperature/batch"  // Publish: timestamped sample batches
+    #define TEMP_SAMPLE_INTERVAL_MS 2000        // Sample every 2 seconds
+    #define TEMP_BATCH_FLUSH_INTERVAL_MS 60000  // Flush a batch every minute
+    #define TEMP_BATCH_SIZE 32                  // Ring buffer capacity (samples)
+
+    // Store-and-forward: readings that cannot be published are appended to a
+    // log in the "readings" flash partition (see partitions.csv) and drained
+    // to MQTT_TOPIC_TEMP_BACKLOG after reconnecting
+    #define STORE_FORWARD_ENABLED
+    #define STORE_FORWARD_PARTITION "readings"
+    #define MQTT_TOPIC_TEMP_BACKLOG "branko/sensor/temperature/backlog"  // Publish: readings taken while offline
+    #define STORE_DRAIN_BATCH_SIZE 20     // Readings per backlog message
+    #define STORE_DRAIN_INTERVAL_MS 1000  // Pause between backlog messages
+    #define STORE_DRAIN_JITTER_MS 5000    // Random delay before draining after a reconnect
+
+    // Deep-sleep duty cycling for battery power (comment out TEMP_DEEP_SLEEP_MODE
+    // to stay awake). Each wake takes one reading into RTC memory and goes back
+    // to sleep; WiFi and MQTT only come up every TEMP_SLEEP_CONNECT_EVERY wakes,
+    // when the temperature moved TEMP_SLEEP_REPORT_DELTA_C from the last
+    // published value, or when the buffer is full. The buffered readings then go
+    // to MQTT_TOPIC_TEMP_BATCH and an energy estimate to MQTT_TOPIC_TEMP_ENERGY.
+    //#define TEMP_DEEP_SLEEP_MODE
+    #define MQTT_TOPIC_TEMP_ENERGY "branko/sensor/energy"  // Publish: duty-cycle energy estimate
+    #define TEMP_SLEEP_INTERVAL_MS 60000        // Wake-to-wake period
+    #define TEMP_SLEEP_MIN_MS 1000              // Shortest sleep after a long wake
+    #define TEMP_SLEEP_CONNECT_EVERY 10         // Publish at least every N wakes
+    #define TEMP_SLEEP_REPORT_DELTA_C 0.5f      // Publish early on a change this large
+    #define TEMP_SLEEP_BUFFER_SIZE 64           // Readings kept in RTC memory
+    #define TEMP_SLEEP_CONNECT_TIMEOUT_MS 10000 // Give up on WiFi/MQTT and keep the readings
+    #define TEMP_SLEEP_FLUSH_TIMEOUT_MS 2000    // Wait for QoS 1 publishes to leave the outbox
+
+    // Current draw for the energy estimate (ESP32-WROOM-32 + AHT20, 3.3 V);
+    // measure the actual board to calibrate
+    #define ENERGY_SUPPLY_MV 3300
+    #define ENERGY_SLEEP_UA 10                  // Deep sleep: RTC timer and RTC memory
+    #define ENERGY_AWAKE_MA 30                  // CPU on, radio off
+    #define ENERGY_RADIO_MA 120                 // Average with WiFi up
+
+    // Sample filtering (sensor_filter.h), in integer hundredths of each unit.
+    // A sample averages SENSOR_OVERSAMPLE back-to-back conversions, then goes
+    // through a running median of the last SENSOR_MEDIAN_WINDOW samples
+    // (drops single outliers; odd, 1 = off) and an EMA in which a new sample
+    // weighs 1/2^SENSOR_EMA_SHIFT (0 = off). The published readings are the
+    // filtered ones. The duty cycle keeps one conversion per wake: a second
+    // one costs ~80 ms awake, and the median and EMA would hold back a
+    // TEMP_SLEEP_REPORT_DELTA_C change across wakes a minute apart.
+    #ifdef TEMP_DEEP_SLEEP_MODE
+    #define SENSOR_OVERSAMPLE 1
+    #define SENSOR_MEDIAN_WINDOW 1
+    #define SENSOR_EMA_SHIFT 0
+    #else
+    #define SENSOR_OVERSAMPLE 2
+    #define SENSOR_MEDIAN_WINDOW 3
+    #define SENSOR_EMA_SHIFT 2
+    #endif
 #endif
 
 // ============================================
@@ -53,5 +245,55 @@
 // ============================================
 #define STATUS_LED_GPIO 2
 #define HEARTBEAT_INTERVAL_MS 30000  // Send heartbeat every 30 seconds
+#define MQTT_TOPIC_HEARTBEAT "branko/devices/" DEVICE_NAME "/heartbeat"  // Publish: binary health record (heartbeat.h)
+
+// Binary payloads (uncomment PAYLOAD_BINARY): temperature readings, batches,
+// the connection status (and LWT) and relay ACKs are published as
+// schema-versioned CBOR (payload.h) instead of text and JSON. The webapp reads
+// them through the payload bridge in host/bridge. Relay commands are accepted
+// in either form regardless of this setting.
+//#define PAYLOAD_BINARY
+
+// Latency tracing (uncomment LATENCY_TRACE to build the probes in): the time
+// from an MQTT command to its GPIO write and ACK, and from an AHT20 trigger to
+// the publish, is kept in per-stage histograms and published to
+// MQTT_TOPIC_DIAG_LATENCY whenever a message arrives on MQTT_TOPIC_DIAG_REQUEST
+//#define LATENCY_TRACE
+#define MQTT_TOPIC_DIAG_REQUEST "branko/devices/" DEVICE_NAME "/diag/request"  // Subscribe: "latency" or "reset"
+#define MQTT_TOPIC_DIAG_LATENCY "branko/devices/" DEVICE_NAME "/diag/latency"  // Publish: one report per stage
+
+// Deferred logging (uncomment DEFERRED_LOG): log calls on the command and
+// sensor paths (DLOGx in dlog.h) only copy their arguments into a ring; a
+// low-priority task formats and prints them. Messages appear up to
+// DLOG_FLUSH_INTERVAL_MS late, and are dropped (and counted) if the ring fills.
+//#define DEFERRED_LOG
+#define DLOG_RING_SLOTS 32              // Records waiting to be printed, 120 bytes each on the ESP32 (power of two)
+#define DLOG_FLUSH_INTERVAL_MS 20
+#define DLOG_TASK_PRIORITY 1            // Below every task that logs through it
+
+// Peer link (uncomment PEER_LINK): messages on PEER_LINK_TOPICS also go
+// straight to the paired device over ESP-NOW, without the broker, so a
+// sensor and relay in the same room skip two broker hops. The broker still
+// gets every message (the backend needs them) and the receiving device
+// drops the second copy. A peer that stops acknowledging is probed every
+// PEER_LINK_PROBE_MS until it answers; meanwhile the broker path carries
+// on alone. Both devices need the same list. Handlers of these topics also
+// run on the peer link task, so relay command topics are refused (peer_link.h).
+// Set PEER_LINK_LMK (16 bytes) to encrypt the frames.
+//#define PEER_LINK
+#ifndef PEER_LINK_TRANSPORT
+#define PEER_LINK_TRANSPORT transport_espnow   // transport.h
+#endif
+#define PEER_LINK_PEER_MAC { 0x24, 0x6F, 0x28, 0x00, 0x00, 0x00 }   // Station MAC of the other device
+#define PEER_LINK_TOPICS { "branko/sensor/temperature" }            // Sensor readings, to the thermostat
+//#define PEER_LINK_LMK "0123456789abcdef"
+#define PEER_LINK_DEDUP_MS 2000         // Copies further apart count as two messages
+#define PEER_LINK_FAIL_LIMIT 3          // Unacknowledged frames in a row before the link is down
+#define PEER_LINK_PROBE_MS 30000
+
+// Runtime log levels: "TAG=level[,TAG=level...]" on this topic calls
+// esp_log_level_set(); level is none/error/warn/info/debug/verbose (or the
+// first letter) and TAG "*" sets the default for every tag
+#define MQTT_TOPIC_DIAG_LOG_LEVEL "branko/devices/" DEVICE_NAME "/diag/log_level"  // Subscribe: level settings
 
 #endif // CONFIG_H
\ No newline at end of file
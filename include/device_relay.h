@@ -2,41 +2,173 @@
 #define DEVICE_RELAY_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
 #include "esp_err.h"
 
-// Relay GPIO pin (IO27 / D27)
-#define RELAY_GPIO_PIN 27
+#define RELAY_MAX_CHANNELS 8
+#define RELAY_ALL_CHANNELS ((uint8_t)((1U << RELAY_CHANNEL_COUNT) - 1))
 
 /**
- * @brief Initialize the relay GPIO
+ * @brief Where a queued relay command came from
+ */
+typedef enum {
+    RELAY_CMD_CONTROL = 0,  // ON/OFF on MQTT_TOPIC_COMMAND (channel 0)
+    RELAY_CMD_SYNC,         // State sync response from the webapp (channel 0)
+    RELAY_CMD_CHANNEL,      // ON/OFF on one channel's own topic
+    RELAY_CMD_BATCH,        // Several channels on MQTT_TOPIC_CHANNELS_SET
+    RELAY_CMD_THERMOSTAT,   // On-device thermostat (channel 0), see relay_submit_local()
+} relay_cmd_source_t;
+
+/**
+ * @brief One decoded command for the actuator task
+ *
+ * Channel n is bit n of both masks.
+ */
+typedef struct {
+    uint8_t mask;               // Channels to switch
+    uint8_t states;             // Their new states (bit set = ON); bits outside mask are ignored
+    relay_cmd_source_t source;
+    uint32_t seq;               // Sender's sequence number, 0 if none; echoed in the ACK
+    bool redelivered;           // Delivered again by the broker (MQTT DUP flag)
+#ifdef LATENCY_TRACE
+    int64_t origin_us;          // MQTT_EVENT_DATA receipt, 0 if not traced
+#endif
+} relay_cmd_t;
+
+typedef struct {
+    uint32_t queued;            // Accepted by relay_submit() / relay_submit_local()
+    uint32_t dropped;           // Rejected: the queue was full
+    uint32_t applied;           // Taken off a queue by the actuator task
+    uint32_t coalesced;         // Replaced by a newer command before it was applied (RELAY_COMMAND_SEQ)
+    uint32_t stale;             // Refused by relay_seq_accept() (RELAY_COMMAND_SEQ)
+} relay_stats_t;
+
+/**
+ * @brief Called on the actuator task after a command was applied
+ *
+ * @param cmd The command
+ * @param states State of every channel after switching (unchanged if switching failed)
+ * @param result Result of relay_set_channels()
+ */
+typedef void (*relay_done_cb_t)(const relay_cmd_t *cmd, uint8_t states, esp_err_t result, void *ctx);
+
+/**
+ * @brief Initialize the relay GPIOs and start the actuator task
  *
- * Configures GPIO2 as output and sets initial state to OFF
+ * Latches every channel's level, restored from NVS (all OFF if none, or
+ * without RELAY_PERSIST_STATE), before its pin becomes an output, then starts
+ * the task that applies queued commands (RELAY_ACTUATOR_PRIORITY, pinned to
+ * RELAY_ACTUATOR_CORE). A state sync that matches the restored state does not
+ * touch the outputs.
  *
- * @return ESP_OK on success, ESP_FAIL on error
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if a channel GPIO is not 0-31,
+ *         ESP_FAIL on error
  */
 esp_err_t relay_init(void);
 
 /**
- * @brief Set relay state
+ * @brief Switch several channels at once
+ *
+ * All pins change together: one write to the GPIO set register and one to
+ * the clear register (only those needed), never a read-modify-write of the
+ * output register. A change is written to NVS after RELAY_PERSIST_DELAY_MS,
+ * coalesced with any further changes and at most once per
+ * RELAY_PERSIST_MIN_INTERVAL_MS.
+ *
+ * @param mask Channels to switch (bit n = channel n)
+ * @param states New state of each channel in mask (bit set = ON)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if mask is empty or names a
+ *         channel beyond RELAY_CHANNEL_COUNT
+ */
+esp_err_t relay_set_channels(uint8_t mask, uint8_t states);
+
+/**
+ * @brief Set one channel
+ */
+esp_err_t relay_set_channel(uint8_t channel, bool state);
+
+/**
+ * @brief Set channel 0 (the boiler)
  *
  * @param state true to turn relay ON, false to turn relay OFF
- * @return ESP_OK on success, ESP_FAIL on error
  */
 esp_err_t relay_set_state(bool state);
 
 /**
- * @brief Get current relay state
+ * @brief Queue a command for the actuator task
+ *
+ * Lock-free and never blocks. Only one task may submit (the MQTT task).
+ *
+ * With RELAY_COMMAND_SEQ, each source (each channel for RELAY_CMD_CHANNEL)
+ * has a single slot instead: the command merges into one still waiting there,
+ * its states winning on the channels both name, and the merged command
+ * carries its number; the older one is not ACKed on its own. The channels
+ * it names are dropped from the other slots, so an older state never lands
+ * after it; a command left with no channels is not ACKed either. The
+ * actuator takes the slots in the order they were last written.
+ *
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM if RELAY_CMD_QUEUE_LEN commands are
+ *         already waiting, ESP_ERR_INVALID_STATE if the actuator is not running
+ */
+esp_err_t relay_submit(const relay_cmd_t *cmd);
+
+#ifdef RELAY_COMMAND_SEQ
+/**
+ * @brief Check a command's sequence number against its source's window
+ *
+ * A command may end in "#<seq>" ("ON#42", "0=ON,2=OFF#43"; a trailing
+ * field in binary payloads) and its ACK echoes the number ("ACK:ON#42").
+ * Commands are latest-wins (see relay_submit()), so only the applied one is
+ * ACKed: a sender takes an ACK with a higher number as the answer to its own.
+ *
+ * Accepts a command without a number, one newer than any submitted from its
+ * source, and one below that the sender restarted its count for: it is
+ * RELAY_SEQ_WINDOW or more below, or it is not flagged redelivered and came
+ * RELAY_SEQ_RESTART_MS or more after the newest. A repeat of the newest is
+ * never a restart. Call it from the submitting task before relay_submit(),
+ * which makes the number the newest once the command is queued.
+ *
+ * @return false for a redelivered or stale command, counted in stale
+ */
+bool relay_seq_accept(const relay_cmd_t *cmd);
+#endif
+
+/**
+ * @brief Queue a command from a task on the device (the thermostat)
+ *
+ * Same as relay_submit() over a queue of its own, so a second task can
+ * submit next to the MQTT task. Only one task may use it.
+ */
+esp_err_t relay_submit_local(const relay_cmd_t *cmd);
+
+/**
+ * @brief Set the function told about each applied command (NULL for none)
+ *
+ * Set it before commands can arrive; it is read by the actuator task.
+ */
+void relay_set_done_handler(relay_done_cb_t handler, void *ctx);
+
+relay_stats_t relay_get_stats(void);
+
+/**
+ * @brief Get the state of every channel (bit n set = channel n ON)
+ */
+uint8_t relay_get_channels(void);
+
+/**
+ * @brief Get the state of channel 0
  *
  * @return true if relay is ON, false if relay is OFF
  */
 bool relay_get_state(void);
 
 /**
- * @brief Toggle relay state
+ * @brief Toggle channel 0
  *
  * Switches relay from ON to OFF or OFF to ON
  *
- * @return ESP_OK on success, ESP_FAIL on error
+ * @return ESP_OK on success
  */
 esp_err_t relay_toggle(void);
 
@@ -1,32 +1,29 @@
 #ifndef DEVICE_TEMP_H
 #define DEVICE_TEMP_H
 
+#include <stdint.h>
 #include "esp_err.h"
 #include "mqtt_client.h"
+#include "sensor_manager.h"
 
 /**
- * @brief Sensor reading structure
- */
-typedef struct {
-    float aht20_temp;      // Temperature from AHT20 (°C)
-    float aht20_humidity;  // Humidity from AHT20 (%)
-    bool aht20_valid;      // AHT20 reading valid
-} sensor_data_t;
-
-/**
- * @brief Initialize I2C and temperature sensor (AHT20)
+ * @brief Bring up the I2C buses and every sensor in SENSOR_TABLE
  *
- * @return ESP_OK on success
+ * Requires nvs_flash_init() for the cached bus maps; without NVS every boot
+ * scans the buses in full. Readings are taken through sensor_manager.h.
+ *
+ * @return ESP_OK on success, also when sensors are missing
  */
 esp_err_t temp_sensor_init(void);
 
 /**
- * @brief Read data from AHT20 sensor
+ * @brief Scan every I2C bus in use and refresh the cached bus maps
  *
- * @param data Pointer to sensor_data_t structure to store readings
- * @return ESP_OK on success
+ * Also initializes sensors that were not found at boot but answer now.
+ *
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if a bus appears stuck
  */
-esp_err_t temp_sensor_read(sensor_data_t *data);
+esp_err_t temp_sensor_rescan_bus(void);
 
 /**
  * @brief Start periodic temperature publishing task
@@ -36,4 +33,15 @@ esp_err_t temp_sensor_read(sensor_data_t *data);
  */
 esp_err_t temp_sensor_start_publishing(esp_mqtt_client_handle_t client);
 
+/**
+ * @brief Run one wake of the deep-sleep duty cycle (TEMP_DEEP_SLEEP_MODE)
+ *
+ * Takes a reading of the primary sensor into the RTC-memory buffer and,
+ * when a publish is due, brings up WiFi and MQTT to send the buffered
+ * readings along with the other sensors' current ones. Call after
+ * temp_sensor_init() instead of starting WiFi and the publishing task; it
+ * ends in deep sleep and does not return.
+ */
+void temp_sensor_run_duty_cycle(void);
+
 #endif // DEVICE_TEMP_H
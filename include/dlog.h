@@ -0,0 +1,108 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include "config.h"
+#include "esp_log.h"
+
+/*
+ * Deferred logging for hot paths (DEFERRED_LOG in config.h).
+ *
+ * DLOGx() takes the same arguments as ESP_LOGx(). With DEFERRED_LOG the call
+ * only walks the format's conversions and copies the raw arguments (strings
+ * by value) into a lock-free ring, together with the format pointer, which
+ * serves as the message ID. A low-priority task formats the records and
+ * writes them through esp_log_write() later. When the ring is full the record
+ * is dropped and counted; a producer never waits.
+ *
+ * Without DEFERRED_LOG the macros are plain ESP_LOGx().
+ */
+
+#ifdef DEFERRED_LOG
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define DLOG_ARG_BYTES 96   // Raw arguments per record; longer strings are cut
+
+/**
+ * @brief One deferred log call, as copied out of the ring
+ */
+typedef struct {
+    uint32_t timestamp_ms;      // esp_log_timestamp() at the call
+    const char *format;
+    const char *tag;
+    esp_log_level_t level;
+    bool truncated;             // Arguments did not all fit
+    uint16_t len;               // Bytes used in args
+    uint8_t args[DLOG_ARG_BYTES];
+} dlog_record_t;
+
+typedef struct {
+    uint32_t written;
+    uint32_t dropped;           // Ring full
+    uint32_t truncated;
+} dlog_stats_t;
+
+#define DLOG_LEVEL(level, tag, format, ...) do {                       \
+        if (LOG_LOCAL_LEVEL >= (level)) {                               \
+            dlog_write((level), (tag), format, ##__VA_ARGS__);          \
+        }                                                               \
+    } while (0)
+
+#define DLOGE(tag, format, ...) DLOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...) DLOG_LEVEL(ESP_LOG_WARN,  tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...) DLOG_LEVEL(ESP_LOG_INFO,  tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) DLOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+/**
+ * @brief Set up the ring and start the task that prints it
+ *
+ * Call first thing in app_main. Calls made before fall back to immediate
+ * formatting.
+ */
+esp_err_t dlog_init(void);
+
+/**
+ * @brief Record a message for later formatting (use the DLOGx macros)
+ *
+ * Skipped when the tag's runtime level (esp_log_level_set) filters it out.
+ * Supports the printf conversions d i u o x X c s p f e g a and %%, with flags,
+ * width, precision (including '*') and length modifiers. Strings are copied,
+ * so "%.*s" over a buffer that is about to be reused is safe.
+ */
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * @brief Take the oldest record out of the ring (single consumer)
+ *
+ * @return false if the ring is empty
+ */
+bool dlog_pop(dlog_record_t *record);
+
+/**
+ * @brief Format a record's message (without the level/time/tag prefix)
+ *
+ * @return Length written (excluding NUL), truncated to len - 1
+ */
+size_t dlog_render(const dlog_record_t *record, char *buf, size_t len);
+
+/**
+ * @brief Print every record in the ring now, e.g. before a restart
+ */
+void dlog_flush(void);
+
+dlog_stats_t dlog_get_stats(void);
+
+#else
+
+#define DLOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+
+#endif // DEFERRED_LOG
+
+#endif // DLOG_H
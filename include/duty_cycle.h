@@ -0,0 +1,128 @@
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sample_ring.h"
+
+/**
+ * @brief Why a wake brings up WiFi and MQTT
+ */
+typedef enum {
+    DUTY_CONNECT_NONE = 0,      // Sample only, back to sleep
+    DUTY_CONNECT_SCHEDULED,     // Every TEMP_SLEEP_CONNECT_EVERY wakes
+    DUTY_CONNECT_THRESHOLD,     // Reading moved TEMP_SLEEP_REPORT_DELTA_C from the last published one
+    DUTY_CONNECT_BUFFER_FULL,   // The next sample would overwrite an unpublished one
+} duty_connect_reason_t;
+
+/**
+ * @brief Energy use since power-on, from the current model in config.h
+ */
+typedef struct {
+    uint32_t wakes;
+    uint32_t samples;           // Readings taken
+    uint32_t connects;          // Wakes that brought up the radio
+    uint32_t failed_connects;   // ... and could not publish
+    uint64_t elapsed_ms;        // Awake plus asleep
+    uint64_t awake_ms;
+    uint64_t radio_ms;          // Part of awake_ms with WiFi on
+    uint32_t avg_current_ua;
+    uint32_t uj_per_sample;     // Energy per reading, publishing included
+} duty_cycle_energy_t;
+
+/**
+ * @brief Duty-cycle state that survives deep sleep
+ *
+ * Lives in RTC slow memory (RTC_DATA_ATTR) together with the sample storage,
+ * so it is kept across deep sleep and cleared by a power-on reset. Only
+ * touched by the one task that runs the wake.
+ */
+typedef struct {
+    uint32_t magic;             // Set once initialized; anything else is a fresh start
+    uint32_t wakes;
+    uint16_t since_connect;     // Wakes since the last connection attempt
+    bool connect_failed;        // Last attempt could not publish
+    bool reported;              // reported_temp is valid
+    float reported_temp;        // Last temperature published
+    uint64_t clock_ms;          // Time since power-on at the start of this wake
+    uint32_t samples;
+    uint32_t connects;
+    uint32_t failed_connects;
+    uint64_t awake_ms;
+    uint64_t radio_ms;
+    uint64_t charge_nc;         // Charge drawn, in nanocoulombs (uA x ms)
+    sample_ring_t ring;         // Readings not yet published
+} duty_cycle_t;
+
+/**
+ * @brief Pick up the state kept over deep sleep, or start over
+ *
+ * @param storage Sample storage, also in RTC memory
+ * @param woke_from_sleep false after a power-on or reset, which discards any state
+ * @return true if the state from before the sleep was kept
+ */
+bool duty_cycle_init(duty_cycle_t *dc, sensor_sample_t *storage, uint16_t capacity, bool woke_from_sleep);
+
+/**
+ * @brief Time since power-on, for sample timestamps that stay ordered over sleeps
+ *
+ * @param uptime_ms Milliseconds since this wake started (esp_timer)
+ */
+uint64_t duty_cycle_now_ms(const duty_cycle_t *dc, uint32_t uptime_ms);
+
+/**
+ * @brief Count a wake and buffer its reading
+ *
+ * After a failed connection the threshold is not acted on again until the
+ * next scheduled attempt, so an outage does not keep the radio on every wake.
+ *
+ * @param sample The reading, or NULL if the sensor failed
+ * @return Whether to connect and publish on this wake
+ */
+duty_connect_reason_t duty_cycle_on_wake(duty_cycle_t *dc, const sensor_sample_t *sample);
+
+/**
+ * @brief Drop the n oldest buffered readings after they were published
+ */
+void duty_cycle_on_published(duty_cycle_t *dc, uint16_t n);
+
+/**
+ * @brief Finish a connection attempt
+ *
+ * @param published true if the buffer was handed to the broker
+ * @param latest Newest reading published, the reference for the threshold
+ *               (NULL keeps the previous one)
+ */
+void duty_cycle_on_connect_done(duty_cycle_t *dc, bool published, const sensor_sample_t *latest);
+
+/**
+ * @brief Sleep that keeps wakes TEMP_SLEEP_INTERVAL_MS apart
+ *
+ * @param awake_ms Time spent in this wake so far
+ */
+uint32_t duty_cycle_sleep_ms(uint32_t awake_ms);
+
+/**
+ * @brief Account for this wake and the sleep that follows
+ *
+ * @param awake_ms Time since this wake started
+ * @param radio_ms Part of it with WiFi on
+ * @param sleep_ms Deep sleep about to start
+ */
+void duty_cycle_on_sleep(duty_cycle_t *dc, uint32_t awake_ms, uint32_t radio_ms, uint32_t sleep_ms);
+
+/**
+ * @brief Energy and wake counters since power-on
+ */
+duty_cycle_energy_t duty_cycle_energy(const duty_cycle_t *dc);
+
+/**
+ * @brief Encode the energy counters as JSON
+ *
+ * Format: {"wakes":N,"samples":N,"connects":N,"failed":N,"awake_ms":N,"radio_ms":N,"avg_ua":N,"uj_per_sample":N}
+ *
+ * @return Length of the payload (excluding NUL), 0 if it does not fit
+ */
+size_t duty_cycle_encode_energy(const duty_cycle_t *dc, char *buf, size_t len);
+
+#endif // DUTY_CYCLE_H
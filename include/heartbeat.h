@@ -0,0 +1,92 @@
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Health record published to MQTT_TOPIC_HEARTBEAT every HEARTBEAT_INTERVAL_MS
+ * while the broker is connected.
+ *
+ * Payload, little-endian, HEARTBEAT_FIXED_LEN + 2 bytes per watched task:
+ *
+ *   off size
+ *    0   1  version (HEARTBEAT_VERSION)
+ *    1   4  uptime, s
+ *    5   4  free heap, bytes
+ *    9   4  minimum free heap since boot, bytes
+ *   13   1  RSSI, dBm (signed; 0 while not associated)
+ *   14   2  MQTT outbox, bytes (saturates at 0xFFFF)
+ *   16   2  WiFi reconnects
+ *   18   2  MQTT reconnects
+ *   20   4  publishes accepted by the client
+ *   24   4  publishes rejected by the client
+ *   28   1  task count N
+ *   29  2N  stack high-water mark per task, bytes never used
+ *           (0xFFFF: task not running), in heartbeat_task_name() order
+ *  +0    4  time without WiFi since first joining, s          (version 2)
+ *  +4    4  time without the broker since first connecting, s
+ *  +8    4  broker time to recover, last outage, ms
+ *  +12   4  broker time to recover, longest outage, ms
+ *
+ * Offsets marked + follow the stack marks. A layout change bumps the
+ * version; fields are only ever appended.
+ */
+
+#define HEARTBEAT_VERSION   2
+#define HEARTBEAT_FIXED_LEN 29
+#define HEARTBEAT_LINK_LEN  16
+#define HEARTBEAT_MAX_TASKS 8
+#define HEARTBEAT_MAX_LEN   (HEARTBEAT_FIXED_LEN + 2 * HEARTBEAT_MAX_TASKS + HEARTBEAT_LINK_LEN)
+#define HEARTBEAT_NO_TASK   0xFFFF
+
+typedef struct {
+    uint32_t uptime_s;
+    uint32_t free_heap;
+    uint32_t min_free_heap;
+    int8_t rssi;
+    uint16_t outbox_bytes;
+    uint16_t wifi_reconnects;
+    uint16_t mqtt_reconnects;
+    uint32_t published;
+    uint32_t publish_failed;
+    uint8_t task_count;
+    uint16_t stack_free[HEARTBEAT_MAX_TASKS];
+    uint32_t wifi_down_s;
+    uint32_t offline_s;
+    uint32_t last_recovery_ms;
+    uint32_t longest_recovery_ms;
+} heartbeat_t;
+
+/**
+ * @brief Take a snapshot of the device's health
+ */
+void heartbeat_collect(heartbeat_t *hb);
+
+/**
+ * @brief Serialize a snapshot in the layout above
+ *
+ * @return Payload length, 0 if buf is too small
+ */
+size_t heartbeat_encode(const heartbeat_t *hb, uint8_t *buf, size_t len);
+
+/**
+ * @brief Parse a payload of this or a later version (extra bytes are ignored)
+ *
+ * @return ESP_ERR_INVALID_VERSION for an older version, ESP_ERR_INVALID_SIZE
+ *         if truncated
+ */
+esp_err_t heartbeat_decode(const uint8_t *buf, size_t len, heartbeat_t *hb);
+
+/**
+ * @brief Name of the task in stack slot i (NULL past the last)
+ */
+const char *heartbeat_task_name(size_t i);
+
+/**
+ * @brief Start the low-priority task that publishes the heartbeat
+ */
+esp_err_t heartbeat_start(void);
+
+#endif // HEARTBEAT_H
@@ -0,0 +1,66 @@
+#ifndef I2C_TOPOLOGY_H
+#define I2C_TOPOLOGY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/i2c_master.h"
+
+/**
+ * @brief Set of 7-bit addresses that acknowledged on one bus
+ */
+typedef struct {
+    uint8_t present[16];    // Bit (addr % 8) of byte (addr / 8)
+} i2c_topology_t;
+
+/**
+ * @brief How a topology was established
+ */
+typedef struct {
+    bool from_cache;    // Cached addresses answered; no full scan was needed
+    bool full_scan;     // Every address was probed
+    bool bus_stuck;     // Probing stopped after I2C_SCAN_MAX_TIMEOUTS timeouts in a row
+    uint16_t probes;    // Addresses probed
+    uint8_t devices;    // Addresses that acknowledged
+} i2c_topology_result_t;
+
+/**
+ * @brief Find the devices on a bus, using the map cached in NVS when possible
+ *
+ * Only the cached addresses are probed. A full scan runs when there is no
+ * cache, when one of the expected addresses does not answer, or when
+ * force_scan is set. Every probe uses I2C_PROBE_TIMEOUT_MS. The map is saved
+ * back to NVS when it changed; without NVS the bus is scanned every time.
+ *
+ * @param bus Bus to probe
+ * @param port Port number of the bus (selects the cache entry)
+ * @param expected Addresses the firmware needs, may be NULL
+ * @param expected_count Number of expected addresses
+ * @param force_scan Ignore the cache and probe every address
+ * @param topology Filled with the addresses that answered
+ * @param result Optional details of the discovery
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if the bus appears stuck
+ */
+esp_err_t i2c_topology_discover(i2c_master_bus_handle_t bus, int port,
+                                const uint8_t *expected, size_t expected_count, bool force_scan,
+                                i2c_topology_t *topology, i2c_topology_result_t *result);
+
+/**
+ * @brief Drop the cached map of a bus so the next discovery scans it
+ */
+esp_err_t i2c_topology_forget(int port);
+
+static inline bool i2c_topology_has(const i2c_topology_t *topology, uint8_t addr)
+{
+    return addr < 128 && (topology->present[addr / 8] & (1u << (addr % 8))) != 0;
+}
+
+static inline void i2c_topology_add(i2c_topology_t *topology, uint8_t addr)
+{
+    if (addr < 128) {
+        topology->present[addr / 8] |= (uint8_t)(1u << (addr % 8));
+    }
+}
+
+#endif // I2C_TOPOLOGY_H
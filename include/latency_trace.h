@@ -0,0 +1,93 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include "config.h"
+
+/*
+ * Latency probes on the command and sensor paths (LATENCY_TRACE in config.h).
+ *
+ * Each path has an origin timestamp (MQTT_EVENT_DATA receipt for a relay
+ * command, the AHT20 trigger for a reading); a probe adds the time from that
+ * origin to the histogram of its stage. Comparing stages shows where the time
+ * goes. Without LATENCY_TRACE the macros expand to nothing, so neither the
+ * probes nor the origin variables they use are compiled in.
+ */
+
+#ifdef LATENCY_TRACE
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#define LATENCY_BUCKETS 24  // Bucket i counts [2^i, 2^(i+1)) us (0 includes 0, the last everything from 8.4 s)
+
+typedef enum {
+#ifdef DEVICE_TYPE_RELAY
+    LATENCY_CMD_DISPATCH,       // Topic handler entered
+    LATENCY_CMD_RELAY_SET,      // relay_set_channels() entered on the actuator task
+    LATENCY_CMD_GPIO,           // GPIO written
+    LATENCY_CMD_ACK,            // ACK enqueued
+#endif
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+    LATENCY_SENSOR_CONVERTED,   // Frame read and decoded by the poll state machine
+    LATENCY_SENSOR_COLLECTED,   // Reading returned by sensor_manager_collect()
+    LATENCY_SENSOR_PUBLISHED,   // Publish accepted by the client (TEMP_BATCH_MODE: at the flush)
+#endif
+    LATENCY_STAGE_COUNT,
+} latency_stage_t;
+
+/**
+ * @brief Accumulated latencies of one stage
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[LATENCY_BUCKETS];
+} latency_hist_t;
+
+#define LATENCY_TRACE_STAMP(var) ((var) = esp_timer_get_time())
+#define LATENCY_TRACE_RECORD(stage, origin_us) latency_trace_record((stage), (origin_us))
+
+/**
+ * @brief Register the diagnostics request topic
+ *
+ * A message on MQTT_TOPIC_DIAG_REQUEST publishes one report per stage to
+ * MQTT_TOPIC_DIAG_LATENCY; the payload "reset" also clears the histograms
+ * afterwards. Call before the broker connects (mqtt_client_init does).
+ */
+esp_err_t latency_trace_init(void);
+
+/**
+ * @brief Add the time since origin_us to a stage (origin 0 is ignored)
+ *
+ * Static memory only, no locks: each stage is recorded from a single task.
+ */
+void latency_trace_record(latency_stage_t stage, int64_t origin_us);
+
+/**
+ * @brief Snapshot of one stage's histogram
+ */
+latency_hist_t latency_trace_get(latency_stage_t stage);
+
+/**
+ * @brief Encode one stage as JSON
+ *
+ * Format: {"stage":"gpio","n":N,"mean_us":N,"p50_us":N,"p99_us":N,"max_us":N,"h":[...]}
+ * Percentiles are bucket upper bounds; "h" stops at the last non-empty bucket.
+ *
+ * @return Length of the payload (excluding NUL), 0 if it does not fit
+ */
+size_t latency_trace_encode_json(latency_stage_t stage, char *buf, size_t len);
+
+void latency_trace_reset(void);
+
+#else
+
+#define LATENCY_TRACE_STAMP(var) ((void)0)
+#define LATENCY_TRACE_RECORD(stage, origin_us) ((void)0)
+
+#endif // LATENCY_TRACE
+
+#endif // LATENCY_TRACE_H
@@ -0,0 +1,30 @@
+#ifndef LOG_CONTROL_H
+#define LOG_CONTROL_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * Runtime log levels over MQTT (MQTT_TOPIC_DIAG_LOG_LEVEL in config.h).
+ *
+ * A message "TAG=level[,TAG=level...]" calls esp_log_level_set() for each
+ * entry, so one module can be turned up to debug on a running device without
+ * a rebuild. Works with both ESP_LOGx and the deferred DLOGx calls.
+ */
+
+/**
+ * @brief Apply a level setting message
+ *
+ * Levels are none, error, warn, info, debug, verbose or their first letter
+ * (case-insensitive). Valid entries are applied even if others are not.
+ *
+ * @return ESP_ERR_INVALID_ARG if any entry was rejected
+ */
+esp_err_t log_control_apply(const char *data, size_t len);
+
+/**
+ * @brief Subscribe to MQTT_TOPIC_DIAG_LOG_LEVEL (call before the client starts)
+ */
+esp_err_t log_control_init(void);
+
+#endif // LOG_CONTROL_H
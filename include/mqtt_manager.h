@@ -1,15 +1,22 @@
 #ifndef MQTT_MANAGER_H
 #define MQTT_MANAGER_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
 #include "mqtt_client.h"
+#include "reconnect.h"
 
 /**
  * @brief Initialize and connect to MQTT broker with LWT
  *
  * This function initializes the MQTT client, sets up Last Will and Testament (LWT),
- * and connects to the broker. After successful connection, it publishes the device
- * status with IP address.
+ * and connects to the broker once WiFi has an address. After successful connection,
+ * it publishes the device status with IP address and boot timings.
+ *
+ * Call after wifi_manager_init() (which creates the default event loop) and
+ * before the station can have an address, so the start is not missed.
+ * BOOT_EVENT_MQTT is set while the broker session is up.
  *
  * @return ESP_OK on success, ESP_FAIL on error
  */
@@ -22,6 +29,51 @@ esp_err_t mqtt_client_init(void);
  */
 esp_mqtt_client_handle_t mqtt_get_client(void);
 
+/**
+ * @brief Check if the MQTT client is currently connected to the broker
+ *
+ * @return true between MQTT_EVENT_CONNECTED and MQTT_EVENT_DISCONNECTED
+ */
+bool mqtt_is_connected(void);
+
+/**
+ * @brief Publish/message counters since boot
+ */
+typedef struct {
+    uint32_t connects;          // MQTT_EVENT_CONNECTED
+    uint32_t disconnects;       // MQTT_EVENT_DISCONNECTED
+    uint32_t published;         // Accepted by the client (sent or queued)
+    uint32_t publish_failed;    // Rejected by the client (msg_id < 0)
+} mqtt_stats_t;
+
+/**
+ * @brief esp_mqtt_client_publish() that counts the outcome in mqtt_get_stats()
+ *
+ * Firmware modules publish through this (and mqtt_enqueue()) rather than
+ * calling the client directly, so the heartbeat sees every message.
+ *
+ * @return msg_id as returned by the client, -1 on failure
+ */
+int mqtt_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                 int len, int qos, int retain);
+
+/**
+ * @brief esp_mqtt_client_enqueue() that counts the outcome in mqtt_get_stats()
+ */
+int mqtt_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                 int len, int qos, int retain, bool store);
+
+mqtt_stats_t mqtt_get_stats(void);
+
+/**
+ * @brief Outages of the broker session since boot, time spent offline and
+ *        time to recover
+ *
+ * A lost or failed session is retried with jittered backoff
+ * (MQTT_BACKOFF_*_MS) while WiFi is up, and at once when WiFi comes back.
+ */
+reconnect_stats_t mqtt_get_link_stats(void);
+
 /**
  * @brief Publish device connection status (online/offline with IP)
  *
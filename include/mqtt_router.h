@@ -0,0 +1,146 @@
+#ifndef MQTT_ROUTER_H
+#define MQTT_ROUTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Maximum number of topics the router can hold (a power of two). An 8-channel
+// thermostat relay with every diagnostic topic registers 16.
+#define MQTT_ROUTER_MAX_ROUTES 32
+
+/**
+ * @brief Handler for messages on one topic
+ *
+ * @param data Payload (not NUL-terminated)
+ * @param data_len Payload length in bytes
+ * @param ctx Context pointer given at registration
+ */
+typedef void (*mqtt_topic_handler_t)(const char *data, int data_len, void *ctx);
+
+/**
+ * @brief Streaming handler, called once per received fragment
+ *
+ * Lets a module parse messages of any size incrementally without the
+ * payload ever being copied.
+ *
+ * @param chunk Fragment bytes (not NUL-terminated)
+ * @param chunk_len Fragment length in bytes
+ * @param offset Offset of this fragment within the message
+ * @param total_len Length of the whole message
+ * @param ctx Context pointer given at registration
+ */
+typedef void (*mqtt_stream_handler_t)(const char *chunk, int chunk_len, int offset, int total_len, void *ctx);
+
+/**
+ * @brief One topic -> handler binding
+ *
+ * Exactly one of handler (contiguous payload) or stream (per fragment) is set.
+ * A route marked mqtt_task_only is never handed to mqtt_router_deliver():
+ * its handler feeds a single-producer queue owned by the MQTT task.
+ */
+typedef struct {
+    const char *topic;
+    uint16_t topic_len;
+    mqtt_topic_handler_t handler;
+    void *ctx;
+    mqtt_stream_handler_t stream;
+    bool mqtt_task_only;
+} mqtt_route_t;
+
+/**
+ * @brief Build a route from a topic string literal (e.g. an MQTT_TOPIC_* macro)
+ *
+ * The topic length is taken with sizeof, so it is fixed at compile time.
+ */
+#define MQTT_ROUTE(topic_literal, handler_fn, handler_ctx) \
+    { (topic_literal), (uint16_t)(sizeof(topic_literal) - 1), (handler_fn), (handler_ctx) }
+
+/**
+ * @brief Same as MQTT_ROUTE(), for a handler that must run on the MQTT task
+ */
+#define MQTT_TASK_ROUTE(topic_literal, handler_fn, handler_ctx) \
+    { (topic_literal), (uint16_t)(sizeof(topic_literal) - 1), (handler_fn), (handler_ctx), NULL, true }
+
+/**
+ * @brief Register a handler for an exact topic
+ *
+ * Routes are meant to be registered during init, before the MQTT client
+ * starts delivering messages. The topic string must stay valid.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the topic is already
+ *         routed, ESP_ERR_NO_MEM if the table is full
+ */
+esp_err_t mqtt_router_register(const char *topic, mqtt_topic_handler_t handler, void *ctx);
+
+/**
+ * @brief Register a streaming handler for an exact topic
+ *
+ * Same rules as mqtt_router_register(); the handler sees every fragment as
+ * it arrives instead of a reassembled payload.
+ */
+esp_err_t mqtt_router_register_stream(const char *topic, mqtt_stream_handler_t handler, void *ctx);
+
+/**
+ * @brief Register a handler that must run on the MQTT task (relay commands)
+ *
+ * Same rules as mqtt_router_register(); mqtt_router_deliver() refuses it.
+ */
+esp_err_t mqtt_router_register_mqtt_task(const char *topic, mqtt_topic_handler_t handler, void *ctx);
+
+/**
+ * @brief Register a table of routes built with MQTT_ROUTE()
+ *
+ * @return ESP_OK on success, or the first registration error
+ */
+esp_err_t mqtt_router_register_routes(const mqtt_route_t *routes, size_t count);
+
+/**
+ * @brief Dispatch one MQTT_EVENT_DATA to the handler of its topic
+ *
+ * esp-mqtt splits messages larger than its buffer into several events; only
+ * the first carries the topic. Single-event messages are passed through
+ * without copying. Fragmented messages go straight to streaming handlers, or
+ * are reassembled into a fixed arena of MQTT_REASSEMBLY_BUFFER_SIZE bytes and
+ * delivered once complete. Messages larger than the arena are dropped.
+ *
+ * Matching is exact: a topic that is only a prefix of a routed topic does
+ * not match. Lookup is a single hash probe plus one compare.
+ *
+ * @param topic Topic of the message (NULL / 0 on continuation fragments)
+ * @param data Payload bytes of this event
+ * @param offset current_data_offset of the event
+ * @param total_len total_data_len of the event
+ * @return true if the event belongs to a routed message, false otherwise
+ */
+bool mqtt_router_dispatch(const char *topic, int topic_len, const char *data, int data_len,
+                          int offset, int total_len);
+
+/**
+ * @brief Deliver a whole message that did not come from the client (the peer link)
+ *
+ * Leaves a fragmented MQTT message being reassembled alone, so it may be
+ * called from another task than the MQTT one; the handler then runs on
+ * that task. Routes marked mqtt_task_only are refused.
+ *
+ * @return true if the topic is routed and was delivered
+ */
+bool mqtt_router_deliver(const char *topic, int topic_len, const char *data, int data_len);
+
+/**
+ * @brief Whether a topic is routed to a handler that must run on the MQTT task
+ */
+bool mqtt_router_mqtt_task_only(const char *topic, int topic_len);
+
+/**
+ * @brief Number of registered routes
+ */
+size_t mqtt_router_route_count(void);
+
+/**
+ * @brief Topic of the route at index (registration order), NULL if out of range
+ */
+const char *mqtt_router_route_topic(size_t index);
+
+#endif // MQTT_ROUTER_H
@@ -0,0 +1,109 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sample_ring.h"
+
+/*
+ * Binary payload schema (PAYLOAD_BINARY in config.h), encoded as CBOR.
+ *
+ * Every message is one array: [version, type, fields...]. Fields are
+ * positional; a new field is only ever appended, and decoders skip fields
+ * they do not know, so the version changes only on an incompatible change.
+ *
+ *   PAYLOAD_TEMPERATURE    [1, 1, temp_centi, humidity_centi]
+ *   PAYLOAD_SAMPLE_BATCH   [1, 2, now_ms, [age_ms, temp_centi, humidity_centi, ...]]
+ *                          age is now_ms minus the sample's timestamp_ms
+ *   PAYLOAD_STATUS         [1, 3, online, device_type, ip (4 bytes), wifi_ms, mqtt_ms, first_publish_ms]
+ *                          boot times are null until reached
+ *   PAYLOAD_RELAY_COMMAND  [1, 4, on, seq]
+ *   PAYLOAD_RELAY_ACK      [1, 5, on, seq]
+ *                          seq is the sender's sequence number, left out if
+ *                          there is none (RELAY_COMMAND_SEQ)
+ *
+ * Temperatures and humidities are hundredths (the precision of the "%.2f"
+ * text payloads), so no floats go on the wire.
+ */
+
+#define PAYLOAD_SCHEMA_VERSION 1
+
+typedef enum {
+    PAYLOAD_TEMPERATURE = 1,
+    PAYLOAD_SAMPLE_BATCH = 2,
+    PAYLOAD_STATUS = 3,
+    PAYLOAD_RELAY_COMMAND = 4,
+    PAYLOAD_RELAY_ACK = 5,
+} payload_type_t;
+
+typedef enum {
+    PAYLOAD_DEVICE_RELAY = 1,
+    PAYLOAD_DEVICE_TEMP_SENSOR = 2,
+} payload_device_t;
+
+/**
+ * @brief Connection status; boot times are -1 until reached
+ */
+typedef struct {
+    bool online;
+    payload_device_t device_type;
+    uint8_t ip[4];          // Network order, as in esp_ip4_addr_t
+    int32_t wifi_ms;
+    int32_t mqtt_ms;
+    int32_t first_publish_ms;
+} payload_status_t;
+
+#define PAYLOAD_TEMPERATURE_MAX_LEN 13
+#define PAYLOAD_STATUS_MAX_LEN      32
+#define PAYLOAD_RELAY_MAX_LEN       9
+
+/**
+ * @brief Encoders; each returns the payload length, 0 if buf is too small
+ */
+size_t payload_encode_temperature(float temperature, float humidity, uint8_t *buf, size_t len);
+size_t payload_encode_status(const payload_status_t *status, uint8_t *buf, size_t len);
+/**
+ * @param seq Sequence number, 0 for none (the field is left out)
+ */
+size_t payload_encode_relay(payload_type_t type, bool on, uint32_t seq, uint8_t *buf, size_t len);
+
+/**
+ * @brief Encode the samples in the ring, oldest first, as one batch
+ *
+ * Same contract as sample_ring_encode_json(): samples that do not fit are
+ * left out and encoded reports how many made it.
+ */
+size_t payload_encode_batch(const sample_ring_t *ring, uint32_t now_ms, uint8_t *buf, size_t len,
+                            uint16_t *encoded);
+
+/**
+ * @brief Check the envelope and return the message type
+ *
+ * @return ESP_ERR_INVALID_VERSION for another schema version,
+ *         ESP_ERR_INVALID_RESPONSE if buf is not a schema message
+ */
+esp_err_t payload_peek_type(const uint8_t *buf, size_t len, payload_type_t *type);
+
+/**
+ * @brief Decoders; each fails with ESP_ERR_INVALID_RESPONSE on another type
+ *        or a malformed message
+ */
+esp_err_t payload_decode_temperature(const uint8_t *buf, size_t len, float *temperature, float *humidity);
+esp_err_t payload_decode_status(const uint8_t *buf, size_t len, payload_status_t *status);
+
+/**
+ * @param seq Sequence number, 0 if the sender gave none (NULL to ignore it)
+ */
+esp_err_t payload_decode_relay(const uint8_t *buf, size_t len, payload_type_t type, bool *on, uint32_t *seq);
+
+/**
+ * @brief Decode a batch into caller storage, timestamps restored from the ages
+ *
+ * @return ESP_ERR_INVALID_SIZE if the batch holds more than capacity samples
+ */
+esp_err_t payload_decode_batch(const uint8_t *buf, size_t len, uint32_t *now_ms,
+                               sensor_sample_t *samples, uint16_t capacity, uint16_t *count);
+
+#endif // PAYLOAD_H
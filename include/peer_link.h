@@ -0,0 +1,115 @@
+#ifndef PEER_LINK_H
+#define PEER_LINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "transport.h"
+
+/*
+ * Direct link to the paired device (PEER_LINK in config.h).
+ *
+ * Messages on PEER_LINK_TOPICS go to the broker as always and, in the same
+ * publish call, straight to the peer over a transport (ESP-NOW on the
+ * ESP32). The peer delivers them to its router as if they came from the
+ * broker; whichever copy arrives second is dropped. When frames stop
+ * being acknowledged the link is marked down and only probed every
+ * PEER_LINK_PROBE_MS, leaving the broker to carry the messages alone.
+ *
+ * Relay command topics cannot be peer topics: their handlers may only run
+ * on the MQTT task, so peer_link_init() refuses them.
+ *
+ * Frame (little endian):
+ *   version (1), boot id (2), sequence (4), topic length (1), topic, payload
+ *
+ * The boot id is random per boot, so a restarted sender's sequence starts
+ * afresh at the receiver.
+ */
+
+#define PEER_FRAME_VERSION  1
+#define PEER_FRAME_HEADER   8
+#define PEER_FRAME_MAX      250         // ESP-NOW payload limit
+
+typedef struct {
+    uint16_t boot_id;
+    uint32_t seq;
+    const char *topic;          // Points into the frame
+    uint8_t topic_len;
+    const uint8_t *data;        // Points into the frame
+    size_t len;
+} peer_frame_t;
+
+/**
+ * @brief Encode a frame
+ *
+ * @return Length written, 0 if it does not fit in size
+ */
+size_t peer_frame_encode(uint16_t boot_id, uint32_t seq, const char *topic, const void *data, size_t len,
+                         uint8_t *buf, size_t size);
+
+/**
+ * @brief Decode a frame; topic and data point into buf
+ *
+ * @return ESP_ERR_INVALID_VERSION for another frame version,
+ *         ESP_ERR_INVALID_SIZE if truncated
+ */
+esp_err_t peer_frame_decode(const uint8_t *buf, size_t len, peer_frame_t *frame);
+
+/**
+ * @brief Sequence numbers seen from the peer: the highest and the 32 before it
+ */
+typedef struct {
+    bool valid;
+    uint16_t boot_id;
+    uint32_t highest;
+    uint32_t seen;              // Bit n: highest - n has been accepted
+} peer_seq_window_t;
+
+/**
+ * @brief Accept a sequence number unless it was seen or is too old to tell
+ */
+bool peer_seq_accept(peer_seq_window_t *window, uint16_t boot_id, uint32_t seq);
+
+typedef struct {
+    uint32_t sent;              // Frames handed to the transport
+    uint32_t delivered;         // Acknowledged by the peer
+    uint32_t failed;            // Not acknowledged, or rejected by the transport
+    uint32_t skipped;           // Not sent while the link was down
+    uint32_t received;          // Frames delivered to the router
+    uint32_t rejected;          // Malformed, or on a topic not in PEER_LINK_TOPICS
+    uint32_t replayed;          // Sequence number already seen
+    uint32_t overflow;          // Receive queue full
+    uint32_t peer_copies;       // Dropped: the broker's copy came first
+    uint32_t mqtt_copies;       // Dropped: the peer's copy came first
+    bool up;
+} peer_link_stats_t;
+
+/**
+ * @brief Start the transport and the task that delivers received frames
+ *
+ * Call once the device has registered its routes (end of app_main).
+ */
+esp_err_t peer_link_init(const transport_t *transport);
+
+/**
+ * @brief Send a message on a PEER_LINK_TOPICS topic to the peer
+ *
+ * mqtt_publish() and mqtt_enqueue() call this for every message; other
+ * topics are ignored. Any task may call it.
+ *
+ * @param len Payload length, or 0 to take strlen(data) as esp-mqtt does
+ * @return ESP_ERR_NOT_SUPPORTED for other topics, ESP_ERR_INVALID_STATE
+ *         while the link is down and not due a probe
+ */
+esp_err_t peer_link_forward(const char *topic, const char *data, int len);
+
+/**
+ * @brief Whether to deliver a message from the broker, or drop it as the
+ *        second copy of one the peer already delivered (MQTT task)
+ */
+bool peer_link_accept_mqtt(const char *topic, int topic_len, const char *data, int len);
+
+peer_link_stats_t peer_link_get_stats(void);
+
+#endif // PEER_LINK_H
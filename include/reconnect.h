@@ -0,0 +1,75 @@
+#ifndef RECONNECT_H
+#define RECONNECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Reconnect timing and outage accounting for one link (the WiFi association
+ * or the broker session).
+ *
+ * Attempt n since the link was last up waits a random time between 0 and
+ * min(max_ms, base_ms * 2^n) ("full jitter"). The window grows while the
+ * link stays down, and devices that lost the same AP or broker at the same
+ * moment spread their attempts over the whole window instead of retrying in
+ * lockstep. There is no attempt limit: the link is retried until it is up.
+ *
+ * An outage runs from a loss of a link that had been up to the moment it is
+ * up again; attempts before the first success (boot) are not an outage.
+ *
+ * Pure logic on caller-supplied timestamps, so it runs unchanged on the host.
+ */
+
+typedef struct {
+    uint32_t base_ms;
+    uint32_t max_ms;
+    uint32_t rng;               // xorshift32 state, never 0
+    bool up;
+    bool ever_up;
+    uint32_t attempt;           // Attempts since the link was last up
+    uint32_t down_since_ms;     // Start of the current outage
+    uint32_t outages;
+    uint32_t attempts;
+    uint64_t downtime_ms;       // Finished outages
+    uint32_t last_recovery_ms;
+    uint32_t longest_recovery_ms;
+} reconnect_t;
+
+typedef struct {
+    bool up;
+    uint32_t outages;               // Losses of the link after it had been up
+    uint32_t attempts;              // Delays handed out since boot
+    uint64_t downtime_ms;           // Time in outages, the current one included
+    uint32_t last_recovery_ms;      // Loss to up again, last finished outage
+    uint32_t longest_recovery_ms;
+} reconnect_stats_t;
+
+/**
+ * @brief Start a link as down and never connected
+ *
+ * @param seed Jitter seed, different per device (esp_random() on the target)
+ */
+void reconnect_init(reconnect_t *r, uint32_t base_ms, uint32_t max_ms, uint32_t seed);
+
+/**
+ * @brief The link was lost; starts an outage if it was up, else does nothing
+ */
+void reconnect_down(reconnect_t *r, uint32_t now_ms);
+
+/**
+ * @brief Draw the wait before the next attempt and count the attempt
+ *
+ * @return Delay in ms, at most max_ms
+ */
+uint32_t reconnect_next_ms(reconnect_t *r);
+
+/**
+ * @brief The link is up: ends the outage and resets the backoff
+ *
+ * @return Length of the outage just ended, 0 for the first connection
+ */
+uint32_t reconnect_up(reconnect_t *r, uint32_t now_ms);
+
+reconnect_stats_t reconnect_get_stats(const reconnect_t *r, uint32_t now_ms);
+
+#endif // RECONNECT_H
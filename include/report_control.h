@@ -0,0 +1,42 @@
+#ifndef REPORT_CONTROL_H
+#define REPORT_CONTROL_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "report_policy.h"
+
+/*
+ * Report-by-exception settings over MQTT (TEMP_REPORT_BY_EXCEPTION).
+ *
+ * A message on MQTT_TOPIC_REPORT_SET ("key=value[,key=value...]", see
+ * report_config_apply) changes the deadbands and intervals on a running
+ * device. Accepted settings are kept in NVS over reboots, and the settings in
+ * force are published retained to MQTT_TOPIC_REPORT_CONFIG after every
+ * message, accepted or not.
+ */
+
+/**
+ * @brief Load the settings from NVS and subscribe to MQTT_TOPIC_REPORT_SET
+ *        (call before the client starts)
+ */
+esp_err_t report_control_init(void);
+
+/**
+ * @brief Copy of the settings in force
+ */
+void report_control_get(report_config_t *cfg);
+
+/**
+ * @brief Wait up to ticks for the settings to change
+ *
+ * @return true if they changed; the caller then reloads them
+ */
+bool report_control_wait(TickType_t ticks);
+
+/**
+ * @brief Publish the settings in force to MQTT_TOPIC_REPORT_CONFIG (retained)
+ */
+esp_err_t report_control_publish(void);
+
+#endif // REPORT_CONTROL_H
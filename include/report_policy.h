@@ -0,0 +1,124 @@
+#ifndef REPORT_POLICY_H
+#define REPORT_POLICY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sensor_manager.h"
+
+/*
+ * Report-by-exception decisions for one sensor (TEMP_REPORT_BY_EXCEPTION).
+ *
+ * A reading is published when one of its quantities moved at least its
+ * deadband away from the last published value, or when nothing was
+ * published for max_silence_ms. The sampling interval follows the readings:
+ * about half the time the fastest-moving quantity needs to cross its
+ * deadband, clamped to [min_interval_ms, max_interval_ms]. A fast change
+ * drops it at once; a calm spell at most doubles it from one sample to the
+ * next.
+ *
+ * Pure logic on caller-supplied timestamps, so it runs unchanged on the host.
+ */
+
+#define REPORT_QUANTITIES 3     // One per SENSOR_HAS_* bit
+
+/**
+ * @brief Report settings, changeable at runtime
+ */
+typedef struct {
+    float temperature;          // Deadband, °C (0 publishes every sample)
+    float humidity;             // Deadband, %RH
+    float pressure;             // Deadband, hPa
+    uint32_t max_silence_ms;    // Publish at least this often
+    uint32_t min_interval_ms;   // Sampling interval bounds
+    uint32_t max_interval_ms;
+} report_config_t;
+
+/**
+ * @brief Why a reading is published
+ */
+typedef enum {
+    REPORT_NONE = 0,        // Within the deadbands: skip
+    REPORT_FIRST,           // Nothing published yet
+    REPORT_DEADBAND,        // A quantity moved past its deadband
+    REPORT_SILENCE,         // max_silence_ms since the last publish
+} report_reason_t;
+
+/**
+ * @brief Per-sensor state
+ */
+typedef struct {
+    bool reported;
+    float last[REPORT_QUANTITIES];      // Last published values
+    uint32_t last_report_ms;
+    bool sampled;
+    float previous[REPORT_QUANTITIES];  // Previous sample, for the rate of change
+    uint32_t previous_ms;
+    uint32_t interval_ms;               // Sampling interval this sensor asks for
+} report_state_t;
+
+/**
+ * @brief Settings from config.h (REPORT_DEADBAND_*, REPORT_*_MS)
+ */
+void report_config_defaults(report_config_t *cfg);
+
+/**
+ * @brief Whether the settings are usable: deadbands not negative, intervals
+ *        of at least 1 s and at most a day, min <= max <= max silence
+ */
+bool report_config_valid(const report_config_t *cfg);
+
+/**
+ * @brief Apply a settings message: "key=value[,key=value...]"
+ *
+ * Keys: temperature, humidity, pressure (deadbands), max_silence,
+ * min_interval, max_interval (whole seconds), or "defaults" alone to go back
+ * to config.h. The message is applied as a whole or not at all.
+ *
+ * @return ESP_ERR_INVALID_ARG on an unknown key, a bad value or settings
+ *         that would not be valid; cfg is then unchanged
+ */
+esp_err_t report_config_apply(report_config_t *cfg, const char *data, size_t len);
+
+/**
+ * @brief Encode the settings as JSON, in the units of the settings message
+ *
+ * @return Length written (without the NUL), 0 if buf is too small
+ */
+size_t report_config_encode_json(const report_config_t *cfg, char *buf, size_t len);
+
+/**
+ * @brief Start a sensor over: its next valid reading is published
+ */
+void report_state_init(report_state_t *st, const report_config_t *cfg);
+
+/**
+ * @brief Take new settings: keep the last published values, sample at the
+ *        minimum interval until the readings say otherwise
+ */
+void report_state_reconfigure(report_state_t *st, const report_config_t *cfg);
+
+/**
+ * @brief Record a valid reading and decide whether to publish it
+ *
+ * Also updates the sampling interval the sensor asks for.
+ *
+ * @param now_ms Monotonic milliseconds (wraps after 49 days)
+ */
+report_reason_t report_on_sample(report_state_t *st, const report_config_t *cfg, const sensor_data_t *d,
+                                 uint32_t now_ms);
+
+/**
+ * @brief The reading was published (or kept for later): measure the deadbands from it
+ */
+void report_on_published(report_state_t *st, const sensor_data_t *d, uint32_t now_ms);
+
+/**
+ * @brief Milliseconds until this sensor wants its next sample
+ *
+ * The sampling interval, cut short so that max silence is kept.
+ */
+uint32_t report_next_sample_ms(const report_state_t *st, const report_config_t *cfg, uint32_t now_ms);
+
+#endif // REPORT_POLICY_H
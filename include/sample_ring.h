@@ -0,0 +1,80 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief One timestamped sensor sample
+ */
+typedef struct {
+    uint32_t timestamp_ms;  // Milliseconds since boot when the sample was taken
+    float temperature;      // °C
+    float humidity;         // %
+} sensor_sample_t;
+
+/**
+ * @brief Fixed-capacity ring of samples over caller-provided storage
+ *
+ * When full, pushing overwrites the oldest sample. Not thread-safe; each ring
+ * is owned by one task.
+ */
+typedef struct {
+    sensor_sample_t *slots;
+    uint16_t capacity;
+    uint16_t head;      // Index of the oldest sample
+    uint16_t count;
+    uint32_t dropped;   // Samples overwritten before they were consumed
+} sample_ring_t;
+
+/**
+ * @brief Initialize a ring over storage for capacity samples
+ */
+void sample_ring_init(sample_ring_t *ring, sensor_sample_t *storage, uint16_t capacity);
+
+/**
+ * @brief Append a sample, overwriting the oldest one if the ring is full
+ */
+void sample_ring_push(sample_ring_t *ring, const sensor_sample_t *sample);
+
+/**
+ * @brief Sample at position index (0 = oldest), NULL if out of range
+ */
+const sensor_sample_t *sample_ring_at(const sample_ring_t *ring, uint16_t index);
+
+/**
+ * @brief Drop the n oldest samples
+ */
+void sample_ring_consume(sample_ring_t *ring, uint16_t n);
+
+static inline bool sample_ring_full(const sample_ring_t *ring)
+{
+    return ring->count == ring->capacity;
+}
+
+static inline bool sample_ring_empty(const sample_ring_t *ring)
+{
+    return ring->count == 0;
+}
+
+/**
+ * @brief Encode the samples in the ring as a compact JSON batch
+ *
+ * Format: {"now":<ms>,"s":[[<ms>,<temp>,<hum>],...]}
+ * "now" is the uptime at encode time, so a receiver can place each sample on
+ * its own clock as receive_time - (now - ms) without the device knowing
+ * wall-clock time.
+ *
+ * Samples that do not fit in the buffer are left out.
+ *
+ * @param now_ms Uptime at encode time
+ * @param buf Output buffer
+ * @param len Output buffer size
+ * @param encoded Set to the number of samples written (may be NULL)
+ * @return Length of the payload (excluding NUL), 0 if nothing fits
+ */
+size_t sample_ring_encode_json(const sample_ring_t *ring, uint32_t now_ms, char *buf, size_t len,
+                               uint16_t *encoded);
+
+#endif // SAMPLE_RING_H
@@ -0,0 +1,45 @@
+#ifndef SENSOR_CONVERT_H
+#define SENSOR_CONVERT_H
+
+#include <stdint.h>
+
+/*
+ * Raw sensor words to hundredths of the published unit, in integer math.
+ * The ESP32 FPU is single precision only, so the double expressions these
+ * replace were emulated in software on every sample.
+ *
+ * Each kernel rounds to nearest (halves up) and is bit-exact against the
+ * datasheet formula evaluated exactly. The host benchmark checks every
+ * possible input against a double reference.
+ */
+
+/**
+ * @brief AHT20 20-bit humidity word to 0.01 %RH
+ *
+ * RH = raw * 100 / 2^20 %, so raw * 625 / 2^16 hundredths; the product fits
+ * 32 bits for every 20-bit word.
+ */
+static inline int32_t aht20_humidity_centi(uint32_t raw)
+{
+    return (int32_t)((raw * 625u + 0x8000u) >> 16);
+}
+
+/**
+ * @brief AHT20 20-bit temperature word to 0.01 °C
+ *
+ * T = raw * 200 / 2^20 - 50 °C, so raw * 1250 / 2^16 - 5000 hundredths.
+ */
+static inline int32_t aht20_temperature_centi(uint32_t raw)
+{
+    return (int32_t)((raw * 1250u + 0x8000u) >> 16) - 5000;
+}
+
+/**
+ * @brief BMP280 compensated pressure (1/256 Pa) to 0.01 hPa, i.e. Pa
+ */
+static inline int32_t bmp280_pressure_centi(uint32_t q8_pa)
+{
+    return (int32_t)((q8_pa + 0x80u) >> 8);
+}
+
+#endif // SENSOR_CONVERT_H
@@ -0,0 +1,67 @@
+#ifndef SENSOR_DRIVER_H
+#define SENSOR_DRIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/i2c_master.h"
+#include "sensor_manager.h"
+
+/*
+ * What the sensor manager needs to know about one sensor type. Every
+ * supported sensor measures the same way: a trigger command, a wait, status
+ * polls until the busy flag clears, and one frame read. The manager runs
+ * that sequence asynchronously; a driver only describes the bytes.
+ */
+
+#define SENSOR_TRIGGER_MAX  3
+#define SENSOR_FRAME_MAX    7
+#define SENSOR_CALIB_MAX    24
+
+// Quantities of a decoded frame, one per SENSOR_HAS_* bit (1 << channel),
+// in hundredths of the published unit
+typedef enum {
+    SENSOR_CH_TEMPERATURE,  // 0.01 °C
+    SENSOR_CH_HUMIDITY,     // 0.01 %RH
+    SENSOR_CH_PRESSURE,     // 0.01 hPa
+    SENSOR_CHANNELS,
+} sensor_channel_t;
+
+typedef struct {
+    const char *name;
+    uint8_t fields;                 // SENSOR_HAS_*
+
+    // Timing. Polling starts at the shortest conversion; the deadline
+    // leaves room for slow ones.
+    int64_t first_poll_us;
+    int64_t poll_interval_us;
+    int64_t deadline_us;
+
+    uint8_t trigger[SENSOR_TRIGGER_MAX];    // Command that starts a conversion
+    uint8_t trigger_len;
+    int16_t status_reg;     // Register holding the busy flag, -1 to read the status byte directly
+    uint8_t busy_mask;
+    int16_t frame_reg;      // Register the result starts at, -1 to read it directly
+    uint8_t frame_len;
+
+    /**
+     * @brief Blocking bring-up (reset, calibration), before the device goes async
+     *
+     * @param calib SENSOR_CALIB_MAX bytes kept for decode()
+     */
+    esp_err_t (*init)(i2c_master_dev_handle_t dev, uint8_t *calib);
+
+    /**
+     * @brief Convert a frame into fixed point, integer math only
+     *
+     * @param out SENSOR_CHANNELS values; only the channels in fields are set
+     * @return ESP_ERR_NOT_FINISHED if the frame shows a conversion still
+     *         running, ESP_ERR_INVALID_CRC if it is corrupt
+     */
+    esp_err_t (*decode)(const uint8_t *calib, const uint8_t *frame, int32_t *out);
+} sensor_driver_t;
+
+extern const sensor_driver_t sensor_aht20_driver;
+extern const sensor_driver_t sensor_bmp280_driver;
+
+#endif // SENSOR_DRIVER_H
@@ -0,0 +1,58 @@
+#ifndef SENSOR_FILTER_H
+#define SENSOR_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Per-quantity smoothing of sensor samples, in fixed point (the unit of the
+ * input, e.g. 0.01 °C). A sample first goes through a running median of the
+ * last few samples, which drops single outliers, then through an
+ * exponential moving average.
+ *
+ * Both stages pass a constant input through unchanged, so a steady reading
+ * is published exactly as measured.
+ */
+
+#define SENSOR_FILTER_WINDOW_MAX 9
+#define SENSOR_FILTER_EMA_SHIFT_MAX 7
+
+/**
+ * @brief Filter state of one quantity
+ */
+typedef struct {
+    uint8_t median_window;  // Samples in the running median (odd, 1 = off)
+    uint8_t ema_shift;      // A new sample weighs 1/2^ema_shift in the EMA (0 = off)
+    uint8_t count;          // Samples in the window so far
+    uint8_t next;           // Slot the next sample goes to
+    int32_t window[SENSOR_FILTER_WINDOW_MAX];
+    bool ema_valid;
+    int32_t ema;            // 1/256 of the input unit
+} sensor_filter_t;
+
+/**
+ * @brief Set up a filter; out-of-range settings are clamped
+ *
+ * @param median_window Samples in the running median, odd (even values are
+ *                      rounded down), 1 to skip the median
+ * @param ema_shift     EMA weight 1/2^ema_shift of a new sample, 0 to skip
+ *                      the EMA
+ */
+void sensor_filter_init(sensor_filter_t *f, uint8_t median_window, uint8_t ema_shift);
+
+/**
+ * @brief Forget the samples seen so far; the next one passes through as is
+ */
+void sensor_filter_reset(sensor_filter_t *f);
+
+/**
+ * @brief Add a sample and return the filtered value
+ */
+int32_t sensor_filter_update(sensor_filter_t *f, int32_t value);
+
+/**
+ * @brief Mean of n oversampled conversions given their sum, rounded to nearest
+ */
+int32_t sensor_filter_average(int32_t sum, uint32_t n);
+
+#endif // SENSOR_FILTER_H
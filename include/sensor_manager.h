@@ -0,0 +1,121 @@
+#ifndef SENSOR_MANAGER_H
+#define SENSOR_MANAGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Registry of the sensors in SENSOR_TABLE (config.h), on either I2C
+ * controller, and the scheduler that samples them.
+ *
+ * Every sensor runs its own conversion state machine on an esp_timer, so a
+ * sample triggers all of them back to back and then waits once: the sample
+ * takes as long as the slowest conversion rather than the sum of them.
+ */
+
+#define SENSOR_MAX_COUNT 8
+#define SENSOR_ALL       0xFFu   // Mask of every sensor in the table
+
+typedef enum {
+    SENSOR_AHT20,       // Temperature and humidity
+    SENSOR_BMP280,      // Temperature and pressure
+} sensor_type_t;
+
+// Quantities a sensor reports (sensor_data_t.fields)
+#define SENSOR_HAS_TEMPERATURE  0x01
+#define SENSOR_HAS_HUMIDITY     0x02
+#define SENSOR_HAS_PRESSURE     0x04
+
+/**
+ * @brief One SENSOR_TABLE entry
+ */
+typedef struct {
+    const char *name;   // Topic segment, e.g. "bedroom"
+    sensor_type_t type;
+    int port;           // I2C_NUM_0 or I2C_NUM_1
+    uint8_t addr;       // 7-bit address
+} sensor_config_t;
+
+/**
+ * @brief Reading of one sensor
+ */
+typedef struct {
+    const char *name;       // From SENSOR_TABLE
+    uint8_t fields;         // SENSOR_HAS_* of the sensor type
+    bool valid;             // Reading collected in the last sample
+    float temperature;      // °C
+    float humidity;         // %RH (SENSOR_HAS_HUMIDITY)
+    float pressure;         // hPa (SENSOR_HAS_PRESSURE)
+    int64_t trigger_us;     // Start of the conversion (esp_timer time)
+} sensor_data_t;
+
+/**
+ * @brief Bring up the I2C controllers in use and initialize every sensor
+ *
+ * Each bus is discovered with i2c_topology_discover(), expecting the
+ * addresses the table puts on it. A sensor that does not answer is left
+ * out of sampling until a rescan finds it.
+ *
+ * @return ESP_OK, also when sensors are missing; an error only if a bus
+ *         could not be created
+ */
+esp_err_t sensor_manager_init(void);
+
+/**
+ * @brief Scan every bus in use and initialize sensors that answer now
+ *
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if a bus appears stuck
+ */
+esp_err_t sensor_manager_rescan(void);
+
+/**
+ * @brief Number of sensors in SENSOR_TABLE
+ */
+size_t sensor_manager_count(void);
+
+/**
+ * @brief Whether the sensor at index answered and is sampled
+ */
+bool sensor_manager_ready(size_t index);
+
+/**
+ * @brief Trigger a conversion on every initialized sensor in mask
+ *
+ * Returns as soon as the trigger commands are on the bus.
+ *
+ * @param mask Bit n selects the sensor at index n (SENSOR_ALL for every one)
+ * @return ESP_OK if at least one conversion started, ESP_ERR_INVALID_STATE
+ *         if a selected sensor is still converting or none is initialized
+ */
+esp_err_t sensor_manager_start(uint8_t mask);
+
+/**
+ * @brief Collect the conversions started by sensor_manager_start()
+ *
+ * Fills one record per sensor in table order; sensors that were not
+ * started or failed are marked invalid. A sensor collected once is not
+ * returned again by a later call.
+ *
+ * @param data sensor_manager_count() records
+ * @param timeout_ms How long to wait for all of them (0 to only check)
+ * @return ESP_OK if every started sensor delivered, ESP_ERR_TIMEOUT if one
+ *         is still converting (collect again later), ESP_FAIL if one failed
+ */
+esp_err_t sensor_manager_collect(sensor_data_t *data, uint32_t timeout_ms);
+
+/**
+ * @brief Sample every sensor and wait for the results
+ *
+ * @param data sensor_manager_count() records
+ * @return as sensor_manager_collect(); ESP_FAIL if no sensor could start
+ */
+esp_err_t sensor_manager_read(sensor_data_t *data);
+
+/**
+ * @brief Longest a started sample can take, for collect timeouts
+ */
+uint32_t sensor_manager_sample_timeout_ms(void);
+
+#endif // SENSOR_MANAGER_H
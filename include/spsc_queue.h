@@ -0,0 +1,50 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Lock-free single-producer/single-consumer queue over caller-provided storage
+ *
+ * One task pushes and one other task pops; neither ever blocks or takes a
+ * lock, so a producer at any priority cannot be held up by the consumer.
+ * Items are copied in and out by value. Pushing to a full queue fails rather
+ * than overwriting.
+ */
+typedef struct {
+    uint8_t *slots;
+    uint16_t item_size;
+    uint16_t capacity;          // Power of two
+    atomic_uint_fast32_t head;  // Items pushed; written by the producer only
+    atomic_uint_fast32_t tail;  // Items popped; written by the consumer only
+} spsc_queue_t;
+
+/**
+ * @brief Initialize a queue over storage for capacity items of item_size bytes
+ *
+ * @return false if capacity is not a power of two
+ */
+bool spsc_queue_init(spsc_queue_t *queue, void *storage, uint16_t item_size, uint16_t capacity);
+
+/**
+ * @brief Copy an item in (producer side)
+ *
+ * @return false if the queue is full
+ */
+bool spsc_queue_push(spsc_queue_t *queue, const void *item);
+
+/**
+ * @brief Copy the oldest item out (consumer side)
+ *
+ * @return false if the queue is empty
+ */
+bool spsc_queue_pop(spsc_queue_t *queue, void *item);
+
+/**
+ * @brief Items waiting; exact from either side, a snapshot from any other task
+ */
+uint16_t spsc_queue_count(spsc_queue_t *queue);
+
+#endif // SPSC_QUEUE_H
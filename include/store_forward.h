@@ -0,0 +1,79 @@
+#ifndef STORE_FORWARD_H
+#define STORE_FORWARD_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+#include "sample_ring.h"
+
+/**
+ * @brief Store-and-forward counters
+ */
+typedef struct {
+    uint32_t pending;        // Readings waiting to be drained
+    uint32_t capacity;       // Readings the partition can hold
+    uint32_t appended;       // Readings stored since boot
+    uint32_t drained;        // Readings published since boot
+    uint32_t dropped;        // Oldest readings overwritten because the log was full
+    uint32_t corrupt;        // Records skipped because of a bad CRC
+    uint32_t sector_erases;  // Flash sector erases since boot
+    uint32_t flash_writes;   // Flash program operations since boot
+} store_forward_stats_t;
+
+/**
+ * @brief Open the readings partition and recover the log
+ *
+ * Scans the partition to find the newest record and the last drained one,
+ * so readings stored before a reboot are still forwarded. May be called
+ * again to re-open the log (buffered, unflushed readings are lost).
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the partition is missing
+ */
+esp_err_t store_forward_init(void);
+
+/**
+ * @brief Append a reading to the log
+ *
+ * Readings are collected in RAM and written one flash page at a time; a
+ * sector is erased only when the log moves into it. When the log is full the
+ * oldest readings are overwritten.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the store is not open
+ */
+esp_err_t store_forward_append(const sensor_sample_t *sample);
+
+/**
+ * @brief Write buffered readings to flash now
+ */
+esp_err_t store_forward_flush(void);
+
+/**
+ * @brief Number of readings waiting to be drained
+ */
+uint32_t store_forward_pending(void);
+
+/**
+ * @brief Publish up to max_samples of the oldest readings as one message
+ *
+ * Readings are only marked drained once the client accepted the publish.
+ *
+ * @return Number of readings drained, 0 if nothing was pending, -1 on failure
+ */
+int store_forward_drain(esp_mqtt_client_handle_t client, uint16_t max_samples);
+
+/**
+ * @brief Start the background task that drains the log while MQTT is connected
+ *
+ * After a reconnect it waits a random 0..STORE_DRAIN_JITTER_MS, then publishes
+ * one batch of STORE_DRAIN_BATCH_SIZE readings every STORE_DRAIN_INTERVAL_MS.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t store_forward_start(esp_mqtt_client_handle_t client);
+
+/**
+ * @brief Snapshot of the store counters
+ */
+store_forward_stats_t store_forward_get_stats(void);
+
+#endif // STORE_FORWARD_H
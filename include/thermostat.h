@@ -0,0 +1,180 @@
+#ifndef THERMOSTAT_H
+#define THERMOSTAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Boiler control from room temperature readings (RELAY_THERMOSTAT).
+ *
+ * The setpoint comes from a daily schedule, or an override from the webapp.
+ * Hysteresis control switches ON at setpoint - hysteresis and OFF at
+ * setpoint + hysteresis. PID control runs the burner for a duty cycle of
+ * each THERMOSTAT_CYCLE_MS window instead. Either way a run lasts at least
+ * min_on_ms and a pause at least min_off_ms, against short cycling. A
+ * stale or missing reading turns the boiler OFF.
+ *
+ * Pure logic on caller-supplied timestamps, so it runs unchanged on the host.
+ */
+
+#define THERMOSTAT_SCHEDULE_MAX 8
+#define THERMOSTAT_MINUTES_PER_DAY 1440
+
+typedef enum {
+    THERMOSTAT_HYSTERESIS = 0,
+    THERMOSTAT_PID,
+} thermostat_algorithm_t;
+
+/**
+ * @brief Who decides the output
+ */
+typedef enum {
+    THERMOSTAT_AUTO = 0,        // The schedule (the default setpoint without one)
+    THERMOSTAT_HOLD,            // An override setpoint
+    THERMOSTAT_FORCE_ON,        // Override: ON regardless of the temperature
+    THERMOSTAT_FORCE_OFF,
+    THERMOSTAT_MANUAL,          // Not controlling: the relay follows MQTT_TOPIC_COMMAND
+} thermostat_mode_t;
+
+typedef struct {
+    thermostat_algorithm_t algorithm;
+    float default_setpoint;     // °C
+    float hysteresis;           // °C either side of the setpoint
+    float kp;                   // PID: duty per °C
+    float ki;                   // PID: duty per °C·hour
+    float kd;                   // PID: duty per °C/hour
+    uint32_t cycle_ms;          // PID window
+    uint32_t min_on_ms;
+    uint32_t min_off_ms;
+    uint32_t sensor_timeout_ms;
+    uint32_t override_ms;
+} thermostat_params_t;
+
+/**
+ * @brief Setpoint from a minute of the day on
+ */
+typedef struct {
+    uint16_t minute;            // 0 to 1439
+    float setpoint;
+} thermostat_slot_t;
+
+/**
+ * @brief Daily schedule, slots in time order; the last one runs past
+ *        midnight until the first
+ */
+typedef struct {
+    uint8_t count;
+    thermostat_slot_t slots[THERMOSTAT_SCHEDULE_MAX];
+} thermostat_schedule_t;
+
+typedef struct {
+    thermostat_params_t params;
+    thermostat_schedule_t schedule;
+
+    bool clock_valid;           // The webapp told the time of day
+    uint16_t clock_minute;      // Minute of the day at clock_ms
+    uint32_t clock_ms;
+
+    bool has_reading;
+    float temperature;
+    uint32_t reading_ms;
+
+    thermostat_mode_t mode;
+    float hold_setpoint;
+    uint32_t override_ms;       // When the override started
+
+    bool heating;               // Output
+    uint32_t switched_ms;       // Last change of the output
+    bool failsafe;              // OFF for want of a reading
+    uint32_t switches;          // OFF -> ON changes
+
+    // PID
+    bool window_valid;
+    uint32_t window_ms;         // Start of the current window
+    uint32_t on_ms;             // ON time in the current window
+    float duty;
+    float integral;             // °C·hour
+    bool previous_valid;
+    float previous;             // Reading at the previous window start
+} thermostat_t;
+
+/**
+ * @brief Parameters from config.h (THERMOSTAT_*)
+ */
+void thermostat_params_defaults(thermostat_params_t *params);
+
+/**
+ * @brief Start in AUTO with no schedule, clock or reading
+ *
+ * @param heating State the relay is in now
+ */
+void thermostat_init(thermostat_t *t, const thermostat_params_t *params, bool heating, uint32_t now_ms);
+
+/**
+ * @brief A room temperature reading, °C
+ */
+void thermostat_set_reading(thermostat_t *t, float temperature, uint32_t now_ms);
+
+/**
+ * @brief Parse a schedule message: "HH:MM=setpoint" entries separated by
+ *        commas, in any order, and optionally "now=HH:MM"
+ *
+ * @param now_minute Set to the minute of the day given by "now", -1 without
+ * @return ESP_ERR_INVALID_ARG on a malformed entry, a time twice or more
+ *         than THERMOSTAT_SCHEDULE_MAX entries
+ */
+esp_err_t thermostat_parse_schedule(const char *data, size_t len, thermostat_schedule_t *schedule,
+                                    int *now_minute);
+
+void thermostat_set_schedule(thermostat_t *t, const thermostat_schedule_t *schedule);
+
+/**
+ * @brief Set the time of day (minute 0 to 1439) as of now_ms
+ */
+void thermostat_set_clock(thermostat_t *t, uint16_t minute, uint32_t now_ms);
+
+/**
+ * @brief Apply an override message: "ON", "OFF", a setpoint, "auto" or "manual"
+ *
+ * @return ESP_ERR_INVALID_ARG if the message is none of these
+ */
+esp_err_t thermostat_override(thermostat_t *t, const char *data, size_t len, uint32_t now_ms);
+
+/**
+ * @brief An ON/OFF command from the webapp: a forced override, unless in MANUAL
+ *
+ * @return true if the thermostat took it as an override
+ */
+bool thermostat_command(thermostat_t *t, bool on, uint32_t now_ms);
+
+/**
+ * @brief Setpoint in force, °C
+ */
+float thermostat_setpoint(const thermostat_t *t, uint32_t now_ms);
+
+/**
+ * @brief Decide the output
+ *
+ * @param relay_on State of the relay; only followed in MANUAL, where others switch it
+ * @param next_ms  Set to the time until the decision may change without a new
+ *                 reading or message
+ * @return Whether the boiler should be ON
+ */
+bool thermostat_update(thermostat_t *t, bool relay_on, uint32_t now_ms, uint32_t *next_ms);
+
+/**
+ * @brief Name of a mode, as in the override messages
+ */
+const char *thermostat_mode_str(thermostat_mode_t mode);
+
+/**
+ * @brief Encode the state as JSON: mode, setpoint, temperature, heating,
+ *        duty (PID) and failsafe
+ *
+ * @return Length written (without the NUL), 0 if buf is too small
+ */
+size_t thermostat_encode_json(const thermostat_t *t, uint32_t now_ms, char *buf, size_t len);
+
+#endif // THERMOSTAT_H
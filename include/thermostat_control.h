@@ -0,0 +1,38 @@
+#ifndef THERMOSTAT_CONTROL_H
+#define THERMOSTAT_CONTROL_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * The thermostat on the relay device (RELAY_THERMOSTAT): readings, schedule
+ * and overrides over MQTT feed thermostat.h, and a task of its own switches
+ * channel 0 through the actuator when the decision changes. The state
+ * (mode, setpoint, heating, failsafe) is published retained to
+ * MQTT_TOPIC_THERMOSTAT_STATE whenever it changes.
+ */
+
+#define THERMOSTAT_CONTROL_ROUTES 3     // Topics registered by thermostat_control_init()
+
+/**
+ * @brief Load the schedule from NVS and subscribe to the sensor, schedule and
+ *        override topics (call before the client starts)
+ */
+esp_err_t thermostat_control_init(void);
+
+/**
+ * @brief Start the thermostat task (call after relay_init())
+ */
+esp_err_t thermostat_control_start(void);
+
+/**
+ * @brief An ON/OFF command on MQTT_TOPIC_COMMAND: an override unless in manual
+ *
+ * The command is still switched as before; this only keeps the thermostat
+ * from undoing it.
+ *
+ * @return true if the thermostat took it as an override
+ */
+bool thermostat_control_command(bool on);
+
+#endif // THERMOSTAT_CONTROL_H
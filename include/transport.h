@@ -0,0 +1,49 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * A link to the paired device that carries peer_link frames (PEER_LINK).
+ * Frames are datagrams: each arrives whole or not at all, possibly twice.
+ * The peer link does the framing, dedup and failover; a transport only
+ * moves bytes.
+ */
+
+/**
+ * @brief A frame from the peer; the bytes are only valid during the call
+ *
+ * Called from one context at a time (the WiFi task for ESP-NOW).
+ */
+typedef void (*transport_recv_cb_t)(const uint8_t *frame, size_t len);
+
+/**
+ * @brief Outcome of a send: whether the peer acknowledged the frame
+ *
+ * May be called from within send() or later from another task.
+ */
+typedef void (*transport_sent_cb_t)(bool delivered);
+
+typedef struct {
+    const char *name;
+    size_t mtu;                 // Largest frame
+
+    /**
+     * @brief Bring the link up (WiFi must be started)
+     */
+    esp_err_t (*start)(transport_recv_cb_t on_recv, transport_sent_cb_t on_sent);
+
+    /**
+     * @brief Send one frame to the peer
+     *
+     * @return ESP_OK if it went out; on_sent then reports the delivery
+     */
+    esp_err_t (*send)(const uint8_t *frame, size_t len);
+} transport_t;
+
+extern const transport_t transport_espnow;
+
+#endif // TRANSPORT_H
@@ -3,6 +3,8 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include "reconnect.h"
 
 /**
  * @brief Initialize WiFi manager and configure WiFi station mode
@@ -10,6 +12,14 @@
  * This function initializes the WiFi subsystem, registers event handlers,
  * and starts the WiFi connection process. It uses credentials from config_secrets.h
  *
+ * Returns without waiting for the connection, so other initialization can run
+ * while the station associates; BOOT_EVENT_WIFI is set once it has an address.
+ * With WIFI_FAST_REJOIN the AP cached from the last connection is joined
+ * directly.
+ *
+ * The station never gives up: a dropped link first rejoins the same AP
+ * without a scan, then retries with jittered backoff (WIFI_BACKOFF_*_MS).
+ *
  * @return ESP_OK on success, ESP_FAIL on error
  */
 esp_err_t wifi_manager_init(void);
@@ -17,10 +27,10 @@ esp_err_t wifi_manager_init(void);
 /**
  * @brief Wait for WiFi connection to complete
  *
- * This function blocks until either the WiFi connection succeeds or fails
- * after maximum retry attempts.
+ * Blocks until the station has an address; retries go on in the background
+ * for as long as that takes.
  *
- * @return ESP_OK if connected successfully, ESP_FAIL if connection failed
+ * @return ESP_OK once connected
  */
 esp_err_t wifi_manager_connect(void);
 
@@ -31,4 +41,16 @@ esp_err_t wifi_manager_connect(void);
  */
 bool wifi_manager_is_connected(void);
 
+/**
+ * @brief Number of times the station got an address again after the first time
+ *
+ * @return Reconnects since boot
+ */
+uint32_t wifi_manager_reconnect_count(void);
+
+/**
+ * @brief Outages of the WiFi link since boot, time spent down and time to recover
+ */
+reconnect_stats_t wifi_manager_get_link_stats(void);
+
 #endif // WIFI_MANAGER_H
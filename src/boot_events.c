@@ -0,0 +1,80 @@
+#include "boot_events.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "BOOT";
+
+#define BOOT_EVENT_COUNT 4
+
+static EventGroupHandle_t boot_group;
+static volatile int32_t reached_ms[BOOT_EVENT_COUNT] = { -1, -1, -1, -1 };
+
+static int event_index(EventBits_t event)
+{
+    for (int i = 0; i < BOOT_EVENT_COUNT; i++) {
+        if (event == (EventBits_t)(1 << i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t boot_events_init(void)
+{
+    if (boot_group != NULL) {
+        return ESP_OK;
+    }
+    boot_group = xEventGroupCreate();
+    return boot_group != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+bool boot_events_set(EventBits_t events)
+{
+    if (boot_group == NULL) {
+        return false;
+    }
+
+    // Each event has a single owner that sets it, so no lock is needed here
+    int32_t now_ms = (int32_t)(esp_timer_get_time() / 1000);
+    bool first = false;
+    for (int i = 0; i < BOOT_EVENT_COUNT; i++) {
+        if ((events & (1 << i)) && reached_ms[i] < 0) {
+            reached_ms[i] = now_ms;
+            first = true;
+        }
+    }
+    xEventGroupSetBits(boot_group, events);
+
+    if (first && (events & BOOT_EVENT_FIRST_PUBLISH)) {
+        ESP_LOGI(TAG, "Boot to WiFi %ld ms, MQTT %ld ms, peripherals %ld ms, first publish %ld ms",
+                 (long)reached_ms[0], (long)reached_ms[1], (long)reached_ms[2], (long)reached_ms[3]);
+    }
+    return first;
+}
+
+void boot_events_clear(EventBits_t events)
+{
+    if (boot_group != NULL) {
+        xEventGroupClearBits(boot_group, events);
+    }
+}
+
+bool boot_events_is_set(EventBits_t events)
+{
+    return boot_group != NULL && (xEventGroupGetBits(boot_group) & events) == events;
+}
+
+bool boot_events_wait(EventBits_t events, uint32_t timeout_ms)
+{
+    if (boot_group == NULL) {
+        return false;
+    }
+    EventBits_t bits = xEventGroupWaitBits(boot_group, events, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & events) == events;
+}
+
+int32_t boot_events_elapsed_ms(EventBits_t event)
+{
+    int i = event_index(event);
+    return i >= 0 ? reached_ms[i] : -1;
+}
@@ -0,0 +1,330 @@
+#include <string.h>
+#include "cbor.h"
+
+#define MAJOR_UINT   0
+#define MAJOR_NEGINT 1
+#define MAJOR_BYTES  2
+#define MAJOR_TEXT   3
+#define MAJOR_ARRAY  4
+#define MAJOR_MAP    5
+#define MAJOR_TAG    6
+#define MAJOR_SIMPLE 7
+
+#define SIMPLE_FALSE 20
+#define SIMPLE_TRUE  21
+#define SIMPLE_NULL  22
+
+// ============================================
+// Writer
+// ============================================
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t len)
+{
+    w->buf = buf;
+    w->len = len;
+    w->pos = 0;
+    w->overflow = false;
+}
+
+static size_t head_size(uint64_t arg)
+{
+    return arg < 24 ? 1 : arg <= UINT8_MAX ? 2 : arg <= UINT16_MAX ? 3 : arg <= UINT32_MAX ? 5 : 9;
+}
+
+// Initial byte plus the shortest argument encoding, as RFC 8949 requires for
+// deterministic output
+static void put_head(cbor_writer_t *w, uint8_t major, uint64_t arg)
+{
+    size_t size = head_size(arg);
+    if (w->overflow || w->len - w->pos < size) {
+        w->overflow = true;
+        return;
+    }
+
+    uint8_t *p = w->buf + w->pos;
+    if (size == 1) {
+        p[0] = (uint8_t)(major << 5 | arg);
+    } else {
+        static const uint8_t info[] = { [2] = 24, [3] = 25, [5] = 26, [9] = 27 };
+        p[0] = (uint8_t)(major << 5 | info[size]);
+        for (size_t i = size - 1; i > 0; i--) {
+            p[i] = (uint8_t)arg;
+            arg >>= 8;
+        }
+    }
+    w->pos += size;
+}
+
+static void put_raw(cbor_writer_t *w, const void *data, size_t len)
+{
+    if (w->overflow || w->len - w->pos < len) {
+        w->overflow = true;
+        return;
+    }
+    if (len > 0) {
+        memcpy(w->buf + w->pos, data, len);
+    }
+    w->pos += len;
+}
+
+void cbor_put_uint(cbor_writer_t *w, uint64_t value)
+{
+    put_head(w, MAJOR_UINT, value);
+}
+
+void cbor_put_int(cbor_writer_t *w, int64_t value)
+{
+    if (value >= 0) {
+        put_head(w, MAJOR_UINT, (uint64_t)value);
+    } else {
+        // -1 - n without overflowing at INT64_MIN
+        put_head(w, MAJOR_NEGINT, ~(uint64_t)value);
+    }
+}
+
+void cbor_put_bool(cbor_writer_t *w, bool value)
+{
+    put_head(w, MAJOR_SIMPLE, value ? SIMPLE_TRUE : SIMPLE_FALSE);
+}
+
+void cbor_put_null(cbor_writer_t *w)
+{
+    put_head(w, MAJOR_SIMPLE, SIMPLE_NULL);
+}
+
+void cbor_put_bytes(cbor_writer_t *w, const void *data, size_t len)
+{
+    put_head(w, MAJOR_BYTES, len);
+    put_raw(w, data, len);
+}
+
+void cbor_put_text(cbor_writer_t *w, const char *text, size_t len)
+{
+    put_head(w, MAJOR_TEXT, len);
+    put_raw(w, text, len);
+}
+
+void cbor_put_array(cbor_writer_t *w, size_t count)
+{
+    put_head(w, MAJOR_ARRAY, count);
+}
+
+void cbor_put_map(cbor_writer_t *w, size_t count)
+{
+    put_head(w, MAJOR_MAP, count);
+}
+
+size_t cbor_writer_finish(const cbor_writer_t *w)
+{
+    return w->overflow ? 0 : w->pos;
+}
+
+size_t cbor_int_size(int64_t value)
+{
+    return head_size(value >= 0 ? (uint64_t)value : ~(uint64_t)value);
+}
+
+// ============================================
+// Reader
+// ============================================
+
+void cbor_reader_init(cbor_reader_t *r, const uint8_t *buf, size_t len)
+{
+    r->buf = buf;
+    r->len = len;
+    r->pos = 0;
+    r->error = false;
+}
+
+static bool fail(cbor_reader_t *r)
+{
+    r->error = true;
+    return false;
+}
+
+/**
+ * @brief Decode the head at pos without consuming it
+ *
+ * @return Size of the head, 0 if truncated or indefinite
+ */
+static size_t peek_head(const cbor_reader_t *r, uint8_t *major, uint64_t *arg)
+{
+    if (r->error || r->pos >= r->len) {
+        return 0;
+    }
+    uint8_t initial = r->buf[r->pos];
+    uint8_t info = initial & 0x1F;
+    *major = initial >> 5;
+
+    if (info < 24) {
+        *arg = info;
+        return 1;
+    }
+    if (info > 27) {
+        return 0;   // Reserved or indefinite length
+    }
+    size_t extra = (size_t)1 << (info - 24);
+    if (r->len - r->pos - 1 < extra) {
+        return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < extra; i++) {
+        value = value << 8 | r->buf[r->pos + 1 + i];
+    }
+    *arg = value;
+    return 1 + extra;
+}
+
+static bool get_head(cbor_reader_t *r, uint8_t expected_major, uint64_t *arg)
+{
+    uint8_t major;
+    size_t size = peek_head(r, &major, arg);
+    if (size == 0 || major != expected_major) {
+        return fail(r);
+    }
+    r->pos += size;
+    return true;
+}
+
+cbor_type_t cbor_peek_type(const cbor_reader_t *r)
+{
+    if (r->error || r->pos >= r->len) {
+        return CBOR_TYPE_NONE;
+    }
+    return (cbor_type_t)(r->buf[r->pos] >> 5);
+}
+
+bool cbor_peek_null(const cbor_reader_t *r)
+{
+    return !r->error && r->pos < r->len && r->buf[r->pos] == (MAJOR_SIMPLE << 5 | SIMPLE_NULL);
+}
+
+bool cbor_get_uint(cbor_reader_t *r, uint64_t *value)
+{
+    return get_head(r, MAJOR_UINT, value);
+}
+
+bool cbor_get_int(cbor_reader_t *r, int64_t *value)
+{
+    uint8_t major;
+    uint64_t arg;
+    size_t size = peek_head(r, &major, &arg);
+    if (size == 0 || (major != MAJOR_UINT && major != MAJOR_NEGINT) || arg > INT64_MAX) {
+        return fail(r);
+    }
+    r->pos += size;
+    *value = major == MAJOR_UINT ? (int64_t)arg : -1 - (int64_t)arg;
+    return true;
+}
+
+bool cbor_get_bool(cbor_reader_t *r, bool *value)
+{
+    uint64_t arg;
+    size_t start = r->pos;
+    if (!get_head(r, MAJOR_SIMPLE, &arg) || (arg != SIMPLE_FALSE && arg != SIMPLE_TRUE)) {
+        r->pos = start;
+        return fail(r);
+    }
+    *value = arg == SIMPLE_TRUE;
+    return true;
+}
+
+bool cbor_get_null(cbor_reader_t *r)
+{
+    if (!cbor_peek_null(r)) {
+        return fail(r);
+    }
+    r->pos++;
+    return true;
+}
+
+static bool get_string(cbor_reader_t *r, uint8_t major, const uint8_t **data, size_t *len)
+{
+    uint64_t arg;
+    if (!get_head(r, major, &arg)) {
+        return false;
+    }
+    if (arg > r->len - r->pos) {
+        return fail(r);
+    }
+    *data = r->buf + r->pos;
+    *len = (size_t)arg;
+    r->pos += (size_t)arg;
+    return true;
+}
+
+bool cbor_get_bytes(cbor_reader_t *r, const uint8_t **data, size_t *len)
+{
+    return get_string(r, MAJOR_BYTES, data, len);
+}
+
+bool cbor_get_text(cbor_reader_t *r, const char **text, size_t *len)
+{
+    return get_string(r, MAJOR_TEXT, (const uint8_t **)text, len);
+}
+
+// A count larger than the remaining input cannot be genuine (each item takes
+// at least a byte), which also keeps size_t from truncating it
+static bool get_container(cbor_reader_t *r, uint8_t major, size_t *count)
+{
+    uint64_t arg;
+    if (!get_head(r, major, &arg)) {
+        return false;
+    }
+    if (arg > r->len - r->pos) {
+        return fail(r);
+    }
+    *count = (size_t)arg;
+    return true;
+}
+
+bool cbor_get_array(cbor_reader_t *r, size_t *count)
+{
+    return get_container(r, MAJOR_ARRAY, count);
+}
+
+bool cbor_get_map(cbor_reader_t *r, size_t *count)
+{
+    return get_container(r, MAJOR_MAP, count);
+}
+
+bool cbor_skip(cbor_reader_t *r)
+{
+    // Items still to step over; nested items are added as their heads are read
+    uint64_t pending = 1;
+
+    while (pending > 0) {
+        uint8_t major;
+        uint64_t arg;
+        size_t size = peek_head(r, &major, &arg);
+        if (size == 0) {
+            return fail(r);
+        }
+        r->pos += size;
+        pending--;
+
+        uint64_t remaining = r->len - r->pos;
+        switch (major) {
+            case MAJOR_BYTES:
+            case MAJOR_TEXT:
+                if (arg > remaining) {
+                    return fail(r);
+                }
+                r->pos += (size_t)arg;
+                break;
+            case MAJOR_ARRAY:
+            case MAJOR_MAP:
+                if (arg > remaining || (major == MAJOR_MAP && arg * 2 > remaining)) {
+                    return fail(r);
+                }
+                pending += major == MAJOR_MAP ? arg * 2 : arg;
+                break;
+            case MAJOR_TAG:
+                pending++;  // The tagged item follows
+                break;
+            default:
+                break;      // Integers and simple values are all head
+        }
+    }
+    return true;
+}
@@ -1,18 +1,388 @@
+#include <stdatomic.h>
+#include "config.h"
 #include "device_relay.h"
+#include "spsc_queue.h"
+#include "latency_trace.h"
+#include "dlog.h"
 #include "driver/gpio.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 static const char *TAG = "RELAY";
-static bool relay_state = false;
+static const gpio_num_t channel_gpio[RELAY_CHANNEL_COUNT] = RELAY_CHANNEL_GPIOS;
+static volatile uint8_t relay_states = 0;      // Bit n set: channel n ON
+
+_Static_assert(RELAY_CHANNEL_COUNT >= 1 && RELAY_CHANNEL_COUNT <= RELAY_MAX_CHANNELS,
+               "RELAY_CHANNEL_COUNT must be 1 to 8");
+_Static_assert(sizeof(channel_gpio) / sizeof(channel_gpio[0]) == RELAY_CHANNEL_COUNT,
+               "RELAY_CHANNEL_GPIOS needs one pin per channel");
+
+// Actuator task and its command queues (MQTT task -> actuator, and one
+// other device task -> actuator)
+#define RELAY_LOCAL_QUEUE_LEN 4     // Power of two
+#ifndef RELAY_COMMAND_SEQ
+static spsc_queue_t cmd_queue;
+static relay_cmd_t cmd_storage[RELAY_CMD_QUEUE_LEN];
+#endif
+static spsc_queue_t local_queue;
+static relay_cmd_t local_storage[RELAY_LOCAL_QUEUE_LEN];
+static TaskHandle_t actuator_task = NULL;
+static relay_done_cb_t done_handler = NULL;
+static void *done_ctx = NULL;
+#ifdef LATENCY_TRACE
+static int64_t trace_origin_us;     // Command being applied (actuator task only)
+#endif
+
+static atomic_uint_fast32_t stat_queued;
+static atomic_uint_fast32_t stat_dropped;
+static atomic_uint_fast32_t stat_applied;
+static atomic_uint_fast32_t stat_coalesced;
+static atomic_uint_fast32_t stat_stale;
+
+#ifdef RELAY_COMMAND_SEQ
+// Latest-wins slots in place of cmd_queue, one per command source and one
+// per channel: seq << 32 | ticket << 16 | states << 8 | mask, 0 when empty.
+// The ticket counts writes (never 0), so the actuator takes the slots in the
+// order they were last written. The MQTT task writes, the actuator empties.
+// 64-bit atomics are not lock-free on the ESP32; IDF implements them with a
+// short critical section.
+#define SLOT_SYNC       0
+#define SLOT_CONTROL    1
+#define SLOT_BATCH      2
+#define SLOT_CHANNEL    3           // + channel
+#define SLOT_COUNT      (SLOT_CHANNEL + RELAY_CHANNEL_COUNT)
+static atomic_uint_fast64_t cmd_slots[SLOT_COUNT];
+#ifdef LATENCY_TRACE
+static atomic_int_fast64_t slot_origin_us[SLOT_COUNT];
+#endif
+static uint16_t next_ticket = 1;            // Submitting task only
+static uint32_t seq_newest[SLOT_COUNT];     // Submitting task only
+static int64_t seq_newest_us[SLOT_COUNT];   // When seq_newest was submitted
+static bool seq_seen[SLOT_COUNT];
+#endif
+
+#ifdef RELAY_PERSIST_STATE
+#define RELAY_NVS_NAMESPACE "relay"
+#define RELAY_NVS_KEY       "state"
+
+// Owned by the persist timer callback, apart from the load in relay_init
+static esp_timer_handle_t persist_timer = NULL;
+static int stored_state = -1;           // Channel states in NVS, -1 if none
+static int64_t last_write_us = 0;
+static bool written = false;            // last_write_us is valid
+
+/**
+ * @brief Read the channel states kept in NVS
+ *
+ * A value written by the single-channel firmware (0 or 1) is channel 0.
+ *
+ * @return true if one was stored
+ */
+static bool persist_load(uint8_t *states)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(RELAY_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    uint8_t value = 0;
+    esp_err_t err = nvs_get_u8(nvs, RELAY_NVS_KEY, &value);
+    nvs_close(nvs);
+    if (err != ESP_OK) {
+        return false;
+    }
+    // Channels this board no longer has are dropped
+    stored_state = value;
+    *states = value & RELAY_ALL_CHANNELS;
+    return true;
+}
+
+/**
+ * @brief Write the current states if they differ from NVS, at most once per
+ *        RELAY_PERSIST_MIN_INTERVAL_MS
+ *
+ * Runs on the esp_timer task, RELAY_PERSIST_DELAY_MS after the first of a
+ * burst of changes, so only the state the burst settled on is written.
+ */
+static void persist_timer_cb(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next_allowed = last_write_us + (int64_t)RELAY_PERSIST_MIN_INTERVAL_MS * 1000;
+    if (written && now < next_allowed) {
+        esp_timer_start_once(persist_timer, (uint64_t)(next_allowed - now));
+        return;
+    }
+
+    uint8_t states = relay_states;
+    if ((int)states == stored_state) {
+        return;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(RELAY_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_u8(nvs, RELAY_NVS_KEY, states);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to persist relay state: %s", esp_err_to_name(err));
+        return;
+    }
+    stored_state = states;
+    last_write_us = now;
+    written = true;
+    ESP_LOGI(TAG, "Persisted relay states 0x%02x", states);
+}
+
+/**
+ * @brief Schedule a write of a changed state
+ */
+static void persist_schedule(void)
+{
+    // Already armed (a write is pending or rate-limited) picks the change up
+    if (persist_timer != NULL && !esp_timer_is_active(persist_timer)) {
+        esp_timer_start_once(persist_timer, (uint64_t)RELAY_PERSIST_DELAY_MS * 1000);
+    }
+}
+#endif
+
+/**
+ * @brief Pin masks that put the channels in mask into the given states
+ *
+ * @param high Pins to drive HIGH (GPIO_OUT_W1TS)
+ * @param low Pins to drive LOW (GPIO_OUT_W1TC)
+ */
+static void channel_levels(uint8_t mask, uint8_t states, uint32_t *high, uint32_t *low)
+{
+    *high = 0;
+    *low = 0;
+    for (int ch = 0; ch < RELAY_CHANNEL_COUNT; ch++) {
+        if ((mask & (1U << ch)) == 0) {
+            continue;
+        }
+        bool on = (states & (1U << ch)) != 0;
+        bool active_low = (RELAY_CHANNEL_ACTIVE_LOW & (1U << ch)) != 0;
+        if (on != active_low) {
+            *high |= 1UL << channel_gpio[ch];
+        } else {
+            *low |= 1UL << channel_gpio[ch];
+        }
+    }
+}
+
+/**
+ * @brief Drive the pins in both masks
+ *
+ * The set and clear registers only change the pins written as 1, so nothing
+ * else on the port (the status LED) is read back and rewritten, and every
+ * pin going the same way switches in the same store.
+ */
+static void write_levels(uint32_t high, uint32_t low)
+{
+    if (high != 0) {
+        REG_WRITE(GPIO_OUT_W1TS_REG, high);
+    }
+    if (low != 0) {
+        REG_WRITE(GPIO_OUT_W1TC_REG, low);
+    }
+}
+
+#ifdef RELAY_COMMAND_SEQ
+static int cmd_slot(const relay_cmd_t *cmd)
+{
+    switch (cmd->source) {
+        case RELAY_CMD_SYNC:
+            return SLOT_SYNC;
+        case RELAY_CMD_BATCH:
+            return SLOT_BATCH;
+        case RELAY_CMD_CHANNEL: {
+            int ch = cmd->mask != 0 ? __builtin_ctz(cmd->mask) : 0;
+            return SLOT_CHANNEL + (ch < RELAY_CHANNEL_COUNT ? ch : 0);
+        }
+        default:
+            return SLOT_CONTROL;
+    }
+}
+
+static relay_cmd_source_t slot_source(int slot)
+{
+    switch (slot) {
+        case SLOT_SYNC:
+            return RELAY_CMD_SYNC;
+        case SLOT_CONTROL:
+            return RELAY_CMD_CONTROL;
+        case SLOT_BATCH:
+            return RELAY_CMD_BATCH;
+        default:
+            return RELAY_CMD_CHANNEL;
+    }
+}
+
+/**
+ * @brief Drop the given channels from every waiting command but one slot's
+ *
+ * A command emptied this way is counted as coalesced and never ACKed.
+ */
+static void slot_clear_channels(int keep, uint8_t mask)
+{
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        if (i == keep) {
+            continue;
+        }
+        uint64_t waiting = atomic_load_explicit(&cmd_slots[i], memory_order_relaxed);
+        uint64_t cleared;
+        do {
+            if ((waiting & mask) == 0) {
+                break;
+            }
+            uint8_t left = (uint8_t)waiting & ~mask;
+            cleared = left != 0 ? (waiting & ~(uint64_t)0xffff) | ((waiting >> 8) & left) << 8 | left : 0;
+        } while (!atomic_compare_exchange_weak_explicit(&cmd_slots[i], &waiting, cleared,
+                                                        memory_order_release, memory_order_relaxed));
+        if ((waiting & mask) != 0 && ((uint8_t)waiting & ~mask) == 0) {
+            atomic_fetch_add_explicit(&stat_coalesced, 1, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Empty the slot written longest ago, if any is full
+ */
+static bool slot_take(relay_cmd_t *cmd)
+{
+    int oldest = -1;
+    uint16_t oldest_ticket = 0;
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        uint16_t ticket = (uint16_t)(atomic_load_explicit(&cmd_slots[i], memory_order_relaxed) >> 16);
+        if (ticket != 0 && (oldest < 0 || (int16_t)(ticket - oldest_ticket) < 0)) {
+            oldest = i;
+            oldest_ticket = ticket;
+        }
+    }
+    if (oldest < 0) {
+        return false;
+    }
+
+    // The slot may have been rewritten since: that newer command is the one taken
+    uint64_t packed = atomic_exchange_explicit(&cmd_slots[oldest], 0, memory_order_acquire);
+    *cmd = (relay_cmd_t){
+        .mask = (uint8_t)packed,
+        .states = (uint8_t)(packed >> 8),
+        .source = slot_source(oldest),
+        .seq = (uint32_t)(packed >> 32),
+    };
+#ifdef LATENCY_TRACE
+    cmd->origin_us = atomic_load_explicit(&slot_origin_us[oldest], memory_order_relaxed);
+#endif
+    return true;
+}
+#endif
+
+static bool take_command(relay_cmd_t *cmd)
+{
+#ifdef RELAY_COMMAND_SEQ
+    return slot_take(cmd) || spsc_queue_pop(&local_queue, cmd);
+#else
+    return spsc_queue_pop(&cmd_queue, cmd) || spsc_queue_pop(&local_queue, cmd);
+#endif
+}
+
+/**
+ * @brief Apply queued commands: switch first, then report the resulting state
+ */
+static void relay_actuator_task(void *pvParameters)
+{
+    relay_cmd_t cmd;
+    for (;;) {
+        // Each submit gives one notification, so none is lost between the
+        // empty check and the wait
+        while (!take_command(&cmd)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        atomic_fetch_add_explicit(&stat_applied, 1, memory_order_relaxed);
+
+        // A sync that matches the restored state leaves the output alone
+        esp_err_t ret = ESP_OK;
+        if (cmd.source != RELAY_CMD_SYNC || ((relay_states ^ cmd.states) & cmd.mask) != 0) {
+#ifdef LATENCY_TRACE
+            trace_origin_us = cmd.origin_us;
+#endif
+            ret = relay_set_channels(cmd.mask, cmd.states);
+#ifdef LATENCY_TRACE
+            trace_origin_us = 0;
+#endif
+        }
+
+        relay_done_cb_t handler = done_handler;
+        if (handler != NULL) {
+            handler(&cmd, relay_states, ret, done_ctx);
+        }
+    }
+}
+
+static esp_err_t relay_actuator_start(void)
+{
+    if (actuator_task != NULL) {
+        return ESP_OK;
+    }
+#ifndef RELAY_COMMAND_SEQ
+    spsc_queue_init(&cmd_queue, cmd_storage, sizeof(cmd_storage[0]), RELAY_CMD_QUEUE_LEN);
+#endif
+    spsc_queue_init(&local_queue, local_storage, sizeof(local_storage[0]), RELAY_LOCAL_QUEUE_LEN);
+
+    BaseType_t ret = xTaskCreatePinnedToCore(relay_actuator_task, "relay_actuator", 3072, NULL,
+                                             RELAY_ACTUATOR_PRIORITY, &actuator_task, RELAY_ACTUATOR_CORE);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create actuator task");
+        actuator_task = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
 
 esp_err_t relay_init(void) {
-    ESP_LOGI(TAG, "Initializing relay on GPIO %d", RELAY_GPIO_PIN);
+    uint64_t pin_mask = 0;
+    for (int ch = 0; ch < RELAY_CHANNEL_COUNT; ch++) {
+        if (channel_gpio[ch] < 0 || channel_gpio[ch] > 31) {
+            ESP_LOGE(TAG, "Channel %d: GPIO %d is not in the GPIO 0-31 output register", ch, channel_gpio[ch]);
+            return ESP_ERR_INVALID_ARG;
+        }
+        pin_mask |= 1ULL << channel_gpio[ch];
+        ESP_LOGI(TAG, "Channel %d on GPIO %d (active-%s)", ch, channel_gpio[ch],
+                 (RELAY_CHANNEL_ACTIVE_LOW & (1U << ch)) ? "LOW" : "HIGH");
+    }
+
+    // Restore the last states, all OFF if none were stored
+    uint8_t initial = 0;
+#ifdef RELAY_PERSIST_STATE
+    bool restored = persist_load(&initial);
+
+    const esp_timer_create_args_t persist_args = {
+        .callback = persist_timer_cb,
+        .name = "relay_persist",
+    };
+    if (persist_timer == NULL) {
+        esp_err_t timer_ret = esp_timer_create(&persist_args, &persist_timer);
+        if (timer_ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to create persist timer, state will not be kept: %s", esp_err_to_name(timer_ret));
+        }
+    }
+#endif
+
+    // Latch the levels first, so no relay pulses when the pins become outputs
+    uint32_t high, low;
+    channel_levels(RELAY_ALL_CHANNELS, initial, &high, &low);
+    write_levels(high, low);
 
-    // Configure GPIO
     gpio_config_t io_conf = {
-        .pin_bit_mask = (1ULL << RELAY_GPIO_PIN),
+        .pin_bit_mask = pin_mask,
         .mode = GPIO_MODE_OUTPUT,
         .pull_up_en = GPIO_PULLUP_DISABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
@@ -21,52 +391,179 @@ esp_err_t relay_init(void) {
 
     esp_err_t ret = gpio_config(&io_conf);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to configure GPIO %d: %s", RELAY_GPIO_PIN, esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Failed to configure relay GPIOs: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    // Set initial state to OFF
-    // Active-LOW relay: OFF = HIGH (1)
-    ret = gpio_set_level(RELAY_GPIO_PIN, 1);
+    relay_states = initial;
+
+    ret = relay_actuator_start();
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set initial GPIO level: %s", esp_err_to_name(ret));
         return ret;
     }
+#ifdef RELAY_PERSIST_STATE
+    ESP_LOGI(TAG, "Relay initialized successfully, %d channel(s), states: 0x%02x (%s)",
+             RELAY_CHANNEL_COUNT, initial, restored ? "restored from NVS" : "default");
+#else
+    ESP_LOGI(TAG, "Relay initialized successfully, %d channel(s), all OFF", RELAY_CHANNEL_COUNT);
+#endif
+
+    return ESP_OK;
+}
+
+esp_err_t relay_submit(const relay_cmd_t *cmd) {
+    if (actuator_task == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+#ifdef RELAY_COMMAND_SEQ
+    int slot = cmd_slot(cmd);
+    uint64_t ticket = next_ticket;
+    next_ticket = next_ticket == UINT16_MAX ? 1 : next_ticket + 1;
+#ifdef LATENCY_TRACE
+    atomic_store_explicit(&slot_origin_us[slot], cmd->origin_us, memory_order_relaxed);
+#endif
+    // Older states for these channels in other slots must not be applied
+    // after this command, so they go before it is written
+    slot_clear_channels(slot, cmd->mask);
 
-    relay_state = false;
-    ESP_LOGI(TAG, "Relay initialized successfully, state: OFF (active-LOW)");
+    // Merge into a waiting command channel by channel: the newer state wins
+    // where both name a channel, and the newer number is the one ACKed. The
+    // actuator may empty the slot meanwhile, hence the loop.
+    uint64_t waiting = atomic_load_explicit(&cmd_slots[slot], memory_order_relaxed);
+    uint64_t packed;
+    do {
+        uint8_t mask = cmd->mask;
+        uint8_t states = cmd->states & cmd->mask;
+        if (waiting != 0) {
+            mask |= (uint8_t)waiting;
+            states |= (uint8_t)(waiting >> 8) & (uint8_t)waiting & ~cmd->mask;
+        }
+        packed = (uint64_t)cmd->seq << 32 | ticket << 16 | (uint64_t)states << 8 | mask;
+    } while (!atomic_compare_exchange_weak_explicit(&cmd_slots[slot], &waiting, packed,
+                                                    memory_order_release, memory_order_relaxed));
+    if (waiting != 0) {
+        atomic_fetch_add_explicit(&stat_coalesced, 1, memory_order_relaxed);
+    }
 
+    // Only a command that is on its way counts against redeliveries
+    if (cmd->seq != 0) {
+        seq_newest[slot] = cmd->seq;
+        seq_newest_us[slot] = esp_timer_get_time();
+        seq_seen[slot] = true;
+    }
+#else
+    if (!spsc_queue_push(&cmd_queue, cmd)) {
+        atomic_fetch_add_explicit(&stat_dropped, 1, memory_order_relaxed);
+        DLOGW(TAG, "Command queue full, dropping 0x%02x on 0x%02x", cmd->states & cmd->mask, cmd->mask);
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    atomic_fetch_add_explicit(&stat_queued, 1, memory_order_relaxed);
+    xTaskNotifyGive(actuator_task);
     return ESP_OK;
 }
 
-esp_err_t relay_set_state(bool state) {
-    // Active-LOW relay: invert the logic
-    // state = true (ON) -> GPIO LOW (0)
-    // state = false (OFF) -> GPIO HIGH (1)
-    uint32_t level = state ? 0 : 1;
+esp_err_t relay_submit_local(const relay_cmd_t *cmd) {
+    if (actuator_task == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!spsc_queue_push(&local_queue, cmd)) {
+        atomic_fetch_add_explicit(&stat_dropped, 1, memory_order_relaxed);
+        DLOGW(TAG, "Local command queue full, dropping 0x%02x on 0x%02x", cmd->states & cmd->mask, cmd->mask);
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_fetch_add_explicit(&stat_queued, 1, memory_order_relaxed);
+    xTaskNotifyGive(actuator_task);
+    return ESP_OK;
+}
 
-    esp_err_t ret = gpio_set_level(RELAY_GPIO_PIN, level);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set relay state: %s", esp_err_to_name(ret));
-        return ret;
+#ifdef RELAY_COMMAND_SEQ
+bool relay_seq_accept(const relay_cmd_t *cmd) {
+    if (cmd->seq == 0) {
+        return true;
+    }
+    int slot = cmd_slot(cmd);
+    int32_t ahead = (int32_t)(cmd->seq - seq_newest[slot]);
+    // A restarted sender counts again from below; a redelivery comes flagged
+    // DUP, or repeats the newest number when the sender itself retried it
+    bool restarted = ahead < 0 && !cmd->redelivered
+                     && esp_timer_get_time() - seq_newest_us[slot] >= (int64_t)RELAY_SEQ_RESTART_MS * 1000;
+    if (seq_seen[slot] && ahead <= 0 && ahead > -RELAY_SEQ_WINDOW && !restarted) {
+        atomic_fetch_add_explicit(&stat_stale, 1, memory_order_relaxed);
+        DLOGI(TAG, "Command #%lu is not newer than #%lu, ignored", (unsigned long)cmd->seq,
+              (unsigned long)seq_newest[slot]);
+        return false;
+    }
+    return true;
+}
+#endif
+
+void relay_set_done_handler(relay_done_cb_t handler, void *ctx) {
+    done_ctx = ctx;
+    done_handler = handler;
+}
+
+esp_err_t relay_set_channels(uint8_t mask, uint8_t states) {
+    LATENCY_TRACE_RECORD(LATENCY_CMD_RELAY_SET, trace_origin_us);
+    if (mask == 0 || (mask & ~RELAY_ALL_CHANNELS) != 0) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    relay_state = state;
-    ESP_LOGI(TAG, "Relay state changed to: %s", state ? "ON" : "OFF");
+    uint32_t high, low;
+    channel_levels(mask, states, &high, &low);
+    write_levels(high, low);
+    LATENCY_TRACE_RECORD(LATENCY_CMD_GPIO, trace_origin_us);
+
+    uint8_t previous = relay_states;
+    uint8_t current = (uint8_t)((previous & ~mask) | (states & mask));
+    relay_states = current;
+    DLOGI(TAG, "Relay channels 0x%02x -> 0x%02x", previous, current);
+
+#ifdef RELAY_PERSIST_STATE
+    if (current != previous) {
+        persist_schedule();
+    }
+#endif
 
     return ESP_OK;
 }
 
+esp_err_t relay_set_channel(uint8_t channel, bool state) {
+    if (channel >= RELAY_CHANNEL_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return relay_set_channels((uint8_t)(1U << channel), state ? 0xFF : 0);
+}
+
+esp_err_t relay_set_state(bool state) {
+    return relay_set_channel(0, state);
+}
+
+relay_stats_t relay_get_stats(void) {
+    relay_stats_t stats = {
+        .queued = atomic_load_explicit(&stat_queued, memory_order_relaxed),
+        .dropped = atomic_load_explicit(&stat_dropped, memory_order_relaxed),
+        .applied = atomic_load_explicit(&stat_applied, memory_order_relaxed),
+        .coalesced = atomic_load_explicit(&stat_coalesced, memory_order_relaxed),
+        .stale = atomic_load_explicit(&stat_stale, memory_order_relaxed),
+    };
+    return stats;
+}
+
+uint8_t relay_get_channels(void) {
+    return relay_states;
+}
+
 bool relay_get_state(void) {
-    return relay_state;
+    return (relay_states & 0x01) != 0;
 }
 
 esp_err_t relay_toggle(void) {
-    bool new_state = !relay_state;
+    bool state = relay_get_state();
 
     ESP_LOGI(TAG, "Toggling relay from %s to %s",
-             relay_state ? "ON" : "OFF",
-             new_state ? "ON" : "OFF");
+             state ? "ON" : "OFF",
+             !state ? "ON" : "OFF");
 
-    return relay_set_state(new_state);
+    return relay_set_state(!state);
 }
@@ -9,319 +9,557 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "mqtt_client.h"
-#include "driver/i2c.h"
+#include "esp_timer.h"
+#include "sample_ring.h"
+#include "store_forward.h"
+#include "boot_events.h"
+#include "mqtt_manager.h"
+#include "latency_trace.h"
+#include "dlog.h"
+#include "payload.h"
+
+#ifdef TEMP_REPORT_BY_EXCEPTION
+#include "report_control.h"
+#endif
+
+#ifdef TEMP_DEEP_SLEEP_MODE
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "duty_cycle.h"
+#include "wifi_manager.h"
+#endif
 
 static const char *TAG = "TEMP_SENSOR";
 static esp_mqtt_client_handle_t mqtt_client = NULL;
 
-// I2C addresses
-#define AHT20_I2C_ADDR      0x38
+// Public API
+esp_err_t temp_sensor_init(void)
+{
+    ESP_LOGI(TAG, "Initializing I2C and sensors...");
+    return sensor_manager_init();
+}
 
-// AHT20 commands
-#define AHT20_CMD_INIT      0xBE
-#define AHT20_CMD_TRIGGER   0xAC
-#define AHT20_CMD_SOFTRESET 0xBA
+esp_err_t temp_sensor_rescan_bus(void)
+{
+    return sensor_manager_rescan();
+}
+
+/**
+ * @brief First reading of the publishing task
+ *
+ * The conversions run while the broker connection is still coming up, so the
+ * readings are ready the moment MQTT is. If MQTT is not up within
+ * TEMP_FIRST_READING_WAIT_MS the readings take the offline path.
+ */
+static esp_err_t read_first(sensor_data_t *data)
+{
+    esp_err_t ret = sensor_manager_start(SENSOR_ALL);
+    boot_events_wait(BOOT_EVENT_MQTT, TEMP_FIRST_READING_WAIT_MS);
+    if (ret != ESP_OK) {
+        return sensor_manager_read(data);
+    }
+    ret = sensor_manager_collect(data, sensor_manager_sample_timeout_ms());
+    return ret == ESP_OK ? ESP_OK : ESP_FAIL;
+}
 
-// I2C timeout
-#define I2C_TIMEOUT_MS 1000
+/**
+ * @brief Count a publish toward boot-to-first-publish
+ *
+ * The status message goes out again once, with that timing filled in.
+ */
+static void note_published(void)
+{
+    if (boot_events_set(BOOT_EVENT_FIRST_PUBLISH)) {
+        mqtt_publish_connection_status();
+    }
+}
 
-static bool aht20_initialized = false;
+#if defined(TEMP_BATCH_MODE) || defined(TEMP_DEEP_SLEEP_MODE)
+/**
+ * @brief Encode a batch as CBOR with PAYLOAD_BINARY, as JSON otherwise
+ */
+static size_t encode_batch(const sample_ring_t *ring, uint32_t now_ms, char *buf, size_t len, uint16_t *encoded)
+{
+#ifdef PAYLOAD_BINARY
+    return payload_encode_batch(ring, now_ms, (uint8_t *)buf, len, encoded);
+#else
+    return sample_ring_encode_json(ring, now_ms, buf, len, encoded);
+#endif
+}
+#endif
 
-// I2C helper functions
-static void i2c_scanner(void)
+static esp_err_t publish_temperature(const sensor_data_t *data)
 {
-    ESP_LOGI(TAG, "Scanning I2C bus...");
-    uint8_t devices_found = 0;
-
-    for (uint8_t addr = 1; addr < 127; addr++) {
-        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-        i2c_master_start(cmd);
-        i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-        i2c_master_stop(cmd);
-        esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, pdMS_TO_TICKS(50));
-        i2c_cmd_link_delete(cmd);
-
-        if (ret == ESP_OK) {
-            ESP_LOGI(TAG, "  Found device at address 0x%02X", addr);
-            devices_found++;
-        }
+    if (mqtt_client == NULL) {
+        ESP_LOGE(TAG, "MQTT client not set");
+        return ESP_FAIL;
     }
 
-    if (devices_found == 0) {
-        ESP_LOGW(TAG, "No I2C devices found! Check your wiring:");
-        ESP_LOGW(TAG, "  - SDA connected to GPIO%d", I2C_SDA_PIN);
-        ESP_LOGW(TAG, "  - SCL connected to GPIO%d", I2C_SCL_PIN);
-        ESP_LOGW(TAG, "  - Both sensors powered (3.3V and GND)");
-        ESP_LOGW(TAG, "  - Pull-up resistors on SDA/SCL (if needed)");
-    } else {
-        ESP_LOGI(TAG, "I2C scan complete. Found %d device(s)", devices_found);
+    if (!data->valid) {
+        ESP_LOGE(TAG, "No valid sensor data to publish");
+        return ESP_ERR_INVALID_STATE;
     }
+
+#ifdef PAYLOAD_BINARY
+    uint8_t payload[PAYLOAD_TEMPERATURE_MAX_LEN];
+    size_t len = payload_encode_temperature(data->temperature, data->humidity, payload, sizeof(payload));
+
+    DLOGI(TAG, "Publishing temperature to %s: %.2f°C (%u bytes)", MQTT_TOPIC_TEMP, data->temperature,
+          (unsigned)len);
+
+    int msg_id = mqtt_publish(mqtt_client, MQTT_TOPIC_TEMP, (const char *)payload, (int)len, 0, 0);
+#else
+    // Send simple float string (webapp expects: float(payload))
+    char payload[16];
+    snprintf(payload, sizeof(payload), "%.2f", data->temperature);
+
+    DLOGI(TAG, "Publishing temperature to %s: %s°C", MQTT_TOPIC_TEMP, payload);
+
+    int msg_id = mqtt_publish(mqtt_client, MQTT_TOPIC_TEMP, payload, 0, 0, 0);
+#endif
+    if (msg_id < 0) {
+        DLOGE(TAG, "Failed to publish temperature");
+        return ESP_FAIL;
+    }
+
+    LATENCY_TRACE_RECORD(LATENCY_SENSOR_PUBLISHED, data->trigger_us);
+    DLOGI(TAG, "Temperature published successfully, msg_id=%d", msg_id);
+    note_published();
+    return ESP_OK;
 }
 
-static esp_err_t i2c_master_init(void)
+/**
+ * @brief Publish one secondary sensor's reading as JSON to its own topic
+ *
+ * Only the quantities the sensor measures are included, e.g.
+ * {"temperature":21.50,"humidity":45.00}.
+ */
+static esp_err_t publish_sensor(const sensor_data_t *data)
 {
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_SDA_PIN,
-        .scl_io_num = I2C_SCL_PIN,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2C_FREQ_HZ,
-    };
+    char topic[64];
+    char payload[96];
+    snprintf(topic, sizeof(topic), MQTT_TOPIC_SENSOR_PREFIX "%s", data->name);
 
-    esp_err_t err = i2c_param_config(I2C_NUM_0, &conf);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "I2C param config failed: %s", esp_err_to_name(err));
-        return err;
+    int len = snprintf(payload, sizeof(payload), "{\"temperature\":%.2f", data->temperature);
+    if (data->fields & SENSOR_HAS_HUMIDITY) {
+        len += snprintf(payload + len, sizeof(payload) - len, ",\"humidity\":%.2f", data->humidity);
     }
-
-    err = i2c_driver_install(I2C_NUM_0, conf.mode, 0, 0, 0);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "I2C driver install failed: %s", esp_err_to_name(err));
-        return err;
+    if (data->fields & SENSOR_HAS_PRESSURE) {
+        len += snprintf(payload + len, sizeof(payload) - len, ",\"pressure\":%.2f", data->pressure);
     }
+    len += snprintf(payload + len, sizeof(payload) - len, "}");
 
-    ESP_LOGI(TAG, "I2C initialized on SDA=%d, SCL=%d", I2C_SDA_PIN, I2C_SCL_PIN);
+    int msg_id = mqtt_publish(mqtt_client, topic, payload, len, 0, 0);
+    if (msg_id < 0) {
+        DLOGE(TAG, "Failed to publish %s reading", data->name);
+        return ESP_FAIL;
+    }
+    DLOGI(TAG, "Published %s to %s, msg_id=%d", payload, topic, msg_id);
+    note_published();
     return ESP_OK;
 }
 
-static esp_err_t i2c_write_cmd(uint8_t addr, uint8_t *data, size_t len)
+#if !defined(TEMP_REPORT_BY_EXCEPTION) || defined(TEMP_BATCH_MODE) || defined(TEMP_DEEP_SLEEP_MODE)
+/**
+ * @brief Publish the valid readings of every sensor after the primary one
+ */
+static void publish_secondary(const sensor_data_t *data)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-    if (len > 0) {
-        i2c_master_write(cmd, data, len, true);
+    for (size_t i = 1; i < sensor_manager_count(); i++) {
+        if (data[i].valid) {
+            publish_sensor(&data[i]);
+        }
     }
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-    i2c_cmd_link_delete(cmd);
-    return ret;
 }
+#endif
 
-static esp_err_t i2c_read_reg(uint8_t addr, uint8_t reg, uint8_t *data, size_t len)
+#ifdef STORE_FORWARD_ENABLED
+/**
+ * @brief Keep a reading that could not be published for the drain task
+ */
+static void store_for_later(const sensor_sample_t *sample)
 {
-    esp_err_t ret;
+    if (store_forward_append(sample) == ESP_OK) {
+        DLOGI(TAG, "Reading stored for later, %lu queued", (unsigned long)store_forward_pending());
+    }
+}
+#endif
 
-    // Write register address
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, reg, true);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-    i2c_cmd_link_delete(cmd);
+#ifdef TEMP_BATCH_MODE
+static sensor_sample_t batch_storage[TEMP_BATCH_SIZE];
+static sample_ring_t batch_ring;
+static char batch_payload[64 + TEMP_BATCH_SIZE * 32];
 
-    if (ret != ESP_OK) {
-        return ret;
+static void publish_batch(void)
+{
+    if (sample_ring_empty(&batch_ring)) {
+        return;
     }
 
-    // Read data
-    cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_READ, true);
-    if (len > 1) {
-        i2c_master_read(cmd, data, len - 1, I2C_MASTER_ACK);
+    uint16_t encoded = 0;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    size_t len = encode_batch(&batch_ring, now_ms, batch_payload, sizeof(batch_payload), &encoded);
+
+    DLOGI(TAG, "Publishing batch of %u samples (%u bytes) to %s",
+          encoded, (unsigned)len, MQTT_TOPIC_TEMP_BATCH);
+
+    // QoS 1 so a batch survives a short disconnect in the client outbox
+    int msg_id = mqtt_publish(mqtt_client, MQTT_TOPIC_TEMP_BATCH, batch_payload, (int)len, 1, 0);
+    if (msg_id < 0) {
+#ifdef STORE_FORWARD_ENABLED
+        // Move the batch to flash so the ring does not overwrite it
+        ESP_LOGW(TAG, "Failed to publish batch, storing %u samples", encoded);
+        for (uint16_t i = 0; i < encoded; i++) {
+            store_for_later(sample_ring_at(&batch_ring, i));
+        }
+        sample_ring_consume(&batch_ring, encoded);
+#else
+        // Keep the samples; the ring overwrites the oldest if this persists
+        ESP_LOGE(TAG, "Failed to publish batch, keeping %u samples", batch_ring.count);
+#endif
+        return;
     }
-    i2c_master_read_byte(cmd, data + len - 1, I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-    i2c_cmd_link_delete(cmd);
 
-    return ret;
+    sample_ring_consume(&batch_ring, encoded);
+    note_published();
 }
 
-static esp_err_t i2c_write_reg(uint8_t addr, uint8_t reg, uint8_t value)
+static void temperature_task(void *pvParameters)
 {
-    uint8_t data[2] = {reg, value};
-    return i2c_write_cmd(addr, data, 2);
-}
+    esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)pvParameters;
+    mqtt_client = client;
 
-// AHT20 functions
-static esp_err_t aht20_init(void)
-{
-    ESP_LOGI(TAG, "Initializing AHT20...");
+    ESP_LOGI(TAG, "Temperature batching task started");
+    ESP_LOGI(TAG, "Sample interval: %d ms, flush interval: %d ms, batch size: %d",
+             TEMP_SAMPLE_INTERVAL_MS, TEMP_BATCH_FLUSH_INTERVAL_MS, TEMP_BATCH_SIZE);
 
-    vTaskDelay(pdMS_TO_TICKS(40)); // Wait for sensor to be ready
+    sample_ring_init(&batch_ring, batch_storage, TEMP_BATCH_SIZE);
 
-    // Send soft reset
-    uint8_t reset_cmd = AHT20_CMD_SOFTRESET;
-    esp_err_t ret = i2c_write_cmd(AHT20_I2C_ADDR, &reset_cmd, 1);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "AHT20 soft reset failed: %s", esp_err_to_name(ret));
-        return ret;
-    }
+    sensor_data_t data[SENSOR_MAX_COUNT];
+    sensor_data_t latest[SENSOR_MAX_COUNT] = {0};
+    TickType_t last_flush = xTaskGetTickCount();
+    TickType_t last_wake = last_flush;
+    bool first = true;
 
-    vTaskDelay(pdMS_TO_TICKS(20));
+    while (1) {
+        esp_err_t ret = first ? read_first(data) : sensor_manager_read(data);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read sensor data");
+        }
+        if (data[0].valid) {
+            sensor_sample_t sample = {
+                .timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000),
+                .temperature = data[0].temperature,
+                .humidity = data[0].humidity,
+            };
+            sample_ring_push(&batch_ring, &sample);
+        }
+        for (size_t i = 0; i < sensor_manager_count(); i++) {
+            if (data[i].valid) {
+                latest[i] = data[i];
+            }
+        }
 
-    // Initialize sensor
-    uint8_t init_cmd[3] = {AHT20_CMD_INIT, 0x08, 0x00};
-    ret = i2c_write_cmd(AHT20_I2C_ADDR, init_cmd, 3);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "AHT20 init failed: %s", esp_err_to_name(ret));
-        return ret;
-    }
+        // The first reading goes out right away, not after a whole flush interval
+        bool flush_due = first
+            || (xTaskGetTickCount() - last_flush) >= pdMS_TO_TICKS(TEMP_BATCH_FLUSH_INTERVAL_MS);
+        first = false;
+        if (flush_due || sample_ring_full(&batch_ring)) {
+            publish_batch();
+            if (latest[0].valid) {
+                publish_temperature(&latest[0]);
+            }
+            publish_secondary(latest);
+            last_flush = xTaskGetTickCount();
+        }
 
-    vTaskDelay(pdMS_TO_TICKS(10));
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(TEMP_SAMPLE_INTERVAL_MS));
+    }
+}
+#elif defined(TEMP_REPORT_BY_EXCEPTION)
+static report_state_t report_states[SENSOR_MAX_COUNT];
+static uint32_t report_suppressed[SENSOR_MAX_COUNT];
 
-    ESP_LOGI(TAG, "AHT20 initialized successfully!");
-    return ESP_OK;
+static const char *report_reason_str(report_reason_t reason)
+{
+    switch (reason) {
+        case REPORT_FIRST:    return "first";
+        case REPORT_DEADBAND: return "deadband";
+        case REPORT_SILENCE:  return "max silence";
+        default:              return "none";
+    }
 }
 
-static esp_err_t aht20_read(float *temperature, float *humidity)
+/**
+ * @brief Publish sensor i's reading if it moved past a deadband or the sensor
+ *        was silent too long
+ */
+static void report_reading(size_t i, const sensor_data_t *data, const report_config_t *cfg, uint32_t now_ms)
 {
-    // Trigger measurement
-    uint8_t trigger_cmd[3] = {AHT20_CMD_TRIGGER, 0x33, 0x00};
-    esp_err_t ret = i2c_write_cmd(AHT20_I2C_ADDR, trigger_cmd, 3);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "AHT20 trigger failed: %s", esp_err_to_name(ret));
-        return ret;
+    report_reason_t reason = report_on_sample(&report_states[i], cfg, data, now_ms);
+    if (reason == REPORT_NONE) {
+        report_suppressed[i]++;
+        return;
+    }
+
+    DLOGI(TAG, "Reporting %s (%s) after %lu suppressed readings", data->name, report_reason_str(reason),
+          (unsigned long)report_suppressed[i]);
+    esp_err_t ret = i == 0 ? publish_temperature(data) : publish_sensor(data);
+    if (ret == ESP_OK) {
+        report_on_published(&report_states[i], data, now_ms);
+        report_suppressed[i] = 0;
+        return;
+    }
+#ifdef STORE_FORWARD_ENABLED
+    if (i == 0) {
+        // The drain task delivers it: measure the deadbands from it as well
+        sensor_sample_t sample = {
+            .timestamp_ms = now_ms,
+            .temperature = data->temperature,
+            .humidity = data->humidity,
+        };
+        store_for_later(&sample);
+        report_on_published(&report_states[i], data, now_ms);
+        report_suppressed[i] = 0;
     }
+#endif
+}
 
-    vTaskDelay(pdMS_TO_TICKS(80)); // Wait for measurement
+static void temperature_task(void *pvParameters)
+{
+    esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)pvParameters;
+    mqtt_client = client;
 
-    // Read data
-    uint8_t data[7];
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (AHT20_I2C_ADDR << 1) | I2C_MASTER_READ, true);
-    i2c_master_read(cmd, data, 6, I2C_MASTER_ACK);
-    i2c_master_read_byte(cmd, &data[6], I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-    i2c_cmd_link_delete(cmd);
+    report_config_t cfg;
+    report_control_get(&cfg);
+    ESP_LOGI(TAG, "Temperature reporting task started");
+    ESP_LOGI(TAG, "Deadbands: %.2f°C, %.2f%%RH, %.2fhPa; sampling %lu-%lu ms, max silence %lu ms",
+             cfg.temperature, cfg.humidity, cfg.pressure, (unsigned long)cfg.min_interval_ms,
+             (unsigned long)cfg.max_interval_ms, (unsigned long)cfg.max_silence_ms);
 
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "AHT20 read failed: %s", esp_err_to_name(ret));
-        return ret;
+    for (size_t i = 0; i < SENSOR_MAX_COUNT; i++) {
+        report_state_init(&report_states[i], &cfg);
     }
 
-    // Check if busy
-    if (data[0] & 0x80) {
-        ESP_LOGW(TAG, "AHT20 busy");
-        return ESP_ERR_INVALID_STATE;
-    }
+    sensor_data_t data[SENSOR_MAX_COUNT];
+    bool first = true;
 
-    // Calculate humidity
-    uint32_t raw_humidity = ((uint32_t)data[1] << 12) | ((uint32_t)data[2] << 4) | ((data[3] >> 4) & 0x0F);
-    *humidity = (raw_humidity * 100.0) / 1048576.0;
+    while (1) {
+        esp_err_t ret = first ? read_first(data) : sensor_manager_read(data);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read sensor data");
+        }
 
-    // Calculate temperature
-    uint32_t raw_temp = (((uint32_t)data[3] & 0x0F) << 16) | ((uint32_t)data[4] << 8) | data[5];
-    *temperature = ((raw_temp * 200.0) / 1048576.0) - 50.0;
+        uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        uint32_t wait_ms = cfg.max_interval_ms;
+        for (size_t i = 0; i < sensor_manager_count(); i++) {
+            if (data[i].valid) {
+                report_reading(i, &data[i], &cfg, now_ms);
+            }
+            uint32_t next_ms = report_next_sample_ms(&report_states[i], &cfg, now_ms);
+            wait_ms = next_ms < wait_ms ? next_ms : wait_ms;
+        }
+        if (first) {
+            report_control_publish();
+            first = false;
+        }
 
-    return ESP_OK;
+        // New settings end the wait: the next reading is measured against them
+        if (report_control_wait(pdMS_TO_TICKS(wait_ms))) {
+            report_control_get(&cfg);
+            for (size_t i = 0; i < SENSOR_MAX_COUNT; i++) {
+                report_state_reconfigure(&report_states[i], &cfg);
+            }
+        }
+    }
 }
-
-// Public API
-esp_err_t temp_sensor_init(void)
+#else
+static void temperature_task(void *pvParameters)
 {
-    ESP_LOGI(TAG, "Initializing I2C and sensors...");
-    ESP_LOGI(TAG, "I2C SDA: GPIO%d, SCL: GPIO%d", I2C_SDA_PIN, I2C_SCL_PIN);
+    esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)pvParameters;
+    mqtt_client = client;
 
-    // Initialize I2C
-    esp_err_t ret = i2c_master_init();
-    if (ret != ESP_OK) {
-        return ret;
-    }
+    ESP_LOGI(TAG, "Temperature publishing task started");
+    ESP_LOGI(TAG, "Publishing interval: %d ms", TEMP_PUBLISH_INTERVAL_MS);
 
-    vTaskDelay(pdMS_TO_TICKS(100));
+    sensor_data_t data[SENSOR_MAX_COUNT];
+    bool first = true;
 
-    // Scan I2C bus to see what devices are connected
-    i2c_scanner();
+    while (1) {
+        ESP_LOGI(TAG, "Reading sensors...");
 
-    // Initialize AHT20
-    if (aht20_init() == ESP_OK) {
-        aht20_initialized = true;
-    } else {
-        ESP_LOGW(TAG, "AHT20 sensor not initialized! Will continue without sensor data.");
-        ESP_LOGW(TAG, "Check wiring:");
-        ESP_LOGW(TAG, "  SDA -> GPIO%d", I2C_SDA_PIN);
-        ESP_LOGW(TAG, "  SCL -> GPIO%d", I2C_SCL_PIN);
-        // Return OK anyway so the program doesn't crash
-        return ESP_OK;
-    }
+        esp_err_t ret = first ? read_first(data) : sensor_manager_read(data);
+        first = false;
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read sensor data");
+        }
+        if (data[0].valid && publish_temperature(&data[0]) != ESP_OK) {
+#ifdef STORE_FORWARD_ENABLED
+            sensor_sample_t sample = {
+                .timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000),
+                .temperature = data[0].temperature,
+                .humidity = data[0].humidity,
+            };
+            store_for_later(&sample);
+#endif
+        }
+        publish_secondary(data);
 
-    ESP_LOGI(TAG, "AHT20 sensor initialization complete");
-    return ESP_OK;
+        vTaskDelay(pdMS_TO_TICKS(TEMP_PUBLISH_INTERVAL_MS));
+    }
 }
+#endif // TEMP_BATCH_MODE / TEMP_REPORT_BY_EXCEPTION
+
+#ifdef TEMP_DEEP_SLEEP_MODE
+// Kept in RTC slow memory over deep sleep
+static RTC_DATA_ATTR duty_cycle_t duty;
+static RTC_DATA_ATTR sensor_sample_t duty_storage[TEMP_SLEEP_BUFFER_SIZE];
+static char duty_payload[512];
 
-esp_err_t temp_sensor_read(sensor_data_t *data)
+static const char *connect_reason_str(duty_connect_reason_t reason)
 {
-    if (data == NULL) {
-        ESP_LOGE(TAG, "NULL data pointer");
-        return ESP_FAIL;
+    switch (reason) {
+        case DUTY_CONNECT_SCHEDULED:   return "scheduled";
+        case DUTY_CONNECT_THRESHOLD:   return "threshold";
+        case DUTY_CONNECT_BUFFER_FULL: return "buffer full";
+        default:                       return "none";
     }
+}
 
-    // Initialize all fields
-    memset(data, 0, sizeof(sensor_data_t));
+static uint32_t uptime_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
 
-    // Read AHT20
-    if (aht20_initialized) {
-        if (aht20_read(&data->aht20_temp, &data->aht20_humidity) == ESP_OK) {
-            data->aht20_valid = true;
-            ESP_LOGI(TAG, "AHT20 - Temperature: %.2f°C, Humidity: %.2f%%",
-                     data->aht20_temp, data->aht20_humidity);
-        } else {
-            ESP_LOGE(TAG, "Failed to read from AHT20");
+/**
+ * @brief Publish the readings in ring, oldest first, as many batches as needed
+ *
+ * Consumes from ring, which is a copy of the RTC buffer: the buffer itself is
+ * only advanced once the broker has the batches.
+ */
+static bool duty_publish_buffer(sample_ring_t *ring)
+{
+    while (!sample_ring_empty(ring)) {
+        uint16_t encoded = 0;
+        uint32_t now_ms = (uint32_t)duty_cycle_now_ms(&duty, uptime_ms());
+        size_t len = encode_batch(ring, now_ms, duty_payload, sizeof(duty_payload), &encoded);
+        if (encoded == 0) {
+            return false;
         }
+        int msg_id = mqtt_publish(mqtt_client, MQTT_TOPIC_TEMP_BATCH, duty_payload, (int)len, 1, 0);
+        if (msg_id < 0) {
+            ESP_LOGE(TAG, "Failed to publish batch of %u readings", encoded);
+            return false;
+        }
+        ESP_LOGI(TAG, "Published batch of %u readings, msg_id=%d", encoded, msg_id);
+        sample_ring_consume(ring, encoded);
     }
-
-    return data->aht20_valid ? ESP_OK : ESP_FAIL;
+    return true;
 }
 
-static void publish_temperature(sensor_data_t *data)
+/**
+ * @brief Wait for the QoS 1 publishes to be acknowledged before the radio goes off
+ */
+static bool duty_wait_flushed(void)
 {
-    if (mqtt_client == NULL) {
-        ESP_LOGE(TAG, "MQTT client not set");
-        return;
+    int64_t deadline = esp_timer_get_time() + (int64_t)TEMP_SLEEP_FLUSH_TIMEOUT_MS * 1000;
+    while (esp_mqtt_client_get_outbox_size(mqtt_client) > 0) {
+        if (esp_timer_get_time() >= deadline) {
+            ESP_LOGW(TAG, "Outbox not flushed within %d ms", TEMP_SLEEP_FLUSH_TIMEOUT_MS);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
     }
+    return true;
+}
 
-    if (!data->aht20_valid) {
-        ESP_LOGE(TAG, "No valid sensor data to publish");
-        return;
+/**
+ * @brief Bring up WiFi and MQTT, send the buffered readings and the energy estimate
+ *
+ * The sensors after the primary one are not buffered; their readings of
+ * this wake go out as they are.
+ *
+ * @return true if every buffered reading reached the broker
+ */
+static bool duty_connect_and_publish(const sensor_data_t *latest)
+{
+    ESP_ERROR_CHECK(wifi_manager_init());
+    ESP_ERROR_CHECK(mqtt_client_init());
+    mqtt_client = mqtt_get_client();
+
+    if (!boot_events_wait(BOOT_EVENT_MQTT, TEMP_SLEEP_CONNECT_TIMEOUT_MS)) {
+        ESP_LOGW(TAG, "No broker connection within %d ms, keeping %u readings",
+                 TEMP_SLEEP_CONNECT_TIMEOUT_MS, duty.ring.count);
+        mqtt_client_stop();
+        return false;
     }
 
-    // Send simple float string (webapp expects: float(payload))
-    char payload[16];
-    snprintf(payload, sizeof(payload), "%.2f", data->aht20_temp);
-
-    ESP_LOGI(TAG, "Publishing temperature to %s: %s°C", MQTT_TOPIC_TEMP, payload);
+    sample_ring_t pending = duty.ring;
+    bool published = duty_publish_buffer(&pending);
+    if (published && latest[0].valid) {
+        publish_temperature(&latest[0]);
+    }
+    publish_secondary(latest);
+    size_t len = duty_cycle_encode_energy(&duty, duty_payload, sizeof(duty_payload));
+    if (len > 0) {
+        mqtt_publish(mqtt_client, MQTT_TOPIC_TEMP_ENERGY, duty_payload, (int)len, 0, 0);
+    }
 
-    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_TEMP, payload, 0, 0, 0);
-    if (msg_id < 0) {
-        ESP_LOGE(TAG, "Failed to publish temperature");
-    } else {
-        ESP_LOGI(TAG, "Temperature published successfully, msg_id=%d", msg_id);
+    published = published && duty_wait_flushed();
+    if (published) {
+        duty_cycle_on_published(&duty, duty.ring.count - pending.count);
     }
+    mqtt_client_stop();
+    return published;
 }
 
-static void temperature_task(void *pvParameters)
+void temp_sensor_run_duty_cycle(void)
 {
-    esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)pvParameters;
-    mqtt_client = client;
-
-    ESP_LOGI(TAG, "Temperature publishing task started");
-    ESP_LOGI(TAG, "Publishing interval: %d ms", TEMP_PUBLISH_INTERVAL_MS);
+    bool woke = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+    if (!duty_cycle_init(&duty, duty_storage, TEMP_SLEEP_BUFFER_SIZE, woke)) {
+        ESP_LOGI(TAG, "Duty cycle started: wake every %d ms, publish every %d wakes",
+                 TEMP_SLEEP_INTERVAL_MS, TEMP_SLEEP_CONNECT_EVERY);
+    }
 
-    // Wait a bit for MQTT to connect
-    vTaskDelay(pdMS_TO_TICKS(2000));
+    sensor_data_t data[SENSOR_MAX_COUNT];
+    sensor_sample_t sample;
+    const sensor_sample_t *reading = NULL;
+    if (sensor_manager_read(data) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read sensor data");
+    }
+    if (data[0].valid) {
+        sample.timestamp_ms = (uint32_t)duty_cycle_now_ms(&duty, uptime_ms());
+        sample.temperature = data[0].temperature;
+        sample.humidity = data[0].humidity;
+        reading = &sample;
+    }
 
-    sensor_data_t data;
+    duty_connect_reason_t reason = duty_cycle_on_wake(&duty, reading);
+    ESP_LOGI(TAG, "Wake %lu: %u readings buffered, connect: %s",
+             (unsigned long)duty.wakes, duty.ring.count, connect_reason_str(reason));
 
-    while (1) {
-        ESP_LOGI(TAG, "Reading sensors...");
+    uint32_t radio_ms = 0;
+    if (reason != DUTY_CONNECT_NONE) {
+        uint32_t radio_on_ms = uptime_ms();
+        bool published = duty_connect_and_publish(data);
+        duty_cycle_on_connect_done(&duty, published, reading);
+        radio_ms = uptime_ms() - radio_on_ms;
+    }
 
-        if (temp_sensor_read(&data) == ESP_OK) {
-            publish_temperature(&data);
-        } else {
-            ESP_LOGE(TAG, "Failed to read sensor data");
-        }
+    uint32_t awake_ms = uptime_ms();
+    uint32_t sleep_ms = duty_cycle_sleep_ms(awake_ms);
+    duty_cycle_on_sleep(&duty, awake_ms, radio_ms, sleep_ms);
+    ESP_LOGI(TAG, "Awake %lu ms (radio %lu ms), sleeping %lu ms",
+             (unsigned long)awake_ms, (unsigned long)radio_ms, (unsigned long)sleep_ms);
 
-        vTaskDelay(pdMS_TO_TICKS(TEMP_PUBLISH_INTERVAL_MS));
-    }
+#ifdef DEFERRED_LOG
+    dlog_flush();   // RAM, and the ring with it, does not survive deep sleep
+#endif
+    esp_deep_sleep((uint64_t)sleep_ms * 1000);
 }
+#endif // TEMP_DEEP_SLEEP_MODE
 
 esp_err_t temp_sensor_start_publishing(esp_mqtt_client_handle_t client)
 {
@@ -330,6 +568,13 @@ esp_err_t temp_sensor_start_publishing(esp_mqtt_client_handle_t client)
         return ESP_FAIL;
     }
 
+#ifdef STORE_FORWARD_ENABLED
+    // Runs without the log if the partition is missing
+    if (store_forward_init() == ESP_OK) {
+        store_forward_start(client);
+    }
+#endif
+
     ESP_LOGI(TAG, "Starting temperature publishing task");
 
     BaseType_t ret = xTaskCreate(
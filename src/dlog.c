@@ -0,0 +1,543 @@
+#include "dlog.h"
+
+#ifdef DEFERRED_LOG
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "DLOG";
+
+#define DLOG_LINE_MAX   256
+#define DLOG_STACK_SIZE 3072
+
+_Static_assert((DLOG_RING_SLOTS & (DLOG_RING_SLOTS - 1)) == 0, "DLOG_RING_SLOTS must be a power of two");
+
+// Bounded multi-producer queue (Vyukov): a slot is free for the producer that
+// claims position pos when its seq equals pos, and holds a record for the
+// consumer when seq equals pos + 1. Claiming is one CAS on enqueue_pos.
+typedef struct {
+    atomic_uint_fast32_t seq;
+    dlog_record_t record;
+} dlog_slot_t;
+
+static dlog_slot_t ring[DLOG_RING_SLOTS];
+static atomic_uint_fast32_t enqueue_pos;
+static uint32_t dequeue_pos;                // Consumer side, under consumer_lock
+static SemaphoreHandle_t consumer_lock;
+static volatile bool initialized;
+
+static atomic_uint_fast32_t stat_written;
+static atomic_uint_fast32_t stat_dropped;
+static atomic_uint_fast32_t stat_truncated;
+
+// ============================================
+// Conversion specifications
+// ============================================
+
+typedef enum {
+    LEN_NONE,
+    LEN_HH,
+    LEN_H,
+    LEN_L,
+    LEN_LL,
+    LEN_J,
+    LEN_Z,
+    LEN_T,
+    LEN_LONG_DOUBLE,
+} length_t;
+
+typedef struct {
+    char flags[8];
+    bool width_star;
+    int width;          // -1: none
+    bool precision_star;
+    int precision;      // -1: none
+    length_t length;
+    char conversion;
+} spec_t;
+
+/**
+ * @brief Parse the specification after a '%'
+ *
+ * @return Pointer past the conversion character, NULL if malformed
+ */
+static const char *parse_spec(const char *p, spec_t *spec)
+{
+    size_t nflags = 0;
+    memset(spec, 0, sizeof(*spec));
+    spec->width = -1;
+    spec->precision = -1;
+
+    while (strchr("-+ #0", *p) != NULL && *p != '\0') {
+        if (nflags < sizeof(spec->flags) - 1) {
+            spec->flags[nflags++] = *p;
+        }
+        p++;
+    }
+    if (*p == '*') {
+        spec->width_star = true;
+        p++;
+    } else if (*p >= '0' && *p <= '9') {
+        spec->width = 0;
+        while (*p >= '0' && *p <= '9') {
+            spec->width = spec->width * 10 + (*p++ - '0');
+        }
+    }
+    if (*p == '.') {
+        p++;
+        spec->precision = 0;
+        if (*p == '*') {
+            spec->precision_star = true;
+            p++;
+        } else {
+            while (*p >= '0' && *p <= '9') {
+                spec->precision = spec->precision * 10 + (*p++ - '0');
+            }
+        }
+    }
+    switch (*p) {
+        case 'h': spec->length = p[1] == 'h' ? LEN_HH : LEN_H; p += p[1] == 'h' ? 2 : 1; break;
+        case 'l': spec->length = p[1] == 'l' ? LEN_LL : LEN_L; p += p[1] == 'l' ? 2 : 1; break;
+        case 'j': spec->length = LEN_J; p++; break;
+        case 'z': spec->length = LEN_Z; p++; break;
+        case 't': spec->length = LEN_T; p++; break;
+        case 'L': spec->length = LEN_LONG_DOUBLE; p++; break;
+        default: break;
+    }
+    if (*p == '\0' || strchr("diuoxXcspfFeEgGaAn%", *p) == NULL) {
+        return NULL;
+    }
+    spec->conversion = *p;
+    return p + 1;
+}
+
+static bool is_signed_conversion(char c)
+{
+    return c == 'd' || c == 'i';
+}
+
+static bool is_unsigned_conversion(char c)
+{
+    return c == 'u' || c == 'o' || c == 'x' || c == 'X';
+}
+
+static bool is_float_conversion(char c)
+{
+    return strchr("fFeEgGaA", c) != NULL;
+}
+
+// ============================================
+// Producer side
+// ============================================
+
+typedef struct {
+    uint8_t *buf;
+    size_t pos;
+    bool full;
+} packer_t;
+
+static void pack(packer_t *p, const void *data, size_t len)
+{
+    if (p->full || DLOG_ARG_BYTES - p->pos < len) {
+        p->full = true;
+        return;
+    }
+    memcpy(p->buf + p->pos, data, len);
+    p->pos += len;
+}
+
+static void pack_u64(packer_t *p, uint64_t value)
+{
+    pack(p, &value, sizeof(value));
+}
+
+static void pack_string(packer_t *p, const char *s, int precision)
+{
+    if (s == NULL) {
+        s = "(null)";
+    }
+    size_t n = precision >= 0 ? strnlen(s, (size_t)precision) : strlen(s);
+    size_t room = DLOG_ARG_BYTES - p->pos;
+    if (p->full || room < sizeof(uint16_t)) {
+        p->full = true;
+        return;
+    }
+    if (n > room - sizeof(uint16_t)) {
+        n = room - sizeof(uint16_t);
+        p->full = true;     // Cut here; the rest of the arguments are lost too
+    }
+    uint16_t n16 = (uint16_t)n;
+    memcpy(p->buf + p->pos, &n16, sizeof(n16));
+    memcpy(p->buf + p->pos + sizeof(n16), s, n);
+    p->pos += sizeof(n16) + n;
+}
+
+/**
+ * @brief Copy the arguments of format out of args (no formatting)
+ */
+static void pack_args(packer_t *p, const char *format, va_list args)
+{
+    for (const char *f = format; *f != '\0' && !p->full; f++) {
+        if (*f != '%') {
+            continue;
+        }
+        spec_t spec;
+        const char *next = parse_spec(f + 1, &spec);
+        if (next == NULL) {
+            p->full = true;
+            return;
+        }
+        f = next - 1;
+        if (spec.conversion == '%') {
+            continue;
+        }
+
+        if (spec.width_star) {
+            pack_u64(p, (uint64_t)(int64_t)va_arg(args, int));
+        }
+        if (spec.precision_star) {
+            spec.precision = va_arg(args, int);
+            if (spec.conversion != 's') {
+                pack_u64(p, (uint64_t)(int64_t)spec.precision);
+            }
+        }
+
+        char c = spec.conversion;
+        if (is_signed_conversion(c)) {
+            int64_t v;
+            switch (spec.length) {
+                case LEN_L:  v = va_arg(args, long); break;
+                case LEN_LL: v = va_arg(args, long long); break;
+                case LEN_J:  v = va_arg(args, intmax_t); break;
+                case LEN_Z:  v = (int64_t)va_arg(args, size_t); break;
+                case LEN_T:  v = va_arg(args, ptrdiff_t); break;
+                case LEN_HH: v = (signed char)va_arg(args, int); break;
+                case LEN_H:  v = (short)va_arg(args, int); break;
+                default:     v = va_arg(args, int); break;
+            }
+            pack_u64(p, (uint64_t)v);
+        } else if (is_unsigned_conversion(c)) {
+            uint64_t v;
+            switch (spec.length) {
+                case LEN_L:  v = va_arg(args, unsigned long); break;
+                case LEN_LL: v = va_arg(args, unsigned long long); break;
+                case LEN_J:  v = va_arg(args, uintmax_t); break;
+                case LEN_Z:  v = va_arg(args, size_t); break;
+                case LEN_T:  v = (uint64_t)va_arg(args, ptrdiff_t); break;
+                case LEN_HH: v = (unsigned char)va_arg(args, unsigned int); break;
+                case LEN_H:  v = (unsigned short)va_arg(args, unsigned int); break;
+                default:     v = va_arg(args, unsigned int); break;
+            }
+            pack_u64(p, v);
+        } else if (is_float_conversion(c)) {
+            double v = spec.length == LEN_LONG_DOUBLE ? (double)va_arg(args, long double) : va_arg(args, double);
+            pack(p, &v, sizeof(v));
+        } else if (c == 'c') {
+            pack_u64(p, (uint64_t)va_arg(args, int));
+        } else if (c == 's') {
+            pack_string(p, va_arg(args, const char *), spec.precision);
+        } else if (c == 'p') {
+            pack_u64(p, (uint64_t)(uintptr_t)va_arg(args, void *));
+        } else if (c == 'n') {
+            (void)va_arg(args, int *);      // Nothing is written back
+        }
+    }
+}
+
+static char level_letter(esp_log_level_t level)
+{
+    static const char letters[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+    return (size_t)level < sizeof(letters) ? letters[level] : '?';
+}
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    if (level > esp_log_level_get(tag)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    if (!initialized) {
+        // Before dlog_init(): format now, as ESP_LOGx would
+        char line[DLOG_LINE_MAX];
+        vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        esp_log_write(level, tag, "%c (%" PRIu32 ") %s: %s\n", level_letter(level), esp_log_timestamp(), tag, line);
+        return;
+    }
+
+    uint_fast32_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    dlog_slot_t *slot;
+    while (1) {
+        slot = &ring[pos & (DLOG_RING_SLOTS - 1)];
+        uint_fast32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The consumer has not freed this slot yet: the ring is full
+            atomic_fetch_add_explicit(&stat_dropped, 1, memory_order_relaxed);
+            va_end(args);
+            return;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    dlog_record_t *record = &slot->record;
+    record->timestamp_ms = esp_log_timestamp();
+    record->format = format;
+    record->tag = tag;
+    record->level = level;
+
+    packer_t packer = { .buf = record->args };
+    pack_args(&packer, format, args);
+    va_end(args);
+    record->len = (uint16_t)packer.pos;
+    record->truncated = packer.full;
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_fetch_add_explicit(&stat_written, 1, memory_order_relaxed);
+    if (packer.full) {
+        atomic_fetch_add_explicit(&stat_truncated, 1, memory_order_relaxed);
+    }
+}
+
+// ============================================
+// Consumer side
+// ============================================
+
+bool dlog_pop(dlog_record_t *record)
+{
+    if (!initialized) {
+        return false;
+    }
+    xSemaphoreTake(consumer_lock, portMAX_DELAY);
+    dlog_slot_t *slot = &ring[dequeue_pos & (DLOG_RING_SLOTS - 1)];
+    uint_fast32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    bool ready = seq == (uint_fast32_t)(dequeue_pos + 1);
+    if (ready) {
+        memcpy(record, &slot->record, offsetof(dlog_record_t, args) + slot->record.len);
+        // Hand the slot to the producer that will claim it one lap later
+        atomic_store_explicit(&slot->seq, dequeue_pos + DLOG_RING_SLOTS, memory_order_release);
+        dequeue_pos++;
+    }
+    xSemaphoreGive(consumer_lock);
+    return ready;
+}
+
+typedef struct {
+    const uint8_t *args;
+    size_t len;
+    size_t pos;
+    bool missing;
+} unpacker_t;
+
+static bool unpack(unpacker_t *u, void *out, size_t len)
+{
+    if (u->missing || u->len - u->pos < len) {
+        u->missing = true;
+        return false;
+    }
+    memcpy(out, u->args + u->pos, len);
+    u->pos += len;
+    return true;
+}
+
+static void append(char *buf, size_t len, size_t *pos, const char *format, ...)
+{
+    if (*pos >= len - 1) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf + *pos, len - *pos, format, args);
+    va_end(args);
+    if (n > 0) {
+        *pos += (size_t)n < len - *pos ? (size_t)n : len - *pos - 1;
+    }
+}
+
+/**
+ * @brief Rebuild one conversion with a fixed argument type and print it
+ */
+static void render_spec(const spec_t *spec, unpacker_t *u, char *buf, size_t len, size_t *pos)
+{
+    char fmt[32];
+    size_t n = 0;
+    fmt[n++] = '%';
+    for (const char *f = spec->flags; *f != '\0'; f++) {
+        fmt[n++] = *f;
+    }
+
+    int64_t width = spec->width;
+    if (spec->width_star && !unpack(u, &width, sizeof(width))) {
+        return;
+    }
+    if (width >= 0 || spec->width_star) {
+        n += (size_t)snprintf(fmt + n, sizeof(fmt) - n, "%d", (int)width);
+    }
+
+    char c = spec->conversion;
+    int64_t precision = spec->precision;
+    if (c != 's') {
+        if (spec->precision_star && !unpack(u, &precision, sizeof(precision))) {
+            return;
+        }
+        if (precision >= 0) {
+            n += (size_t)snprintf(fmt + n, sizeof(fmt) - n, ".%d", (int)precision);
+        }
+    }
+
+    if (is_signed_conversion(c) || is_unsigned_conversion(c)) {
+        uint64_t v;
+        if (!unpack(u, &v, sizeof(v))) {
+            return;
+        }
+        snprintf(fmt + n, sizeof(fmt) - n, "ll%c", c);
+        if (is_signed_conversion(c)) {
+            append(buf, len, pos, fmt, (long long)(int64_t)v);
+        } else {
+            append(buf, len, pos, fmt, (unsigned long long)v);
+        }
+    } else if (is_float_conversion(c)) {
+        double v;
+        if (!unpack(u, &v, sizeof(v))) {
+            return;
+        }
+        snprintf(fmt + n, sizeof(fmt) - n, "%c", c);
+        append(buf, len, pos, fmt, v);
+    } else if (c == 'c' || c == 'p') {
+        uint64_t v;
+        if (!unpack(u, &v, sizeof(v))) {
+            return;
+        }
+        snprintf(fmt + n, sizeof(fmt) - n, "%c", c);
+        if (c == 'c') {
+            append(buf, len, pos, fmt, (int)v);
+        } else {
+            append(buf, len, pos, fmt, (void *)(uintptr_t)v);
+        }
+    } else if (c == 's') {
+        uint16_t slen;
+        if (!unpack(u, &slen, sizeof(slen)) || u->len - u->pos < slen) {
+            u->missing = true;
+            return;
+        }
+        snprintf(fmt + n, sizeof(fmt) - n, ".*s");
+        append(buf, len, pos, fmt, (int)slen, (const char *)u->args + u->pos);
+        u->pos += slen;
+    }
+}
+
+size_t dlog_render(const dlog_record_t *record, char *buf, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+    unpacker_t u = { .args = record->args, .len = record->len };
+    size_t pos = 0;
+    buf[0] = '\0';
+
+    for (const char *f = record->format; *f != '\0' && pos < len - 1; f++) {
+        if (*f != '%') {
+            buf[pos++] = *f;
+            buf[pos] = '\0';
+            continue;
+        }
+        spec_t spec;
+        const char *next = parse_spec(f + 1, &spec);
+        if (next == NULL) {
+            break;
+        }
+        f = next - 1;
+        if (spec.conversion == '%') {
+            buf[pos++] = '%';
+            buf[pos] = '\0';
+        } else if (spec.conversion != 'n') {
+            render_spec(&spec, &u, buf, len, &pos);
+        }
+        if (u.missing) {
+            break;
+        }
+    }
+    if (record->truncated || u.missing) {
+        append(buf, len, &pos, "...");
+    }
+    return pos;
+}
+
+void dlog_flush(void)
+{
+    static uint32_t reported_drops;
+    static char line[DLOG_LINE_MAX];
+    dlog_record_t record;
+
+    while (dlog_pop(&record)) {
+        dlog_render(&record, line, sizeof(line));
+        esp_log_write(record.level, record.tag, "%c (%" PRIu32 ") %s: %s\n", level_letter(record.level),
+                      record.timestamp_ms, record.tag, line);
+    }
+
+    uint32_t dropped = atomic_load_explicit(&stat_dropped, memory_order_relaxed);
+    if (dropped != reported_drops) {
+        ESP_LOGW(TAG, "%lu log records dropped (ring full)", (unsigned long)(dropped - reported_drops));
+        reported_drops = dropped;
+    }
+}
+
+static void dlog_task(void *arg)
+{
+    while (1) {
+        dlog_flush();
+        vTaskDelay(pdMS_TO_TICKS(DLOG_FLUSH_INTERVAL_MS));
+    }
+}
+
+dlog_stats_t dlog_get_stats(void)
+{
+    dlog_stats_t stats = {
+        .written = atomic_load_explicit(&stat_written, memory_order_relaxed),
+        .dropped = atomic_load_explicit(&stat_dropped, memory_order_relaxed),
+        .truncated = atomic_load_explicit(&stat_truncated, memory_order_relaxed),
+    };
+    return stats;
+}
+
+esp_err_t dlog_init(void)
+{
+    if (initialized) {
+        return ESP_OK;
+    }
+    consumer_lock = xSemaphoreCreateMutex();
+    if (consumer_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint32_t i = 0; i < DLOG_RING_SLOTS; i++) {
+        atomic_init(&ring[i].seq, i);
+    }
+    atomic_init(&enqueue_pos, 0);
+    dequeue_pos = 0;
+    initialized = true;
+
+    BaseType_t ret = xTaskCreate(dlog_task, "dlog", DLOG_STACK_SIZE, NULL, DLOG_TASK_PRIORITY, NULL);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create log task");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Deferred logging: %d slots, flushed every %d ms", DLOG_RING_SLOTS, DLOG_FLUSH_INTERVAL_MS);
+    return ESP_OK;
+}
+
+#endif // DEFERRED_LOG
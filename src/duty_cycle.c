@@ -0,0 +1,130 @@
+#include "config.h"
+
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+
+#include <stdio.h>
+#include <string.h>
+#include "duty_cycle.h"
+
+#define DUTY_CYCLE_MAGIC 0x44435931  // "DCY1"; bump when the layout changes
+
+bool duty_cycle_init(duty_cycle_t *dc, sensor_sample_t *storage, uint16_t capacity, bool woke_from_sleep)
+{
+    if (woke_from_sleep && dc->magic == DUTY_CYCLE_MAGIC
+        && dc->ring.slots == storage && dc->ring.capacity == capacity) {
+        return true;
+    }
+
+    memset(dc, 0, sizeof(*dc));
+    sample_ring_init(&dc->ring, storage, capacity);
+    dc->magic = DUTY_CYCLE_MAGIC;
+    return false;
+}
+
+uint64_t duty_cycle_now_ms(const duty_cycle_t *dc, uint32_t uptime_ms)
+{
+    return dc->clock_ms + uptime_ms;
+}
+
+duty_connect_reason_t duty_cycle_on_wake(duty_cycle_t *dc, const sensor_sample_t *sample)
+{
+    dc->wakes++;
+    dc->since_connect++;
+
+    bool moved = false;
+    if (sample != NULL) {
+        sample_ring_push(&dc->ring, sample);
+        dc->samples++;
+        float delta = sample->temperature - dc->reported_temp;
+        moved = !dc->reported || delta >= TEMP_SLEEP_REPORT_DELTA_C || delta <= -TEMP_SLEEP_REPORT_DELTA_C;
+    }
+
+    if (dc->since_connect >= TEMP_SLEEP_CONNECT_EVERY) {
+        return DUTY_CONNECT_SCHEDULED;
+    }
+    if (sample_ring_full(&dc->ring)) {
+        return DUTY_CONNECT_BUFFER_FULL;
+    }
+    if (moved && !dc->connect_failed) {
+        return DUTY_CONNECT_THRESHOLD;
+    }
+    return DUTY_CONNECT_NONE;
+}
+
+void duty_cycle_on_published(duty_cycle_t *dc, uint16_t n)
+{
+    sample_ring_consume(&dc->ring, n);
+}
+
+void duty_cycle_on_connect_done(duty_cycle_t *dc, bool published, const sensor_sample_t *latest)
+{
+    dc->connects++;
+    dc->since_connect = 0;
+    dc->connect_failed = !published;
+    if (!published) {
+        dc->failed_connects++;
+    } else if (latest != NULL) {
+        dc->reported = true;
+        dc->reported_temp = latest->temperature;
+    }
+}
+
+uint32_t duty_cycle_sleep_ms(uint32_t awake_ms)
+{
+    if (awake_ms + TEMP_SLEEP_MIN_MS >= TEMP_SLEEP_INTERVAL_MS) {
+        return TEMP_SLEEP_MIN_MS;
+    }
+    return TEMP_SLEEP_INTERVAL_MS - awake_ms;
+}
+
+void duty_cycle_on_sleep(duty_cycle_t *dc, uint32_t awake_ms, uint32_t radio_ms, uint32_t sleep_ms)
+{
+    if (radio_ms > awake_ms) {
+        radio_ms = awake_ms;
+    }
+    dc->clock_ms += (uint64_t)awake_ms + sleep_ms;
+    dc->awake_ms += awake_ms;
+    dc->radio_ms += radio_ms;
+    dc->charge_nc += (uint64_t)(awake_ms - radio_ms) * (ENERGY_AWAKE_MA * 1000)
+                   + (uint64_t)radio_ms * (ENERGY_RADIO_MA * 1000)
+                   + (uint64_t)sleep_ms * ENERGY_SLEEP_UA;
+}
+
+duty_cycle_energy_t duty_cycle_energy(const duty_cycle_t *dc)
+{
+    duty_cycle_energy_t e = {
+        .wakes = dc->wakes,
+        .samples = dc->samples,
+        .connects = dc->connects,
+        .failed_connects = dc->failed_connects,
+        .elapsed_ms = dc->clock_ms,
+        .awake_ms = dc->awake_ms,
+        .radio_ms = dc->radio_ms,
+    };
+    if (dc->clock_ms > 0) {
+        e.avg_current_ua = (uint32_t)(dc->charge_nc / dc->clock_ms);
+    }
+    if (dc->samples > 0) {
+        // nC x mV = pJ
+        e.uj_per_sample = (uint32_t)(dc->charge_nc * ENERGY_SUPPLY_MV / 1000000 / dc->samples);
+    }
+    return e;
+}
+
+size_t duty_cycle_encode_energy(const duty_cycle_t *dc, char *buf, size_t len)
+{
+    duty_cycle_energy_t e = duty_cycle_energy(dc);
+    int n = snprintf(buf, len,
+                     "{\"wakes\":%lu,\"samples\":%lu,\"connects\":%lu,\"failed\":%lu,"
+                     "\"awake_ms\":%llu,\"radio_ms\":%llu,\"avg_ua\":%lu,\"uj_per_sample\":%lu}",
+                     (unsigned long)e.wakes, (unsigned long)e.samples, (unsigned long)e.connects,
+                     (unsigned long)e.failed_connects, (unsigned long long)e.awake_ms,
+                     (unsigned long long)e.radio_ms, (unsigned long)e.avg_current_ua,
+                     (unsigned long)e.uj_per_sample);
+    if (n < 0 || (size_t)n >= len) {
+        return 0;
+    }
+    return (size_t)n;
+}
+
+#endif // DEVICE_TYPE_TEMP_SENSOR
@@ -0,0 +1,215 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "config.h"
+#include "heartbeat.h"
+#include "mqtt_manager.h"
+#include "wifi_manager.h"
+
+static const char *TAG = "HEARTBEAT";
+
+#define HEARTBEAT_STACK_SIZE 3072
+#define HEARTBEAT_PRIORITY   1      // Below everything that does real work
+
+// Tasks whose stack headroom is reported, in payload order: the ESP-IDF
+// tasks that run our handlers first, then the firmware's own
+static const char *const task_names[] = {
+    "mqtt_task",
+    "sys_evt",
+    "tiT",
+#ifdef DEVICE_TYPE_RELAY
+    "relay_actuator",
+#ifdef RELAY_THERMOSTAT
+    "thermostat",
+#endif
+#endif
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+    "temp_task",
+#ifdef STORE_FORWARD_ENABLED
+    "store_drain",
+#endif
+#endif
+#ifdef PEER_LINK
+    "peer_link",
+#endif
+    "heartbeat",
+};
+
+#define TASK_COUNT (sizeof(task_names) / sizeof(task_names[0]))
+_Static_assert(TASK_COUNT <= HEARTBEAT_MAX_TASKS, "raise HEARTBEAT_MAX_TASKS");
+
+static uint16_t saturate_u16(uint32_t value, uint16_t max)
+{
+    return value > max ? max : (uint16_t)value;
+}
+
+const char *heartbeat_task_name(size_t i)
+{
+    return i < TASK_COUNT ? task_names[i] : NULL;
+}
+
+void heartbeat_collect(heartbeat_t *hb)
+{
+    memset(hb, 0, sizeof(*hb));
+    hb->uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+    hb->free_heap = esp_get_free_heap_size();
+    hb->min_free_heap = esp_get_minimum_free_heap_size();
+
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        hb->rssi = ap.rssi;
+    }
+
+    esp_mqtt_client_handle_t client = mqtt_get_client();
+    int outbox = client != NULL ? esp_mqtt_client_get_outbox_size(client) : 0;
+    hb->outbox_bytes = saturate_u16(outbox > 0 ? (uint32_t)outbox : 0, UINT16_MAX);
+
+    mqtt_stats_t stats = mqtt_get_stats();
+    hb->wifi_reconnects = saturate_u16(wifi_manager_reconnect_count(), UINT16_MAX);
+    hb->mqtt_reconnects = saturate_u16(stats.connects > 0 ? stats.connects - 1 : 0, UINT16_MAX);
+    hb->published = stats.published;
+    hb->publish_failed = stats.publish_failed;
+
+    reconnect_stats_t wifi = wifi_manager_get_link_stats();
+    reconnect_stats_t broker = mqtt_get_link_stats();
+    hb->wifi_down_s = (uint32_t)(wifi.downtime_ms / 1000);
+    hb->offline_s = (uint32_t)(broker.downtime_ms / 1000);
+    hb->last_recovery_ms = broker.last_recovery_ms;
+    hb->longest_recovery_ms = broker.longest_recovery_ms;
+
+    hb->task_count = TASK_COUNT;
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        TaskHandle_t task = xTaskGetHandle(task_names[i]);
+        hb->stack_free[i] = task != NULL
+            ? saturate_u16(uxTaskGetStackHighWaterMark(task), HEARTBEAT_NO_TASK - 1)
+            : HEARTBEAT_NO_TASK;
+    }
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+size_t heartbeat_encode(const heartbeat_t *hb, uint8_t *buf, size_t len)
+{
+    size_t tasks = hb->task_count < HEARTBEAT_MAX_TASKS ? hb->task_count : HEARTBEAT_MAX_TASKS;
+    size_t total = HEARTBEAT_FIXED_LEN + 2 * tasks + HEARTBEAT_LINK_LEN;
+    if (len < total) {
+        return 0;
+    }
+
+    uint8_t *p = buf;
+    *p++ = HEARTBEAT_VERSION;
+    p = put_u32(p, hb->uptime_s);
+    p = put_u32(p, hb->free_heap);
+    p = put_u32(p, hb->min_free_heap);
+    *p++ = (uint8_t)hb->rssi;
+    p = put_u16(p, hb->outbox_bytes);
+    p = put_u16(p, hb->wifi_reconnects);
+    p = put_u16(p, hb->mqtt_reconnects);
+    p = put_u32(p, hb->published);
+    p = put_u32(p, hb->publish_failed);
+    *p++ = (uint8_t)tasks;
+    for (size_t i = 0; i < tasks; i++) {
+        p = put_u16(p, hb->stack_free[i]);
+    }
+    p = put_u32(p, hb->wifi_down_s);
+    p = put_u32(p, hb->offline_s);
+    p = put_u32(p, hb->last_recovery_ms);
+    p = put_u32(p, hb->longest_recovery_ms);
+    return total;
+}
+
+esp_err_t heartbeat_decode(const uint8_t *buf, size_t len, heartbeat_t *hb)
+{
+    if (len < 1) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (buf[0] < HEARTBEAT_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (len < HEARTBEAT_FIXED_LEN || len < HEARTBEAT_FIXED_LEN + 2 * (size_t)buf[28] + HEARTBEAT_LINK_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memset(hb, 0, sizeof(*hb));
+    hb->uptime_s = get_u32(buf + 1);
+    hb->free_heap = get_u32(buf + 5);
+    hb->min_free_heap = get_u32(buf + 9);
+    hb->rssi = (int8_t)buf[13];
+    hb->outbox_bytes = get_u16(buf + 14);
+    hb->wifi_reconnects = get_u16(buf + 16);
+    hb->mqtt_reconnects = get_u16(buf + 18);
+    hb->published = get_u32(buf + 20);
+    hb->publish_failed = get_u32(buf + 24);
+    hb->task_count = buf[28] < HEARTBEAT_MAX_TASKS ? buf[28] : HEARTBEAT_MAX_TASKS;
+    for (size_t i = 0; i < hb->task_count; i++) {
+        hb->stack_free[i] = get_u16(buf + HEARTBEAT_FIXED_LEN + 2 * i);
+    }
+    const uint8_t *link = buf + HEARTBEAT_FIXED_LEN + 2 * (size_t)buf[28];
+    hb->wifi_down_s = get_u32(link);
+    hb->offline_s = get_u32(link + 4);
+    hb->last_recovery_ms = get_u32(link + 8);
+    hb->longest_recovery_ms = get_u32(link + 12);
+    return ESP_OK;
+}
+
+static void heartbeat_task(void *arg)
+{
+    uint8_t payload[HEARTBEAT_MAX_LEN];
+    heartbeat_t hb;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(HEARTBEAT_INTERVAL_MS));
+        if (!mqtt_is_connected()) {
+            continue;
+        }
+
+        heartbeat_collect(&hb);
+        size_t len = heartbeat_encode(&hb, payload, sizeof(payload));
+        int msg_id = mqtt_publish(mqtt_get_client(), MQTT_TOPIC_HEARTBEAT, (const char *)payload, (int)len, 0, 0);
+        if (msg_id < 0) {
+            ESP_LOGW(TAG, "Failed to publish heartbeat");
+            continue;
+        }
+        ESP_LOGD(TAG, "Heartbeat: heap %lu (min %lu), rssi %d, outbox %u",
+                 (unsigned long)hb.free_heap, (unsigned long)hb.min_free_heap, hb.rssi, hb.outbox_bytes);
+    }
+}
+
+esp_err_t heartbeat_start(void)
+{
+    BaseType_t ret = xTaskCreate(heartbeat_task, "heartbeat", HEARTBEAT_STACK_SIZE, NULL, HEARTBEAT_PRIORITY, NULL);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create heartbeat task");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Publishing a heartbeat every %d ms to %s", HEARTBEAT_INTERVAL_MS, MQTT_TOPIC_HEARTBEAT);
+    return ESP_OK;
+}
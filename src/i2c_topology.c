@@ -0,0 +1,191 @@
+#include "config.h"
+
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+
+#include <stdio.h>
+#include <string.h>
+#include "i2c_topology.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char *TAG = "I2C_TOPO";
+
+#define TOPOLOGY_NVS_NAMESPACE  "i2c_topo"
+#define TOPOLOGY_VERSION        1
+
+// Layout of the NVS blob; the version guards against a changed layout
+typedef struct {
+    uint8_t version;
+    i2c_topology_t topology;
+} topology_record_t;
+
+static void topology_key(int port, char *key, size_t len)
+{
+    snprintf(key, len, "bus%d", port);
+}
+
+static bool topology_load(int port, i2c_topology_t *topology)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(TOPOLOGY_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+
+    char key[8];
+    topology_key(port, key, sizeof(key));
+    topology_record_t record;
+    size_t len = sizeof(record);
+    esp_err_t err = nvs_get_blob(nvs, key, &record, &len);
+    nvs_close(nvs);
+
+    if (err != ESP_OK || len != sizeof(record) || record.version != TOPOLOGY_VERSION) {
+        return false;
+    }
+    *topology = record.topology;
+    return true;
+}
+
+static void topology_save(int port, const i2c_topology_t *topology)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(TOPOLOGY_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot cache bus map: %s", esp_err_to_name(err));
+        return;
+    }
+
+    char key[8];
+    topology_key(port, key, sizeof(key));
+    topology_record_t record = { .version = TOPOLOGY_VERSION, .topology = *topology };
+    err = nvs_set_blob(nvs, key, &record, sizeof(record));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot cache bus map: %s", esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief Probe the addresses in candidates (all of them when NULL)
+ *
+ * @return false if the bus stopped answering (consecutive timeouts)
+ */
+static bool probe_addresses(i2c_master_bus_handle_t bus, const i2c_topology_t *candidates,
+                            i2c_topology_t *found, i2c_topology_result_t *result)
+{
+    uint8_t timeouts = 0;
+
+    for (uint8_t addr = 1; addr < 127; addr++) {
+        if (candidates != NULL && !i2c_topology_has(candidates, addr)) {
+            continue;
+        }
+
+        esp_err_t ret = i2c_master_probe(bus, addr, I2C_PROBE_TIMEOUT_MS);
+        result->probes++;
+
+        if (ret == ESP_OK) {
+            ESP_LOGI(TAG, "  Found device at address 0x%02X", addr);
+            i2c_topology_add(found, addr);
+            result->devices++;
+            timeouts = 0;
+        } else if (ret == ESP_ERR_TIMEOUT) {
+            if (++timeouts >= I2C_SCAN_MAX_TIMEOUTS) {
+                return false;
+            }
+        } else {
+            timeouts = 0;
+        }
+    }
+    return true;
+}
+
+static bool has_expected(const i2c_topology_t *topology, const uint8_t *expected, size_t expected_count)
+{
+    for (size_t i = 0; i < expected_count; i++) {
+        if (!i2c_topology_has(topology, expected[i])) {
+            ESP_LOGW(TAG, "Expected device 0x%02X did not answer", expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t i2c_topology_discover(i2c_master_bus_handle_t bus, int port,
+                                const uint8_t *expected, size_t expected_count, bool force_scan,
+                                i2c_topology_t *topology, i2c_topology_result_t *result)
+{
+    i2c_topology_result_t local_result;
+    if (result == NULL) {
+        result = &local_result;
+    }
+    memset(result, 0, sizeof(*result));
+    memset(topology, 0, sizeof(*topology));
+
+    i2c_topology_t cached;
+    bool have_cache = !force_scan && topology_load(port, &cached);
+
+    if (have_cache) {
+        ESP_LOGI(TAG, "Probing cached I2C devices on bus %d...", port);
+        if (!probe_addresses(bus, &cached, topology, result)) {
+            result->bus_stuck = true;
+            ESP_LOGE(TAG, "I2C bus %d not responding (check pull-ups and wiring)", port);
+            return ESP_ERR_TIMEOUT;
+        }
+        if (has_expected(topology, expected, expected_count)) {
+            result->from_cache = true;
+            if (memcmp(topology, &cached, sizeof(cached)) != 0) {
+                // A device that is no longer needed went away
+                topology_save(port, topology);
+            }
+            return ESP_OK;
+        }
+        memset(topology, 0, sizeof(*topology));
+    }
+
+    ESP_LOGI(TAG, "Scanning I2C bus %d...", port);
+    result->full_scan = true;
+    result->devices = 0;
+    if (!probe_addresses(bus, NULL, topology, result)) {
+        result->bus_stuck = true;
+        ESP_LOGE(TAG, "I2C bus %d not responding, scan aborted after %u probes (check pull-ups and wiring)",
+                 port, result->probes);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    if (result->devices == 0) {
+        // The caller knows the bus pins and logs them per missing sensor
+        ESP_LOGW(TAG, "No I2C devices found on bus %d! Check your wiring:", port);
+        ESP_LOGW(TAG, "  - Sensors powered (3.3V and GND)");
+        ESP_LOGW(TAG, "  - Pull-up resistors on SDA/SCL (if needed)");
+    } else {
+        ESP_LOGI(TAG, "I2C scan complete. Found %d device(s)", result->devices);
+    }
+
+    topology_save(port, topology);
+    return ESP_OK;
+}
+
+esp_err_t i2c_topology_forget(int port)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(TOPOLOGY_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    char key[8];
+    topology_key(port, key, sizeof(key));
+    err = nvs_erase_key(nvs, key);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ESP_OK;
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+#endif // DEVICE_TYPE_TEMP_SENSOR
@@ -0,0 +1,150 @@
+#include "latency_trace.h"
+
+#ifdef LATENCY_TRACE
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "mqtt_client.h"
+#include "mqtt_manager.h"
+#include "mqtt_router.h"
+
+static const char *TAG = "LATENCY";
+static latency_hist_t hists[LATENCY_STAGE_COUNT];
+
+static const char *const stage_names[LATENCY_STAGE_COUNT] = {
+#ifdef DEVICE_TYPE_RELAY
+    [LATENCY_CMD_DISPATCH] = "dispatch",
+    [LATENCY_CMD_RELAY_SET] = "relay_set",
+    [LATENCY_CMD_GPIO] = "gpio",
+    [LATENCY_CMD_ACK] = "ack",
+#endif
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+    [LATENCY_SENSOR_CONVERTED] = "converted",
+    [LATENCY_SENSOR_COLLECTED] = "collected",
+    [LATENCY_SENSOR_PUBLISHED] = "published",
+#endif
+};
+
+static int bucket_of(uint32_t us)
+{
+    int bucket = 0;
+    while (us > 1 && bucket < LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void latency_trace_record(latency_stage_t stage, int64_t origin_us)
+{
+    if (origin_us == 0 || stage >= LATENCY_STAGE_COUNT) {
+        return;
+    }
+    int64_t elapsed = esp_timer_get_time() - origin_us;
+    uint32_t us = elapsed < 0 ? 0 : elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+
+    latency_hist_t *h = &hists[stage];
+    h->buckets[bucket_of(us)]++;
+    h->sum_us += us;
+    if (us > h->max_us) {
+        h->max_us = us;
+    }
+    h->count++;
+}
+
+latency_hist_t latency_trace_get(latency_stage_t stage)
+{
+    latency_hist_t h = {0};
+    if (stage < LATENCY_STAGE_COUNT) {
+        h = hists[stage];
+    }
+    return h;
+}
+
+void latency_trace_reset(void)
+{
+    memset(hists, 0, sizeof(hists));
+}
+
+// Upper bound of the bucket holding the given fraction of the samples
+static uint32_t percentile_us(const latency_hist_t *h, uint32_t permille)
+{
+    uint64_t rank = ((uint64_t)h->count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank && seen > 0) {
+            uint32_t upper = 2U << i;
+            return upper < h->max_us ? upper : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+size_t latency_trace_encode_json(latency_stage_t stage, char *buf, size_t len)
+{
+    if (stage >= LATENCY_STAGE_COUNT) {
+        return 0;
+    }
+    latency_hist_t h = hists[stage];
+    int last = LATENCY_BUCKETS - 1;
+    while (last > 0 && h.buckets[last] == 0) {
+        last--;
+    }
+
+    int n = snprintf(buf, len, "{\"stage\":\"%s\",\"n\":%lu,\"mean_us\":%lu,\"p50_us\":%lu,\"p99_us\":%lu,"
+                     "\"max_us\":%lu,\"h\":[",
+                     stage_names[stage], (unsigned long)h.count,
+                     (unsigned long)(h.count > 0 ? h.sum_us / h.count : 0),
+                     (unsigned long)percentile_us(&h, 500), (unsigned long)percentile_us(&h, 990),
+                     (unsigned long)h.max_us);
+    for (int i = 0; i <= last && n >= 0 && (size_t)n < len; i++) {
+        n += snprintf(buf + n, len - (size_t)n, "%s%lu", i > 0 ? "," : "", (unsigned long)h.buckets[i]);
+    }
+    if (n >= 0 && (size_t)n < len) {
+        n += snprintf(buf + n, len - (size_t)n, "]}");
+    }
+    if (n < 0 || (size_t)n >= len) {
+        return 0;
+    }
+    return (size_t)n;
+}
+
+/**
+ * @brief Publish every stage on request
+ */
+static void handle_diag_request(const char *data, int data_len, void *ctx)
+{
+    esp_mqtt_client_handle_t client = mqtt_get_client();
+    char payload[256];
+
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        size_t len = latency_trace_encode_json((latency_stage_t)stage, payload, sizeof(payload));
+        if (len == 0) {
+            continue;
+        }
+        int msg_id = mqtt_publish(client, MQTT_TOPIC_DIAG_LATENCY, payload, (int)len, 0, 0);
+        if (msg_id < 0) {
+            ESP_LOGW(TAG, "Failed to publish latency report");
+            return;
+        }
+    }
+
+    if (data_len == 5 && memcmp(data, "reset", 5) == 0) {
+        latency_trace_reset();
+        ESP_LOGI(TAG, "Latency histograms reset");
+    }
+}
+
+esp_err_t latency_trace_init(void)
+{
+    esp_err_t ret = mqtt_router_register(MQTT_TOPIC_DIAG_REQUEST, handle_diag_request, NULL);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", MQTT_TOPIC_DIAG_REQUEST, esp_err_to_name(ret));
+        return ret;
+    }
+    return ESP_OK;
+}
+
+#endif // LATENCY_TRACE
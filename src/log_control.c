@@ -0,0 +1,112 @@
+#include "log_control.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include "config.h"
+#include "esp_log.h"
+#include "mqtt_router.h"
+
+static const char *TAG = "LOG_CTRL";
+
+#define LOG_CONTROL_TAG_MAX 24
+
+static const char *const level_names[] = {
+    [ESP_LOG_NONE] = "none",
+    [ESP_LOG_ERROR] = "error",
+    [ESP_LOG_WARN] = "warn",
+    [ESP_LOG_INFO] = "info",
+    [ESP_LOG_DEBUG] = "debug",
+    [ESP_LOG_VERBOSE] = "verbose",
+};
+
+static bool parse_level(const char *s, size_t len, esp_log_level_t *level)
+{
+    for (size_t i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+        const char *name = level_names[i];
+        bool match = len == 1 ? tolower((unsigned char)s[0]) == name[0]
+                              : len == strlen(name) && strncasecmp(s, name, len) == 0;
+        if (match) {
+            *level = (esp_log_level_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void trim(const char **s, size_t *len)
+{
+    while (*len > 0 && isspace((unsigned char)**s)) {
+        (*s)++;
+        (*len)--;
+    }
+    while (*len > 0 && isspace((unsigned char)(*s)[*len - 1])) {
+        (*len)--;
+    }
+}
+
+/**
+ * @brief Apply one "TAG=level" entry
+ */
+static bool apply_entry(const char *entry, size_t len)
+{
+    const char *eq = memchr(entry, '=', len);
+    if (eq == NULL) {
+        return false;
+    }
+    const char *tag = entry;
+    size_t tag_len = (size_t)(eq - entry);
+    const char *value = eq + 1;
+    size_t value_len = len - tag_len - 1;
+    trim(&tag, &tag_len);
+    trim(&value, &value_len);
+
+    esp_log_level_t level;
+    if (tag_len == 0 || tag_len >= LOG_CONTROL_TAG_MAX || !parse_level(value, value_len, &level)) {
+        return false;
+    }
+
+    char tag_buf[LOG_CONTROL_TAG_MAX];
+    memcpy(tag_buf, tag, tag_len);
+    tag_buf[tag_len] = '\0';
+    esp_log_level_set(tag_buf, level);
+    ESP_LOGI(TAG, "Log level %s=%s", tag_buf, level_names[level]);
+    return true;
+}
+
+esp_err_t log_control_apply(const char *data, size_t len)
+{
+    if (len == 0) {
+        return ESP_OK;
+    }
+    bool all_ok = true;
+    size_t start = 0;
+    while (start <= len) {
+        const char *comma = memchr(data + start, ',', len - start);
+        size_t end = comma != NULL ? (size_t)(comma - data) : len;
+        const char *entry = data + start;
+        size_t entry_len = end - start;
+        trim(&entry, &entry_len);
+        if (entry_len > 0 && !apply_entry(entry, entry_len)) {
+            ESP_LOGW(TAG, "Ignoring log level entry '%.*s'", (int)entry_len, entry);
+            all_ok = false;
+        }
+        start = end + 1;
+    }
+    return all_ok ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+static void handle_log_level(const char *data, int data_len, void *ctx)
+{
+    log_control_apply(data, (size_t)data_len);
+}
+
+esp_err_t log_control_init(void)
+{
+    esp_err_t ret = mqtt_router_register(MQTT_TOPIC_DIAG_LOG_LEVEL, handle_log_level, NULL);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", MQTT_TOPIC_DIAG_LOG_LEVEL, esp_err_to_name(ret));
+        return ret;
+    }
+    return ESP_OK;
+}
@@ -6,6 +6,12 @@
 #include "config.h"
 #include "wifi_manager.h"
 #include "mqtt_manager.h"
+#include "boot_events.h"
+#include "heartbeat.h"
+#include "dlog.h"
+#ifdef PEER_LINK
+#include "peer_link.h"
+#endif
 
 #ifdef DEVICE_TYPE_TEMP_SENSOR
 #include "device_temp.h"
@@ -13,6 +19,9 @@
 
 #ifdef DEVICE_TYPE_RELAY
 #include "device_relay.h"
+#ifdef RELAY_THERMOSTAT
+#include "thermostat_control.h"
+#endif
 #endif
 
 static const char *TAG = "MAIN";
@@ -23,6 +32,11 @@ void app_main(void)
     ESP_LOGI(TAG, "ESP32 Device - %s", DEVICE_NAME);
     ESP_LOGI(TAG, "========================================\n");
 
+#ifdef DEFERRED_LOG
+    ESP_ERROR_CHECK(dlog_init());
+#endif
+    ESP_ERROR_CHECK(boot_events_init());
+
     // Initialize NVS (required for WiFi)
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -31,21 +45,31 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
-    // Initialize and connect WiFi
+#if defined(DEVICE_TYPE_TEMP_SENSOR) && defined(TEMP_DEEP_SLEEP_MODE)
+    // Battery mode: one reading per wake, WiFi only when there is something to send
+    ESP_LOGI(TAG, "Device Type: TEMPERATURE SENSOR (deep-sleep duty cycle)");
+    ESP_ERROR_CHECK(temp_sensor_init());
+    boot_events_set(BOOT_EVENT_PERIPHERALS);
+    temp_sensor_run_duty_cycle();   // Ends in deep sleep
+#endif
+
+    // Start WiFi; the device is initialized while the station associates
     ESP_ERROR_CHECK(wifi_manager_init());
-    ESP_ERROR_CHECK(wifi_manager_connect());
 
-    // Initialize MQTT client with LWT and announce connection
+    // Initialize MQTT client with LWT; it connects as soon as WiFi is up
     ESP_LOGI(TAG, "Initializing MQTT...");
     ESP_ERROR_CHECK(mqtt_client_init());
 
     // Device-specific initialization based on config.h
 #ifdef DEVICE_TYPE_RELAY
     ESP_LOGI(TAG, "Device Type: RELAY SWITCH");
-    ESP_LOGI(TAG, "GPIO: %d", RELAY_GPIO_PIN);
+    ESP_LOGI(TAG, "Channels: %d (channel 0 on GPIO %d)", RELAY_CHANNEL_COUNT, RELAY_GPIO_PIN);
 
     // Initialize relay
     ESP_ERROR_CHECK(relay_init());
+#ifdef RELAY_THERMOSTAT
+    ESP_ERROR_CHECK(thermostat_control_start());
+#endif
 
     ESP_LOGI(TAG, "Relay initialized and ready to receive TOGGLE commands via MQTT");
 #endif
@@ -53,6 +77,7 @@ void app_main(void)
 #ifdef DEVICE_TYPE_TEMP_SENSOR
     ESP_LOGI(TAG, "Device Type: TEMPERATURE SENSOR");
     ESP_LOGI(TAG, "I2C SDA: GPIO%d, SCL: GPIO%d", I2C_SDA_PIN, I2C_SCL_PIN);
+    ESP_LOGI(TAG, "Sensors: %u", (unsigned)sensor_manager_count());
     ESP_LOGI(TAG, "Publish Interval: %d ms", TEMP_PUBLISH_INTERVAL_MS);
 
     // Initialize temperature sensor
@@ -63,8 +88,17 @@ void app_main(void)
     ESP_ERROR_CHECK(temp_sensor_start_publishing(mqtt_get_client()));
 #endif
 
-    // Main loop
-    while(1) {
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-    }
-}
\ No newline at end of file
+#ifdef PEER_LINK
+    // Direct link to the paired device, once every route is registered
+    ESP_ERROR_CHECK(peer_link_init(&PEER_LINK_TRANSPORT));
+#endif
+
+    // Health record every HEARTBEAT_INTERVAL_MS once the broker is up
+    ESP_ERROR_CHECK(heartbeat_start());
+
+    boot_events_set(BOOT_EVENT_PERIPHERALS);
+    ESP_LOGI(TAG, "Device initialized after %ld ms, connecting in the background",
+             (long)boot_events_elapsed_ms(BOOT_EVENT_PERIPHERALS));
+
+    // Everything else runs in tasks and event handlers; returning ends the main task
+}
@@ -1,23 +1,63 @@
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 #include "esp_log.h"
 #include "config.h"
 #include "esp_wifi.h"
 #include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "mqtt_client.h"  // ESP-IDF MQTT library
 #include "mqtt_manager.h"  // Our header
+#include "mqtt_router.h"
+#include "log_control.h"
+#include "boot_events.h"
+#include "latency_trace.h"
+#include "dlog.h"
+#include "payload.h"
+#include "reconnect.h"
+#include "wifi_manager.h"
+#ifdef PEER_LINK
+#include "peer_link.h"
+#endif
 
 #ifdef DEVICE_TYPE_RELAY
 #include "device_relay.h"
 #endif
+#if defined(DEVICE_TYPE_RELAY) && defined(RELAY_THERMOSTAT)
+#include "thermostat_control.h"
+#endif
+#if defined(DEVICE_TYPE_TEMP_SENSOR) && defined(TEMP_REPORT_BY_EXCEPTION)
+#include "report_control.h"
+#endif
 
 static const char *TAG = "MQTT_CLIENT";
 static esp_mqtt_client_handle_t mqtt_client = NULL;
+static volatile bool mqtt_connected = false;
+static bool mqtt_started = false;
+
+// Counters for the heartbeat; bumped from the MQTT task and every publisher
+static atomic_uint_fast32_t stat_connects;
+static atomic_uint_fast32_t stat_disconnects;
+static atomic_uint_fast32_t stat_published;
+static atomic_uint_fast32_t stat_publish_failed;
+// Broker reconnects are timed here rather than by the client's fixed interval
+static reconnect_t broker_link;
+static SemaphoreHandle_t link_lock;
+static esp_timer_handle_t retry_timer;
+#ifdef LATENCY_TRACE
+static int64_t data_event_us;   // Origin of the command being dispatched (MQTT task only)
+#endif
+#ifdef RELAY_COMMAND_SEQ
+static bool data_event_dup;     // The message being dispatched is a redelivery (MQTT task only)
+#endif
 
 /**
- * @brief Get the local IP address as a string
+ * @brief Get the station's IPv4 address
  */
-static esp_err_t get_ip_address(char *ip_str, size_t max_len)
+static esp_err_t get_ip_info(esp_netif_ip_info_t *ip_info)
 {
     esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
     if (netif == NULL) {
@@ -25,17 +65,416 @@ static esp_err_t get_ip_address(char *ip_str, size_t max_len)
         return ESP_FAIL;
     }
 
-    esp_netif_ip_info_t ip_info;
-    esp_err_t ret = esp_netif_get_ip_info(netif, &ip_info);
+    esp_err_t ret = esp_netif_get_ip_info(netif, ip_info);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to get IP info");
         return ret;
     }
-
-    snprintf(ip_str, max_len, IPSTR, IP2STR(&ip_info.ip));
     return ESP_OK;
 }
 
+#ifdef PAYLOAD_BINARY
+static payload_device_t device_payload_type(void)
+{
+#ifdef DEVICE_TYPE_RELAY
+    return PAYLOAD_DEVICE_RELAY;
+#else
+    return PAYLOAD_DEVICE_TEMP_SENSOR;
+#endif
+}
+#endif
+
+#ifdef DEVICE_TYPE_RELAY
+/**
+ * @brief Exact payload match (payloads are not NUL-terminated)
+ */
+static bool payload_equals(const char *data, int data_len, const char *expected)
+{
+    size_t len = strlen(expected);
+    return data_len == (int)len && memcmp(data, expected, len) == 0;
+}
+
+/**
+ * @brief Queue the ACK for an applied command with the relay's actual state
+ *
+ * Runs on the relay actuator task once the GPIO has switched. Enqueued rather
+ * than published, so the actuator never waits on the socket.
+ *
+ * @param seq The command's sequence number, echoed as "ACK:ON#<seq>" (0: none)
+ */
+static void send_relay_ack(const char *topic, bool state, uint32_t seq)
+{
+#ifdef PAYLOAD_BINARY
+    uint8_t payload[PAYLOAD_RELAY_MAX_LEN];
+    size_t len = payload_encode_relay(PAYLOAD_RELAY_ACK, state, seq, payload, sizeof(payload));
+    int msg_id = mqtt_enqueue(mqtt_client, topic, (const char *)payload, (int)len, 1, 0, true);
+    DLOGI(TAG, "Sent ACK %s #%lu to %s, msg_id=%d", state ? "ON" : "OFF", (unsigned long)seq, topic, msg_id);
+#else
+    char payload[sizeof("ACK:OFF#4294967295")];
+    if (seq != 0) {
+        snprintf(payload, sizeof(payload), "ACK:%s#%lu", state ? "ON" : "OFF", (unsigned long)seq);
+    } else {
+        snprintf(payload, sizeof(payload), "ACK:%s", state ? "ON" : "OFF");
+    }
+    int msg_id = mqtt_enqueue(mqtt_client, topic, payload, 0, 1, 0, true);
+    DLOGI(TAG, "Sent %s to %s, msg_id=%d", payload, topic, msg_id);
+#endif
+}
+
+/**
+ * @brief Queue the batch ACK: every channel's state, "0=ON,1=OFF,...", and
+ *        "#<seq>" after them if the batch had a sequence number
+ */
+static void send_channels_ack(uint8_t states, uint32_t seq)
+{
+    char payload[RELAY_MAX_CHANNELS * 6 + sizeof("#4294967295")];
+    size_t len = 0;
+    for (int ch = 0; ch < RELAY_CHANNEL_COUNT; ch++) {
+        len += (size_t)snprintf(payload + len, sizeof(payload) - len, "%s%d=%s", ch > 0 ? "," : "", ch,
+                                (states & (1U << ch)) ? "ON" : "OFF");
+    }
+    if (seq != 0) {
+        len += (size_t)snprintf(payload + len, sizeof(payload) - len, "#%lu", (unsigned long)seq);
+    }
+    int msg_id = mqtt_enqueue(mqtt_client, MQTT_TOPIC_CHANNELS_ACK, payload, (int)len, 1, 0, true);
+    DLOGI(TAG, "Sent %s to %s, msg_id=%d", payload, MQTT_TOPIC_CHANNELS_ACK, msg_id);
+}
+
+// "<prefix><n>/set" and "<prefix><n>/ack" per channel (routes keep the pointers)
+static char channel_set_topics[RELAY_CHANNEL_COUNT][sizeof(MQTT_TOPIC_CHANNEL_PREFIX) + 8];
+static char channel_ack_topics[RELAY_CHANNEL_COUNT][sizeof(MQTT_TOPIC_CHANNEL_PREFIX) + 8];
+
+static void relay_command_done(const relay_cmd_t *cmd, uint8_t states, esp_err_t result, void *ctx)
+{
+    if (result != ESP_OK) {
+        DLOGE(TAG, "Relay did not switch 0x%02x on 0x%02x: %s", cmd->states & cmd->mask, cmd->mask,
+              esp_err_to_name(result));
+    }
+    switch (cmd->source) {
+        case RELAY_CMD_SYNC:
+            send_relay_ack(MQTT_TOPIC_STATE_SYNC_ACK, (states & 0x01) != 0, cmd->seq);
+            break;
+        case RELAY_CMD_CHANNEL: {
+            int ch = __builtin_ctz(cmd->mask);
+            send_relay_ack(channel_ack_topics[ch], (states & (1U << ch)) != 0, cmd->seq);
+            break;
+        }
+        case RELAY_CMD_BATCH:
+            send_channels_ack(states, cmd->seq);
+            break;
+        case RELAY_CMD_THERMOSTAT:
+            // Nobody sent it; the change goes out on MQTT_TOPIC_THERMOSTAT_STATE
+            break;
+        default:
+            send_relay_ack(MQTT_TOPIC_ACK, (states & 0x01) != 0, cmd->seq);
+            break;
+    }
+    LATENCY_TRACE_RECORD(LATENCY_CMD_ACK, cmd->origin_us);
+}
+
+static bool parse_on_off(const char *data, int data_len, bool *state)
+{
+    if (payload_equals(data, data_len, "ON")) {
+        *state = true;
+        return true;
+    }
+    if (payload_equals(data, data_len, "OFF")) {
+        *state = false;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Split the sequence number off a text command: "ON#42" -> "ON", 42
+ *
+ * Without RELAY_COMMAND_SEQ, or without a '#', the text is left whole and
+ * seq is 0.
+ *
+ * @return false if what follows the last '#' is not a number from 1 to 2^32-1
+ */
+static bool split_seq(const char *data, int *data_len, uint32_t *seq)
+{
+    *seq = 0;
+#ifdef RELAY_COMMAND_SEQ
+    int hash = *data_len - 1;
+    while (hash >= 0 && data[hash] != '#') {
+        hash--;
+    }
+    if (hash < 0) {
+        return true;
+    }
+    uint64_t value = 0;
+    for (int i = hash + 1; i < *data_len; i++) {
+        if (data[i] < '0' || data[i] > '9' || value > UINT32_MAX) {
+            return false;
+        }
+        value = value * 10 + (uint64_t)(data[i] - '0');
+    }
+    if (value == 0 || value > UINT32_MAX) {
+        return false;
+    }
+    *seq = (uint32_t)value;
+    *data_len = hash;
+#endif
+    return true;
+}
+
+/**
+ * @brief Decode an ON/OFF payload: "ON"/"OFF" text (with RELAY_COMMAND_SEQ
+ *        "ON#<seq>") or a PAYLOAD_RELAY_COMMAND
+ *
+ * @param seq Sequence number, 0 if the payload has none
+ */
+static bool parse_relay_state(const char *data, int data_len, bool *state, uint32_t *seq)
+{
+    int text_len = data_len;
+    if (split_seq(data, &text_len, seq) && parse_on_off(data, text_len, state)) {
+        return true;
+    }
+    esp_err_t ret = payload_decode_relay((const uint8_t *)data, (size_t)data_len, PAYLOAD_RELAY_COMMAND, state, seq);
+#ifndef RELAY_COMMAND_SEQ
+    *seq = 0;   // Checked and echoed only with RELAY_COMMAND_SEQ
+#endif
+    return ret == ESP_OK;
+}
+
+/**
+ * @brief Decode a batch: "<n>=ON|OFF" entries separated by commas, "*" for
+ *        every channel; a later entry for the same channel wins
+ */
+static bool parse_channels(const char *data, int data_len, uint8_t *mask, uint8_t *states)
+{
+    *mask = 0;
+    *states = 0;
+    int pos = 0;
+    while (true) {
+        int end = pos;
+        while (end < data_len && data[end] != ',') {
+            end++;
+        }
+        const char *eq = end > pos ? memchr(data + pos, '=', (size_t)(end - pos)) : NULL;
+        if (eq == NULL) {
+            return false;
+        }
+
+        uint8_t channels;
+        int key_len = (int)(eq - (data + pos));
+        if (key_len == 1 && data[pos] == '*') {
+            channels = RELAY_ALL_CHANNELS;
+        } else if (key_len == 1 && data[pos] >= '0' && data[pos] < '0' + RELAY_CHANNEL_COUNT) {
+            channels = (uint8_t)(1U << (data[pos] - '0'));
+        } else {
+            return false;
+        }
+
+        bool on;
+        if (!parse_on_off(eq + 1, (int)(data + end - (eq + 1)), &on)) {
+            return false;
+        }
+        *mask |= channels;
+        *states = on ? (*states | channels) : (*states & ~channels);
+        if (end == data_len) {
+            return true;
+        }
+        pos = end + 1;
+    }
+}
+
+/**
+ * @brief Drop a command whose sequence number was already seen (RELAY_COMMAND_SEQ)
+ */
+static bool command_is_new(relay_cmd_t *cmd)
+{
+#ifdef RELAY_COMMAND_SEQ
+    cmd->redelivered = data_event_dup;
+    return relay_seq_accept(cmd);
+#else
+    return true;
+#endif
+}
+
+/**
+ * @brief Queue a decoded command; the actuator switches, then sends the ACK
+ */
+static void submit_command(relay_cmd_t *cmd)
+{
+#ifdef RELAY_THERMOSTAT
+    // Keeps the thermostat from switching the webapp's command straight back,
+    // whichever topic named channel 0
+    if (cmd->mask & 0x01) {
+        thermostat_control_command((cmd->states & 0x01) != 0);
+    }
+#endif
+#ifdef LATENCY_TRACE
+    cmd->origin_us = data_event_us;
+#endif
+    // Log after queueing so the UART write is not in the switching path
+    esp_err_t ret = relay_submit(cmd);
+    if (ret != ESP_OK) {
+        DLOGE(TAG, "Failed to queue relay command: %s", esp_err_to_name(ret));
+        return;
+    }
+    DLOGI(TAG, "Received command 0x%02x on channels 0x%02x", cmd->states & cmd->mask, cmd->mask);
+}
+
+/**
+ * @brief Handle state sync response from the webapp
+ */
+static void handle_state_response(const char *data, int data_len, void *ctx)
+{
+    DLOGI(TAG, "Received state sync response (%d bytes)", data_len);
+
+    bool state;
+    uint32_t seq;
+    if (!parse_relay_state(data, data_len, &state, &seq)) {
+        DLOGW(TAG, "Unknown state response: %.*s", data_len, data);
+        // Still confirm the sync, with the state the relay keeps
+        send_relay_ack(MQTT_TOPIC_STATE_SYNC_ACK, relay_get_state(), 0);
+        return;
+    }
+
+    // The actuator task switches the relay and sends the sync ACK
+    relay_cmd_t cmd = { .mask = 0x01, .states = state ? 0x01 : 0, .source = RELAY_CMD_SYNC, .seq = seq };
+    if (command_is_new(&cmd)) {
+        submit_command(&cmd);
+    }
+}
+
+/**
+ * @brief Handle normal ON/OFF control commands (channel 0)
+ */
+static void handle_command(const char *data, int data_len, void *ctx)
+{
+    LATENCY_TRACE_RECORD(LATENCY_CMD_DISPATCH, data_event_us);
+    bool state;
+    uint32_t seq;
+    if (!parse_relay_state(data, data_len, &state, &seq)) {
+        DLOGW(TAG, "Unknown command: %.*s (expected ON or OFF)", data_len, data);
+        return;
+    }
+    relay_cmd_t cmd = { .mask = 0x01, .states = state ? 0x01 : 0, .source = RELAY_CMD_CONTROL, .seq = seq };
+    if (command_is_new(&cmd)) {
+        submit_command(&cmd);
+    }
+}
+
+/**
+ * @brief Handle ON/OFF on one channel's topic (ctx is the channel)
+ */
+static void handle_channel_command(const char *data, int data_len, void *ctx)
+{
+    LATENCY_TRACE_RECORD(LATENCY_CMD_DISPATCH, data_event_us);
+    uint8_t channel = (uint8_t)(uintptr_t)ctx;
+    bool state;
+    uint32_t seq;
+    if (!parse_relay_state(data, data_len, &state, &seq)) {
+        DLOGW(TAG, "Unknown command for channel %u: %.*s (expected ON or OFF)", channel, data_len, data);
+        return;
+    }
+    relay_cmd_t cmd = {
+        .mask = (uint8_t)(1U << channel), .states = state ? 0xFF : 0, .source = RELAY_CMD_CHANNEL, .seq = seq,
+    };
+    if (command_is_new(&cmd)) {
+        submit_command(&cmd);
+    }
+}
+
+/**
+ * @brief Handle a batch on MQTT_TOPIC_CHANNELS_SET, switched in one write
+ */
+static void handle_channels_command(const char *data, int data_len, void *ctx)
+{
+    LATENCY_TRACE_RECORD(LATENCY_CMD_DISPATCH, data_event_us);
+    relay_cmd_t cmd = { .source = RELAY_CMD_BATCH };
+    int batch_len = data_len;
+    if (!split_seq(data, &batch_len, &cmd.seq) || !parse_channels(data, batch_len, &cmd.mask, &cmd.states)) {
+        DLOGW(TAG, "Unknown channel batch: %.*s (expected <n>=ON|OFF,...)", data_len, data);
+        return;
+    }
+    if (command_is_new(&cmd)) {
+        submit_command(&cmd);
+    }
+}
+
+/**
+ * @brief Register the per-channel and batch topics
+ */
+static esp_err_t register_channel_routes(void)
+{
+    for (int ch = 0; ch < RELAY_CHANNEL_COUNT; ch++) {
+        snprintf(channel_set_topics[ch], sizeof(channel_set_topics[ch]), MQTT_TOPIC_CHANNEL_PREFIX "%d/set", ch);
+        snprintf(channel_ack_topics[ch], sizeof(channel_ack_topics[ch]), MQTT_TOPIC_CHANNEL_PREFIX "%d/ack", ch);
+        esp_err_t ret = mqtt_router_register_mqtt_task(channel_set_topics[ch], handle_channel_command,
+                                                        (void *)(uintptr_t)ch);
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            return ret;
+        }
+    }
+    esp_err_t ret = mqtt_router_register_mqtt_task(MQTT_TOPIC_CHANNELS_SET, handle_channels_command, NULL);
+    return ret == ESP_ERR_INVALID_STATE ? ESP_OK : ret;
+}
+
+// Topics this device subscribes to, fixed at compile time from config.h.
+// Their handlers call relay_submit(), which only the MQTT task may do.
+static const mqtt_route_t relay_routes[] = {
+    MQTT_TASK_ROUTE(MQTT_TOPIC_STATE_RESPONSE, handle_state_response, NULL),
+    MQTT_TASK_ROUTE(MQTT_TOPIC_COMMAND, handle_command, NULL),
+};
+
+// Every route a relay build registers: the above, one per channel plus the
+// batch topic, the thermostat's, and the diagnostic ones
+#ifdef RELAY_THERMOSTAT
+#define RELAY_THERMOSTAT_ROUTES THERMOSTAT_CONTROL_ROUTES
+#else
+#define RELAY_THERMOSTAT_ROUTES 0
+#endif
+#ifdef LATENCY_TRACE
+#define RELAY_DIAG_ROUTES 2     // MQTT_TOPIC_DIAG_REQUEST and MQTT_TOPIC_DIAG_LOG_LEVEL
+#else
+#define RELAY_DIAG_ROUTES 1     // MQTT_TOPIC_DIAG_LOG_LEVEL
+#endif
+#define RELAY_ROUTES (sizeof(relay_routes) / sizeof(relay_routes[0]) + RELAY_CHANNEL_COUNT + 1 \
+                      + RELAY_THERMOSTAT_ROUTES + RELAY_DIAG_ROUTES)
+_Static_assert(RELAY_ROUTES <= MQTT_ROUTER_MAX_ROUTES / 2, "keep half of the route table spare");
+#endif
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void retry_cb(void *arg)
+{
+    // Without WiFi the attempt could only fail; the address event retries instead
+    if (mqtt_client != NULL && !mqtt_connected && wifi_manager_is_connected()) {
+        esp_mqtt_client_reconnect(mqtt_client);
+    }
+}
+
+/**
+ * @brief Schedule the next broker attempt after a lost session or a failed one
+ */
+static void broker_lost(void)
+{
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    reconnect_down(&broker_link, now_ms());
+    uint32_t delay_ms = 0;
+    bool retry = wifi_manager_is_connected();
+    if (retry) {
+        delay_ms = reconnect_next_ms(&broker_link);
+    }
+    xSemaphoreGive(link_lock);
+
+    if (retry) {
+        ESP_LOGI(TAG, "Reconnecting to the broker in %lu ms", (unsigned long)delay_ms);
+        esp_timer_stop(retry_timer);
+        esp_timer_start_once(retry_timer, (uint64_t)delay_ms * 1000);
+    } else {
+        ESP_LOGI(TAG, "Reconnecting to the broker once WiFi is back");
+    }
+}
+
 /**
  * @brief MQTT event handler
  */
@@ -47,28 +486,48 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
     switch (event->event_id) {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+            mqtt_connected = true;
+            atomic_fetch_add_explicit(&stat_connects, 1, memory_order_relaxed);
+
+            // Link stats first: a task woken by the event may read them
+            esp_timer_stop(retry_timer);
+            xSemaphoreTake(link_lock, portMAX_DELAY);
+            uint32_t recovery_ms = reconnect_up(&broker_link, now_ms());
+            xSemaphoreGive(link_lock);
+            boot_events_set(BOOT_EVENT_MQTT);
+            if (recovery_ms > 0) {
+                ESP_LOGI(TAG, "Broker back after %lu ms", (unsigned long)recovery_ms);
+            }
 
-            // Publish online status with IP address
-            mqtt_publish_connection_status();
+            // Subscribe to every routed topic
+            for (size_t i = 0; i < mqtt_router_route_count(); i++) {
+                const char *topic = mqtt_router_route_topic(i);
+                int msg_id = esp_mqtt_client_subscribe(mqtt_client, topic, 1);
+                ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", topic, msg_id);
+            }
 
-            // Subscribe to topics for relay devices
             #ifdef DEVICE_TYPE_RELAY
-            int msg_id = esp_mqtt_client_subscribe(mqtt_client, MQTT_TOPIC_COMMAND, 1);
-            ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", MQTT_TOPIC_COMMAND, msg_id);
-
-            msg_id = esp_mqtt_client_subscribe(mqtt_client, MQTT_TOPIC_STATE_RESPONSE, 1);
-            ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", MQTT_TOPIC_STATE_RESPONSE, msg_id);
-
             // Request current state from webapp
             ESP_LOGI(TAG, "Requesting state sync from webapp...");
-            msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_STATE_REQUEST, "REQUEST", 7, 1, 0);
+            int msg_id = mqtt_publish(mqtt_client, MQTT_TOPIC_STATE_REQUEST, "REQUEST", 7, 1, 0);
             ESP_LOGI(TAG, "State sync request sent, msg_id=%d", msg_id);
+            if (msg_id >= 0) {
+                boot_events_set(BOOT_EVENT_FIRST_PUBLISH);
+            }
             #endif
 
+            // Publish online status with IP address and boot timings
+            mqtt_publish_connection_status();
             break;
 
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            mqtt_connected = false;
+            atomic_fetch_add_explicit(&stat_disconnects, 1, memory_order_relaxed);
+            boot_events_clear(BOOT_EVENT_MQTT);
+            if (mqtt_started) {
+                broker_lost();
+            }
             break;
 
         case MQTT_EVENT_SUBSCRIBED:
@@ -80,61 +539,40 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
             break;
 
         case MQTT_EVENT_PUBLISHED:
-            ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            DLOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
             break;
 
         case MQTT_EVENT_DATA:
-            ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-            ESP_LOGI(TAG, "TOPIC=%.*s", event->topic_len, event->topic);
-            ESP_LOGI(TAG, "DATA=%.*s", event->data_len, event->data);
+            LATENCY_TRACE_STAMP(data_event_us);
+#ifdef RELAY_COMMAND_SEQ
+            data_event_dup = event->dup;
+#endif
+            DLOGI(TAG, "MQTT_EVENT_DATA");
+            if (event->current_data_offset == 0) {
+                DLOGI(TAG, "TOPIC=%.*s", event->topic_len, event->topic);
+            }
+            if (event->data_len < event->total_data_len) {
+                DLOGI(TAG, "FRAGMENT offset=%d len=%d total=%d",
+                      event->current_data_offset, event->data_len, event->total_data_len);
+            } else {
+                DLOGI(TAG, "DATA=%.*s", event->data_len, event->data);
+            }
 
-            // Handle incoming messages here
-            #ifdef DEVICE_TYPE_RELAY
-            // Handle state sync response
-            if (strncmp(event->topic, MQTT_TOPIC_STATE_RESPONSE, event->topic_len) == 0) {
-                ESP_LOGI(TAG, "Received state sync response: %.*s", event->data_len, event->data);
-
-                // Set relay state based on response
-                if (strncmp(event->data, "ON", event->data_len) == 0) {
-                    relay_set_state(true);
-                    ESP_LOGI(TAG, "State synced: Relay set to ON");
-                } else if (strncmp(event->data, "OFF", event->data_len) == 0) {
-                    relay_set_state(false);
-                    ESP_LOGI(TAG, "State synced: Relay set to OFF");
-                } else {
-                    ESP_LOGW(TAG, "Unknown state response: %.*s", event->data_len, event->data);
-                }
-
-                // Send sync ACK
-                int ack_msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_STATE_SYNC_ACK, "ACK", 3, 1, 0);
-                ESP_LOGI(TAG, "State sync ACK sent, msg_id=%d", ack_msg_id);
+#ifdef PEER_LINK
+            // Already delivered over the peer link
+            if (event->current_data_offset == 0 && event->data_len >= event->total_data_len
+                && !peer_link_accept_mqtt(event->topic, event->topic_len, event->data, event->data_len)) {
+                break;
             }
-            // Handle normal control commands
-            else if (strncmp(event->topic, MQTT_TOPIC_COMMAND, event->topic_len) == 0) {
-                // Handle ON/OFF commands
-                if (strncmp(event->data, "ON", event->data_len) == 0) {
-                    ESP_LOGI(TAG, "Received ON command for relay");
-
-                    // Send ACK first
-                    int ack_msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_ACK, "ACK", 3, 1, 0);
-                    ESP_LOGI(TAG, "Sent ACK, msg_id=%d", ack_msg_id);
-
-                    // Set relay to ON
-                    relay_set_state(true);
-                } else if (strncmp(event->data, "OFF", event->data_len) == 0) {
-                    ESP_LOGI(TAG, "Received OFF command for relay");
-
-                    // Send ACK first
-                    int ack_msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_ACK, "ACK", 3, 1, 0);
-                    ESP_LOGI(TAG, "Sent ACK, msg_id=%d", ack_msg_id);
-
-                    // Set relay to OFF
-                    relay_set_state(false);
-                } else {
-                    ESP_LOGW(TAG, "Unknown command: %.*s (expected ON or OFF)", event->data_len, event->data);
-                }
+#endif
+
+            // Hand the message to whichever module owns the topic; fragments
+            // of large messages are reassembled or streamed by the router
+            if (!mqtt_router_dispatch(event->topic, event->topic_len, event->data, event->data_len,
+                                      event->current_data_offset, event->total_data_len)
+                && event->current_data_offset == 0) {
+                DLOGW(TAG, "No handler for topic %.*s", event->topic_len, event->topic);
             }
-            #endif
             break;
 
         case MQTT_EVENT_ERROR:
@@ -147,31 +585,126 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
     }
 }
 
+/**
+ * @brief Start connecting once the station has an address
+ *
+ * Starting earlier would only fail the first attempt. After a WiFi outage
+ * the broker is tried at once: the WiFi backoff already spread the fleet.
+ */
+static void ip_event_handler(void *arg, esp_event_base_t event_base,
+                             int32_t event_id, void *event_data)
+{
+    if (mqtt_client == NULL) {
+        return;
+    }
+    if (mqtt_started) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        if (mqtt_connected && event->ip_changed) {
+            // The session's socket is bound to the old address; the lost
+            // session reconnects as any other
+            ESP_LOGI(TAG, "Address changed, reconnecting to the broker");
+            esp_mqtt_client_disconnect(mqtt_client);
+        } else if (!mqtt_connected) {
+            esp_timer_stop(retry_timer);
+            esp_mqtt_client_reconnect(mqtt_client);
+        }
+        return;
+    }
+
+    esp_err_t ret = esp_mqtt_client_start(mqtt_client);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start MQTT client");
+        return;
+    }
+    mqtt_started = true;
+    ESP_LOGI(TAG, "MQTT client started successfully");
+}
+
 esp_err_t mqtt_client_init(void)
 {
     // Create LWT (Last Will and Testament) message - sent when device disconnects unexpectedly
+#ifdef PAYLOAD_BINARY
+    char lwt_payload[PAYLOAD_STATUS_MAX_LEN];
+    payload_status_t offline = {
+        .online = false, .device_type = device_payload_type(), .wifi_ms = -1, .mqtt_ms = -1, .first_publish_ms = -1,
+    };
+    size_t lwt_len = payload_encode_status(&offline, (uint8_t *)lwt_payload, sizeof(lwt_payload));
+#else
     char lwt_payload[128];
     snprintf(lwt_payload, sizeof(lwt_payload), "{\"status\":\"offline\"}");
+    size_t lwt_len = strlen(lwt_payload);
+#endif
 
     ESP_LOGI(TAG, "Initializing MQTT client");
     ESP_LOGI(TAG, "Broker URI: %s", MQTT_BROKER_URI);
     ESP_LOGI(TAG, "Device: %s (%s)", DEVICE_NAME, DEVICE_TYPE_STR);
     ESP_LOGI(TAG, "LWT Topic: %s", MQTT_TOPIC_STATUS);
-    ESP_LOGI(TAG, "LWT Payload: %s", lwt_payload);
+    ESP_LOGI(TAG, "LWT Payload: %u bytes", (unsigned)lwt_len);
 
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = MQTT_BROKER_URI,
         .credentials.username = MQTT_USERNAME,
         .credentials.authentication.password = MQTT_PASSWORD,
         .network.timeout_ms = 5000,
+        .network.disable_auto_reconnect = true,  // See broker_lost()
         .session.keepalive = 20,  // 20 seconds keepalive (faster disconnect detection for testing)
         .session.last_will.topic = MQTT_TOPIC_STATUS,
         .session.last_will.msg = lwt_payload,
-        .session.last_will.msg_len = strlen(lwt_payload),
+        .session.last_will.msg_len = (int)lwt_len,
         .session.last_will.qos = 1,
         .session.last_will.retain = 1,  // Retain the offline message
     };
 
+#ifdef DEVICE_TYPE_RELAY
+    esp_err_t route_ret = mqtt_router_register_routes(relay_routes, sizeof(relay_routes) / sizeof(relay_routes[0]));
+    if (route_ret == ESP_OK) {
+        route_ret = register_channel_routes();
+    }
+    if (route_ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register relay topics");
+        return route_ret;
+    }
+    relay_set_done_handler(relay_command_done, NULL);
+#ifdef RELAY_THERMOSTAT
+    route_ret = thermostat_control_init();
+    if (route_ret != ESP_OK) {
+        return route_ret;
+    }
+#endif
+#endif
+
+    esp_err_t log_ret = log_control_init();
+    if (log_ret != ESP_OK) {
+        return log_ret;
+    }
+
+#ifdef LATENCY_TRACE
+    esp_err_t trace_ret = latency_trace_init();
+    if (trace_ret != ESP_OK) {
+        return trace_ret;
+    }
+#endif
+
+#if defined(DEVICE_TYPE_TEMP_SENSOR) && defined(TEMP_REPORT_BY_EXCEPTION)
+    esp_err_t report_ret = report_control_init();
+    if (report_ret != ESP_OK) {
+        return report_ret;
+    }
+#endif
+
+    if (link_lock == NULL) {
+        link_lock = xSemaphoreCreateMutex();
+        const esp_timer_create_args_t retry_args = {
+            .callback = retry_cb,
+            .name = "mqtt_retry",
+        };
+        if (link_lock == NULL || esp_timer_create(&retry_args, &retry_timer) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create the reconnect timer");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    reconnect_init(&broker_link, MQTT_BACKOFF_BASE_MS, MQTT_BACKOFF_MAX_MS, esp_random());
+
     mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     if (mqtt_client == NULL) {
         ESP_LOGE(TAG, "Failed to initialize MQTT client");
@@ -180,16 +713,28 @@ esp_err_t mqtt_client_init(void)
 
     esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
 
-    esp_err_t ret = esp_mqtt_client_start(mqtt_client);
+    esp_err_t ret = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, ip_event_handler, NULL);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to start MQTT client");
+        ESP_LOGE(TAG, "Failed to register for WiFi address events");
         return ret;
     }
 
-    ESP_LOGI(TAG, "MQTT client started successfully");
+    ESP_LOGI(TAG, "MQTT client created, connecting once WiFi is up");
     return ESP_OK;
 }
 
+#ifndef PAYLOAD_BINARY
+static void format_boot_ms(char *buf, size_t len, EventBits_t event)
+{
+    int32_t ms = boot_events_elapsed_ms(event);
+    if (ms < 0) {
+        snprintf(buf, len, "null");
+    } else {
+        snprintf(buf, len, "%ld", (long)ms);
+    }
+}
+#endif
+
 esp_err_t mqtt_publish_connection_status(void)
 {
     if (mqtt_client == NULL) {
@@ -198,23 +743,53 @@ esp_err_t mqtt_publish_connection_status(void)
     }
 
     // Get IP address
-    char ip_str[16];
-    esp_err_t ret = get_ip_address(ip_str, sizeof(ip_str));
+    esp_netif_ip_info_t ip_info = {0};
+    esp_err_t ret = get_ip_info(&ip_info);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to get IP address");
+    }
+
+#ifdef PAYLOAD_BINARY
+    payload_status_t status = {
+        .online = true,
+        .device_type = device_payload_type(),
+        .wifi_ms = boot_events_elapsed_ms(BOOT_EVENT_WIFI),
+        .mqtt_ms = boot_events_elapsed_ms(BOOT_EVENT_MQTT),
+        .first_publish_ms = boot_events_elapsed_ms(BOOT_EVENT_FIRST_PUBLISH),
+    };
+    memcpy(status.ip, &ip_info.ip.addr, sizeof(status.ip));
+    uint8_t payload[PAYLOAD_STATUS_MAX_LEN];
+    size_t len = payload_encode_status(&status, payload, sizeof(payload));
+
+    ESP_LOGI(TAG, "Publishing connection status to %s (%u bytes)", MQTT_TOPIC_STATUS, (unsigned)len);
+
+    int msg_id = mqtt_publish(mqtt_client, MQTT_TOPIC_STATUS, (const char *)payload, (int)len, 1, 1);
+#else
+    char ip_str[16];
+    if (ret == ESP_OK) {
+        snprintf(ip_str, sizeof(ip_str), IPSTR, IP2STR(&ip_info.ip));
+    } else {
         strcpy(ip_str, "unknown");
     }
 
+    // Boot timings, null until reached
+    char wifi_ms[12], mqtt_ms[12], publish_ms[12];
+    format_boot_ms(wifi_ms, sizeof(wifi_ms), BOOT_EVENT_WIFI);
+    format_boot_ms(mqtt_ms, sizeof(mqtt_ms), BOOT_EVENT_MQTT);
+    format_boot_ms(publish_ms, sizeof(publish_ms), BOOT_EVENT_FIRST_PUBLISH);
+
     // Create JSON payload
     char payload[256];
     snprintf(payload, sizeof(payload),
-             "{\"status\":\"online\",\"device_type\":\"%s\",\"ip_address\":\"%s\"}",
-             DEVICE_TYPE_STR, ip_str);
+             "{\"status\":\"online\",\"device_type\":\"%s\",\"ip_address\":\"%s\","
+             "\"boot_ms\":{\"wifi\":%s,\"mqtt\":%s,\"first_publish\":%s}}",
+             DEVICE_TYPE_STR, ip_str, wifi_ms, mqtt_ms, publish_ms);
 
     ESP_LOGI(TAG, "Publishing connection status to %s", MQTT_TOPIC_STATUS);
     ESP_LOGI(TAG, "Payload: %s", payload);
 
-    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_STATUS, payload, 0, 1, 1);
+    int msg_id = mqtt_publish(mqtt_client, MQTT_TOPIC_STATUS, payload, 0, 1, 1);
+#endif
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to publish connection status");
         return ESP_FAIL;
@@ -224,17 +799,73 @@ esp_err_t mqtt_publish_connection_status(void)
     return ESP_OK;
 }
 
+static int count_publish(int msg_id)
+{
+    atomic_fetch_add_explicit(msg_id < 0 ? &stat_publish_failed : &stat_published, 1, memory_order_relaxed);
+    return msg_id;
+}
+
+int mqtt_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                 int len, int qos, int retain)
+{
+#ifdef PEER_LINK
+    peer_link_forward(topic, data, len);
+#endif
+    return count_publish(esp_mqtt_client_publish(client, topic, data, len, qos, retain));
+}
+
+int mqtt_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                 int len, int qos, int retain, bool store)
+{
+#ifdef PEER_LINK
+    peer_link_forward(topic, data, len);
+#endif
+    return count_publish(esp_mqtt_client_enqueue(client, topic, data, len, qos, retain, store));
+}
+
+reconnect_stats_t mqtt_get_link_stats(void)
+{
+    reconnect_stats_t stats = {0};
+    if (link_lock == NULL) {
+        return stats;
+    }
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    stats = reconnect_get_stats(&broker_link, now_ms());
+    xSemaphoreGive(link_lock);
+    return stats;
+}
+
+mqtt_stats_t mqtt_get_stats(void)
+{
+    mqtt_stats_t stats = {
+        .connects = atomic_load_explicit(&stat_connects, memory_order_relaxed),
+        .disconnects = atomic_load_explicit(&stat_disconnects, memory_order_relaxed),
+        .published = atomic_load_explicit(&stat_published, memory_order_relaxed),
+        .publish_failed = atomic_load_explicit(&stat_publish_failed, memory_order_relaxed),
+    };
+    return stats;
+}
+
 esp_mqtt_client_handle_t mqtt_get_client(void)
 {
     return mqtt_client;
 }
 
+bool mqtt_is_connected(void)
+{
+    return mqtt_connected;
+}
+
 void mqtt_client_stop(void)
 {
     if (mqtt_client != NULL) {
         ESP_LOGI(TAG, "Stopping MQTT client");
+        mqtt_started = false;
+        esp_timer_stop(retry_timer);
         esp_mqtt_client_stop(mqtt_client);
         esp_mqtt_client_destroy(mqtt_client);
+        esp_event_handler_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, ip_event_handler);
         mqtt_client = NULL;
+        mqtt_connected = false;
     }
 }
@@ -0,0 +1,256 @@
+#include <string.h>
+#include "esp_log.h"
+#include "config.h"
+#include "mqtt_router.h"
+
+static const char *TAG = "MQTT_ROUTER";
+
+// Open-addressed hash table, kept at most half full so probes stay short
+#define ROUTER_SLOTS (MQTT_ROUTER_MAX_ROUTES * 2)
+_Static_assert((ROUTER_SLOTS & (ROUTER_SLOTS - 1)) == 0, "probes wrap with a mask: ROUTER_SLOTS must be a power of two");
+_Static_assert(MQTT_ROUTER_MAX_ROUTES <= INT8_MAX, "slots hold an int8_t index into entries");
+
+typedef struct {
+    mqtt_route_t route;
+    uint32_t hash;
+} router_entry_t;
+
+static router_entry_t entries[MQTT_ROUTER_MAX_ROUTES];
+static size_t entry_count = 0;
+static int8_t slots[ROUTER_SLOTS];   // index into entries, -1 = empty
+static bool slots_ready = false;
+
+// Reassembly of fragmented messages. esp-mqtt delivers the fragments of one
+// message back to back on its own task, so a single arena is enough.
+static char reassembly_arena[MQTT_REASSEMBLY_BUFFER_SIZE];
+static struct {
+    const mqtt_route_t *route;   // NULL = no message in progress / dropping
+    int total_len;
+    int received;
+} pending;
+
+/**
+ * @brief FNV-1a over the topic bytes
+ */
+static uint32_t topic_hash(const char *topic, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)topic[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int find_entry(const char *topic, size_t len, uint32_t hash)
+{
+    for (size_t probe = 0; probe < ROUTER_SLOTS; probe++) {
+        int idx = slots[(hash + probe) & (ROUTER_SLOTS - 1)];
+        if (idx < 0) {
+            return -1;
+        }
+        const router_entry_t *e = &entries[idx];
+        if (e->hash == hash && e->route.topic_len == len && memcmp(e->route.topic, topic, len) == 0) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+static esp_err_t add_route(const mqtt_route_t *route)
+{
+    if (route->topic == NULL || (route->handler == NULL) == (route->stream == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!slots_ready) {
+        memset(slots, -1, sizeof(slots));
+        slots_ready = true;
+    }
+
+    uint32_t hash = topic_hash(route->topic, route->topic_len);
+    if (find_entry(route->topic, route->topic_len, hash) >= 0) {
+        ESP_LOGE(TAG, "Topic already routed: %s", route->topic);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (entry_count >= MQTT_ROUTER_MAX_ROUTES) {
+        ESP_LOGE(TAG, "Route table full, cannot add %s", route->topic);
+        return ESP_ERR_NO_MEM;
+    }
+
+    entries[entry_count].route = *route;
+    entries[entry_count].hash = hash;
+
+    for (size_t probe = 0; probe < ROUTER_SLOTS; probe++) {
+        size_t slot = (hash + probe) & (ROUTER_SLOTS - 1);
+        if (slots[slot] < 0) {
+            slots[slot] = (int8_t)entry_count;
+            break;
+        }
+    }
+    entry_count++;
+
+    return ESP_OK;
+}
+
+esp_err_t mqtt_router_register(const char *topic, mqtt_topic_handler_t handler, void *ctx)
+{
+    if (topic == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mqtt_route_t route = {
+        .topic = topic,
+        .topic_len = (uint16_t)strlen(topic),
+        .handler = handler,
+        .ctx = ctx,
+    };
+    return add_route(&route);
+}
+
+esp_err_t mqtt_router_register_mqtt_task(const char *topic, mqtt_topic_handler_t handler, void *ctx)
+{
+    if (topic == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mqtt_route_t route = {
+        .topic = topic,
+        .topic_len = (uint16_t)strlen(topic),
+        .handler = handler,
+        .ctx = ctx,
+        .mqtt_task_only = true,
+    };
+    return add_route(&route);
+}
+
+esp_err_t mqtt_router_register_stream(const char *topic, mqtt_stream_handler_t handler, void *ctx)
+{
+    if (topic == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mqtt_route_t route = {
+        .topic = topic,
+        .topic_len = (uint16_t)strlen(topic),
+        .ctx = ctx,
+        .stream = handler,
+    };
+    return add_route(&route);
+}
+
+esp_err_t mqtt_router_register_routes(const mqtt_route_t *routes, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        esp_err_t ret = add_route(&routes[i]);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+static const mqtt_route_t *lookup(const char *topic, int topic_len)
+{
+    if (topic == NULL || topic_len <= 0 || entry_count == 0) {
+        return NULL;
+    }
+
+    int idx = find_entry(topic, (size_t)topic_len, topic_hash(topic, (size_t)topic_len));
+    return idx < 0 ? NULL : &entries[idx].route;
+}
+
+bool mqtt_router_deliver(const char *topic, int topic_len, const char *data, int data_len)
+{
+    const mqtt_route_t *route = lookup(topic, topic_len);
+    if (route == NULL) {
+        return false;
+    }
+    if (route->mqtt_task_only) {
+        ESP_LOGW(TAG, "%s is handled on the MQTT task only, not delivering", route->topic);
+        return false;
+    }
+    if (route->stream) {
+        route->stream(data, data_len, 0, data_len, route->ctx);
+    } else {
+        route->handler(data, data_len, route->ctx);
+    }
+    return true;
+}
+
+bool mqtt_router_mqtt_task_only(const char *topic, int topic_len)
+{
+    const mqtt_route_t *route = lookup(topic, topic_len);
+    return route != NULL && route->mqtt_task_only;
+}
+
+bool mqtt_router_dispatch(const char *topic, int topic_len, const char *data, int data_len,
+                          int offset, int total_len)
+{
+    if (offset == 0) {
+        pending.route = NULL;
+
+        const mqtt_route_t *route = lookup(topic, topic_len);
+        if (route == NULL) {
+            return false;
+        }
+
+        // Whole message in one event: hand over the client buffer as is
+        if (data_len >= total_len) {
+            if (route->stream) {
+                route->stream(data, data_len, 0, data_len, route->ctx);
+            } else {
+                route->handler(data, data_len, route->ctx);
+            }
+            return true;
+        }
+
+        if (route->handler && total_len > MQTT_REASSEMBLY_BUFFER_SIZE) {
+            ESP_LOGE(TAG, "Message on %s too large (%d > %d bytes), dropping",
+                     route->topic, total_len, MQTT_REASSEMBLY_BUFFER_SIZE);
+            return true;
+        }
+
+        pending.route = route;
+        pending.total_len = total_len;
+        pending.received = 0;
+    } else if (pending.route == NULL) {
+        // Continuation of a message that was not routed or was dropped
+        return false;
+    } else if (offset != pending.received || total_len != pending.total_len) {
+        ESP_LOGW(TAG, "Fragment out of sequence on %s (offset %d, expected %d), dropping message",
+                 pending.route->topic, offset, pending.received);
+        pending.route = NULL;
+        return true;
+    }
+
+    const mqtt_route_t *route = pending.route;
+    if (data_len > pending.total_len - pending.received) {
+        data_len = pending.total_len - pending.received;
+    }
+
+    if (route->stream) {
+        route->stream(data, data_len, offset, pending.total_len, route->ctx);
+    } else {
+        memcpy(reassembly_arena + pending.received, data, (size_t)data_len);
+    }
+    pending.received += data_len;
+
+    if (pending.received == pending.total_len) {
+        pending.route = NULL;
+        if (route->handler) {
+            route->handler(reassembly_arena, pending.total_len, route->ctx);
+        }
+    }
+    return true;
+}
+
+size_t mqtt_router_route_count(void)
+{
+    return entry_count;
+}
+
+const char *mqtt_router_route_topic(size_t index)
+{
+    return index < entry_count ? entries[index].route.topic : NULL;
+}
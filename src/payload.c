@@ -0,0 +1,271 @@
+#include <math.h>
+#include <string.h>
+#include "cbor.h"
+#include "payload.h"
+
+static int32_t to_centi(float value)
+{
+    return (int32_t)lroundf(value * 100.0f);
+}
+
+static void put_envelope(cbor_writer_t *w, payload_type_t type, size_t fields)
+{
+    cbor_put_array(w, 2 + fields);
+    cbor_put_uint(w, PAYLOAD_SCHEMA_VERSION);
+    cbor_put_uint(w, type);
+}
+
+static void put_boot_ms(cbor_writer_t *w, int32_t ms)
+{
+    if (ms < 0) {
+        cbor_put_null(w);
+    } else {
+        cbor_put_uint(w, (uint32_t)ms);
+    }
+}
+
+size_t payload_encode_temperature(float temperature, float humidity, uint8_t *buf, size_t len)
+{
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+    put_envelope(&w, PAYLOAD_TEMPERATURE, 2);
+    cbor_put_int(&w, to_centi(temperature));
+    cbor_put_int(&w, to_centi(humidity));
+    return cbor_writer_finish(&w);
+}
+
+size_t payload_encode_status(const payload_status_t *status, uint8_t *buf, size_t len)
+{
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+    put_envelope(&w, PAYLOAD_STATUS, 6);
+    cbor_put_bool(&w, status->online);
+    cbor_put_uint(&w, status->device_type);
+    cbor_put_bytes(&w, status->ip, sizeof(status->ip));
+    put_boot_ms(&w, status->wifi_ms);
+    put_boot_ms(&w, status->mqtt_ms);
+    put_boot_ms(&w, status->first_publish_ms);
+    return cbor_writer_finish(&w);
+}
+
+size_t payload_encode_relay(payload_type_t type, bool on, uint32_t seq, uint8_t *buf, size_t len)
+{
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+    put_envelope(&w, type, seq != 0 ? 2 : 1);
+    cbor_put_bool(&w, on);
+    if (seq != 0) {
+        cbor_put_uint(&w, seq);
+    }
+    return cbor_writer_finish(&w);
+}
+
+static size_t sample_size(const sensor_sample_t *s, uint32_t now_ms)
+{
+    return cbor_int_size((uint32_t)(now_ms - s->timestamp_ms)) + cbor_int_size(to_centi(s->temperature))
+         + cbor_int_size(to_centi(s->humidity));
+}
+
+size_t payload_encode_batch(const sample_ring_t *ring, uint32_t now_ms, uint8_t *buf, size_t len,
+                            uint16_t *encoded)
+{
+    if (encoded != NULL) {
+        *encoded = 0;
+    }
+
+    // The array header carries the count, so size the samples first. Headers
+    // are budgeted at their largest (5 bytes for now_ms and the sample array).
+    size_t used = 1 + 1 + 1 + 5 + 5;
+    uint16_t count = 0;
+    while (count < ring->count) {
+        size_t size = sample_size(sample_ring_at(ring, count), now_ms);
+        if (used + size > len) {
+            break;
+        }
+        used += size;
+        count++;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+    put_envelope(&w, PAYLOAD_SAMPLE_BATCH, 2);
+    cbor_put_uint(&w, now_ms);
+    cbor_put_array(&w, (size_t)count * 3);
+    for (uint16_t i = 0; i < count; i++) {
+        const sensor_sample_t *s = sample_ring_at(ring, i);
+        cbor_put_uint(&w, (uint32_t)(now_ms - s->timestamp_ms));
+        cbor_put_int(&w, to_centi(s->temperature));
+        cbor_put_int(&w, to_centi(s->humidity));
+    }
+
+    size_t total = cbor_writer_finish(&w);
+    if (total > 0 && encoded != NULL) {
+        *encoded = count;
+    }
+    return total;
+}
+
+/**
+ * @brief Open a message of the expected type
+ *
+ * @param fields Set to the number of fields after version and type
+ */
+static esp_err_t open_message(cbor_reader_t *r, const uint8_t *buf, size_t len, payload_type_t *type,
+                              size_t *fields)
+{
+    size_t count;
+    uint64_t version, value;
+    cbor_reader_init(r, buf, len);
+    if (!cbor_get_array(r, &count) || count < 2 || !cbor_get_uint(r, &version)) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (version != PAYLOAD_SCHEMA_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (!cbor_get_uint(r, &value) || value > UINT8_MAX) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    *type = (payload_type_t)value;
+    *fields = count - 2;
+    return ESP_OK;
+}
+
+static esp_err_t open_expected(cbor_reader_t *r, const uint8_t *buf, size_t len, payload_type_t expected,
+                               size_t min_fields, size_t *fields)
+{
+    payload_type_t type;
+    esp_err_t ret = open_message(r, buf, len, &type, fields);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return type == expected && *fields >= min_fields ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+// Step over fields appended by a newer sender
+static esp_err_t close_message(cbor_reader_t *r, size_t extra_fields)
+{
+    for (size_t i = 0; i < extra_fields; i++) {
+        cbor_skip(r);
+    }
+    return cbor_reader_ok(r) ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+static bool get_i32(cbor_reader_t *r, int32_t *value)
+{
+    int64_t v;
+    if (!cbor_get_int(r, &v) || v < INT32_MIN || v > INT32_MAX) {
+        return false;
+    }
+    *value = (int32_t)v;
+    return true;
+}
+
+static bool get_boot_ms(cbor_reader_t *r, int32_t *ms)
+{
+    if (cbor_peek_null(r)) {
+        *ms = -1;
+        return cbor_get_null(r);
+    }
+    return get_i32(r, ms);
+}
+
+esp_err_t payload_peek_type(const uint8_t *buf, size_t len, payload_type_t *type)
+{
+    cbor_reader_t r;
+    size_t fields;
+    return open_message(&r, buf, len, type, &fields);
+}
+
+esp_err_t payload_decode_temperature(const uint8_t *buf, size_t len, float *temperature, float *humidity)
+{
+    cbor_reader_t r;
+    size_t fields;
+    int32_t t, h;
+    esp_err_t ret = open_expected(&r, buf, len, PAYLOAD_TEMPERATURE, 2, &fields);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!get_i32(&r, &t) || !get_i32(&r, &h)) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    *temperature = t / 100.0f;
+    *humidity = h / 100.0f;
+    return close_message(&r, fields - 2);
+}
+
+esp_err_t payload_decode_status(const uint8_t *buf, size_t len, payload_status_t *status)
+{
+    cbor_reader_t r;
+    size_t fields, ip_len;
+    uint64_t device_type;
+    const uint8_t *ip;
+    esp_err_t ret = open_expected(&r, buf, len, PAYLOAD_STATUS, 6, &fields);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!cbor_get_bool(&r, &status->online) || !cbor_get_uint(&r, &device_type)
+        || !cbor_get_bytes(&r, &ip, &ip_len) || ip_len != sizeof(status->ip)
+        || !get_boot_ms(&r, &status->wifi_ms) || !get_boot_ms(&r, &status->mqtt_ms)
+        || !get_boot_ms(&r, &status->first_publish_ms)) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    status->device_type = (payload_device_t)device_type;
+    memcpy(status->ip, ip, sizeof(status->ip));
+    return close_message(&r, fields - 6);
+}
+
+esp_err_t payload_decode_relay(const uint8_t *buf, size_t len, payload_type_t type, bool *on, uint32_t *seq)
+{
+    cbor_reader_t r;
+    size_t fields;
+    uint64_t value = 0;
+    esp_err_t ret = open_expected(&r, buf, len, type, 1, &fields);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!cbor_get_bool(&r, on)) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (fields >= 2 && (!cbor_get_uint(&r, &value) || value > UINT32_MAX)) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (seq != NULL) {
+        *seq = (uint32_t)value;
+    }
+    return close_message(&r, fields > 2 ? fields - 2 : 0);
+}
+
+esp_err_t payload_decode_batch(const uint8_t *buf, size_t len, uint32_t *now_ms,
+                               sensor_sample_t *samples, uint16_t capacity, uint16_t *count)
+{
+    cbor_reader_t r;
+    size_t fields, values;
+    uint64_t now;
+    esp_err_t ret = open_expected(&r, buf, len, PAYLOAD_SAMPLE_BATCH, 2, &fields);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!cbor_get_uint(&r, &now) || now > UINT32_MAX || !cbor_get_array(&r, &values) || values % 3 != 0) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (values / 3 > capacity) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    for (size_t i = 0; i < values / 3; i++) {
+        int64_t age;
+        int32_t t, h;
+        if (!cbor_get_int(&r, &age) || age < 0 || age > UINT32_MAX || !get_i32(&r, &t) || !get_i32(&r, &h)) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        samples[i].timestamp_ms = (uint32_t)now - (uint32_t)age;
+        samples[i].temperature = t / 100.0f;
+        samples[i].humidity = h / 100.0f;
+    }
+    *now_ms = (uint32_t)now;
+    *count = (uint16_t)(values / 3);
+    return close_message(&r, fields - 2);
+}
@@ -0,0 +1,390 @@
+#include "config.h"
+
+#ifdef PEER_LINK
+
+#include <stdatomic.h>
+#include <string.h>
+#include "peer_link.h"
+#include "mqtt_router.h"
+#include "spsc_queue.h"
+#include "dlog.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "PEER_LINK";
+
+#define PEER_RX_QUEUE_LEN   8       // Frames waiting for the task (power of two)
+#define PEER_RECENT_SLOTS   8       // Messages remembered for PEER_LINK_DEDUP_MS
+#define PEER_TASK_STACK     3072
+#define PEER_TASK_PRIORITY  5       // Same as the MQTT task, which runs the same handlers
+#define PEER_SEQ_WINDOW     32
+
+static const char *const peer_topics[] = PEER_LINK_TOPICS;
+#define PEER_TOPIC_COUNT (sizeof(peer_topics) / sizeof(peer_topics[0]))
+
+typedef struct {
+    uint8_t len;
+    uint8_t data[PEER_FRAME_MAX];
+} rx_slot_t;
+
+// Set once the transport is up; read by every publishing task
+static const transport_t *volatile peer_transport = NULL;
+static uint16_t boot_id;
+static atomic_uint_fast32_t next_seq;
+static atomic_bool link_up;
+static atomic_uint_fast32_t unacknowledged;     // In a row
+static atomic_uint_fast32_t last_probe_ms;
+
+// Transport receive callback -> peer task
+static spsc_queue_t rx_queue;
+static rx_slot_t rx_storage[PEER_RX_QUEUE_LEN];
+static TaskHandle_t peer_task = NULL;
+static peer_seq_window_t window;                // Peer task only
+
+// Messages delivered lately from either path, by hash; MQTT task and peer task
+typedef struct {
+    bool used;
+    uint32_t hash;
+    uint32_t at_ms;
+} recent_t;
+static recent_t recent[PEER_RECENT_SLOTS];
+static size_t recent_next;
+static SemaphoreHandle_t recent_lock = NULL;
+
+static atomic_uint_fast32_t stat_sent;
+static atomic_uint_fast32_t stat_delivered;
+static atomic_uint_fast32_t stat_failed;
+static atomic_uint_fast32_t stat_skipped;
+static atomic_uint_fast32_t stat_received;
+static atomic_uint_fast32_t stat_rejected;
+static atomic_uint_fast32_t stat_replayed;
+static atomic_uint_fast32_t stat_overflow;
+static atomic_uint_fast32_t stat_peer_copies;
+static atomic_uint_fast32_t stat_mqtt_copies;
+
+static void count(atomic_uint_fast32_t *counter)
+{
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// ============================================
+// Frames
+// ============================================
+
+size_t peer_frame_encode(uint16_t boot, uint32_t seq, const char *topic, const void *data, size_t len,
+                         uint8_t *buf, size_t size)
+{
+    size_t topic_len = strlen(topic);
+    if (topic_len == 0 || topic_len > UINT8_MAX || PEER_FRAME_HEADER + topic_len + len > size) {
+        return 0;
+    }
+    buf[0] = PEER_FRAME_VERSION;
+    buf[1] = (uint8_t)boot;
+    buf[2] = (uint8_t)(boot >> 8);
+    for (int i = 0; i < 4; i++) {
+        buf[3 + i] = (uint8_t)(seq >> (8 * i));
+    }
+    buf[7] = (uint8_t)topic_len;
+    memcpy(buf + PEER_FRAME_HEADER, topic, topic_len);
+    memcpy(buf + PEER_FRAME_HEADER + topic_len, data, len);
+    return PEER_FRAME_HEADER + topic_len + len;
+}
+
+esp_err_t peer_frame_decode(const uint8_t *buf, size_t len, peer_frame_t *frame)
+{
+    if (len < PEER_FRAME_HEADER) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (buf[0] != PEER_FRAME_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    frame->topic_len = buf[7];
+    if (frame->topic_len == 0 || PEER_FRAME_HEADER + (size_t)frame->topic_len > len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    frame->boot_id = (uint16_t)(buf[1] | (buf[2] << 8));
+    frame->seq = 0;
+    for (int i = 0; i < 4; i++) {
+        frame->seq |= (uint32_t)buf[3 + i] << (8 * i);
+    }
+    frame->topic = (const char *)buf + PEER_FRAME_HEADER;
+    frame->data = buf + PEER_FRAME_HEADER + frame->topic_len;
+    frame->len = len - PEER_FRAME_HEADER - frame->topic_len;
+    return ESP_OK;
+}
+
+bool peer_seq_accept(peer_seq_window_t *w, uint16_t boot, uint32_t seq)
+{
+    if (!w->valid || boot != w->boot_id) {
+        w->valid = true;
+        w->boot_id = boot;
+        w->highest = seq;
+        w->seen = 1;
+        return true;
+    }
+    int32_t ahead = (int32_t)(seq - w->highest);
+    if (ahead > 0) {
+        w->seen = ahead >= PEER_SEQ_WINDOW ? 1 : (w->seen << ahead) | 1;
+        w->highest = seq;
+        return true;
+    }
+    uint32_t behind = (uint32_t)-ahead;
+    if (behind >= PEER_SEQ_WINDOW || (w->seen & (1u << behind)) != 0) {
+        return false;
+    }
+    w->seen |= 1u << behind;
+    return true;
+}
+
+// ============================================
+// Dedup across the two paths
+// ============================================
+
+static bool peer_topic(const char *topic, size_t topic_len)
+{
+    for (size_t i = 0; i < PEER_TOPIC_COUNT; i++) {
+        if (strlen(peer_topics[i]) == topic_len && memcmp(peer_topics[i], topic, topic_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// FNV-1a over topic and payload
+static uint32_t message_hash(const char *topic, size_t topic_len, const void *data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < topic_len; i++) {
+        hash = (hash ^ (uint8_t)topic[i]) * 16777619u;
+    }
+    hash = (hash ^ 0) * 16777619u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ ((const uint8_t *)data)[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Remember a message, or forget it if this is its second copy
+ *
+ * A message arrives at most twice (peer and broker), so the entry is freed
+ * by the second copy and the same payload later counts as new.
+ *
+ * @return true for the first copy
+ */
+static bool first_copy(const char *topic, size_t topic_len, const void *data, size_t len)
+{
+    uint32_t hash = message_hash(topic, topic_len, data, len);
+    uint32_t now = now_ms();
+    bool first = true;
+
+    xSemaphoreTake(recent_lock, portMAX_DELAY);
+    for (size_t i = 0; i < PEER_RECENT_SLOTS; i++) {
+        if (recent[i].used && recent[i].hash == hash && now - recent[i].at_ms < PEER_LINK_DEDUP_MS) {
+            recent[i].used = false;
+            first = false;
+            break;
+        }
+    }
+    if (first) {
+        recent[recent_next] = (recent_t){ .used = true, .hash = hash, .at_ms = now };
+        recent_next = (recent_next + 1) % PEER_RECENT_SLOTS;
+    }
+    xSemaphoreGive(recent_lock);
+    return first;
+}
+
+bool peer_link_accept_mqtt(const char *topic, int topic_len, const char *data, int len)
+{
+    if (peer_transport == NULL || !peer_topic(topic, (size_t)topic_len)) {
+        return true;
+    }
+    if (first_copy(topic, (size_t)topic_len, data, (size_t)len)) {
+        return true;
+    }
+    count(&stat_mqtt_copies);
+    DLOGD(TAG, "Broker copy of %.*s already delivered by the peer", topic_len, topic);
+    return false;
+}
+
+// ============================================
+// Sending
+// ============================================
+
+static void on_sent(bool delivered)
+{
+    if (delivered) {
+        count(&stat_delivered);
+        atomic_store(&unacknowledged, 0);
+        if (!atomic_exchange(&link_up, true)) {
+            ESP_LOGI(TAG, "Peer link up");
+        }
+        return;
+    }
+    count(&stat_failed);
+    if (atomic_fetch_add(&unacknowledged, 1) + 1 >= PEER_LINK_FAIL_LIMIT && atomic_exchange(&link_up, false)) {
+        atomic_store(&last_probe_ms, now_ms());
+        ESP_LOGW(TAG, "Peer link down after %d unacknowledged frames, the broker carries on alone",
+                 PEER_LINK_FAIL_LIMIT);
+    }
+}
+
+esp_err_t peer_link_forward(const char *topic, const char *data, int len)
+{
+    const transport_t *transport = peer_transport;
+    if (transport == NULL || !peer_topic(topic, strlen(topic))) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // While down, one message per PEER_LINK_PROBE_MS goes out to find out
+    // whether the peer is back
+    if (!atomic_load(&link_up)) {
+        uint32_t now = now_ms();
+        uint_fast32_t last = atomic_load(&last_probe_ms);
+        if (now - (uint32_t)last < PEER_LINK_PROBE_MS
+            || !atomic_compare_exchange_strong(&last_probe_ms, &last, now)) {
+            count(&stat_skipped);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    uint8_t frame[PEER_FRAME_MAX];
+    size_t size = transport->mtu < sizeof(frame) ? transport->mtu : sizeof(frame);
+    size_t payload_len = len > 0 ? (size_t)len : strlen(data);
+    uint32_t seq = (uint32_t)atomic_fetch_add(&next_seq, 1);
+    size_t frame_len = peer_frame_encode(boot_id, seq, topic, data, payload_len, frame, size);
+    if (frame_len == 0) {
+        DLOGW(TAG, "Message on %s too large for the peer link (%u bytes)", topic, (unsigned)payload_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    count(&stat_sent);
+    esp_err_t ret = transport->send(frame, frame_len);
+    if (ret != ESP_OK) {
+        DLOGW(TAG, "Peer send failed: %s", esp_err_to_name(ret));
+        on_sent(false);
+    }
+    return ret;
+}
+
+// ============================================
+// Receiving
+// ============================================
+
+static void on_recv(const uint8_t *frame, size_t len)
+{
+    rx_slot_t slot;
+    if (len > sizeof(slot.data)) {
+        count(&stat_rejected);
+        return;
+    }
+    slot.len = (uint8_t)len;
+    memcpy(slot.data, frame, len);
+    if (!spsc_queue_push(&rx_queue, &slot)) {
+        count(&stat_overflow);
+        return;
+    }
+    xTaskNotifyGive(peer_task);
+}
+
+/**
+ * @brief Deliver received frames to the router, in the order they came
+ */
+static void peer_task_fn(void *pvParameters)
+{
+    rx_slot_t slot;
+    peer_frame_t frame;
+
+    for (;;) {
+        while (!spsc_queue_pop(&rx_queue, &slot)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+
+        if (peer_frame_decode(slot.data, slot.len, &frame) != ESP_OK
+            || !peer_topic(frame.topic, frame.topic_len)) {
+            count(&stat_rejected);
+            DLOGW(TAG, "Dropping a %u-byte frame that is malformed or not on a peer topic", slot.len);
+            continue;
+        }
+        if (!peer_seq_accept(&window, frame.boot_id, frame.seq)) {
+            count(&stat_replayed);
+            continue;
+        }
+        if (!first_copy(frame.topic, frame.topic_len, frame.data, frame.len)) {
+            count(&stat_peer_copies);
+            continue;
+        }
+        mqtt_router_deliver(frame.topic, frame.topic_len, (const char *)frame.data, (int)frame.len);
+        count(&stat_received);
+    }
+}
+
+esp_err_t peer_link_init(const transport_t *transport)
+{
+    if (peer_transport != NULL) {
+        return ESP_OK;
+    }
+
+    // Peer frames are delivered on the peer task, which must not submit relay
+    // commands: those topics stay on the broker
+    for (size_t i = 0; i < PEER_TOPIC_COUNT; i++) {
+        if (mqtt_router_mqtt_task_only(peer_topics[i], (int)strlen(peer_topics[i]))) {
+            ESP_LOGE(TAG, "%s cannot be a peer link topic, its handler runs on the MQTT task only", peer_topics[i]);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    recent_lock = xSemaphoreCreateMutex();
+    if (recent_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create dedup lock");
+        return ESP_ERR_NO_MEM;
+    }
+    spsc_queue_init(&rx_queue, rx_storage, sizeof(rx_storage[0]), PEER_RX_QUEUE_LEN);
+    boot_id = (uint16_t)esp_random();
+    atomic_store(&link_up, true);
+
+    BaseType_t created = xTaskCreate(peer_task_fn, "peer_link", PEER_TASK_STACK, NULL, PEER_TASK_PRIORITY,
+                                     &peer_task);
+    if (created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create peer link task");
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = transport->start(on_recv, on_sent);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start %s: %s", transport->name, esp_err_to_name(ret));
+        return ret;
+    }
+    peer_transport = transport;
+    ESP_LOGI(TAG, "Peer link over %s for %u topics", transport->name, (unsigned)PEER_TOPIC_COUNT);
+    return ESP_OK;
+}
+
+peer_link_stats_t peer_link_get_stats(void)
+{
+    peer_link_stats_t stats = {
+        .sent = atomic_load_explicit(&stat_sent, memory_order_relaxed),
+        .delivered = atomic_load_explicit(&stat_delivered, memory_order_relaxed),
+        .failed = atomic_load_explicit(&stat_failed, memory_order_relaxed),
+        .skipped = atomic_load_explicit(&stat_skipped, memory_order_relaxed),
+        .received = atomic_load_explicit(&stat_received, memory_order_relaxed),
+        .rejected = atomic_load_explicit(&stat_rejected, memory_order_relaxed),
+        .replayed = atomic_load_explicit(&stat_replayed, memory_order_relaxed),
+        .overflow = atomic_load_explicit(&stat_overflow, memory_order_relaxed),
+        .peer_copies = atomic_load_explicit(&stat_peer_copies, memory_order_relaxed),
+        .mqtt_copies = atomic_load_explicit(&stat_mqtt_copies, memory_order_relaxed),
+        .up = atomic_load(&link_up),
+    };
+    return stats;
+}
+
+#endif // PEER_LINK
@@ -0,0 +1,76 @@
+#include <string.h>
+#include "reconnect.h"
+
+void reconnect_init(reconnect_t *r, uint32_t base_ms, uint32_t max_ms, uint32_t seed)
+{
+    memset(r, 0, sizeof(*r));
+    r->base_ms = base_ms > 0 ? base_ms : 1;
+    r->max_ms = max_ms > r->base_ms ? max_ms : r->base_ms;
+    r->rng = seed != 0 ? seed : 0x9E3779B9u;
+}
+
+static uint32_t next_random(reconnect_t *r)
+{
+    uint32_t x = r->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    r->rng = x;
+    return x;
+}
+
+void reconnect_down(reconnect_t *r, uint32_t now_ms)
+{
+    if (!r->up) {
+        return;
+    }
+    r->up = false;
+    r->attempt = 0;
+    r->down_since_ms = now_ms;
+    r->outages++;
+}
+
+uint32_t reconnect_next_ms(reconnect_t *r)
+{
+    // Window doubles per attempt until it reaches max_ms
+    uint32_t window = r->base_ms;
+    for (uint32_t i = 0; i < r->attempt && window < r->max_ms; i++) {
+        window = window > r->max_ms / 2 ? r->max_ms : window * 2;
+    }
+    r->attempt++;
+    r->attempts++;
+    return (uint32_t)((uint64_t)next_random(r) * ((uint64_t)window + 1) >> 32);
+}
+
+uint32_t reconnect_up(reconnect_t *r, uint32_t now_ms)
+{
+    uint32_t recovery = 0;
+    if (!r->up && r->ever_up) {
+        recovery = now_ms - r->down_since_ms;
+        r->downtime_ms += recovery;
+        r->last_recovery_ms = recovery;
+        if (recovery > r->longest_recovery_ms) {
+            r->longest_recovery_ms = recovery;
+        }
+    }
+    r->up = true;
+    r->ever_up = true;
+    r->attempt = 0;
+    return recovery;
+}
+
+reconnect_stats_t reconnect_get_stats(const reconnect_t *r, uint32_t now_ms)
+{
+    reconnect_stats_t stats = {
+        .up = r->up,
+        .outages = r->outages,
+        .attempts = r->attempts,
+        .downtime_ms = r->downtime_ms,
+        .last_recovery_ms = r->last_recovery_ms,
+        .longest_recovery_ms = r->longest_recovery_ms,
+    };
+    if (!r->up && r->ever_up) {
+        stats.downtime_ms += now_ms - r->down_since_ms;
+    }
+    return stats;
+}
@@ -0,0 +1,142 @@
+#include "config.h"
+
+#if defined(DEVICE_TYPE_TEMP_SENSOR) && defined(TEMP_REPORT_BY_EXCEPTION)
+
+#include <string.h>
+#include "report_control.h"
+#include "esp_log.h"
+#include "freertos/semphr.h"
+#include "mqtt_manager.h"
+#include "mqtt_router.h"
+#include "nvs.h"
+
+static const char *TAG = "REPORT_CTRL";
+
+#define REPORT_NVS_NAMESPACE    "report"
+#define REPORT_NVS_KEY          "config"
+#define REPORT_VERSION          1
+
+// Layout of the NVS blob; the version guards against a changed layout
+typedef struct {
+    uint8_t version;
+    report_config_t config;
+} report_record_t;
+
+static report_config_t config;
+static SemaphoreHandle_t config_mutex = NULL;
+static SemaphoreHandle_t changed = NULL;
+
+static bool config_load(report_config_t *cfg)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(REPORT_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+
+    report_record_t record;
+    size_t len = sizeof(record);
+    esp_err_t err = nvs_get_blob(nvs, REPORT_NVS_KEY, &record, &len);
+    nvs_close(nvs);
+
+    if (err != ESP_OK || len != sizeof(record) || record.version != REPORT_VERSION
+        || !report_config_valid(&record.config)) {
+        return false;
+    }
+    *cfg = record.config;
+    return true;
+}
+
+static void config_save(const report_config_t *cfg)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(REPORT_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot keep report settings: %s", esp_err_to_name(err));
+        return;
+    }
+
+    report_record_t record = { .version = REPORT_VERSION, .config = *cfg };
+    err = nvs_set_blob(nvs, REPORT_NVS_KEY, &record, sizeof(record));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot keep report settings: %s", esp_err_to_name(err));
+    }
+}
+
+static void handle_report_set(const char *data, int data_len, void *ctx)
+{
+    xSemaphoreTake(config_mutex, portMAX_DELAY);
+    report_config_t next = config;
+    esp_err_t ret = report_config_apply(&next, data, (size_t)data_len);
+    if (ret == ESP_OK) {
+        config = next;
+    }
+    xSemaphoreGive(config_mutex);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring report settings '%.*s'", data_len, data);
+    } else {
+        ESP_LOGI(TAG, "Report settings '%.*s' applied", data_len, data);
+        config_save(&next);
+        xSemaphoreGive(changed);
+    }
+    report_control_publish();
+}
+
+esp_err_t report_control_init(void)
+{
+    if (config_mutex == NULL) {
+        config_mutex = xSemaphoreCreateMutex();
+        changed = xSemaphoreCreateBinary();
+        if (config_mutex == NULL || changed == NULL) {
+            ESP_LOGE(TAG, "Failed to create report settings locks");
+            return ESP_ERR_NO_MEM;
+        }
+        if (!config_load(&config)) {
+            report_config_defaults(&config);
+        }
+    }
+
+    esp_err_t ret = mqtt_router_register(MQTT_TOPIC_REPORT_SET, handle_report_set, NULL);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", MQTT_TOPIC_REPORT_SET, esp_err_to_name(ret));
+        return ret;
+    }
+    return ESP_OK;
+}
+
+void report_control_get(report_config_t *cfg)
+{
+    xSemaphoreTake(config_mutex, portMAX_DELAY);
+    *cfg = config;
+    xSemaphoreGive(config_mutex);
+}
+
+bool report_control_wait(TickType_t ticks)
+{
+    return xSemaphoreTake(changed, ticks) == pdTRUE;
+}
+
+esp_err_t report_control_publish(void)
+{
+    esp_mqtt_client_handle_t client = mqtt_get_client();
+    if (client == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    report_config_t cfg;
+    report_control_get(&cfg);
+    char payload[160];
+    size_t len = report_config_encode_json(&cfg, payload, sizeof(payload));
+    if (len == 0 || mqtt_publish(client, MQTT_TOPIC_REPORT_CONFIG, payload, (int)len, 1, 1) < 0) {
+        ESP_LOGW(TAG, "Failed to publish report settings");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+#endif // DEVICE_TYPE_TEMP_SENSOR && TEMP_REPORT_BY_EXCEPTION
@@ -0,0 +1,277 @@
+#include "config.h"
+
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "report_policy.h"
+
+#define REPORT_INTERVAL_MIN_MS      1000
+#define REPORT_INTERVAL_MAX_MS      86400000u   // A day
+#define REPORT_DEADBAND_MAX         1000.0f
+#define REPORT_KEY_MAX              16
+
+void report_config_defaults(report_config_t *cfg)
+{
+    cfg->temperature = REPORT_DEADBAND_TEMP_C;
+    cfg->humidity = REPORT_DEADBAND_HUMIDITY;
+    cfg->pressure = REPORT_DEADBAND_PRESSURE_HPA;
+    cfg->max_silence_ms = REPORT_MAX_SILENCE_MS;
+    cfg->min_interval_ms = REPORT_MIN_INTERVAL_MS;
+    cfg->max_interval_ms = REPORT_MAX_INTERVAL_MS;
+}
+
+static bool deadband_valid(float deadband)
+{
+    return deadband >= 0.0f && deadband <= REPORT_DEADBAND_MAX;
+}
+
+bool report_config_valid(const report_config_t *cfg)
+{
+    return deadband_valid(cfg->temperature) && deadband_valid(cfg->humidity) && deadband_valid(cfg->pressure)
+        && cfg->min_interval_ms >= REPORT_INTERVAL_MIN_MS
+        && cfg->min_interval_ms <= cfg->max_interval_ms
+        && cfg->max_interval_ms <= cfg->max_silence_ms
+        && cfg->max_silence_ms <= REPORT_INTERVAL_MAX_MS;
+}
+
+static void trim(const char **s, size_t *len)
+{
+    while (*len > 0 && isspace((unsigned char)**s)) {
+        (*s)++;
+        (*len)--;
+    }
+    while (*len > 0 && isspace((unsigned char)(*s)[*len - 1])) {
+        (*len)--;
+    }
+}
+
+// Parse the whole of value as a number; strtof needs a NUL-terminated copy
+static bool parse_number(const char *value, size_t len, float *out)
+{
+    char buf[24];
+    if (len == 0 || len >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, value, len);
+    buf[len] = '\0';
+    char *end;
+    float v = strtof(buf, &end);
+    if (*end != '\0' || !isfinite(v)) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static bool parse_seconds(const char *value, size_t len, uint32_t *ms)
+{
+    float s;
+    if (!parse_number(value, len, &s) || s < 0.0f || s > REPORT_INTERVAL_MAX_MS / 1000 || s != floorf(s)) {
+        return false;
+    }
+    *ms = (uint32_t)s * 1000;
+    return true;
+}
+
+/**
+ * @brief Apply one "key=value" entry to cfg
+ */
+static bool apply_entry(report_config_t *cfg, const char *entry, size_t len)
+{
+    const char *eq = memchr(entry, '=', len);
+    if (eq == NULL) {
+        return false;
+    }
+    const char *key = entry;
+    size_t key_len = (size_t)(eq - entry);
+    const char *value = eq + 1;
+    size_t value_len = len - key_len - 1;
+    trim(&key, &key_len);
+    trim(&value, &value_len);
+    if (key_len == 0 || key_len >= REPORT_KEY_MAX) {
+        return false;
+    }
+
+    char name[REPORT_KEY_MAX];
+    memcpy(name, key, key_len);
+    name[key_len] = '\0';
+
+    if (strcasecmp(name, "temperature") == 0) {
+        return parse_number(value, value_len, &cfg->temperature);
+    }
+    if (strcasecmp(name, "humidity") == 0) {
+        return parse_number(value, value_len, &cfg->humidity);
+    }
+    if (strcasecmp(name, "pressure") == 0) {
+        return parse_number(value, value_len, &cfg->pressure);
+    }
+    if (strcasecmp(name, "max_silence") == 0) {
+        return parse_seconds(value, value_len, &cfg->max_silence_ms);
+    }
+    if (strcasecmp(name, "min_interval") == 0) {
+        return parse_seconds(value, value_len, &cfg->min_interval_ms);
+    }
+    if (strcasecmp(name, "max_interval") == 0) {
+        return parse_seconds(value, value_len, &cfg->max_interval_ms);
+    }
+    return false;
+}
+
+esp_err_t report_config_apply(report_config_t *cfg, const char *data, size_t len)
+{
+    const char *msg = data;
+    size_t msg_len = len;
+    trim(&msg, &msg_len);
+    if (msg_len == strlen("defaults") && strncasecmp(msg, "defaults", msg_len) == 0) {
+        report_config_defaults(cfg);
+        return ESP_OK;
+    }
+
+    report_config_t next = *cfg;
+    size_t start = 0;
+    while (start <= len) {
+        const char *comma = memchr(data + start, ',', len - start);
+        size_t end = comma != NULL ? (size_t)(comma - data) : len;
+        const char *entry = data + start;
+        size_t entry_len = end - start;
+        trim(&entry, &entry_len);
+        if (entry_len > 0 && !apply_entry(&next, entry, entry_len)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        start = end + 1;
+    }
+    if (!report_config_valid(&next)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *cfg = next;
+    return ESP_OK;
+}
+
+size_t report_config_encode_json(const report_config_t *cfg, char *buf, size_t len)
+{
+    int n = snprintf(buf, len,
+                     "{\"temperature\":%.2f,\"humidity\":%.2f,\"pressure\":%.2f,"
+                     "\"max_silence\":%lu,\"min_interval\":%lu,\"max_interval\":%lu}",
+                     cfg->temperature, cfg->humidity, cfg->pressure,
+                     (unsigned long)(cfg->max_silence_ms / 1000), (unsigned long)(cfg->min_interval_ms / 1000),
+                     (unsigned long)(cfg->max_interval_ms / 1000));
+    return n > 0 && (size_t)n < len ? (size_t)n : 0;
+}
+
+// Quantity q (SENSOR_HAS_* bit q) of a reading and its deadband
+static float quantity(const sensor_data_t *d, int q)
+{
+    switch (q) {
+        case 0:  return d->temperature;
+        case 1:  return d->humidity;
+        default: return d->pressure;
+    }
+}
+
+static float deadband(const report_config_t *cfg, int q)
+{
+    switch (q) {
+        case 0:  return cfg->temperature;
+        case 1:  return cfg->humidity;
+        default: return cfg->pressure;
+    }
+}
+
+// Readings are in hundredths: compare there, so 21.70 - 21.50 counts as 0.20
+static bool moved(float from, float to, float band)
+{
+    return lroundf(fabsf(to - from) * 100.0f) >= lroundf(band * 100.0f);
+}
+
+void report_state_init(report_state_t *st, const report_config_t *cfg)
+{
+    memset(st, 0, sizeof(*st));
+    st->interval_ms = cfg->min_interval_ms;
+}
+
+void report_state_reconfigure(report_state_t *st, const report_config_t *cfg)
+{
+    st->interval_ms = cfg->min_interval_ms;
+}
+
+/**
+ * @brief Sampling interval from the rate of change since the previous sample
+ *
+ * Half the time the fastest quantity needs to cross its deadband at that
+ * rate. Shortening takes effect at once, lengthening at most doubles.
+ */
+static void adapt_interval(report_state_t *st, const report_config_t *cfg, const sensor_data_t *d, uint32_t now_ms)
+{
+    uint32_t elapsed_ms = now_ms - st->previous_ms;
+    float target_ms = (float)cfg->max_interval_ms;
+    for (int q = 0; q < REPORT_QUANTITIES; q++) {
+        float band = deadband(cfg, q);
+        float delta = fabsf(quantity(d, q) - st->previous[q]);
+        if (!(d->fields & (1u << q)) || band <= 0.0f || delta <= 0.0f) {
+            continue;
+        }
+        float cross_ms = band * (float)elapsed_ms / delta;
+        if (cross_ms / 2.0f < target_ms) {
+            target_ms = cross_ms / 2.0f;
+        }
+    }
+
+    uint32_t target = target_ms <= (float)cfg->min_interval_ms ? cfg->min_interval_ms : (uint32_t)target_ms;
+    if (target > st->interval_ms) {
+        uint32_t doubled = st->interval_ms > cfg->max_interval_ms / 2 ? cfg->max_interval_ms : st->interval_ms * 2;
+        target = target < doubled ? target : doubled;
+    }
+    st->interval_ms = target;
+}
+
+report_reason_t report_on_sample(report_state_t *st, const report_config_t *cfg, const sensor_data_t *d,
+                                 uint32_t now_ms)
+{
+    if (st->sampled) {
+        adapt_interval(st, cfg, d, now_ms);
+    }
+    st->sampled = true;
+    st->previous_ms = now_ms;
+    for (int q = 0; q < REPORT_QUANTITIES; q++) {
+        st->previous[q] = quantity(d, q);
+    }
+
+    if (!st->reported) {
+        return REPORT_FIRST;
+    }
+    for (int q = 0; q < REPORT_QUANTITIES; q++) {
+        if ((d->fields & (1u << q)) && moved(st->last[q], quantity(d, q), deadband(cfg, q))) {
+            return REPORT_DEADBAND;
+        }
+    }
+    if (now_ms - st->last_report_ms >= cfg->max_silence_ms) {
+        return REPORT_SILENCE;
+    }
+    return REPORT_NONE;
+}
+
+void report_on_published(report_state_t *st, const sensor_data_t *d, uint32_t now_ms)
+{
+    st->reported = true;
+    st->last_report_ms = now_ms;
+    for (int q = 0; q < REPORT_QUANTITIES; q++) {
+        st->last[q] = quantity(d, q);
+    }
+}
+
+uint32_t report_next_sample_ms(const report_state_t *st, const report_config_t *cfg, uint32_t now_ms)
+{
+    if (!st->reported) {
+        return st->interval_ms;
+    }
+    uint32_t silent_ms = now_ms - st->last_report_ms;
+    uint32_t until_silence = silent_ms >= cfg->max_silence_ms ? 0 : cfg->max_silence_ms - silent_ms;
+    return until_silence < st->interval_ms ? until_silence : st->interval_ms;
+}
+
+#endif // DEVICE_TYPE_TEMP_SENSOR
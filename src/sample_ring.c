@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include "sample_ring.h"
+
+void sample_ring_init(sample_ring_t *ring, sensor_sample_t *storage, uint16_t capacity)
+{
+    ring->slots = storage;
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->count = 0;
+    ring->dropped = 0;
+}
+
+void sample_ring_push(sample_ring_t *ring, const sensor_sample_t *sample)
+{
+    if (ring->capacity == 0) {
+        return;
+    }
+
+    if (ring->count == ring->capacity) {
+        // Full: overwrite the oldest
+        ring->slots[ring->head] = *sample;
+        ring->head = (uint16_t)((ring->head + 1) % ring->capacity);
+        ring->dropped++;
+        return;
+    }
+
+    ring->slots[(ring->head + ring->count) % ring->capacity] = *sample;
+    ring->count++;
+}
+
+const sensor_sample_t *sample_ring_at(const sample_ring_t *ring, uint16_t index)
+{
+    if (index >= ring->count) {
+        return NULL;
+    }
+    return &ring->slots[(ring->head + index) % ring->capacity];
+}
+
+void sample_ring_consume(sample_ring_t *ring, uint16_t n)
+{
+    if (n > ring->count) {
+        n = ring->count;
+    }
+    ring->head = (uint16_t)((ring->head + n) % ring->capacity);
+    ring->count = (uint16_t)(ring->count - n);
+}
+
+size_t sample_ring_encode_json(const sample_ring_t *ring, uint32_t now_ms, char *buf, size_t len,
+                               uint16_t *encoded)
+{
+    uint16_t written = 0;
+    size_t pos;
+    int n;
+
+    if (encoded != NULL) {
+        *encoded = 0;
+    }
+
+    n = snprintf(buf, len, "{\"now\":%lu,\"s\":[", (unsigned long)now_ms);
+    if (n < 0 || (size_t)n + 3 > len) {
+        return 0;
+    }
+    pos = (size_t)n;
+
+    for (uint16_t i = 0; i < ring->count; i++) {
+        const sensor_sample_t *s = sample_ring_at(ring, i);
+        // Reserve two bytes for the closing "]}"
+        size_t room = len - pos;
+        n = snprintf(buf + pos, room, "%s[%lu,%.2f,%.2f]", written ? "," : "",
+                     (unsigned long)s->timestamp_ms, s->temperature, s->humidity);
+        if (n < 0 || (size_t)n + 2 >= room) {
+            break;
+        }
+        pos += (size_t)n;
+        written++;
+    }
+
+    buf[pos++] = ']';
+    buf[pos++] = '}';
+    buf[pos] = '\0';
+
+    if (encoded != NULL) {
+        *encoded = written;
+    }
+    return pos;
+}
@@ -0,0 +1,105 @@
+#include "config.h"
+
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+
+#include "sensor_driver.h"
+#include "sensor_convert.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "AHT20";
+
+// AHT20 commands
+#define AHT20_CMD_INIT      0xBE
+#define AHT20_CMD_TRIGGER   0xAC
+#define AHT20_CMD_SOFTRESET 0xBA
+
+// AHT20 status bits
+#define AHT20_STATUS_BUSY   0x80
+
+// Blocking transactions during bring-up
+#define AHT20_I2C_TIMEOUT_MS 1000
+
+static esp_err_t aht20_init(i2c_master_dev_handle_t dev, uint8_t *calib)
+{
+    (void)calib;
+    ESP_LOGI(TAG, "Initializing AHT20...");
+
+    vTaskDelay(pdMS_TO_TICKS(40)); // Wait for sensor to be ready
+
+    // Send soft reset
+    uint8_t reset_cmd = AHT20_CMD_SOFTRESET;
+    esp_err_t ret = i2c_master_transmit(dev, &reset_cmd, 1, AHT20_I2C_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "AHT20 soft reset failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(20));
+
+    // Initialize sensor
+    uint8_t init_cmd[3] = {AHT20_CMD_INIT, 0x08, 0x00};
+    ret = i2c_master_transmit(dev, init_cmd, 3, AHT20_I2C_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "AHT20 init failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(10));
+
+    ESP_LOGI(TAG, "AHT20 initialized successfully!");
+    return ESP_OK;
+}
+
+static uint8_t aht20_crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static esp_err_t aht20_decode(const uint8_t *calib, const uint8_t *data, int32_t *out)
+{
+    (void)calib;
+    if (data[0] & AHT20_STATUS_BUSY) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+    if (aht20_crc8(data, 6) != data[6]) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Calculate humidity
+    uint32_t raw_humidity = ((uint32_t)data[1] << 12) | ((uint32_t)data[2] << 4) | ((data[3] >> 4) & 0x0F);
+    out[SENSOR_CH_HUMIDITY] = aht20_humidity_centi(raw_humidity);
+
+    // Calculate temperature
+    uint32_t raw_temp = (((uint32_t)data[3] & 0x0F) << 16) | ((uint32_t)data[4] << 8) | data[5];
+    out[SENSOR_CH_TEMPERATURE] = aht20_temperature_centi(raw_temp);
+
+    return ESP_OK;
+}
+
+// The datasheet allows 80 ms per conversion; most finish sooner
+const sensor_driver_t sensor_aht20_driver = {
+    .name = "AHT20",
+    .fields = SENSOR_HAS_TEMPERATURE | SENSOR_HAS_HUMIDITY,
+    .first_poll_us = 40000,
+    .poll_interval_us = 5000,
+    .deadline_us = 150000,
+    .trigger = { AHT20_CMD_TRIGGER, 0x33, 0x00 },
+    .trigger_len = 3,
+    .status_reg = -1,
+    .busy_mask = AHT20_STATUS_BUSY,
+    .frame_reg = -1,
+    .frame_len = 7,
+    .init = aht20_init,
+    .decode = aht20_decode,
+};
+
+#endif // DEVICE_TYPE_TEMP_SENSOR
@@ -0,0 +1,173 @@
+#include "config.h"
+
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+
+#include "sensor_driver.h"
+#include "sensor_convert.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "BMP280";
+
+// BMP280 registers
+#define BMP280_REG_CALIB    0x88
+#define BMP280_REG_CHIP_ID  0xD0
+#define BMP280_REG_RESET    0xE0
+#define BMP280_REG_STATUS   0xF3
+#define BMP280_REG_CTRL     0xF4
+#define BMP280_REG_CONFIG   0xF5
+#define BMP280_REG_DATA     0xF7
+
+#define BMP280_CHIP_ID          0x58
+#define BMP280_RESET_VALUE      0xB6
+#define BMP280_STATUS_MEASURING 0x08
+#define BMP280_CALIB_LEN        24
+#define BMP280_ADC_SKIPPED      0x80000     // Data register value when nothing was measured
+
+// Forced mode at standard resolution: temperature x1, pressure x4.
+// 11.5 ms typical, 13.3 ms at most per conversion.
+#define BMP280_CTRL_FORCED  ((1 << 5) | (3 << 2) | 1)
+
+// Blocking transactions during bring-up
+#define BMP280_I2C_TIMEOUT_MS 1000
+
+static esp_err_t bmp280_init(i2c_master_dev_handle_t dev, uint8_t *calib)
+{
+    ESP_LOGI(TAG, "Initializing BMP280...");
+
+    uint8_t reg = BMP280_REG_CHIP_ID;
+    uint8_t chip_id = 0;
+    esp_err_t ret = i2c_master_transmit_receive(dev, &reg, 1, &chip_id, 1, BMP280_I2C_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "BMP280 chip ID read failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    if (chip_id != BMP280_CHIP_ID) {
+        ESP_LOGE(TAG, "Unexpected chip ID 0x%02X (BMP280 is 0x%02X)", chip_id, BMP280_CHIP_ID);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint8_t reset_cmd[2] = {BMP280_REG_RESET, BMP280_RESET_VALUE};
+    ret = i2c_master_transmit(dev, reset_cmd, sizeof(reset_cmd), BMP280_I2C_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "BMP280 soft reset failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(10));  // Start-up time is 2 ms; a tick is 10
+
+    // Trimming parameters, decoded on every reading
+    reg = BMP280_REG_CALIB;
+    ret = i2c_master_transmit_receive(dev, &reg, 1, calib, BMP280_CALIB_LEN, BMP280_I2C_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "BMP280 calibration read failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // IIR filter off: each forced conversion stands on its own
+    uint8_t config_cmd[2] = {BMP280_REG_CONFIG, 0x00};
+    ret = i2c_master_transmit(dev, config_cmd, sizeof(config_cmd), BMP280_I2C_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "BMP280 config failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "BMP280 initialized successfully!");
+    return ESP_OK;
+}
+
+static uint16_t calib_u16(const uint8_t *calib, int index)
+{
+    return (uint16_t)(calib[index * 2] | (calib[index * 2 + 1] << 8));
+}
+
+static int16_t calib_s16(const uint8_t *calib, int index)
+{
+    return (int16_t)calib_u16(calib, index);
+}
+
+/*
+ * Integer compensation from the BMP280 datasheet (section 8.2): temperature
+ * in hundredths of a degree, pressure in 1/256 Pa. Shifts of negative
+ * intermediates are written as multiplications.
+ */
+static int32_t bmp280_compensate_t(const uint8_t *calib, int32_t adc_t, int32_t *t_fine)
+{
+    int32_t t1 = calib_u16(calib, 0);
+    int32_t t2 = calib_s16(calib, 1);
+    int32_t t3 = calib_s16(calib, 2);
+
+    int32_t var1 = (((adc_t >> 3) - (t1 * 2)) * t2) >> 11;
+    int32_t var2 = (((((adc_t >> 4) - t1) * ((adc_t >> 4) - t1)) >> 12) * t3) >> 14;
+    *t_fine = var1 + var2;
+    return (*t_fine * 5 + 128) >> 8;
+}
+
+static uint32_t bmp280_compensate_p(const uint8_t *calib, int32_t adc_p, int32_t t_fine)
+{
+    int64_t p1 = calib_u16(calib, 3);
+    int64_t p2 = calib_s16(calib, 4);
+    int64_t p3 = calib_s16(calib, 5);
+    int64_t p4 = calib_s16(calib, 6);
+    int64_t p5 = calib_s16(calib, 7);
+    int64_t p6 = calib_s16(calib, 8);
+    int64_t p7 = calib_s16(calib, 9);
+    int64_t p8 = calib_s16(calib, 10);
+    int64_t p9 = calib_s16(calib, 11);
+
+    int64_t var1 = (int64_t)t_fine - 128000;
+    int64_t var2 = var1 * var1 * p6;
+    var2 = var2 + var1 * p5 * ((int64_t)1 << 17);
+    var2 = var2 + p4 * ((int64_t)1 << 35);
+    var1 = ((var1 * var1 * p3) >> 8) + var1 * p2 * ((int64_t)1 << 12);
+    var1 = ((((int64_t)1 << 47) + var1) * p1) >> 33;
+    if (var1 == 0) {
+        return 0;   // Would divide by zero (blank calibration)
+    }
+
+    int64_t p = 1048576 - adc_p;
+    p = ((p * ((int64_t)1 << 31)) - var2) * 3125 / var1;
+    var1 = (p9 * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (p8 * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + p7 * 16;
+    return (uint32_t)p;
+}
+
+static esp_err_t bmp280_decode(const uint8_t *calib, const uint8_t *data, int32_t *out)
+{
+    int32_t adc_p = (int32_t)(((uint32_t)data[0] << 12) | ((uint32_t)data[1] << 4) | (data[2] >> 4));
+    int32_t adc_t = (int32_t)(((uint32_t)data[3] << 12) | ((uint32_t)data[4] << 4) | (data[5] >> 4));
+    if (adc_t == BMP280_ADC_SKIPPED || adc_p == BMP280_ADC_SKIPPED) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    int32_t t_fine;
+    int32_t centi_c = bmp280_compensate_t(calib, adc_t, &t_fine);
+    uint32_t q8_pa = bmp280_compensate_p(calib, adc_p, t_fine);
+    if (q8_pa == 0) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    out[SENSOR_CH_TEMPERATURE] = centi_c;
+    out[SENSOR_CH_PRESSURE] = bmp280_pressure_centi(q8_pa);
+    return ESP_OK;
+}
+
+const sensor_driver_t sensor_bmp280_driver = {
+    .name = "BMP280",
+    .fields = SENSOR_HAS_TEMPERATURE | SENSOR_HAS_PRESSURE,
+    .first_poll_us = 10000,
+    .poll_interval_us = 2000,
+    .deadline_us = 50000,
+    .trigger = { BMP280_REG_CTRL, BMP280_CTRL_FORCED },
+    .trigger_len = 2,
+    .status_reg = BMP280_REG_STATUS,
+    .busy_mask = BMP280_STATUS_MEASURING,
+    .frame_reg = BMP280_REG_DATA,
+    .frame_len = 6,
+    .init = bmp280_init,
+    .decode = bmp280_decode,
+};
+
+#endif // DEVICE_TYPE_TEMP_SENSOR
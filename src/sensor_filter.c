@@ -0,0 +1,88 @@
+#include <string.h>
+#include "sensor_filter.h"
+
+#define EMA_FRAC_BITS 8
+
+// Integer division rounding halves away from zero
+static int32_t div_round(int32_t num, int32_t den)
+{
+    return num >= 0 ? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+void sensor_filter_init(sensor_filter_t *f, uint8_t median_window, uint8_t ema_shift)
+{
+    if (median_window > SENSOR_FILTER_WINDOW_MAX) {
+        median_window = SENSOR_FILTER_WINDOW_MAX;
+    }
+    if (median_window % 2 == 0) {
+        median_window = median_window > 0 ? median_window - 1 : 1;
+    }
+    f->median_window = median_window;
+    f->ema_shift = ema_shift > SENSOR_FILTER_EMA_SHIFT_MAX ? SENSOR_FILTER_EMA_SHIFT_MAX : ema_shift;
+    sensor_filter_reset(f);
+}
+
+void sensor_filter_reset(sensor_filter_t *f)
+{
+    f->count = 0;
+    f->next = 0;
+    f->ema_valid = false;
+    f->ema = 0;
+    memset(f->window, 0, sizeof(f->window));
+}
+
+/**
+ * @brief Median of the samples in the window
+ *
+ * Until the window fills, the median of what is there (the mean of the
+ * middle two for an even count). Insertion sort: nine entries at most.
+ */
+static int32_t window_median(const sensor_filter_t *f)
+{
+    int32_t sorted[SENSOR_FILTER_WINDOW_MAX];
+    for (uint8_t i = 0; i < f->count; i++) {
+        int32_t v = f->window[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    if (f->count % 2 == 1) {
+        return sorted[f->count / 2];
+    }
+    return div_round(sorted[f->count / 2 - 1] + sorted[f->count / 2], 2);
+}
+
+int32_t sensor_filter_update(sensor_filter_t *f, int32_t value)
+{
+    if (f->median_window > 1) {
+        f->window[f->next] = value;
+        f->next = (uint8_t)((f->next + 1) % f->median_window);
+        if (f->count < f->median_window) {
+            f->count++;
+        }
+        value = window_median(f);
+    }
+
+    if (f->ema_shift == 0) {
+        return value;
+    }
+
+    // The EMA keeps 8 fractional bits, so a steady input converges exactly:
+    // the truncated step leaves less than half a unit behind
+    int32_t scaled = value * (1 << EMA_FRAC_BITS);
+    if (!f->ema_valid) {
+        f->ema = scaled;
+        f->ema_valid = true;
+    } else {
+        f->ema += (scaled - f->ema) / (1 << f->ema_shift);
+    }
+    return div_round(f->ema, 1 << EMA_FRAC_BITS);
+}
+
+int32_t sensor_filter_average(int32_t sum, uint32_t n)
+{
+    return n > 1 ? div_round(sum, (int32_t)n) : sum;
+}
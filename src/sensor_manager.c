@@ -0,0 +1,615 @@
+#include "config.h"
+
+#ifdef DEVICE_TYPE_TEMP_SENSOR
+
+#include <string.h>
+#include "sensor_manager.h"
+#include "sensor_driver.h"
+#include "sensor_filter.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/i2c_master.h"
+#include "i2c_topology.h"
+#include "latency_trace.h"
+#include "dlog.h"
+
+static const char *TAG = "SENSORS";
+
+// Every sensor can have one transaction queued at a time
+#define I2C_TRANS_QUEUE_DEPTH   SENSOR_MAX_COUNT
+
+// Bus timeout of a status poll or frame read
+#define SENSOR_POLL_I2C_TIMEOUT_MS  10
+
+// Slack on top of the slowest deadline for esp_timer latency
+#define SENSOR_COLLECT_MARGIN_MS    50
+
+_Static_assert(SENSOR_OVERSAMPLE >= 1 && SENSOR_OVERSAMPLE <= 16, "SENSOR_OVERSAMPLE must be 1 to 16");
+
+/*
+ * Measurements run as a small state machine per sensor on an esp_timer
+ * instead of a fixed delay: trigger, wait the shortest conversion time, then
+ * poll the status until the busy flag clears and read the frame. A busy
+ * sensor or a failed poll is retried until the deadline, so a slow
+ * conversion costs latency rather than the sample. The caller's task is free
+ * while the conversions run, and the sensors convert at the same time.
+ *
+ * Bus transactions are asynchronous: the completion callback (interrupt
+ * context) only records the outcome and kicks the timer, so every state
+ * change happens in the esp_timer task.
+ *
+ * With SENSOR_OVERSAMPLE above 1 the machine triggers the next conversion
+ * as soon as a frame is decoded, and sums the fixed-point values. Averaging
+ * and filtering happen when the sample is collected.
+ */
+typedef enum {
+    SENSOR_IDLE,
+    SENSOR_TRIGGERING,  // Trigger command on the bus
+    SENSOR_CONVERTING,  // Waiting for the next poll
+    SENSOR_POLLING,     // Status read on the bus
+    SENSOR_READING,     // Frame read on the bus
+    SENSOR_DONE,
+} sensor_state_t;
+
+typedef struct {
+    const sensor_config_t *config;
+    const sensor_driver_t *driver;
+    i2c_master_dev_handle_t dev;
+    bool initialized;
+    volatile sensor_state_t state;
+    esp_timer_handle_t timer;
+    SemaphoreHandle_t done;
+    int64_t deadline_us;
+    volatile esp_err_t xfer_result;     // Outcome of the last bus transaction
+    uint8_t tx[SENSOR_TRIGGER_MAX];     // Buffers must outlive the async transaction
+    uint8_t reg;
+    uint8_t rx[SENSOR_FRAME_MAX];
+    uint8_t calib[SENSOR_CALIB_MAX];
+    uint8_t conversions;                // Started in this sample
+    uint8_t converted;                  // Decoded in this sample
+    int32_t sum[SENSOR_CHANNELS];       // Of the decoded conversions, fixed point
+    sensor_filter_t filters[SENSOR_CHANNELS];
+    esp_err_t result;
+    sensor_data_t reading;
+    uint32_t busy_polls;    // Polls that found a conversion still running (since boot)
+} sensor_t;
+
+typedef struct {
+    i2c_master_bus_handle_t handle;
+    i2c_topology_t devices;             // Found at boot (or by the last rescan)
+    uint8_t expected[SENSOR_MAX_COUNT]; // Addresses SENSOR_TABLE puts on this bus
+    size_t expected_count;
+} sensor_bus_t;
+
+static const sensor_config_t sensor_table[] = SENSOR_TABLE;
+#define SENSOR_COUNT (sizeof(sensor_table) / sizeof(sensor_table[0]))
+_Static_assert(SENSOR_COUNT >= 1 && SENSOR_COUNT <= SENSOR_MAX_COUNT, "SENSOR_TABLE needs 1 to 8 sensors");
+
+// Pins of I2C_NUM_0 and I2C_NUM_1 (the ESP32 has two controllers)
+static const struct {
+    int sda;
+    int scl;
+} bus_pins[I2C_NUM_MAX] = {
+    { I2C_SDA_PIN, I2C_SCL_PIN },
+    { I2C1_SDA_PIN, I2C1_SCL_PIN },
+};
+
+// Bus and device handles live for the lifetime of the firmware, so sampling
+// does no heap allocation
+static sensor_bus_t buses[I2C_NUM_MAX];
+static sensor_t sensors[SENSOR_COUNT];
+
+static const sensor_driver_t *driver_for(sensor_type_t type)
+{
+    switch (type) {
+        case SENSOR_AHT20:  return &sensor_aht20_driver;
+        case SENSOR_BMP280: return &sensor_bmp280_driver;
+        default:            return NULL;
+    }
+}
+
+static esp_err_t bus_init(int port)
+{
+    i2c_master_bus_config_t bus_config = {
+        .i2c_port = port,
+        .sda_io_num = bus_pins[port].sda,
+        .scl_io_num = bus_pins[port].scl,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .trans_queue_depth = I2C_TRANS_QUEUE_DEPTH,
+        .flags.enable_internal_pullup = true,
+    };
+
+    esp_err_t err = i2c_new_master_bus(&bus_config, &buses[port].handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "I2C bus %d init failed: %s", port, esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "I2C bus %d initialized on SDA=%d, SCL=%d", port, bus_pins[port].sda, bus_pins[port].scl);
+    return ESP_OK;
+}
+
+static esp_err_t bus_discover(int port, bool force_scan)
+{
+    sensor_bus_t *bus = &buses[port];
+    return i2c_topology_discover(bus->handle, port, bus->expected, bus->expected_count, force_scan,
+                                 &bus->devices, NULL);
+}
+
+static void sensor_finish(sensor_t *s, esp_err_t result)
+{
+    s->result = result;
+    s->state = SENSOR_DONE;
+    xSemaphoreGive(s->done);
+}
+
+// End the sample: it succeeds if any conversion was decoded, even when the
+// last one failed with err
+static void sensor_complete(sensor_t *s, esp_err_t err)
+{
+    if (s->converted == 0) {
+        sensor_finish(s, err);
+        return;
+    }
+    LATENCY_TRACE_RECORD(LATENCY_SENSOR_CONVERTED, s->reading.trigger_us);
+    sensor_finish(s, ESP_OK);
+}
+
+// Send the trigger of the next conversion in the sample
+static esp_err_t sensor_trigger(sensor_t *s)
+{
+    s->deadline_us = esp_timer_get_time() + s->driver->deadline_us;
+    s->conversions++;
+    memcpy(s->tx, s->driver->trigger, s->driver->trigger_len);
+
+    // Set before queueing: the completion may run before transmit returns
+    s->state = SENSOR_TRIGGERING;
+    return i2c_master_transmit(s->dev, s->tx, s->driver->trigger_len, SENSOR_POLL_I2C_TIMEOUT_MS);
+}
+
+// A frame was read: add it to the sample, then convert again or finish
+static void sensor_converted(sensor_t *s, esp_err_t result, const int32_t *value)
+{
+    if (result == ESP_OK) {
+        for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+            s->sum[ch] += value[ch];
+        }
+        s->converted++;
+    }
+    if (s->conversions < SENSOR_OVERSAMPLE) {
+        esp_err_t ret = sensor_trigger(s);
+        if (ret == ESP_OK) {
+            return;
+        }
+        ESP_LOGE(TAG, "%s trigger failed: %s", s->config->name, esp_err_to_name(ret));
+        result = ret;
+    }
+    sensor_complete(s, result);
+}
+
+// Poll again unless that would overrun the deadline
+static void sensor_retry(sensor_t *s, esp_err_t last_err)
+{
+    if (esp_timer_get_time() + s->driver->poll_interval_us > s->deadline_us) {
+        ESP_LOGW(TAG, "%s conversion not finished after %lld us", s->config->name,
+                 (long long)(esp_timer_get_time() - s->reading.trigger_us));
+        sensor_complete(s, last_err == ESP_OK ? ESP_ERR_TIMEOUT : last_err);
+        return;
+    }
+    s->state = SENSOR_CONVERTING;
+    esp_timer_start_once(s->timer, s->driver->poll_interval_us);
+}
+
+// Bus transaction finished (interrupt context): hand over to the timer task
+static bool sensor_on_trans_done(i2c_master_dev_handle_t i2c_dev, const i2c_master_event_data_t *evt_data, void *arg)
+{
+    sensor_t *s = (sensor_t *)arg;
+    (void)i2c_dev;
+
+    s->xfer_result = evt_data->event == I2C_EVENT_DONE ? ESP_OK : ESP_FAIL;
+    esp_timer_start_once(s->timer, 0);
+    return false;
+}
+
+// Queue an asynchronous read, from reg unless it is negative; a failed
+// submission counts as a failed poll
+static void sensor_receive(sensor_t *s, sensor_state_t state, int16_t reg, size_t len)
+{
+    s->state = state;
+    esp_err_t ret;
+    if (reg < 0) {
+        ret = i2c_master_receive(s->dev, s->rx, len, SENSOR_POLL_I2C_TIMEOUT_MS);
+    } else {
+        s->reg = (uint8_t)reg;
+        ret = i2c_master_transmit_receive(s->dev, &s->reg, 1, s->rx, len, SENSOR_POLL_I2C_TIMEOUT_MS);
+    }
+    if (ret != ESP_OK) {
+        sensor_retry(s, ret);
+    }
+}
+
+// esp_timer callback: advance the measurement by one step
+static void sensor_step(void *arg)
+{
+    sensor_t *s = (sensor_t *)arg;
+    const sensor_driver_t *drv = s->driver;
+    esp_err_t ret = s->xfer_result;
+    int32_t value[SENSOR_CHANNELS] = {0};
+
+    switch (s->state) {
+        case SENSOR_TRIGGERING:
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "%s trigger failed: %s", s->config->name, esp_err_to_name(ret));
+                sensor_complete(s, ret);
+                break;
+            }
+            s->state = SENSOR_CONVERTING;
+            esp_timer_start_once(s->timer, drv->first_poll_us);
+            break;
+
+        case SENSOR_CONVERTING:
+            sensor_receive(s, SENSOR_POLLING, drv->status_reg, 1);
+            break;
+
+        case SENSOR_POLLING:
+            if (ret == ESP_OK && !(s->rx[0] & drv->busy_mask)) {
+                sensor_receive(s, SENSOR_READING, drv->frame_reg, drv->frame_len);
+                break;
+            }
+            if (ret == ESP_OK) {
+                s->busy_polls++;
+            }
+            sensor_retry(s, ret);
+            break;
+
+        case SENSOR_READING:
+            if (ret == ESP_OK) {
+                ret = drv->decode(s->calib, s->rx, value);
+            }
+            if (ret == ESP_OK || ret == ESP_ERR_INVALID_CRC) {
+                sensor_converted(s, ret, value);
+                break;
+            }
+            sensor_retry(s, ret);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static esp_err_t sensor_attach(sensor_t *s)
+{
+    if (s->dev != NULL) {
+        return ESP_OK;
+    }
+    i2c_device_config_t dev_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = s->config->addr,
+        .scl_speed_hz = I2C_FREQ_HZ,
+    };
+    return i2c_master_bus_add_device(buses[s->config->port].handle, &dev_config, &s->dev);
+}
+
+// Switch the device to asynchronous transactions once the blocking init is done
+static esp_err_t sensor_enable_async(sensor_t *s)
+{
+    if (s->timer != NULL) {
+        return ESP_OK;
+    }
+
+    s->done = xSemaphoreCreateBinary();
+    if (s->done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = sensor_step,
+        .arg = s,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sensor_poll",
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &s->timer);
+    if (ret == ESP_OK) {
+        const i2c_master_event_callbacks_t callbacks = {
+            .on_trans_done = sensor_on_trans_done,
+        };
+        ret = i2c_master_register_event_callbacks(s->dev, &callbacks, s);
+        if (ret != ESP_OK) {
+            esp_timer_delete(s->timer);
+            s->timer = NULL;
+        }
+    }
+    if (ret != ESP_OK) {
+        vSemaphoreDelete(s->done);
+        s->done = NULL;
+    }
+    return ret;
+}
+
+static esp_err_t sensor_bring_up(sensor_t *s)
+{
+    const sensor_config_t *cfg = s->config;
+    if (buses[cfg->port].handle == NULL || !i2c_topology_has(&buses[cfg->port].devices, cfg->addr)) {
+        ESP_LOGW(TAG, "%s (%s at 0x%02X on bus %d) not found", cfg->name, s->driver->name, cfg->addr, cfg->port);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t ret = sensor_attach(s);
+    if (ret == ESP_OK) {
+        ret = s->driver->init(s->dev, s->calib);
+    }
+    if (ret == ESP_OK) {
+        ret = sensor_enable_async(s);
+    }
+    if (ret == ESP_OK) {
+        // Readings from before the sensor went missing say nothing about now
+        for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+            sensor_filter_reset(&s->filters[ch]);
+        }
+        s->initialized = true;
+        ESP_LOGI(TAG, "%s (%s at 0x%02X on bus %d) ready", cfg->name, s->driver->name, cfg->addr, cfg->port);
+    }
+    return ret;
+}
+
+static esp_err_t sensor_start(sensor_t *s)
+{
+    // Discard a result nobody collected
+    xSemaphoreTake(s->done, 0);
+
+    s->reading.trigger_us = esp_timer_get_time();
+    s->conversions = 0;
+    s->converted = 0;
+    memset(s->sum, 0, sizeof(s->sum));
+
+    esp_err_t ret = sensor_trigger(s);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s trigger failed: %s", s->config->name, esp_err_to_name(ret));
+        s->state = SENSOR_IDLE;
+    }
+    return ret;
+}
+
+// Average the sample's conversions, filter them and convert to the published units
+static void sensor_output(sensor_t *s, sensor_data_t *d)
+{
+    int32_t value[SENSOR_CHANNELS] = {0};
+    for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        if (d->fields & (1u << ch)) {
+            value[ch] = sensor_filter_update(&s->filters[ch], sensor_filter_average(s->sum[ch], s->converted));
+        }
+    }
+    // Single precision only: the ESP32 FPU has no double
+    d->temperature = (float)value[SENSOR_CH_TEMPERATURE] / 100.0f;
+    d->humidity = (float)value[SENSOR_CH_HUMIDITY] / 100.0f;
+    d->pressure = (float)value[SENSOR_CH_PRESSURE] / 100.0f;
+}
+
+static void log_reading(const sensor_data_t *d)
+{
+    if (d->fields & SENSOR_HAS_HUMIDITY) {
+        DLOGI(TAG, "%s - Temperature: %.2f°C, Humidity: %.2f%%", d->name, d->temperature, d->humidity);
+    } else if (d->fields & SENSOR_HAS_PRESSURE) {
+        DLOGI(TAG, "%s - Temperature: %.2f°C, Pressure: %.2f hPa", d->name, d->temperature, d->pressure);
+    } else {
+        DLOGI(TAG, "%s - Temperature: %.2f°C", d->name, d->temperature);
+    }
+}
+
+// Public API
+esp_err_t sensor_manager_init(void)
+{
+    ESP_LOGI(TAG, "Initializing %u sensor(s)...", (unsigned)SENSOR_COUNT);
+    ESP_LOGI(TAG, "Filtering: %d conversion(s) per sample, median of %d, EMA weight 1/%d",
+             SENSOR_OVERSAMPLE, SENSOR_MEDIAN_WINDOW, 1 << SENSOR_EMA_SHIFT);
+
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        sensor_t *s = &sensors[i];
+        const sensor_config_t *cfg = &sensor_table[i];
+        s->config = cfg;
+        s->driver = driver_for(cfg->type);
+        s->reading.name = cfg->name;
+        for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+            sensor_filter_init(&s->filters[ch], SENSOR_MEDIAN_WINDOW, SENSOR_EMA_SHIFT);
+        }
+        if (s->driver == NULL || cfg->port < 0 || cfg->port >= I2C_NUM_MAX || cfg->addr > 0x7F) {
+            ESP_LOGE(TAG, "Sensor %u (%s): bad type, port or address in SENSOR_TABLE", (unsigned)i, cfg->name);
+            s->driver = NULL;
+            continue;
+        }
+        s->reading.fields = s->driver->fields;
+
+        sensor_bus_t *bus = &buses[cfg->port];
+        bus->expected[bus->expected_count++] = cfg->addr;
+    }
+
+    // Only the controllers the table uses are brought up
+    for (int port = 0; port < I2C_NUM_MAX; port++) {
+        if (buses[port].expected_count > 0 && buses[port].handle == NULL) {
+            esp_err_t ret = bus_init(port);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    // Find the connected devices, probing only the cached ones when they all answer
+#ifdef I2C_FORCE_FULL_SCAN
+    bool force_scan = true;
+#else
+    bool force_scan = false;
+#endif
+    for (int port = 0; port < I2C_NUM_MAX; port++) {
+        if (buses[port].handle != NULL) {
+            bus_discover(port, force_scan);
+        }
+    }
+
+    size_t ready = 0;
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        sensor_t *s = &sensors[i];
+        if (s->driver != NULL && sensor_bring_up(s) == ESP_OK) {
+            ready++;
+            continue;
+        }
+        // Will continue without this sensor's data
+        if (s->driver != NULL) {
+            int port = s->config->port;
+            ESP_LOGW(TAG, "Check wiring of bus %d: SDA -> GPIO%d, SCL -> GPIO%d",
+                     port, bus_pins[port].sda, bus_pins[port].scl);
+        }
+    }
+
+    // Return OK anyway so the program doesn't crash
+    ESP_LOGI(TAG, "%u of %u sensor(s) ready", (unsigned)ready, (unsigned)SENSOR_COUNT);
+    return ESP_OK;
+}
+
+esp_err_t sensor_manager_rescan(void)
+{
+    bool any_bus = false;
+    for (int port = 0; port < I2C_NUM_MAX; port++) {
+        if (buses[port].handle == NULL) {
+            continue;
+        }
+        any_bus = true;
+        esp_err_t ret = bus_discover(port, true);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    if (!any_bus) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Pick up sensors that were connected after boot
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        if (sensors[i].driver != NULL && !sensors[i].initialized) {
+            sensor_bring_up(&sensors[i]);
+        }
+    }
+    return ESP_OK;
+}
+
+size_t sensor_manager_count(void)
+{
+    return SENSOR_COUNT;
+}
+
+bool sensor_manager_ready(size_t index)
+{
+    return index < SENSOR_COUNT && sensors[index].initialized;
+}
+
+esp_err_t sensor_manager_start(uint8_t mask)
+{
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    bool started = false;
+
+    // Every trigger goes out before any conversion is waited on
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        sensor_t *s = &sensors[i];
+        if (!(mask & (1u << i)) || !s->initialized) {
+            continue;
+        }
+        if (s->state != SENSOR_IDLE && s->state != SENSOR_DONE) {
+            continue;   // Still converting; collect it first
+        }
+        esp_err_t err = sensor_start(s);
+        if (err == ESP_OK) {
+            started = true;
+        } else {
+            ret = err;
+        }
+    }
+    return started ? ESP_OK : ret;
+}
+
+esp_err_t sensor_manager_collect(sensor_data_t *data, uint32_t timeout_ms)
+{
+    if (data == NULL) {
+        ESP_LOGE(TAG, "NULL data pointer");
+        return ESP_FAIL;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t wait = pdMS_TO_TICKS(timeout_ms);
+    bool any = false;
+    bool failed = false;
+    bool pending = false;
+
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        sensor_t *s = &sensors[i];
+        sensor_data_t *d = &data[i];
+        memset(d, 0, sizeof(*d));
+        d->name = s->reading.name;
+        d->fields = s->reading.fields;
+        if (!s->initialized || s->state == SENSOR_IDLE) {
+            continue;
+        }
+        any = true;
+
+        // One deadline for the whole sample: sensors wait concurrently
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (xSemaphoreTake(s->done, elapsed < wait ? wait - elapsed : 0) != pdTRUE) {
+            pending = true;     // Still running; the caller may collect again later
+            continue;
+        }
+
+        s->state = SENSOR_IDLE;
+        if (s->result != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read from %s: %s", s->config->name, esp_err_to_name(s->result));
+            failed = true;
+            continue;
+        }
+
+        *d = s->reading;
+        d->valid = true;
+        sensor_output(s, d);
+        LATENCY_TRACE_RECORD(LATENCY_SENSOR_COLLECTED, d->trigger_us);
+        log_reading(d);
+    }
+
+    if (pending) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return any && !failed ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t sensor_manager_read(sensor_data_t *data)
+{
+    if (data == NULL) {
+        ESP_LOGE(TAG, "NULL data pointer");
+        return ESP_FAIL;
+    }
+
+    if (sensor_manager_start(SENSOR_ALL) != ESP_OK) {
+        sensor_manager_collect(data, 0);
+        return ESP_FAIL;
+    }
+
+    // The poll state machines finish by their own deadlines
+    esp_err_t ret = sensor_manager_collect(data, sensor_manager_sample_timeout_ms());
+    return ret == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+uint32_t sensor_manager_sample_timeout_ms(void)
+{
+    int64_t deadline_us = 0;
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        const sensor_driver_t *drv = driver_for(sensor_table[i].type);
+        if (drv != NULL && drv->deadline_us > deadline_us) {
+            deadline_us = drv->deadline_us;
+        }
+    }
+    return (uint32_t)(deadline_us * SENSOR_OVERSAMPLE / 1000) + SENSOR_COLLECT_MARGIN_MS;
+}
+
+#endif // DEVICE_TYPE_TEMP_SENSOR
@@ -0,0 +1,48 @@
+#include <string.h>
+#include "spsc_queue.h"
+
+bool spsc_queue_init(spsc_queue_t *queue, void *storage, uint16_t item_size, uint16_t capacity)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+    queue->slots = storage;
+    queue->item_size = item_size;
+    queue->capacity = capacity;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return true;
+}
+
+bool spsc_queue_push(spsc_queue_t *queue, const void *item)
+{
+    uint_fast32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint_fast32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if ((uint32_t)(head - tail) >= queue->capacity) {
+        return false;
+    }
+    memcpy(queue->slots + (head & (queue->capacity - 1)) * queue->item_size, item, queue->item_size);
+    // Publish the slot contents before the new head
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t *queue, void *item)
+{
+    uint_fast32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint_fast32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+    memcpy(item, queue->slots + (tail & (queue->capacity - 1)) * queue->item_size, queue->item_size);
+    // Hand the slot back only after it has been read
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint16_t spsc_queue_count(spsc_queue_t *queue)
+{
+    uint_fast32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    uint_fast32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return (uint16_t)(uint32_t)(head - tail);
+}
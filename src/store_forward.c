@@ -0,0 +1,450 @@
+#include "config.h"
+
+#ifdef STORE_FORWARD_ENABLED
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "store_forward.h"
+#include "mqtt_manager.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "STORE_FWD";
+
+// On-flash record. The slot of a record is fixed by its sequence number
+// (seq % capacity), so the log needs no index: recovery only has to find the
+// newest record and the newest "drained" mark.
+typedef struct {
+    uint8_t magic;           // RECORD_MAGIC once written, 0xFF in an erased slot
+    uint8_t drained;         // 0xFF pending, 0x00 = this and all older records drained
+    uint8_t boot;            // Boot the reading was taken in
+    uint8_t crc;             // CRC-8 over boot and everything after crc
+    uint32_t seq;
+    uint32_t timestamp_ms;   // Uptime within that boot
+    int16_t temp_centi;      // °C * 100
+    uint16_t humidity_centi; // % * 100
+} sf_record_t;
+
+_Static_assert(sizeof(sf_record_t) == 16, "record must stay 16 bytes");
+
+#define RECORD_MAGIC        0xA5
+#define RECORDS_PER_SECTOR  (SPI_FLASH_SEC_SIZE / sizeof(sf_record_t))
+#define WRITE_BATCH         16    // Records per flash program (one 256-byte page)
+#define SCAN_CHUNK          16    // Records read per flash access during recovery/drain
+#define DRAIN_PAYLOAD_SIZE  (64 + STORE_DRAIN_BATCH_SIZE * 40)
+
+static const esp_partition_t *partition = NULL;
+static SemaphoreHandle_t store_lock = NULL;
+static uint32_t capacity = 0;        // Records the partition holds
+static uint32_t head_seq = 0;        // Next sequence number to assign
+static uint32_t tail_seq = 0;        // Oldest reading not yet drained
+static uint32_t flushed_seq = 0;     // Records below this are in flash, the rest in write_buffer
+static uint8_t boot_id = 0;
+static sf_record_t write_buffer[WRITE_BATCH];
+static store_forward_stats_t stats;
+static char drain_payload[DRAIN_PAYLOAD_SIZE];
+
+static uint8_t crc8(uint8_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint8_t record_crc(const sf_record_t *rec)
+{
+    const uint8_t *bytes = (const uint8_t *)rec;
+    uint8_t crc = crc8(0xFF, &rec->boot, 1);
+    return crc8(crc, bytes + offsetof(sf_record_t, seq), sizeof(*rec) - offsetof(sf_record_t, seq));
+}
+
+static bool record_valid(const sf_record_t *rec)
+{
+    return rec->magic == RECORD_MAGIC && rec->crc == record_crc(rec);
+}
+
+static size_t slot_offset(uint32_t seq)
+{
+    return (size_t)(seq % capacity) * sizeof(sf_record_t);
+}
+
+/**
+ * @brief Erase the sector the log is about to enter
+ *
+ * Whatever the sector held is the oldest data in the ring; readings in it
+ * that were never drained are counted as dropped.
+ */
+static esp_err_t enter_sector(uint32_t seq)
+{
+    size_t offset = slot_offset(seq);
+    esp_err_t ret = esp_partition_erase_range(partition, offset, SPI_FLASH_SEC_SIZE);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Sector erase at 0x%x failed: %s", (unsigned)offset, esp_err_to_name(ret));
+        return ret;
+    }
+    stats.sector_erases++;
+
+    // Oldest reading still in flash after this erase
+    int64_t oldest = (int64_t)seq + RECORDS_PER_SECTOR - capacity;
+    if (oldest > (int64_t)tail_seq) {
+        stats.dropped += (uint32_t)(oldest - tail_seq);
+        tail_seq = (uint32_t)oldest;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t flush_locked(void)
+{
+    while (flushed_seq != head_seq) {
+        uint32_t seq = flushed_seq;
+        if (seq % RECORDS_PER_SECTOR == 0) {
+            esp_err_t ret = enter_sector(seq);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+
+        // Program a contiguous run that stays within the current sector
+        uint32_t run = head_seq - seq;
+        uint32_t sector_left = RECORDS_PER_SECTOR - (seq % RECORDS_PER_SECTOR);
+        if (run > sector_left) {
+            run = sector_left;
+        }
+
+        esp_err_t ret = esp_partition_write(partition, slot_offset(seq), write_buffer, run * sizeof(sf_record_t));
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Flash write failed: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        stats.flash_writes++;
+
+        // Shift what is left of the buffer down
+        memmove(write_buffer, &write_buffer[run], (head_seq - seq - run) * sizeof(sf_record_t));
+        flushed_seq += run;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Load the record with the given sequence number (from RAM or flash)
+ */
+static esp_err_t load_record(uint32_t seq, sf_record_t *rec)
+{
+    if (seq >= flushed_seq) {
+        *rec = write_buffer[seq - flushed_seq];
+        return ESP_OK;
+    }
+    return esp_partition_read(partition, slot_offset(seq), rec, sizeof(*rec));
+}
+
+static void recover_locked(void)
+{
+    sf_record_t chunk[SCAN_CHUNK];
+    bool any = false;
+    bool any_drained = false;
+    uint32_t max_seq = 0;
+    uint32_t min_seq = UINT32_MAX;
+    uint32_t max_drained = 0;
+    uint8_t last_boot = 0;
+
+    for (uint32_t slot = 0; slot < capacity; slot += SCAN_CHUNK) {
+        uint32_t n = capacity - slot < SCAN_CHUNK ? capacity - slot : SCAN_CHUNK;
+        if (esp_partition_read(partition, slot * sizeof(sf_record_t), chunk, n * sizeof(sf_record_t)) != ESP_OK) {
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            const sf_record_t *rec = &chunk[i];
+            if (!record_valid(rec) || rec->seq % capacity != slot + i) {
+                continue;
+            }
+            if (!any || rec->seq > max_seq) {
+                max_seq = rec->seq;
+                last_boot = rec->boot;
+            }
+            if (rec->seq < min_seq) {
+                min_seq = rec->seq;
+            }
+            if (rec->drained == 0x00 && (!any_drained || rec->seq > max_drained)) {
+                max_drained = rec->seq;
+                any_drained = true;
+            }
+            any = true;
+        }
+    }
+
+    if (!any) {
+        // Blank or foreign partition: start a new log at the first sector
+        head_seq = 0;
+        tail_seq = 0;
+        boot_id = 0;
+    } else {
+        head_seq = max_seq + 1;
+        tail_seq = any_drained && max_drained + 1 > min_seq ? max_drained + 1 : min_seq;
+        boot_id = (uint8_t)(last_boot + 1);
+
+        // The slot after the newest record must be blank; if a write was cut
+        // short, continue at the next sector boundary (which gets erased)
+        sf_record_t next;
+        if (head_seq % RECORDS_PER_SECTOR != 0 &&
+            esp_partition_read(partition, slot_offset(head_seq), &next, sizeof(next)) == ESP_OK &&
+            next.magic != 0xFF) {
+            head_seq += RECORDS_PER_SECTOR - (head_seq % RECORDS_PER_SECTOR);
+        }
+    }
+    flushed_seq = head_seq;
+}
+
+esp_err_t store_forward_init(void)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         STORE_FORWARD_PARTITION);
+    if (partition == NULL) {
+        ESP_LOGW(TAG, "Partition '%s' not found, store-and-forward disabled", STORE_FORWARD_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (store_lock == NULL) {
+        store_lock = xSemaphoreCreateMutex();
+        if (store_lock == NULL) {
+            partition = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    capacity = partition->size / sizeof(sf_record_t);
+    capacity -= capacity % RECORDS_PER_SECTOR;
+    memset(&stats, 0, sizeof(stats));
+    recover_locked();
+    uint32_t pending = head_seq - tail_seq;
+    xSemaphoreGive(store_lock);
+
+    ESP_LOGI(TAG, "Readings log: %lu slots, %lu pending, boot %u",
+             (unsigned long)capacity, (unsigned long)pending, boot_id);
+    return ESP_OK;
+}
+
+esp_err_t store_forward_append(const sensor_sample_t *sample)
+{
+    if (partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    sf_record_t rec = {
+        .magic = RECORD_MAGIC,
+        .drained = 0xFF,
+        .boot = boot_id,
+        .timestamp_ms = sample->timestamp_ms,
+        .temp_centi = (int16_t)(sample->temperature * 100.0f + (sample->temperature < 0 ? -0.5f : 0.5f)),
+        .humidity_centi = (uint16_t)(sample->humidity * 100.0f + 0.5f),
+    };
+
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+
+    // Buffer still full from a failed flush: retry before taking more
+    esp_err_t ret = ESP_OK;
+    if (head_seq - flushed_seq == WRITE_BATCH) {
+        ret = flush_locked();
+        if (ret != ESP_OK) {
+            xSemaphoreGive(store_lock);
+            return ret;
+        }
+    }
+
+    rec.seq = head_seq;
+    rec.crc = record_crc(&rec);
+    write_buffer[head_seq - flushed_seq] = rec;
+    head_seq++;
+    stats.appended++;
+
+    if (head_seq - flushed_seq == WRITE_BATCH) {
+        ret = flush_locked();
+    }
+    xSemaphoreGive(store_lock);
+    return ret;
+}
+
+esp_err_t store_forward_flush(void)
+{
+    if (partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    esp_err_t ret = flush_locked();
+    xSemaphoreGive(store_lock);
+    return ret;
+}
+
+uint32_t store_forward_pending(void)
+{
+    if (partition == NULL) {
+        return 0;
+    }
+
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    uint32_t pending = head_seq - tail_seq;
+    xSemaphoreGive(store_lock);
+    return pending;
+}
+
+/**
+ * @brief Mark everything up to and including seq as drained
+ *
+ * Only the newest drained record is marked; recovery treats all older ones as
+ * drained too. Clearing the byte from 0xFF to 0x00 needs no erase.
+ */
+static void mark_drained_locked(uint32_t seq)
+{
+    if (seq >= flushed_seq) {
+        write_buffer[seq - flushed_seq].drained = 0x00;
+    } else {
+        uint8_t mark = 0x00;
+        if (esp_partition_write(partition, slot_offset(seq) + offsetof(sf_record_t, drained), &mark, 1) == ESP_OK) {
+            stats.flash_writes++;
+        }
+    }
+    tail_seq = seq + 1;
+}
+
+int store_forward_drain(esp_mqtt_client_handle_t client, uint16_t max_samples)
+{
+    if (partition == NULL || client == NULL) {
+        return -1;
+    }
+
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t seq = tail_seq;
+    uint32_t last_seq = 0;
+    uint16_t count = 0;
+    int batch_boot = -1;
+    size_t pos = 0;
+
+    while (seq != head_seq && count < max_samples) {
+        sf_record_t rec;
+        if (load_record(seq, &rec) != ESP_OK || !record_valid(&rec) || rec.seq != seq) {
+            stats.corrupt++;
+            seq++;
+            continue;
+        }
+
+        // One boot per message: uptimes from different boots don't compare
+        if (batch_boot < 0) {
+            batch_boot = rec.boot;
+            int n = (rec.boot == boot_id)
+                ? snprintf(drain_payload, sizeof(drain_payload), "{\"boot\":%u,\"now\":%lu,\"s\":[",
+                           rec.boot, (unsigned long)now_ms)
+                : snprintf(drain_payload, sizeof(drain_payload), "{\"boot\":%u,\"s\":[", rec.boot);
+            pos = (size_t)n;
+        } else if (rec.boot != batch_boot) {
+            break;
+        }
+
+        int n = snprintf(drain_payload + pos, sizeof(drain_payload) - pos, "%s[%lu,%.2f,%.2f]",
+                         count ? "," : "", (unsigned long)rec.timestamp_ms,
+                         rec.temp_centi / 100.0, rec.humidity_centi / 100.0);
+        if (n < 0 || pos + (size_t)n + 3 > sizeof(drain_payload)) {
+            break;
+        }
+        pos += (size_t)n;
+        last_seq = seq;
+        count++;
+        seq++;
+    }
+
+    int result = 0;
+    if (count > 0) {
+        drain_payload[pos++] = ']';
+        drain_payload[pos++] = '}';
+        drain_payload[pos] = '\0';
+
+        int msg_id = mqtt_publish(client, MQTT_TOPIC_TEMP_BACKLOG, drain_payload, (int)pos, 1, 0);
+        if (msg_id < 0) {
+            ESP_LOGW(TAG, "Backlog publish failed, %lu readings stay queued",
+                     (unsigned long)(head_seq - tail_seq));
+            result = -1;
+        } else {
+            mark_drained_locked(last_seq);
+            stats.drained += count;
+            result = count;
+        }
+    } else if (seq != tail_seq) {
+        // Only corrupt records were in the way
+        tail_seq = seq;
+    }
+
+    xSemaphoreGive(store_lock);
+    return result;
+}
+
+static void drain_task(void *pvParameters)
+{
+    esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)pvParameters;
+    bool was_connected = false;
+
+    while (1) {
+        bool connected = mqtt_is_connected();
+
+        if (connected && !was_connected && store_forward_pending() > 0) {
+            // Spread a reconnecting fleet's backlog over time
+            uint32_t jitter_ms = STORE_DRAIN_JITTER_MS > 0 ? esp_random() % STORE_DRAIN_JITTER_MS : 0;
+            ESP_LOGI(TAG, "Reconnected with %lu readings queued, draining in %lu ms",
+                     (unsigned long)store_forward_pending(), (unsigned long)jitter_ms);
+            vTaskDelay(pdMS_TO_TICKS(jitter_ms));
+        }
+        was_connected = connected;
+
+        if (connected && store_forward_pending() > 0) {
+            int drained = store_forward_drain(client, STORE_DRAIN_BATCH_SIZE);
+            if (drained > 0) {
+                ESP_LOGI(TAG, "Drained %d readings, %lu left", drained, (unsigned long)store_forward_pending());
+            }
+            vTaskDelay(pdMS_TO_TICKS(STORE_DRAIN_INTERVAL_MS));
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+    }
+}
+
+esp_err_t store_forward_start(esp_mqtt_client_handle_t client)
+{
+    if (partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    BaseType_t ret = xTaskCreate(drain_task, "store_drain", 3072, (void *)client, 4, NULL);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create drain task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+store_forward_stats_t store_forward_get_stats(void)
+{
+    store_forward_stats_t snapshot = {0};
+    if (partition == NULL) {
+        return snapshot;
+    }
+
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    snapshot = stats;
+    snapshot.pending = head_seq - tail_seq;
+    snapshot.capacity = capacity;
+    xSemaphoreGive(store_lock);
+    return snapshot;
+}
+
+#endif // STORE_FORWARD_ENABLED
@@ -0,0 +1,397 @@
+#include "config.h"
+
+#ifdef DEVICE_TYPE_RELAY
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "thermostat.h"
+
+#define SETPOINT_MIN_C      5.0f
+#define SETPOINT_MAX_C      35.0f
+#define MS_PER_HOUR         3600000.0f
+#define MS_PER_MINUTE       60000u
+#define UPDATE_MAX_MS       MS_PER_MINUTE   // The schedule may move on every minute
+#define UPDATE_MIN_MS       100
+
+void thermostat_params_defaults(thermostat_params_t *params)
+{
+#ifdef THERMOSTAT_PID
+    params->algorithm = THERMOSTAT_PID;
+#else
+    params->algorithm = THERMOSTAT_HYSTERESIS;
+#endif
+    params->default_setpoint = THERMOSTAT_DEFAULT_SETPOINT_C;
+    params->hysteresis = THERMOSTAT_HYSTERESIS_C;
+    params->kp = THERMOSTAT_KP;
+    params->ki = THERMOSTAT_KI;
+    params->kd = THERMOSTAT_KD;
+    params->cycle_ms = THERMOSTAT_CYCLE_MS;
+    params->min_on_ms = THERMOSTAT_MIN_ON_MS;
+    params->min_off_ms = THERMOSTAT_MIN_OFF_MS;
+    params->sensor_timeout_ms = THERMOSTAT_SENSOR_TIMEOUT_MS;
+    params->override_ms = THERMOSTAT_OVERRIDE_MS;
+}
+
+void thermostat_init(thermostat_t *t, const thermostat_params_t *params, bool heating, uint32_t now_ms)
+{
+    memset(t, 0, sizeof(*t));
+    t->params = *params;
+    t->mode = THERMOSTAT_AUTO;
+    t->heating = heating;
+    t->switched_ms = now_ms;
+}
+
+void thermostat_set_reading(thermostat_t *t, float temperature, uint32_t now_ms)
+{
+    t->has_reading = true;
+    t->temperature = temperature;
+    t->reading_ms = now_ms;
+}
+
+static void trim(const char **s, size_t *len)
+{
+    while (*len > 0 && isspace((unsigned char)**s)) {
+        (*s)++;
+        (*len)--;
+    }
+    while (*len > 0 && isspace((unsigned char)(*s)[*len - 1])) {
+        (*len)--;
+    }
+}
+
+static bool equals(const char *s, size_t len, const char *word)
+{
+    return len == strlen(word) && strncasecmp(s, word, len) == 0;
+}
+
+// A setpoint in °C: the whole of s, within SETPOINT_MIN_C..SETPOINT_MAX_C
+static bool parse_setpoint(const char *s, size_t len, float *out)
+{
+    char buf[16];
+    if (len == 0 || len >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    char *end;
+    float v = strtof(buf, &end);
+    if (*end != '\0' || !(v >= SETPOINT_MIN_C && v <= SETPOINT_MAX_C)) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+// "HH:MM" as a minute of the day
+static bool parse_time(const char *s, size_t len, uint16_t *minute)
+{
+    if (len != 5 || s[2] != ':' || !isdigit((unsigned char)s[0]) || !isdigit((unsigned char)s[1])
+        || !isdigit((unsigned char)s[3]) || !isdigit((unsigned char)s[4])) {
+        return false;
+    }
+    int h = (s[0] - '0') * 10 + (s[1] - '0');
+    int m = (s[3] - '0') * 10 + (s[4] - '0');
+    if (h > 23 || m > 59) {
+        return false;
+    }
+    *minute = (uint16_t)(h * 60 + m);
+    return true;
+}
+
+/**
+ * @brief Add a slot, keeping the schedule in time order
+ */
+static bool schedule_insert(thermostat_schedule_t *schedule, uint16_t minute, float setpoint)
+{
+    if (schedule->count >= THERMOSTAT_SCHEDULE_MAX) {
+        return false;
+    }
+    int i = schedule->count;
+    while (i > 0 && schedule->slots[i - 1].minute >= minute) {
+        if (schedule->slots[i - 1].minute == minute) {
+            return false;
+        }
+        schedule->slots[i] = schedule->slots[i - 1];
+        i--;
+    }
+    schedule->slots[i].minute = minute;
+    schedule->slots[i].setpoint = setpoint;
+    schedule->count++;
+    return true;
+}
+
+esp_err_t thermostat_parse_schedule(const char *data, size_t len, thermostat_schedule_t *schedule,
+                                    int *now_minute)
+{
+    thermostat_schedule_t parsed = { .count = 0 };
+    int now = -1;
+    size_t start = 0;
+    while (start <= len) {
+        const char *comma = memchr(data + start, ',', len - start);
+        size_t end = comma != NULL ? (size_t)(comma - data) : len;
+        const char *entry = data + start;
+        size_t entry_len = end - start;
+        start = end + 1;
+        trim(&entry, &entry_len);
+        if (entry_len == 0) {
+            continue;
+        }
+
+        const char *eq = memchr(entry, '=', entry_len);
+        if (eq == NULL) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        const char *key = entry;
+        size_t key_len = (size_t)(eq - entry);
+        const char *value = eq + 1;
+        size_t value_len = entry_len - key_len - 1;
+        trim(&key, &key_len);
+        trim(&value, &value_len);
+
+        uint16_t minute;
+        float setpoint;
+        if (equals(key, key_len, "now")) {
+            if (!parse_time(value, value_len, &minute)) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            now = minute;
+        } else if (!parse_time(key, key_len, &minute) || !parse_setpoint(value, value_len, &setpoint)
+                   || !schedule_insert(&parsed, minute, setpoint)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    *schedule = parsed;
+    *now_minute = now;
+    return ESP_OK;
+}
+
+void thermostat_set_schedule(thermostat_t *t, const thermostat_schedule_t *schedule)
+{
+    t->schedule = *schedule;
+}
+
+void thermostat_set_clock(thermostat_t *t, uint16_t minute, uint32_t now_ms)
+{
+    t->clock_valid = true;
+    t->clock_minute = minute % THERMOSTAT_MINUTES_PER_DAY;
+    t->clock_ms = now_ms;
+}
+
+static void start_override(thermostat_t *t, thermostat_mode_t mode, uint32_t now_ms)
+{
+    t->mode = mode;
+    t->override_ms = now_ms;
+}
+
+esp_err_t thermostat_override(thermostat_t *t, const char *data, size_t len, uint32_t now_ms)
+{
+    trim(&data, &len);
+    float setpoint;
+    if (equals(data, len, "ON")) {
+        start_override(t, THERMOSTAT_FORCE_ON, now_ms);
+    } else if (equals(data, len, "OFF")) {
+        start_override(t, THERMOSTAT_FORCE_OFF, now_ms);
+    } else if (equals(data, len, "auto")) {
+        t->mode = THERMOSTAT_AUTO;
+    } else if (equals(data, len, "manual")) {
+        t->mode = THERMOSTAT_MANUAL;
+    } else if (parse_setpoint(data, len, &setpoint)) {
+        t->hold_setpoint = setpoint;
+        start_override(t, THERMOSTAT_HOLD, now_ms);
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+bool thermostat_command(thermostat_t *t, bool on, uint32_t now_ms)
+{
+    if (t->mode == THERMOSTAT_MANUAL) {
+        return false;
+    }
+    start_override(t, on ? THERMOSTAT_FORCE_ON : THERMOSTAT_FORCE_OFF, now_ms);
+    return true;
+}
+
+static bool override_expired(const thermostat_t *t, uint32_t now_ms)
+{
+    return (t->mode == THERMOSTAT_HOLD || t->mode == THERMOSTAT_FORCE_ON || t->mode == THERMOSTAT_FORCE_OFF)
+        && now_ms - t->override_ms >= t->params.override_ms;
+}
+
+static float schedule_setpoint(const thermostat_t *t, uint32_t now_ms)
+{
+    if (!t->clock_valid || t->schedule.count == 0) {
+        return t->params.default_setpoint;
+    }
+    uint32_t minute = (t->clock_minute + (now_ms - t->clock_ms) / MS_PER_MINUTE) % THERMOSTAT_MINUTES_PER_DAY;
+    // Before the first slot of the day, yesterday's last one still runs
+    const thermostat_slot_t *slot = &t->schedule.slots[t->schedule.count - 1];
+    for (uint8_t i = 0; i < t->schedule.count && t->schedule.slots[i].minute <= minute; i++) {
+        slot = &t->schedule.slots[i];
+    }
+    return slot->setpoint;
+}
+
+float thermostat_setpoint(const thermostat_t *t, uint32_t now_ms)
+{
+    if (t->mode == THERMOSTAT_HOLD && !override_expired(t, now_ms)) {
+        return t->hold_setpoint;
+    }
+    return schedule_setpoint(t, now_ms);
+}
+
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+/**
+ * @brief PID output for the window starting now, as ON time
+ *
+ * The integral only moves while the output is not saturated in the
+ * direction it would push, so a long cold start does not wind it up. A run
+ * shorter than min_on_ms is dropped, and a pause shorter than min_off_ms
+ * is not taken.
+ */
+static void start_window(thermostat_t *t, float setpoint, uint32_t now_ms)
+{
+    const thermostat_params_t *p = &t->params;
+    float error = setpoint - t->temperature;
+    float dt_h = t->window_valid ? (float)(now_ms - t->window_ms) / MS_PER_HOUR : 0.0f;
+    float rate = t->previous_valid && dt_h > 0.0f ? (t->temperature - t->previous) / dt_h : 0.0f;
+
+    float trial = p->kp * error + p->ki * (t->integral + error * dt_h) - p->kd * rate;
+    if (!(trial > 1.0f && error > 0.0f) && !(trial < 0.0f && error < 0.0f)) {
+        t->integral += error * dt_h;
+    }
+    float duty = p->kp * error + p->ki * t->integral - p->kd * rate;
+    t->duty = duty < 0.0f ? 0.0f : duty > 1.0f ? 1.0f : duty;
+
+    uint32_t on_ms = (uint32_t)(t->duty * (float)p->cycle_ms);
+    if (on_ms < p->min_on_ms) {
+        on_ms = 0;
+    } else if (p->cycle_ms - on_ms < p->min_off_ms) {
+        on_ms = p->cycle_ms;
+    }
+    t->on_ms = on_ms;
+    t->window_ms = now_ms;
+    t->window_valid = true;
+    t->previous = t->temperature;
+    t->previous_valid = true;
+}
+
+bool thermostat_update(thermostat_t *t, bool relay_on, uint32_t now_ms, uint32_t *next_ms)
+{
+    const thermostat_params_t *p = &t->params;
+    if (override_expired(t, now_ms)) {
+        t->mode = THERMOSTAT_AUTO;
+    }
+
+    uint32_t next = UPDATE_MAX_MS;
+    if (t->mode == THERMOSTAT_MANUAL) {
+        if (relay_on != t->heating) {
+            t->heating = relay_on;
+            t->switched_ms = now_ms;
+        }
+        t->failsafe = false;
+        t->window_valid = false;
+        *next_ms = next;
+        return t->heating;
+    }
+
+    bool want;
+    bool protect = true;
+    if (t->mode == THERMOSTAT_FORCE_ON || t->mode == THERMOSTAT_FORCE_OFF) {
+        // The webapp's explicit call: no minimum run or pause
+        want = t->mode == THERMOSTAT_FORCE_ON;
+        protect = false;
+        t->window_valid = false;
+        next = min_u32(next, p->override_ms - (now_ms - t->override_ms));
+    } else if (!t->has_reading || now_ms - t->reading_ms >= p->sensor_timeout_ms) {
+        want = false;
+        protect = false;
+        t->failsafe = true;
+        t->window_valid = false;
+    } else {
+        t->failsafe = false;
+        next = min_u32(next, p->sensor_timeout_ms - (now_ms - t->reading_ms));
+        if (t->mode == THERMOSTAT_HOLD) {
+            next = min_u32(next, p->override_ms - (now_ms - t->override_ms));
+        }
+
+        float setpoint = thermostat_setpoint(t, now_ms);
+        if (p->algorithm == THERMOSTAT_PID) {
+            if (!t->window_valid || now_ms - t->window_ms >= p->cycle_ms) {
+                start_window(t, setpoint, now_ms);
+            }
+            uint32_t elapsed = now_ms - t->window_ms;
+            want = elapsed < t->on_ms;
+            next = min_u32(next, want ? t->on_ms - elapsed : p->cycle_ms - elapsed);
+        } else if (t->temperature <= setpoint - p->hysteresis) {
+            want = true;
+        } else if (t->temperature >= setpoint + p->hysteresis) {
+            want = false;
+        } else {
+            want = t->heating;
+        }
+    }
+
+    if (protect && want != t->heating) {
+        uint32_t min_ms = t->heating ? p->min_on_ms : p->min_off_ms;
+        uint32_t since = now_ms - t->switched_ms;
+        if (since < min_ms) {
+            want = t->heating;
+            next = min_u32(next, min_ms - since);
+        }
+    }
+    if (want != t->heating) {
+        t->heating = want;
+        t->switched_ms = now_ms;
+        if (want) {
+            t->switches++;
+        }
+    }
+
+    *next_ms = next < UPDATE_MIN_MS ? UPDATE_MIN_MS : next;
+    return t->heating;
+}
+
+const char *thermostat_mode_str(thermostat_mode_t mode)
+{
+    switch (mode) {
+        case THERMOSTAT_AUTO:      return "auto";
+        case THERMOSTAT_HOLD:      return "hold";
+        case THERMOSTAT_FORCE_ON:  return "ON";
+        case THERMOSTAT_FORCE_OFF: return "OFF";
+        case THERMOSTAT_MANUAL:    return "manual";
+        default:                   return "unknown";
+    }
+}
+
+size_t thermostat_encode_json(const thermostat_t *t, uint32_t now_ms, char *buf, size_t len)
+{
+    char temperature[16];
+    if (t->has_reading) {
+        snprintf(temperature, sizeof(temperature), "%.2f", t->temperature);
+    } else {
+        strcpy(temperature, "null");
+    }
+    int n = snprintf(buf, len, "{\"mode\":\"%s\",\"setpoint\":%.2f,\"temperature\":%s,\"heating\":%s,"
+                     "\"failsafe\":%s",
+                     thermostat_mode_str(t->mode), thermostat_setpoint(t, now_ms), temperature,
+                     t->heating ? "true" : "false", t->failsafe ? "true" : "false");
+    if (n > 0 && (size_t)n < len && t->params.algorithm == THERMOSTAT_PID) {
+        n += snprintf(buf + n, len - (size_t)n, ",\"duty\":%.2f", t->duty);
+    }
+    if (n > 0 && (size_t)n < len) {
+        n += snprintf(buf + n, len - (size_t)n, "}");
+    }
+    return n > 0 && (size_t)n < len ? (size_t)n : 0;
+}
+
+#endif // DEVICE_TYPE_RELAY
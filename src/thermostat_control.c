@@ -0,0 +1,294 @@
+#include "config.h"
+
+#if defined(DEVICE_TYPE_RELAY) && defined(RELAY_THERMOSTAT)
+
+#include <stdlib.h>
+#include <string.h>
+#include "thermostat_control.h"
+#include "thermostat.h"
+#include "device_relay.h"
+#include "mqtt_manager.h"
+#include "mqtt_router.h"
+#include "payload.h"
+#include "dlog.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "THERMOSTAT";
+
+#define THERMOSTAT_NVS_NAMESPACE    "thermostat"
+#define THERMOSTAT_NVS_KEY          "schedule"
+#define THERMOSTAT_VERSION          1
+#define THERMOSTAT_STACK_SIZE       3072
+#define THERMOSTAT_PRIORITY         5   // With the MQTT task, below the actuator
+
+// Layout of the NVS blob; the version guards against a changed layout
+typedef struct {
+    uint8_t version;
+    thermostat_schedule_t schedule;
+} schedule_record_t;
+
+// Engine state, shared by the MQTT task (inputs) and the thermostat task
+static thermostat_t engine;
+static SemaphoreHandle_t engine_lock = NULL;
+static TaskHandle_t thermostat_task = NULL;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static bool schedule_load(thermostat_schedule_t *schedule)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(THERMOSTAT_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+
+    schedule_record_t record;
+    size_t len = sizeof(record);
+    esp_err_t err = nvs_get_blob(nvs, THERMOSTAT_NVS_KEY, &record, &len);
+    nvs_close(nvs);
+
+    if (err != ESP_OK || len != sizeof(record) || record.version != THERMOSTAT_VERSION
+        || record.schedule.count > THERMOSTAT_SCHEDULE_MAX) {
+        return false;
+    }
+    *schedule = record.schedule;
+    return true;
+}
+
+static void schedule_save(const thermostat_schedule_t *schedule)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(THERMOSTAT_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot keep schedule: %s", esp_err_to_name(err));
+        return;
+    }
+
+    schedule_record_t record = { .version = THERMOSTAT_VERSION };
+    record.schedule = *schedule;
+    err = nvs_set_blob(nvs, THERMOSTAT_NVS_KEY, &record, sizeof(record));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot keep schedule: %s", esp_err_to_name(err));
+    }
+}
+
+static void wake_task(void)
+{
+    if (thermostat_task != NULL) {
+        xTaskNotifyGive(thermostat_task);
+    }
+}
+
+/**
+ * @brief Decode a reading: the sensor's "21.50" text or its binary payload
+ */
+static bool parse_reading(const char *data, int data_len, float *temperature)
+{
+    float humidity;
+    if (payload_decode_temperature((const uint8_t *)data, (size_t)data_len, temperature, &humidity) == ESP_OK) {
+        return true;
+    }
+    char buf[16];
+    if (data_len <= 0 || data_len >= (int)sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, data, (size_t)data_len);
+    buf[data_len] = '\0';
+    char *end;
+    *temperature = strtof(buf, &end);
+    return end != buf && *end == '\0' && *temperature > -50.0f && *temperature < 100.0f;
+}
+
+static void handle_reading(const char *data, int data_len, void *ctx)
+{
+    float temperature;
+    if (!parse_reading(data, data_len, &temperature)) {
+        DLOGW(TAG, "Ignoring reading '%.*s'", data_len, data);
+        return;
+    }
+    xSemaphoreTake(engine_lock, portMAX_DELAY);
+    thermostat_set_reading(&engine, temperature, now_ms());
+    xSemaphoreGive(engine_lock);
+    wake_task();
+}
+
+static void handle_schedule(const char *data, int data_len, void *ctx)
+{
+    thermostat_schedule_t schedule;
+    int now_minute;
+    if (thermostat_parse_schedule(data, (size_t)data_len, &schedule, &now_minute) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring schedule '%.*s'", data_len, data);
+        return;
+    }
+
+    xSemaphoreTake(engine_lock, portMAX_DELAY);
+    bool changed = memcmp(&schedule, &engine.schedule, sizeof(schedule)) != 0;
+    thermostat_set_schedule(&engine, &schedule);
+    if (now_minute >= 0) {
+        thermostat_set_clock(&engine, (uint16_t)now_minute, now_ms());
+    }
+    xSemaphoreGive(engine_lock);
+
+    ESP_LOGI(TAG, "Schedule of %u slots%s", schedule.count, now_minute >= 0 ? ", clock set" : "");
+    if (changed) {
+        schedule_save(&schedule);
+    }
+    wake_task();
+}
+
+static void handle_override(const char *data, int data_len, void *ctx)
+{
+    xSemaphoreTake(engine_lock, portMAX_DELAY);
+    esp_err_t ret = thermostat_override(&engine, data, (size_t)data_len, now_ms());
+    thermostat_mode_t mode = engine.mode;
+    xSemaphoreGive(engine_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Unknown override '%.*s' (expected ON, OFF, a setpoint, auto or manual)", data_len, data);
+        return;
+    }
+    ESP_LOGI(TAG, "Override '%.*s': mode %s", data_len, data, thermostat_mode_str(mode));
+    wake_task();
+}
+
+bool thermostat_control_command(bool on)
+{
+    if (engine_lock == NULL) {
+        return false;
+    }
+    xSemaphoreTake(engine_lock, portMAX_DELAY);
+    bool taken = thermostat_command(&engine, on, now_ms());
+    xSemaphoreGive(engine_lock);
+    if (taken) {
+        wake_task();
+    }
+    return taken;
+}
+
+/**
+ * @brief What the state message reports; it goes out when this changes
+ */
+typedef struct {
+    thermostat_mode_t mode;
+    float setpoint;
+    bool heating;
+    bool failsafe;
+} thermostat_summary_t;
+
+static void publish_state(const char *payload, size_t len)
+{
+    esp_mqtt_client_handle_t client = mqtt_get_client();
+    if (client == NULL || mqtt_enqueue(client, MQTT_TOPIC_THERMOSTAT_STATE, payload, (int)len, 1, 1, true) < 0) {
+        DLOGW(TAG, "Failed to queue thermostat state");
+        return;
+    }
+    DLOGI(TAG, "State %s", payload);
+}
+
+/**
+ * @brief Decide, switch channel 0 when the decision differs from the relay,
+ *        and sleep until the next reading, message or deadline
+ */
+static void thermostat_task_fn(void *pvParameters)
+{
+    char payload[160];
+    thermostat_summary_t published = { .setpoint = -1.0f };
+
+    for (;;) {
+        uint32_t now = now_ms();
+        uint32_t next_ms;
+
+        xSemaphoreTake(engine_lock, portMAX_DELAY);
+        bool relay_on = relay_get_state();
+        bool heating = thermostat_update(&engine, relay_on, now, &next_ms);
+        thermostat_summary_t summary = {
+            .mode = engine.mode,
+            .setpoint = thermostat_setpoint(&engine, now),
+            .heating = heating,
+            .failsafe = engine.failsafe,
+        };
+        size_t len = thermostat_encode_json(&engine, now, payload, sizeof(payload));
+        xSemaphoreGive(engine_lock);
+
+        if (summary.mode != THERMOSTAT_MANUAL && heating != relay_on) {
+            relay_cmd_t cmd = { .mask = 0x01, .states = heating ? 0x01 : 0, .source = RELAY_CMD_THERMOSTAT };
+            esp_err_t ret = relay_submit_local(&cmd);
+            if (ret != ESP_OK) {
+                DLOGE(TAG, "Failed to queue boiler %s: %s", heating ? "ON" : "OFF", esp_err_to_name(ret));
+            }
+        }
+        if (len > 0 && memcmp(&summary, &published, sizeof(summary)) != 0) {
+            publish_state(payload, len);
+            published = summary;
+        }
+
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(next_ms));
+    }
+}
+
+esp_err_t thermostat_control_init(void)
+{
+    if (engine_lock == NULL) {
+        engine_lock = xSemaphoreCreateMutex();
+        if (engine_lock == NULL) {
+            ESP_LOGE(TAG, "Failed to create thermostat lock");
+            return ESP_ERR_NO_MEM;
+        }
+
+        // OFF until the first reading: the relay is switched once the task runs
+        thermostat_params_t params;
+        thermostat_params_defaults(&params);
+        thermostat_init(&engine, &params, false, now_ms());
+        thermostat_schedule_t schedule;
+        if (schedule_load(&schedule)) {
+            thermostat_set_schedule(&engine, &schedule);
+            ESP_LOGI(TAG, "Schedule of %u slots restored, waiting for the clock", schedule.count);
+        }
+    }
+
+    static const mqtt_route_t routes[] = {
+        MQTT_ROUTE(MQTT_TOPIC_THERMOSTAT_SENSOR, handle_reading, NULL),
+        MQTT_ROUTE(MQTT_TOPIC_THERMOSTAT_SCHEDULE, handle_schedule, NULL),
+        MQTT_ROUTE(MQTT_TOPIC_THERMOSTAT_OVERRIDE, handle_override, NULL),
+    };
+    _Static_assert(sizeof(routes) / sizeof(routes[0]) == THERMOSTAT_CONTROL_ROUTES, "update THERMOSTAT_CONTROL_ROUTES");
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        esp_err_t ret = mqtt_router_register(routes[i].topic, routes[i].handler, routes[i].ctx);
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            ESP_LOGE(TAG, "Failed to register %s: %s", routes[i].topic, esp_err_to_name(ret));
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t thermostat_control_start(void)
+{
+    if (thermostat_task != NULL) {
+        return ESP_OK;
+    }
+    BaseType_t ret = xTaskCreate(thermostat_task_fn, "thermostat", THERMOSTAT_STACK_SIZE, NULL,
+                                 THERMOSTAT_PRIORITY, &thermostat_task);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create thermostat task");
+        thermostat_task = NULL;
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Thermostat started (%s), setpoint %.1f°C until a schedule arrives",
+             engine.params.algorithm == THERMOSTAT_PID ? "PID" : "hysteresis", engine.params.default_setpoint);
+    return ESP_OK;
+}
+
+#endif // DEVICE_TYPE_RELAY && RELAY_THERMOSTAT
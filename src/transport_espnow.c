@@ -0,0 +1,78 @@
+#include "config.h"
+
+#ifdef PEER_LINK
+
+#include <string.h>
+#include "transport.h"
+#include "peer_link.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_wifi.h"
+
+static const char *TAG = "ESPNOW";
+
+static const uint8_t peer_mac[ESP_NOW_ETH_ALEN] = PEER_LINK_PEER_MAC;
+static transport_recv_cb_t recv_cb = NULL;
+static transport_sent_cb_t sent_cb = NULL;
+
+// Both callbacks run on the WiFi task
+static void espnow_recv(const esp_now_recv_info_t *info, const uint8_t *data, int len)
+{
+    // Only the paired device may feed the router
+    if (memcmp(info->src_addr, peer_mac, ESP_NOW_ETH_ALEN) != 0 || len <= 0) {
+        return;
+    }
+    recv_cb(data, (size_t)len);
+}
+
+static void espnow_sent(const esp_now_send_info_t *tx_info, esp_now_send_status_t status)
+{
+    sent_cb(status == ESP_NOW_SEND_SUCCESS);
+}
+
+static esp_err_t espnow_start(transport_recv_cb_t on_recv, transport_sent_cb_t on_sent)
+{
+    recv_cb = on_recv;
+    sent_cb = on_sent;
+
+    esp_err_t ret = esp_now_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    esp_now_register_recv_cb(espnow_recv);
+    esp_now_register_send_cb(espnow_sent);
+
+    // Channel 0 follows the station: both devices are on the AP's channel
+    esp_now_peer_info_t peer = {
+        .channel = 0,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, peer_mac, ESP_NOW_ETH_ALEN);
+#ifdef PEER_LINK_LMK
+    peer.encrypt = true;
+    memcpy(peer.lmk, PEER_LINK_LMK, ESP_NOW_KEY_LEN);
+#endif
+    ret = esp_now_add_peer(&peer);
+    if (ret != ESP_OK) {
+        esp_now_deinit();
+        return ret;
+    }
+    ESP_LOGI(TAG, "Paired with %02x:%02x:%02x:%02x:%02x:%02x%s", peer_mac[0], peer_mac[1], peer_mac[2],
+             peer_mac[3], peer_mac[4], peer_mac[5], peer.encrypt ? " (encrypted)" : "");
+    return ESP_OK;
+}
+
+static esp_err_t espnow_send(const uint8_t *frame, size_t len)
+{
+    return esp_now_send(peer_mac, frame, len);
+}
+
+const transport_t transport_espnow = {
+    .name = "ESP-NOW",
+    .mtu = ESP_NOW_MAX_DATA_LEN,
+    .start = espnow_start,
+    .send = espnow_send,
+};
+
+#endif // PEER_LINK
@@ -3,19 +3,199 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "nvs.h"
+#include "boot_events.h"
+#include "reconnect.h"
 #include "config.h"
 
 // Event group bits
 #define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
+
+#define WIFI_CACHE_NAMESPACE "wifi_cache"
+#define WIFI_CACHE_KEY       "ap"
+#define WIFI_CACHE_VERSION   1
 
 static const char *TAG = "WIFI_MANAGER";
 static EventGroupHandle_t wifi_event_group;
-static int retry_count = 0;
+static volatile uint32_t connect_count;  // Addresses obtained since boot
+static esp_netif_t *sta_netif;
+
+// Backoff and outage figures; the event loop updates them, the heartbeat reads them
+static reconnect_t wifi_link;
+static SemaphoreHandle_t link_lock;
+static esp_timer_handle_t retry_timer;
+
+// AP of the current connection, rejoined directly when the link drops
+static uint8_t last_channel;
+static uint8_t last_bssid[6];
+
+// AP and lease of the last DHCP connection, kept in NVS for a fast rejoin.
+// The version guards against a changed layout, the SSID against new credentials.
+typedef struct {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    char ssid[33];
+    esp_netif_ip_info_t lease;
+    uint32_t dns;
+} wifi_cache_t;
+
+static bool using_cache;        // Joining a known AP directly
+static bool lease_reused;       // Running on the cached lease instead of DHCP
+static esp_timer_handle_t lease_check_timer;
+
+static void base_config(wifi_config_t *config)
+{
+    memset(config, 0, sizeof(*config));
+    strncpy((char *)config->sta.ssid, WIFI_SSID, sizeof(config->sta.ssid));
+    strncpy((char *)config->sta.password, WIFI_PASS, sizeof(config->sta.password));
+    config->sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+}
+
+/**
+ * @brief Join this AP without a scan
+ */
+static void direct_join(wifi_config_t *config, uint8_t channel, const uint8_t *bssid)
+{
+    config->sta.channel = channel;
+    config->sta.bssid_set = true;
+    memcpy(config->sta.bssid, bssid, sizeof(config->sta.bssid));
+    using_cache = true;
+}
+
+/**
+ * @brief Go back to scanning and DHCP
+ */
+static void cache_drop(void)
+{
+    wifi_config_t config;
+    base_config(&config);
+    esp_wifi_set_config(WIFI_IF_STA, &config);
+    if (lease_reused) {
+        esp_netif_dhcpc_start(sta_netif);
+    }
+    using_cache = false;
+    lease_reused = false;
+}
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void retry_cb(void *arg)
+{
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "WiFi retry not started: %s", esp_err_to_name(err));
+    }
+}
+
+#ifdef WIFI_FAST_REJOIN
+static bool cache_load(wifi_cache_t *cache)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(*cache);
+    esp_err_t err = nvs_get_blob(nvs, WIFI_CACHE_KEY, cache, &len);
+    nvs_close(nvs);
+
+    return err == ESP_OK && len == sizeof(*cache) && cache->version == WIFI_CACHE_VERSION
+        && cache->channel != 0 && strncmp(cache->ssid, WIFI_SSID, sizeof(cache->ssid)) == 0;
+}
+
+/**
+ * @brief Remember the AP and lease just obtained (no flash write if unchanged)
+ */
+static void cache_save(void)
+{
+    wifi_ap_record_t ap;
+    esp_netif_dns_info_t dns;
+    wifi_cache_t cache = { .version = WIFI_CACHE_VERSION };
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK
+        || esp_netif_get_ip_info(sta_netif, &cache.lease) != ESP_OK
+        || esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) != ESP_OK) {
+        return;
+    }
+    cache.channel = ap.primary;
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    strncpy(cache.ssid, WIFI_SSID, sizeof(cache.ssid) - 1);
+    cache.dns = dns.ip.u_addr.ip4.addr;
+
+    wifi_cache_t stored;
+    if (cache_load(&stored) && memcmp(&stored, &cache, sizeof(cache)) == 0) {
+        return;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, WIFI_CACHE_KEY, &cache, sizeof(cache));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to cache AP details: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "Cached AP on channel %d for fast rejoin", cache.channel);
+    }
+}
+
+/**
+ * @brief Join the cached AP directly, without a scan, on the cached lease
+ */
+static void cache_apply(const wifi_cache_t *cache, wifi_config_t *config)
+{
+    direct_join(config, cache->channel, cache->bssid);
+    ESP_LOGI(TAG, "Rejoining cached AP on channel %d", cache->channel);
+
+#ifdef WIFI_REUSE_LEASE
+    esp_netif_dhcpc_stop(sta_netif);
+    esp_netif_dns_info_t dns = { .ip = { .u_addr.ip4.addr = cache->dns, .type = ESP_IPADDR_TYPE_V4 } };
+    if (esp_netif_set_ip_info(sta_netif, &cache->lease) == ESP_OK
+        && esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        lease_reused = true;
+        ESP_LOGI(TAG, "Reusing lease " IPSTR, IP2STR(&cache->lease.ip));
+    } else {
+        esp_netif_dhcpc_start(sta_netif);
+    }
+#endif
+}
+
+/**
+ * @brief A reused lease may have been handed to another host meanwhile; if the
+ * broker is not reachable on it, rejoin and ask the DHCP server instead.
+ * Otherwise hand the address back to DHCP, so the server renews the lease
+ * before it expires and could go to another host. Starting DHCP resets the
+ * address, which drops the broker session; MQTT reconnects on the GOT_IP
+ * that follows (CONFIG_LWIP_DHCP_RESTORE_LAST_IP asks for the same address).
+ */
+static void lease_check_cb(void *arg)
+{
+    if (!lease_reused) {
+        return;
+    }
+    if (!boot_events_is_set(BOOT_EVENT_MQTT)) {
+        ESP_LOGW(TAG, "No broker connection on the cached lease, renewing via DHCP");
+        esp_wifi_disconnect();
+        return;
+    }
+    ESP_LOGI(TAG, "Cached lease works, renewing it with the DHCP server");
+    lease_reused = false;
+    esp_netif_dhcpc_start(sta_netif);
+}
+#endif // WIFI_FAST_REJOIN
 
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
@@ -25,35 +205,104 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         esp_wifi_connect();
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (retry_count < WIFI_MAX_RETRY) {
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        bool was_connected = (xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT) != 0;
+        xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+        boot_events_clear(BOOT_EVENT_WIFI);
+#ifdef WIFI_FAST_REJOIN
+        if (lease_check_timer != NULL) {
+            esp_timer_stop(lease_check_timer);
+        }
+#endif
+        if (was_connected) {
+            xSemaphoreTake(link_lock, portMAX_DELAY);
+            reconnect_down(&wifi_link, now_ms());
+            xSemaphoreGive(link_lock);
+
+            // Most drops are brief: rejoin the same AP at once, without a scan,
+            // and ask DHCP again if the address was a reused lease
+            if (lease_reused) {
+                cache_drop();
+            }
+            if (last_channel != 0) {
+                ESP_LOGW(TAG, "WiFi lost (reason %d), rejoining AP on channel %d", event->reason, last_channel);
+                wifi_config_t config;
+                base_config(&config);
+                direct_join(&config, last_channel, last_bssid);
+                esp_wifi_set_config(WIFI_IF_STA, &config);
+                esp_wifi_connect();
+                return;
+            }
+        }
+        if (using_cache) {
+            // The AP moved, went away or the lease went stale; this attempt is not a retry
+            ESP_LOGW(TAG, "Known AP not usable, falling back to a scan");
+            cache_drop();
             esp_wifi_connect();
-            retry_count++;
-            ESP_LOGI(TAG, "Retry connecting to WiFi... (%d/%d)", retry_count, WIFI_MAX_RETRY);
-        } else {
-            xEventGroupSetBits(wifi_event_group, WIFI_FAIL_BIT);
-            ESP_LOGE(TAG, "Failed to connect to WiFi after %d attempts", WIFI_MAX_RETRY);
+            return;
         }
+
+        xSemaphoreTake(link_lock, portMAX_DELAY);
+        uint32_t delay_ms = reconnect_next_ms(&wifi_link);
+        uint32_t attempt = wifi_link.attempt;
+        xSemaphoreGive(link_lock);
+        ESP_LOGI(TAG, "WiFi not connected (reason %d), retry %lu in %lu ms", event->reason,
+                 (unsigned long)attempt, (unsigned long)delay_ms);
+        esp_timer_start_once(retry_timer, (uint64_t)delay_ms * 1000);
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+        if (xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT) {
+            // DHCP took over a reused lease, or renewed one, on a link already up;
+            // MQTT reconnects if the address changed
+            ESP_LOGI(TAG, "Lease from DHCP: " IPSTR "%s", IP2STR(&event->ip_info.ip),
+                     event->ip_changed ? " (address changed)" : "");
+#ifdef WIFI_FAST_REJOIN
+            cache_save();
+#endif
+            return;
+        }
         ESP_LOGI(TAG, "========================================");
         ESP_LOGI(TAG, "WiFi Connection SUCCESSFUL!");
         ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
         ESP_LOGI(TAG, "Gateway: " IPSTR, IP2STR(&event->ip_info.gw));
         ESP_LOGI(TAG, "Netmask: " IPSTR, IP2STR(&event->ip_info.netmask));
         ESP_LOGI(TAG, "========================================");
-        retry_count = 0;
+        connect_count++;
+
+        wifi_ap_record_t ap;
+        if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+            last_channel = ap.primary;
+            memcpy(last_bssid, ap.bssid, sizeof(last_bssid));
+        }
+        // Link stats first: a task woken by the event may read them
+        xSemaphoreTake(link_lock, portMAX_DELAY);
+        uint32_t recovery_ms = reconnect_up(&wifi_link, now_ms());
+        xSemaphoreGive(link_lock);
         xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
+        boot_events_set(BOOT_EVENT_WIFI);
+        if (recovery_ms > 0) {
+            ESP_LOGI(TAG, "WiFi back after %lu ms", (unsigned long)recovery_ms);
+        }
+#ifdef WIFI_FAST_REJOIN
+        if (lease_reused) {
+            esp_timer_start_once(lease_check_timer, (uint64_t)WIFI_LEASE_CHECK_MS * 1000);
+        } else {
+            cache_save();
+        }
+#endif
     }
 }
 
 esp_err_t wifi_manager_init(void)
 {
     wifi_event_group = xEventGroupCreate();
+    link_lock = xSemaphoreCreateMutex();
+    reconnect_init(&wifi_link, WIFI_BACKOFF_BASE_MS, WIFI_BACKOFF_MAX_MS, esp_random());
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -71,13 +320,28 @@ esp_err_t wifi_manager_init(void)
                                                         NULL,
                                                         &instance_got_ip));
 
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASS,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-        },
+    const esp_timer_create_args_t retry_args = {
+        .callback = retry_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &retry_timer));
+
+    wifi_config_t wifi_config;
+    base_config(&wifi_config);
+
+#ifdef WIFI_FAST_REJOIN
+    const esp_timer_create_args_t timer_args = {
+        .callback = lease_check_cb,
+        .name = "wifi_lease",
     };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &lease_check_timer));
+
+    wifi_cache_t cache;
+    if (cache_load(&cache)) {
+        cache_apply(&cache, &wifi_config);
+    }
+#endif
+
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
@@ -90,27 +354,13 @@ esp_err_t wifi_manager_init(void)
 
 esp_err_t wifi_manager_connect(void)
 {
-    // Wait for connection or failure
-    EventBits_t bits = xEventGroupWaitBits(wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-            pdFALSE,
-            pdFALSE,
-            portMAX_DELAY);
-
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "========================================");
-        ESP_LOGI(TAG, "   STATUS: Connected to WiFi!");
-        ESP_LOGI(TAG, "========================================");
-        return ESP_OK;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGE(TAG, "========================================");
-        ESP_LOGE(TAG, "   STATUS: Failed to connect to WiFi");
-        ESP_LOGE(TAG, "   Check your SSID and password!");
-        ESP_LOGE(TAG, "========================================");
-        return ESP_FAIL;
-    }
+    // Retries never stop, so this only returns once connected
+    xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
 
-    return ESP_FAIL;
+    ESP_LOGI(TAG, "========================================");
+    ESP_LOGI(TAG, "   STATUS: Connected to WiFi!");
+    ESP_LOGI(TAG, "========================================");
+    return ESP_OK;
 }
 
 bool wifi_manager_is_connected(void)
@@ -122,3 +372,21 @@ bool wifi_manager_is_connected(void)
     EventBits_t bits = xEventGroupGetBits(wifi_event_group);
     return (bits & WIFI_CONNECTED_BIT) != 0;
 }
+
+uint32_t wifi_manager_reconnect_count(void)
+{
+    uint32_t connects = connect_count;
+    return connects > 0 ? connects - 1 : 0;
+}
+
+reconnect_stats_t wifi_manager_get_link_stats(void)
+{
+    reconnect_stats_t stats = {0};
+    if (link_lock == NULL) {
+        return stats;
+    }
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    stats = reconnect_get_stats(&wifi_link, now_ms());
+    xSemaphoreGive(link_lock);
+    return stats;
+}